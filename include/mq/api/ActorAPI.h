@@ -14,9 +14,11 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace mq {
 
@@ -37,6 +39,48 @@ enum class ResponseStatus : int8_t
 	NoConnection            = -2,                  // no connection established
 	RoutingFailed           = -3,                  // message routing failed
 	AmbiguousRecipient      = -4,                  // RPC message couldn't determine single recipient
+	MailboxFull             = -5,                  // the receiving mailbox is full and rejected the message
+};
+
+/**
+ * What a mailbox does with a message that is delivered while its queue is full. Under every policy,
+ * a discarded RPC is answered with MailboxFull.
+ */
+enum class MailboxOverflowAPI : uint8_t
+{
+	DropOldest,                                    // discard the oldest queued message to make room
+	DropNewest,                                    // discard the delivered message
+	Reject,                                        // discard the delivered message
+};
+
+/**
+ * The queue limits of a mailbox
+ */
+struct MailboxOptionsAPI
+{
+	/** The most messages the mailbox queues before the overflow policy applies */
+	size_t Capacity = 4096;
+
+	/** What happens to messages delivered while the queue is full */
+	MailboxOverflowAPI Overflow = MailboxOverflowAPI::Reject;
+};
+
+/**
+ * The queue depth statistics of a mailbox
+ */
+struct MailboxStatsAPI
+{
+	/** How many messages are waiting to be processed */
+	size_t Depth = 0;
+
+	/** The deepest the queue has been */
+	size_t HighWater = 0;
+
+	/** The most messages the queue will hold */
+	size_t Capacity = 0;
+
+	/** How many messages the overflow policy has discarded */
+	uint64_t Dropped = 0;
 };
 
 
@@ -102,8 +146,36 @@ public:
 	std::optional<std::string> Payload;
 };
 
+/**
+ * A single reply to a gather request
+ */
+struct GatherReply
+{
+	/** The status the recipient replied with, or a ResponseStatus if the message couldn't be delivered to it */
+	int Status = 0;
+
+	/** The reply, its Sender tells the replies apart */
+	std::shared_ptr<Message> Reply;
+};
+
+/**
+ * The collected replies to a gather request
+ */
+struct GatherResponse
+{
+	/** 0 if the recipients of the request were found, otherwise a ResponseStatus */
+	int Status = 0;
+
+	/** The replies, in the order they arrived */
+	std::vector<GatherReply> Replies;
+
+	/** The recipients that didn't reply before the timeout */
+	std::vector<Address> TimedOut;
+};
+
 using ReceiveCallbackAPI = std::function<void(const std::shared_ptr<Message>&)>;
 using ResponseCallbackAPI = std::function<void(int, const std::shared_ptr<Message>&)>;
+using GatherCallbackAPI = std::function<void(const GatherResponse&)>;
 
 /**
  * A dropbox shim used to store a reference to the actual dropbox and provide functions to interact with it
@@ -138,6 +210,34 @@ struct DropboxAPI
 	 */
 	void Post(const Address& address, const std::string& data, const ResponseCallbackAPI& callback = nullptr) const;
 
+	/**
+	 * Sends a message to every actor that matches an address and collects the replies. Unlike an
+	 * RPC through Post, the address can match any number of recipients.
+	 *
+	 * @tparam T the message being sent, usually some kind of proto
+	 *
+	 * @param address the address to send the message
+	 * @param obj the message (as an object)
+	 * @param timeout how long to wait for the recipients to reply
+	 * @param callback called once, when every recipient has replied or the timeout has passed
+	 */
+	template <typename T>
+	void Gather(const Address& address, const T& obj, std::chrono::milliseconds timeout, const GatherCallbackAPI& callback) const
+	{
+		Gather(address, obj.SerializeAsString(), timeout, callback);
+	}
+
+	/**
+	 * Sends a message to every actor that matches an address and collects the replies. Unlike an
+	 * RPC through Post, the address can match any number of recipients.
+	 *
+	 * @param address the address to send the message
+	 * @param data the message (as a data string)
+	 * @param timeout how long to wait for the recipients to reply
+	 * @param callback called once, when every recipient has replied or the timeout has passed
+	 */
+	void Gather(const Address& address, const std::string& data, std::chrono::milliseconds timeout, const GatherCallbackAPI& callback) const;
+
 	/**
 	 * Sends a reply to the sender of a message
 	 *
@@ -162,6 +262,11 @@ struct DropboxAPI
 	 */
 	void PostReply(const std::shared_ptr<Message>& message, const std::string& data, uint8_t status = 0) const;
 
+	/**
+	 * Gets the queue depth statistics of the mailbox
+	 */
+	MailboxStatsAPI GetStats() const;
+
 	/**
 	 * Removes the mailbox with the same name from the post office
 	 */
@@ -172,18 +277,20 @@ struct DropboxAPI
  * Creates and registers a mailbox with the post office
  *
  * @param receive a callback rvalue that will process messages as they are received in this mailbox
+ * @param options the queue limits of the mailbox
  * @return an dropbox that the creator can use to send addressed messages. will be invalid if it failed to add
  */
-DropboxAPI AddActor(ReceiveCallbackAPI&& receive);
+DropboxAPI AddActor(ReceiveCallbackAPI&& receive, const MailboxOptionsAPI& options = {});
 
 /**
  * Creates and registers a mailbox with the post office
  *
  * @param localAddress the string address to create the address at
  * @param receive a callback rvalue that will process messages as they are received in this mailbox
+ * @param options the queue limits of the mailbox
  * @return an dropbox that the creator can use to send addressed messages. will be invalid if it failed to add
  */
-DropboxAPI AddActor(const char* localAddress, ReceiveCallbackAPI&& receive);
+DropboxAPI AddActor(const char* localAddress, ReceiveCallbackAPI&& receive, const MailboxOptionsAPI& options = {});
 
 /**
  * Sends a message to an address
@@ -22,6 +22,7 @@
 #include "eqlib/game/CXStr.h"
 #include "eqlib/game/Items.h"
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -453,6 +454,10 @@ public:
 
 	MQLIB_OBJECT bool CanEvaluateMethodOrMember(const std::string& Name);
 
+	// Identifies the current set of members and methods. Changes whenever a member or method is added
+	// or removed, so it can be used to validate cached lookups.
+	MQLIB_OBJECT uint64_t GetMemberTableSerial() const;
+
 	inline bool InheritsFrom(MQ2Type* testType)
 	{
 		MQ2Type* parentType = m_parent;
@@ -524,10 +529,25 @@ protected:
 	mutable std::mutex m_mutex;
 
 private:
+	// Immutable perfect hash tables of member and method names. Built on first lookup after
+	// the members change, and read without locking.
+	struct MemberTable;
+	const MemberTable& GetMemberTable() const;
+
+	// Replaced tables are kept until the pulse after they were retired, then freed by the data api.
+	void RetireMemberTable(std::unique_lock<std::mutex>& lock);
+	bool ReleaseRetiredMemberTables(uint64_t pulse);
+	friend void ReleaseRetiredMemberTables();
+
 	std::vector<std::unique_ptr<MQTypeMember>> Members;
 	std::vector<std::unique_ptr<MQTypeMember>> Methods;
 	std::unordered_map<std::string, int> MemberMap;
 	std::unordered_map<std::string, int> MethodMap;
+
+	mutable std::atomic<const MemberTable*> m_memberTable = nullptr;
+	mutable std::vector<std::unique_ptr<MemberTable>> m_memberTables; // current and retired tables
+	std::vector<std::unique_ptr<MQTypeMember>> m_retiredMembers;      // removed, but possibly referenced by a retired table
+	uint64_t m_retiredPulse = 0;                                      // pulse of the last retirement
 };
 
 } // namespace datatypes
@@ -37,6 +37,14 @@ public:
 		const postoffice::ResponseCallbackAPI& callback,
 		const MQPluginHandle& pluginHandle) = 0;
 
+	virtual void GatherFromActors(
+		postoffice::Dropbox* dropbox,
+		const postoffice::Address& address,
+		const std::string& data,
+		std::chrono::milliseconds timeout,
+		const postoffice::GatherCallbackAPI& callback,
+		const MQPluginHandle& pluginHandle) = 0;
+
 	virtual void ReplyToActor(
 		postoffice::Dropbox* dropbox,
 		const std::shared_ptr<postoffice::Message>& message,
@@ -47,12 +55,17 @@ public:
 	virtual postoffice::Dropbox* AddActor(
 		const char* localAddress,
 		postoffice::ReceiveCallbackAPI&& receive,
+		const postoffice::MailboxOptionsAPI& options,
 		const MQPluginHandle& pluginHandle) = 0;
 
 	virtual void RemoveActor(
 		postoffice::Dropbox*& dropbox,
 		const MQPluginHandle& pluginHandle) = 0;
 
+	virtual postoffice::MailboxStatsAPI GetActorStats(
+		postoffice::Dropbox* dropbox,
+		const MQPluginHandle& pluginHandle) = 0;
+
 	//
 	// Command API
 	//
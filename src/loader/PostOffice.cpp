@@ -88,7 +88,11 @@ LauncherPostOffice::LauncherPostOffice()
 			GetConfiguredValue<unsigned int>("MulticastPeriod", 1000),
 			static_cast<uint16_t>(GetConfiguredValue<unsigned int>("MulticastPort", 30000 + mq::DEFAULT_NETWORK_PEER_PORT)),
 			GetConfiguredValue<std::string>("MulticastAddress", mq::DEFAULT_MULTICAST_ADDRESS),
-			GetConfiguredValue<std::string>("MulticastListenAddress", "0.0.0.0")
+			GetConfiguredValue<std::string>("MulticastListenAddress", "0.0.0.0"),
+			GetConfiguredValue<bool>("Compression", true),
+			GetConfiguredValue<unsigned int>("CompressionThreshold", 512),
+			GetConfiguredValue<int>("CompressionLevel", 3),
+			GetConfiguredValue<std::string>("CompressionDictionary", "")
 		})
 {
 	InitializePostOfficeImGui();
@@ -16,14 +16,34 @@
 #include "loader/ImGui.h"
 
 #include <fmt/format.h>
+#include <google/protobuf/util/json_util.h>
 
 #include <algorithm>
 
 using namespace mq::postoffice;
 
+// a rough median of the RPC latency histogram, as the bucket that contains it
+static std::string FormatLatency(const ActorStatsCounters& counters)
+{
+	const uint32_t count = counters.RpcCount();
+	if (count == 0)
+		return "-";
+
+	uint32_t seen = 0;
+	for (size_t i = 0; i < ActorStatsCounters::LatencyLimits.size(); ++i)
+	{
+		seen += counters.RpcLatency[i];
+		if (seen * 2 >= count)
+			return fmt::format("< {} ms", ActorStatsCounters::LatencyLimits[i]);
+	}
+
+	return fmt::format(">= {} ms", ActorStatsCounters::LatencyLimits.back());
+}
+
 void ShowActorsWindow()
 {
 	static bool show_dropped = false;
+	static bool show_connections = false;
 	static ImGuiTableFlags table_flags = ImGuiTableFlags_ScrollY
 		| ImGuiTableFlags_ScrollX
 		| ImGuiTableFlags_SizingFixedFit
@@ -35,33 +55,41 @@ void ShowActorsWindow()
 		| ImGuiTableFlags_Hideable;
 
 	auto content_region = ImGui::GetContentRegionAvail();
-	content_region.y -= ImGui::GetFrameHeightWithSpacing();
+	content_region.y -= ImGui::GetFrameHeightWithSpacing() + ImGui::GetTextLineHeightWithSpacing() * 2;
 
-	if (ImGui::BeginTable("Actor Stats", 4, table_flags, content_region))
+	if (ImGui::BeginTable("Actor Stats", 8, table_flags, content_region))
 	{
-		auto stats = GetPostOffice().GetStats(show_dropped);
-		size_t recv_tot = 0, send_tot = 0;
-		for (const auto stat : stats)
-		{
-			recv_tot += stat->Received.size();
-			send_tot += stat->Sent.size();
-		}
+		auto stats = show_connections ? GetPostOffice().GetConnectionStats() : GetPostOffice().GetStats(show_dropped);
+		ActorStatsCounters totals;
+		for (const auto& stat : stats)
+			totals += stat.Totals;
 
 		fmt::memory_buffer buf;
 		const auto buf_ins = std::back_inserter(buf);
 
 		ImGui::TableSetupScrollFreeze(0, 1);
-		ImGui::TableSetupColumn("Identity", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn(show_connections ? "Connection" : "Identity", ImGuiTableColumnFlags_WidthFixed);
 
-		fmt::format_to(buf_ins, "Received ({})", recv_tot);
+		fmt::format_to(buf_ins, "Received ({})", totals.Received);
 		ImGui::TableSetupColumn(fmt::to_string(buf).c_str(), ImGuiTableColumnFlags_WidthStretch);
 
 		buf.clear();
-		fmt::format_to(buf_ins, "Sent ({})", send_tot);
+		fmt::format_to(buf_ins, "Sent ({})", totals.Sent);
 		ImGui::TableSetupColumn(fmt::to_string(buf).c_str(), ImGuiTableColumnFlags_WidthStretch);
 
 		buf.clear();
-		fmt::format_to(buf_ins, "Total ({})", recv_tot + send_tot);
+		fmt::format_to(buf_ins, "Total ({})", totals.Received + totals.Sent);
+		ImGui::TableSetupColumn(fmt::to_string(buf).c_str(), ImGuiTableColumnFlags_WidthStretch);
+
+		ImGui::TableSetupColumn("Bytes In", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("Bytes Out", ImGuiTableColumnFlags_WidthStretch);
+
+		buf.clear();
+		fmt::format_to(buf_ins, "Failures ({})", totals.RoutingFailures);
+		ImGui::TableSetupColumn(fmt::to_string(buf).c_str(), ImGuiTableColumnFlags_WidthStretch);
+
+		buf.clear();
+		fmt::format_to(buf_ins, "RPC Latency ({})", totals.RpcCount());
 		ImGui::TableSetupColumn(fmt::to_string(buf).c_str(), ImGuiTableColumnFlags_WidthStretch);
 		ImGui::TableHeadersRow();
 
@@ -75,16 +103,28 @@ void ShowActorsWindow()
 				ImGui::TableNextRow();
 
 				ImGui::TableSetColumnIndex(0);
-				ImGui::Text("%s", stat->Identity.ToStringLite().c_str());
+				ImGui::Text("%s", stat.Name.c_str());
 
 				ImGui::TableSetColumnIndex(1);
-				ImGui::Text("%zu", stat->Received.size());
+				ImGui::Text("%u", stat.Totals.Received);
 
 				ImGui::TableSetColumnIndex(2);
-				ImGui::Text("%zu", stat->Sent.size());
+				ImGui::Text("%u", stat.Totals.Sent);
 
 				ImGui::TableSetColumnIndex(3);
-				ImGui::Text("%zu", stat->Received.size() + stat->Sent.size());
+				ImGui::Text("%u", stat.Totals.Received + stat.Totals.Sent);
+
+				ImGui::TableSetColumnIndex(4);
+				ImGui::Text("%llu", stat.Totals.ReceivedBytes);
+
+				ImGui::TableSetColumnIndex(5);
+				ImGui::Text("%llu", stat.Totals.SentBytes);
+
+				ImGui::TableSetColumnIndex(6);
+				ImGui::Text("%u", stat.Totals.RoutingFailures);
+
+				ImGui::TableSetColumnIndex(7);
+				ImGui::Text("%s", FormatLatency(stat.Totals).c_str());
 			}
 		}
 
@@ -93,16 +133,56 @@ void ShowActorsWindow()
 
 	ImGui::Checkbox("Show Dropped Actors", &show_dropped);
 	ImGui::SameLine();
+	ImGui::Checkbox("Show Connections", &show_connections);
+	ImGui::SameLine();
+
+	if (ImGui::Button("Copy Snapshot"))
+	{
+		// the snapshot is exported as json so it can be pasted into other tools
+		std::string json;
+		google::protobuf::util::JsonPrintOptions options;
+		options.add_whitespace = true;
+		if (google::protobuf::util::MessageToJsonString(GetPostOffice().GetStatsSnapshot(show_dropped), &json, options).ok())
+			ImGui::SetClipboardText(json.c_str());
+	}
+	ImGui::SameLine();
 
 	static int lookback_seconds = GetPostOffice().GetStatLookback();
 	ImGui::PushItemWidth(ImGui::CalcItemWidth() - ImGui::CalcTextSize("Lookback Seconds").x);
 	if (ImGui::InputInt("Lookback Seconds", &lookback_seconds))
 	{
-		lookback_seconds = std::max(lookback_seconds, 1);
+		lookback_seconds = std::clamp(lookback_seconds, 1, static_cast<int>(ActorStatsWindow::MaxSeconds));
 
 		GetPostOffice().SetStatLookback(lookback_seconds);
 	}
 	ImGui::PopItemWidth();
+
+	const auto compression = GetPostOffice().GetNetworkCompressionStats();
+	ImGui::Text("Network compression: %llu bytes saved sending (%llu messages), %llu bytes saved receiving (%llu messages)",
+		compression.SentBytesSaved(), compression.MessagesCompressed,
+		compression.ReceivedBytesSaved(), compression.MessagesDecompressed);
+
+	const auto mailboxes = GetPostOffice().GetMailboxStatsSnapshot();
+	size_t depth = 0, high_water = 0;
+	uint64_t dropped = 0;
+	for (const auto& [_, stat] : mailboxes)
+	{
+		depth += stat.Depth;
+		high_water = std::max(high_water, stat.HighWater);
+		dropped += stat.Dropped;
+	}
+
+	ImGui::Text("Launcher mailboxes: %zu queued, deepest queue %zu, %llu dropped", depth, high_water, dropped);
+	if (ImGui::IsItemHovered() && !mailboxes.empty())
+	{
+		ImGui::BeginTooltip();
+		for (const auto& [address, stat] : mailboxes)
+		{
+			ImGui::Text("%s: %zu / %zu queued, high water %zu, %llu dropped",
+				address.c_str(), stat.Depth, stat.Capacity, stat.HighWater, stat.Dropped);
+		}
+		ImGui::EndTooltip();
+	}
 }
 
 void InitializePostOfficeImGui()
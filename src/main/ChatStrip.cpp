@@ -0,0 +1,100 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ChatStrip.h"
+
+#include <bit>
+#include <cstring>
+#include <emmintrin.h>
+
+namespace mq {
+
+// Returns the position of the first character StripChatColors needs to look at: a color code, a
+// newline or the end of the string. Checks 16 characters at a time.
+static size_t FindChatControlChar(const char* text, size_t length)
+{
+	size_t pos = 0;
+
+	const __m128i bell = _mm_set1_epi8('\a');
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+
+	for (; pos + 16 <= length; pos += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+		const __m128i matches = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, bell), _mm_cmpeq_epi8(chunk, newline)),
+			_mm_cmpeq_epi8(chunk, nul));
+
+		if (const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(matches)))
+			return pos + std::countr_zero(mask);
+	}
+
+	for (; pos < length; ++pos)
+	{
+		const char ch = text[pos];
+		if (ch == '\a' || ch == '\n' || ch == 0)
+			return pos;
+	}
+
+	return length;
+}
+
+void StripChatColors(std::string_view in, char* out)
+{
+	const char* text = in.data();
+	const size_t length = in.size();
+	size_t i = 0;
+	size_t o = 0;
+
+	while (i < length)
+	{
+		// copy everything up to the next color code in one go
+		const size_t run = FindChatControlChar(text + i, length - i);
+		memcpy(out + o, text + i, run);
+		o += run;
+		i += run;
+
+		if (i >= length || text[i] == 0)
+			break;
+
+		if (text[i] == '\a')
+		{
+			if (i + 1 < length && text[i + 1] == '-')
+			{
+				// \a-x
+				i += 3;
+			}
+			else if (i + 1 < length && text[i + 1] == '#')
+			{
+				// \a#rrggbb
+				i += 8;
+			}
+			else
+			{
+				// \ax
+				i += 2;
+			}
+		}
+		else
+		{
+			// newline
+			i++;
+		}
+	}
+
+	out[o] = 0;
+}
+
+} // namespace mq
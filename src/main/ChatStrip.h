@@ -0,0 +1,28 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+// This header only depends on the standard library so that the chat stripper can be built
+// outside of MQ2Main (see src/tests/ChatStrip).
+
+#include <string_view>
+
+namespace mq {
+
+// Removes \a color codes and newlines from a line of chat. Stops at the end of the view or at the
+// first NUL. out must have room for in.size() + 1 characters and is always NUL terminated.
+void StripChatColors(std::string_view in, char* out);
+
+} // namespace mq
@@ -0,0 +1,243 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "DataExpression.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+
+namespace mq {
+
+/**
+ * @fn CompileDataExpression
+ *
+ * @brief Parses the data portion of a ${...} expression into a list of operations
+ *
+ * This mirrors the original character-by-character parse of ParseMQ2DataPortion, including
+ * its quirks (for example, the index of a typecast object carries over to the member that
+ * follows the cast), so that evaluating the compiled form is indistinguishable from parsing
+ * the text each time. Errors are compiled into the operation list in the position where the
+ * original parser would have reported them, after any evaluations that precede them.
+ */
+std::shared_ptr<CompiledExpression> CompileDataExpression(std::string_view expression)
+{
+	using OpCode = CompiledExpression::OpCode;
+
+	auto compiled = std::make_shared<CompiledExpression>();
+	auto& ops = compiled->ops;
+
+	auto emit = [&ops](OpCode code, std::string_view name = {}, std::string_view index = {}, bool allowFunction = false)
+	{
+		CompiledExpression::Op& op = ops.emplace_back();
+		op.code = code;
+		op.allowFunction = allowFunction;
+		op.name = name;
+		op.index = index;
+	};
+
+	std::string index;
+	bool functionAllowed = false;
+	size_t start = 0;
+	size_t nameEnd = std::string_view::npos;
+	size_t pos = 0;
+
+	auto currentName = [&]() { return expression.substr(start, std::min(nameEnd, pos) - start); };
+	auto peek = [&](size_t at) -> char { return at < expression.length() ? expression[at] : 0; };
+
+	while (true)
+	{
+		if (pos == expression.length())
+		{
+			// end completely. process
+			if (start == pos)
+			{
+				emit(OpCode::Finish, "Nothing to parse");
+				break;
+			}
+
+			emit(OpCode::Evaluate, currentName(), index, functionAllowed);
+			emit(OpCode::Done);
+			break;
+		}
+
+		const char ch = expression[pos];
+
+		if (ch == '(')
+		{
+			if (start == pos)
+			{
+				emit(OpCode::Finish, "Encountered typecast without object to cast");
+				break;
+			}
+
+			emit(OpCode::Evaluate, currentName(), index);
+			emit(OpCode::RequireType);
+
+			const size_t typeStart = pos + 1;
+			const size_t typeEnd = expression.find(')', typeStart);
+			if (typeEnd == std::string_view::npos)
+			{
+				emit(OpCode::Error, "Encountered unmatched parenthesis");
+				break;
+			}
+
+			emit(OpCode::Cast, expression.substr(typeStart, typeEnd - typeStart));
+			pos = typeEnd;
+
+			if (peek(pos + 1) == '.')
+			{
+				++pos;
+				start = pos + 1;
+				nameEnd = std::string_view::npos;
+			}
+			else if (pos + 1 == expression.length())
+			{
+				emit(OpCode::Done);
+				break;
+			}
+			else
+			{
+				emit(OpCode::Error, fmt::format("Invalid character found after typecast '){}'", expression.substr(pos + 1)));
+				break;
+			}
+		}
+		else if (ch == '[')
+		{
+			// index
+			nameEnd = std::min(nameEnd, pos);
+			++pos;
+			functionAllowed = true;
+			index.clear();
+
+			bool quote = false;
+			bool beginParam = true;
+			bool terminated = false;
+
+			while (true)
+			{
+				if (pos == expression.length())
+				{
+					emit(OpCode::Error, fmt::format("Unmatched bracket or invalid character following bracket found in index: '{}'", index));
+					terminated = true;
+					break;
+				}
+
+				const char c = expression[pos];
+
+				if (beginParam)
+				{
+					beginParam = false;
+					if (c == '\"')
+					{
+						quote = true;
+						++pos;
+						continue;
+					}
+				}
+
+				if (quote)
+				{
+					if (c == '\"')
+					{
+						if (peek(pos + 1) == ']' || peek(pos + 1) == ',')
+						{
+							quote = false;
+							++pos;
+							continue;
+						}
+					}
+				}
+				else
+				{
+					if (c == ']')
+					{
+						const char next = peek(pos + 1);
+						if (next == '.' || next == '(' || next == 0)
+							break; // valid end
+					}
+					else if (c == ',')
+					{
+						beginParam = true;
+					}
+				}
+
+				index.push_back(c);
+				++pos;
+			}
+
+			if (terminated)
+				break;
+		}
+		else if (ch == '.')
+		{
+			// end of this one, but more to come!
+			if (start == pos)
+			{
+				emit(OpCode::Finish, "Encountered member access without object");
+				break;
+			}
+
+			emit(OpCode::Evaluate, currentName(), index);
+
+			start = pos + 1;
+			nameEnd = std::string_view::npos;
+			index.clear();
+		}
+
+		++pos;
+	}
+
+	return compiled;
+}
+
+std::shared_ptr<const CompiledExpression> CompiledExpressionCache::Get(std::string_view expression)
+{
+	if (expression.length() > MAX_CACHED_EXPRESSION_LENGTH)
+		return CompileDataExpression(expression);
+
+	{
+		std::scoped_lock lock(m_expressionCacheMutex);
+
+		auto iter = m_expressionCache.find(expression);
+		if (iter != m_expressionCache.end())
+		{
+			// move to the front of the LRU
+			m_expressionLRU.splice(m_expressionLRU.begin(), m_expressionLRU, iter->second);
+			return iter->second->second;
+		}
+	}
+
+	// Compile outside of the lock. If two threads race to compile the same expression, the
+	// second insert is simply dropped.
+	std::shared_ptr<const CompiledExpression> compiled = CompileDataExpression(expression);
+
+	std::scoped_lock lock(m_expressionCacheMutex);
+
+	if (m_expressionCache.find(expression) == m_expressionCache.end())
+	{
+		m_expressionLRU.emplace_front(std::string(expression), compiled);
+		m_expressionCache.emplace(m_expressionLRU.front().first, m_expressionLRU.begin());
+
+		while (m_expressionLRU.size() > MAX_CACHED_EXPRESSIONS)
+		{
+			m_expressionCache.erase(m_expressionLRU.back().first);
+			m_expressionLRU.pop_back();
+		}
+	}
+
+	return compiled;
+}
+
+} // namespace mq
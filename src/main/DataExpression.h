@@ -0,0 +1,98 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+// This header only depends on the standard library so that the expression compiler can be built
+// outside of MQ2Main (see src/tests/DataExpression).
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mq {
+
+struct MQTypeMember;
+
+namespace datatypes {
+class MQ2Type;
+}
+
+// Compiled form of the data portion of a ${...} expression (the text between the braces).
+// Parsing produces a flat list of operations that can be replayed without re-scanning the text.
+struct CompiledExpression
+{
+	enum class OpCode : uint8_t
+	{
+		Evaluate,            // Evaluate TLO, variable or member 'name' with 'index'
+		RequireType,         // Stop (unsuccessfully) if there is no result yet
+		Cast,                // Typecast the result to the type 'name'
+		Finish,              // Stop. Succeeds if there is a result, otherwise reports 'name' as an error
+		Error,               // Report 'name' as an error and stop unsuccessfully
+		Done,                // Stop successfully
+	};
+
+	// Members and methods named by an Evaluate op, as resolved on the last type it was evaluated
+	// against (and that type's parent). Valid while the types and their member tables are unchanged.
+	struct ResolvedMember
+	{
+		datatypes::MQ2Type* type = nullptr;
+		uint64_t serial = 0;
+		datatypes::MQ2Type* parent = nullptr;
+		uint64_t parentSerial = 0;
+		MQTypeMember* member[2] = { nullptr, nullptr };
+		MQTypeMember* method[2] = { nullptr, nullptr };
+	};
+
+	struct Op
+	{
+		OpCode code;
+		bool allowFunction = false;
+		std::string name;
+		std::string index;
+
+		// Expressions are only evaluated on the main thread, so this is updated without synchronization.
+		mutable ResolvedMember resolved;
+	};
+
+	std::vector<Op> ops;
+};
+
+std::shared_ptr<CompiledExpression> CompileDataExpression(std::string_view expression);
+
+// Bounded LRU of compiled expressions, safe to use from any thread.
+class CompiledExpressionCache
+{
+public:
+	// Number of distinct expressions kept in the cache, and the longest expression that will be
+	// cached. Longer expressions are still compiled, they just aren't retained.
+	static constexpr size_t MAX_CACHED_EXPRESSIONS = 2048;
+	static constexpr size_t MAX_CACHED_EXPRESSION_LENGTH = 512;
+
+	std::shared_ptr<const CompiledExpression> Get(std::string_view expression);
+
+private:
+	// Keys are views into the strings owned by the list nodes.
+	using ExpressionCacheList = std::list<std::pair<std::string, std::shared_ptr<const CompiledExpression>>>;
+	ExpressionCacheList m_expressionLRU;
+	std::unordered_map<std::string_view, ExpressionCacheList::iterator> m_expressionCache;
+	std::mutex m_expressionCacheMutex;
+};
+
+} // namespace mq
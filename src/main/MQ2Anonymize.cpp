@@ -18,7 +18,8 @@
 
 #include "mq/utils/Args.h"
 
-#include <regex>
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <Yaml.hpp>
 
@@ -123,24 +124,11 @@ private:
 	Anonymization strategy;
 	std::string target;
 	std::set<std::string> alternates;
-	std::regex search_string;
-
-private:
-	void build_regex()
-	{
-		search_string = std::regex(
-			fmt::format("\\b({}{})\\b", name, std::accumulate(alternates.cbegin(), alternates.cend(), std::string(),
-				[](const std::string& text, std::string_view alt) -> std::string {
-					return fmt::format("{}|{}", text, alt);
-				})),
-			std::regex_constants::icase);
-	}
 
 public:
 	anon_replacer(std::string_view name, Anonymization strategy, std::string_view target = "")
 		: name(name), strategy(strategy), target(target)
 	{
-		build_regex();
 	}
 
 	anon_replacer(Yaml::Node& node)
@@ -153,8 +141,6 @@ public:
 			for (auto alt = node["alternates"].Begin(); alt != node["alternates"].End(); alt++)
 				alternates.emplace((*alt).second.As<std::string>());
 		}
-
-		build_regex();
 	}
 
 	anon_replacer(SPAWNINFO* pSpawn, Anonymization strategy, std::string_view target = "")
@@ -164,20 +150,21 @@ public:
 	{
 		if (pSpawn->Lastname[0])
 			add_alternate(pSpawn->Name);
-
-		build_regex();
 	}
 
 	void add_alternate(std::string_view alternate)
 	{
 		alternates.emplace(std::string(alternate));
-		build_regex();
 	}
 
 	void drop_alternate(std::string_view alternate)
 	{
 		alternates.erase(std::string(alternate));
-		build_regex();
+	}
+
+	const std::set<std::string>& get_alternates() const
+	{
+		return alternates;
 	}
 
 	void update_strategy(Anonymization strategy)
@@ -264,13 +251,6 @@ public:
 		}
 	}
 
-	std::string replace_text(std::string_view text) const
-	{
-		std::string result;
-		std::regex_replace(std::back_inserter(result), std::cbegin(text), std::cend(text), search_string, anonymize());
-		return result;
-	}
-
 	Yaml::Node Serialize()
 	{
 		Yaml::Node node;
@@ -286,6 +266,251 @@ public:
 	}
 };
 
+// Case-insensitive Aho-Corasick automaton over every active name and alternate. Each pattern
+// maps back to the replacer that owns it, so a single pass over the text finds every name
+// regardless of how many replacers are active. The goto function is expanded into a dense
+// table over only the characters that appear in a pattern, which keeps it small enough for a
+// full guild roster while still costing a single lookup per character of text.
+class anon_matcher
+{
+	struct pattern
+	{
+		std::string text;
+		const anon_replacer* replacer;
+	};
+
+	struct node_output
+	{
+		const anon_replacer* replacer = nullptr;
+		int length = 0;
+	};
+
+	struct match
+	{
+		size_t start;
+		size_t length;
+		const anon_replacer* replacer;
+	};
+
+	std::vector<pattern> patterns;
+	std::array<uint8_t, 256> char_class{};
+	size_t num_classes = 1;
+	std::vector<int> transitions;
+	std::vector<node_output> outputs;
+	std::vector<int> dictionary;
+
+	static bool is_space(unsigned char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+	}
+
+	static char fold(char c)
+	{
+		unsigned char uc = static_cast<unsigned char>(c);
+		return is_space(uc) ? ' ' : static_cast<char>(std::tolower(uc));
+	}
+
+	static bool is_word(char c)
+	{
+		unsigned char uc = static_cast<unsigned char>(c);
+		return std::isalnum(uc) || uc == '_';
+	}
+
+	// mirrors the \b anchors the names used to be wrapped with
+	static bool is_boundary(std::string_view text, size_t pos)
+	{
+		bool before = pos > 0 && is_word(text[pos - 1]);
+		bool after = pos < text.length() && is_word(text[pos]);
+		return before != after;
+	}
+
+	void add_pattern(std::string_view text, const anon_replacer* replacer)
+	{
+		// names built from spawns join first and last name with a regex whitespace escape,
+		// which matches any single whitespace character just like a folded space does here.
+		std::string folded;
+		folded.reserve(text.length());
+		for (size_t i = 0; i < text.length(); ++i)
+		{
+			if (text[i] == '\\' && i + 1 < text.length() && text[i + 1] == 's')
+			{
+				folded.push_back(' ');
+				++i;
+			}
+			else
+			{
+				folded.push_back(fold(text[i]));
+			}
+		}
+
+		if (!folded.empty())
+			patterns.push_back({ std::move(folded), replacer });
+	}
+
+public:
+	void clear()
+	{
+		patterns.clear();
+		char_class.fill(0);
+		num_classes = 1;
+		transitions.clear();
+		outputs.clear();
+		dictionary.clear();
+	}
+
+	bool empty() const
+	{
+		return outputs.empty();
+	}
+
+	void add_replacer(const anon_replacer* replacer)
+	{
+		add_pattern(replacer->name, replacer);
+		for (const std::string& alternate : replacer->get_alternates())
+			add_pattern(alternate, replacer);
+	}
+
+	void build()
+	{
+		transitions.clear();
+		outputs.clear();
+		dictionary.clear();
+
+		if (patterns.empty())
+			return;
+
+		// class 0 is every character that doesn't appear in a pattern, and always leads back to the root
+		std::array<uint8_t, 256> folded_class{};
+		num_classes = 1;
+		for (const pattern& p : patterns)
+		{
+			for (char c : p.text)
+			{
+				uint8_t& cls = folded_class[static_cast<unsigned char>(c)];
+				if (cls == 0)
+					cls = static_cast<uint8_t>(num_classes++);
+			}
+		}
+
+		for (int c = 0; c < 256; ++c)
+			char_class[c] = folded_class[static_cast<unsigned char>(fold(static_cast<char>(c)))];
+
+		// build the trie. The first replacer to claim a pattern keeps it, which preserves the
+		// priority the replacers were applied in when they each ran separately.
+		transitions.assign(num_classes, -1);
+		outputs.emplace_back();
+
+		for (const pattern& p : patterns)
+		{
+			int state = 0;
+			for (char c : p.text)
+			{
+				int& next = transitions[state * num_classes + folded_class[static_cast<unsigned char>(c)]];
+				if (next == -1)
+				{
+					next = static_cast<int>(outputs.size());
+					outputs.emplace_back();
+					transitions.resize(transitions.size() + num_classes, -1);
+				}
+
+				// resizing may have moved the table, so index it again
+				state = transitions[state * num_classes + folded_class[static_cast<unsigned char>(c)]];
+			}
+
+			if (outputs[state].replacer == nullptr)
+				outputs[state] = { p.replacer, static_cast<int>(p.text.length()) };
+		}
+
+		// breadth first pass to fill in the failure transitions and the dictionary suffix links
+		std::vector<int> fail(outputs.size(), 0);
+		dictionary.assign(outputs.size(), -1);
+
+		std::vector<int> queue;
+		queue.reserve(outputs.size());
+
+		for (size_t c = 0; c < num_classes; ++c)
+		{
+			int& next = transitions[c];
+			if (next == -1)
+				next = 0;
+			else
+				queue.push_back(next);
+		}
+
+		for (size_t i = 0; i < queue.size(); ++i)
+		{
+			int state = queue[i];
+			int failure = fail[state];
+			dictionary[state] = outputs[failure].replacer != nullptr ? failure : dictionary[failure];
+
+			for (size_t c = 0; c < num_classes; ++c)
+			{
+				int& next = transitions[state * num_classes + c];
+				int fallback = transitions[failure * num_classes + c];
+				if (next == -1)
+				{
+					next = fallback;
+				}
+				else
+				{
+					fail[next] = fallback;
+					queue.push_back(next);
+				}
+			}
+		}
+	}
+
+	// returns false (and leaves result untouched) if nothing in the text needs replacing
+	bool replace_text(std::string_view text, std::string& result) const
+	{
+		if (empty())
+			return false;
+
+		// reused between calls, this runs on every string the game draws
+		static thread_local std::vector<match> matches;
+		matches.clear();
+
+		int state = 0;
+
+		for (size_t i = 0; i < text.length(); ++i)
+		{
+			state = transitions[state * num_classes + char_class[static_cast<unsigned char>(text[i])]];
+
+			for (int out = outputs[state].replacer != nullptr ? state : dictionary[state]; out != -1; out = dictionary[out])
+			{
+				size_t length = outputs[out].length;
+				size_t start = i + 1 - length;
+				if (is_boundary(text, start) && is_boundary(text, i + 1))
+					matches.push_back({ start, length, outputs[out].replacer });
+			}
+		}
+
+		if (matches.empty())
+			return false;
+
+		// leftmost match wins, and the longest name wins among matches that start together
+		std::sort(matches.begin(), matches.end(),
+			[](const match& a, const match& b) { return a.start < b.start || (a.start == b.start && a.length > b.length); });
+
+		result.clear();
+		result.reserve(text.length());
+
+		size_t pos = 0;
+		for (const match& m : matches)
+		{
+			if (m.start < pos)
+				continue;
+
+			result.append(text.substr(pos, m.start - pos));
+			result.append(m.replacer->anonymize());
+			pos = m.start + m.length;
+		}
+
+		result.append(text.substr(pos));
+		return true;
+	}
+};
+
 // the source string_view is checked _after_ string parsing
 // the target string is parsed before replacement
 static std::vector<std::unique_ptr<anon_replacer>> replacers;
@@ -295,8 +520,29 @@ static ci_unordered::map<std::string_view, std::unique_ptr<anon_replacer>> guild
 static ci_unordered::map<std::string_view, std::unique_ptr<anon_replacer>> raid_memoization;
 static std::unique_ptr<anon_replacer> self_replacer;
 
-// the source string_view here will be used to index
-// creating a regex that looks like `(source|all|the|alternates)`
+// everything above is folded into a single automaton that is rebuilt lazily whenever the
+// replacers change or the group/fellowship/guild/raid membership moves underneath it
+static anon_matcher matcher;
+static bool matcher_dirty = true;
+static std::vector<std::string> member_names;
+static size_t member_name_count = 0;
+static size_t roster_signature = 0;
+static size_t roster_counters = 0;
+static uint64_t roster_check = 0;
+static size_t guild_roster_signature = 0;
+static uint64_t guild_roster_check = 0;
+
+// the raid names are hashed as soon as the raid size or guild changes, and otherwise only this often
+// to catch a raid member being replaced by another without the count changing
+constexpr uint64_t RAID_CHECK_INTERVAL = 250;
+
+// the guild roster can be very large and rarely changes, so only walk it this often
+constexpr uint64_t GUILD_ROSTER_CHECK_INTERVAL = 1000;
+
+static void InvalidateMatcher()
+{
+	matcher_dirty = true;
+}
 
 // helper function to find a replacer by name
 static std::vector<std::unique_ptr<anon_replacer>>::iterator FindReplacer(std::string_view Name)
@@ -313,7 +559,7 @@ static void SetAnonymization(AnonymizationClasses AnonClass, Anonymization Strat
 		if (Strategy != anon_group)
 		{
 			anon_group = Strategy;
-			group_memoization.clear();
+			InvalidateMatcher();
 		}
 		break;
 
@@ -321,7 +567,7 @@ static void SetAnonymization(AnonymizationClasses AnonClass, Anonymization Strat
 		if (Strategy != anon_fellowship)
 		{
 			anon_fellowship = Strategy;
-			fellowship_memoization.clear();
+			InvalidateMatcher();
 		}
 		break;
 
@@ -329,7 +575,7 @@ static void SetAnonymization(AnonymizationClasses AnonClass, Anonymization Strat
 		if (Strategy != anon_guild)
 		{
 			anon_guild = Strategy;
-			guild_memoization.clear();
+			InvalidateMatcher();
 		}
 		break;
 
@@ -337,7 +583,7 @@ static void SetAnonymization(AnonymizationClasses AnonClass, Anonymization Strat
 		if (Strategy != anon_raid)
 		{
 			anon_raid = Strategy;
-			raid_memoization.clear();
+			InvalidateMatcher();
 		}
 		break;
 
@@ -345,10 +591,7 @@ static void SetAnonymization(AnonymizationClasses AnonClass, Anonymization Strat
 		if (Strategy != anon_self)
 		{
 			anon_self = Strategy;
-			if (!self_replacer)
-				self_replacer = std::make_unique<anon_replacer>(pLocalPlayer, anon_self);
-			else
-				self_replacer->update_strategy(Strategy);
+			InvalidateMatcher();
 		}
 		break;
 
@@ -378,6 +621,7 @@ static void AddAnonymization(std::string_view Name, Anonymization Strategy, std:
 	else
 	{
 		replacers.emplace_back(std::make_unique<anon_replacer>(Name, Strategy, Replace));
+		InvalidateMatcher();
 		WriteChatf("Added anonymization \at%s\ax with \at%s\ax%s",
 			Name.data(),
 			GetStringFromAnonymization(Strategy).data(),
@@ -392,6 +636,7 @@ static void DropAnonymization(std::string_view Name)
 	if (replacer_it != std::end(replacers))
 	{
 		replacers.erase(replacer_it);
+		InvalidateMatcher();
 		WriteChatf("Un-Anonymized \at%s\ax.", Name.data());
 	}
 	else
@@ -408,6 +653,7 @@ static void AddAlternate(std::string_view Name, std::string_view Alternate)
 	if (replacer_it != std::end(replacers))
 	{
 		(*replacer_it)->add_alternate(Alternate);
+		InvalidateMatcher();
 		WriteChatf("Added Alias \ay%s\ax to \at%s\ax.", Alternate.data(), Name.data());
 	}
 	else
@@ -424,6 +670,7 @@ static void DropAlternate(std::string_view Name, std::string_view Alternate)
 	if (replacer_it != std::end(replacers))
 	{
 		(*replacer_it)->drop_alternate(Alternate);
+		InvalidateMatcher();
 		WriteChatf("Dropped Alias \ay%s\ax from \at%s\ax.", Alternate.data(), Name.data());
 	}
 	else
@@ -447,7 +694,9 @@ static void DropAlternate(std::string_view Alternate)
 			}
 		});
 
-	if (!changed)
+	if (changed)
+		InvalidateMatcher();
+	else
 		WriteChatf("Could not find a filter that contains \ay%s\ax, no alias removed!", Alternate.data());
 }
 
@@ -540,6 +789,7 @@ static void Deserialize()
 	guild_memoization.clear();
 	raid_memoization.clear();
 	self_replacer.reset();
+	InvalidateMatcher();
 	WriteChatf("Done.");
 }
 
@@ -549,58 +799,187 @@ bool IsAnonymized()
 }
 
 
-// process string to anonymize
-CXStr& PluginAnonymize(CXStr& Text)
+static void CombineSignature(size_t& signature, size_t value)
 {
-	if (MaybeAnonymize(Text))
-		Text = Anonymize(Text);
+	signature ^= value + 0x9e3779b9 + (signature << 6) + (signature >> 2);
+}
 
-	return Text;
+static void CombineSignature(size_t& signature, std::string_view name)
+{
+	CombineSignature(signature, std::hash<std::string_view>{}(name));
 }
 
-CXStr Anonymize(const CXStr& Text)
+// compares the self, group and fellowship names with the ones the matcher was built from. That
+// is at most 19 names, so this runs on every call and a swapped member is never missed.
+static bool UpdateMemberNames()
 {
-	if (!MaybeAnonymize(Text))
-		return Text;
+	size_t count = 0;
+	bool changed = false;
 
-	if (!pLocalPlayer || !pLocalPC)
-		return Text;
+	auto compare = [&count, &changed](std::string_view name)
+	{
+		if (count == member_names.size())
+		{
+			member_names.emplace_back(name);
+			changed = true;
+		}
+		else if (member_names[count] != name)
+		{
+			member_names[count].assign(name);
+			changed = true;
+		}
 
-	EnterMQ2Benchmark(bmAnonymizer);
+		++count;
+	};
 
-	std::string new_text(Text);
+	// an empty name separates the lists, so a member moving from one list to the next is a change
+	if (anon_self != Anonymization::None)
+		compare(pLocalPlayer->Name);
+	compare({});
 
-	for (const auto& replacer : replacers)
+	if (anon_group != Anonymization::None && pLocalPC->Group)
 	{
-		if (replacer)
+		for (const CGroupMember* pMember : *pLocalPC->Group)
 		{
-			new_text = replacer->replace_text(new_text);
+			if (pMember && pMember->Name[0])
+				compare(pMember->Name);
 		}
 	}
+	compare({});
+
+	if (anon_fellowship != Anonymization::None)
+	{
+		for (const SFellowshipMember& f : pLocalPlayer->Fellowship.FellowshipMember)
+		{
+			if (f.Name[0])
+				compare(f.Name);
+		}
+	}
+
+	if (count != member_name_count)
+		changed = true;
+
+	member_name_count = count;
+	return changed;
+}
+
+// run on every call, this only reads counts and doesn't touch any of the raid or guild names
+static size_t GetRosterCounters()
+{
+	size_t counters = 0;
+
+	CombineSignature(counters, static_cast<size_t>(pRaid ? pRaid->RaidMemberCount : 0));
+	CombineSignature(counters, static_cast<size_t>(pLocalPC->GuildID));
+
+	return counters;
+}
+
+// hashes the raid and guild names. The guild roster is only walked once per
+// GUILD_ROSTER_CHECK_INTERVAL.
+static size_t GetRosterSignature()
+{
+	size_t signature = 0;
+
+	if (anon_raid != Anonymization::None && pRaid)
+	{
+		for (const RaidMember& pMember : pRaid->RaidMember)
+		{
+			if (pMember.Name[0] != '\0')
+				CombineSignature(signature, pMember.Name);
+		}
+	}
+
+	if (anon_guild != Anonymization::None && pGuild)
+	{
+		CombineSignature(signature, pGuild->GetGuildName(pLocalPC->GuildID));
+
+		uint64_t now = GetTickCount64();
+		if (now >= guild_roster_check)
+		{
+			guild_roster_check = now + GUILD_ROSTER_CHECK_INTERVAL;
+			guild_roster_signature = 0;
+
+			for (GuildMember* pMember = pGuild->pFirstGuildMember; pMember; pMember = pMember->pNext)
+			{
+				if (pMember->Name[0] != '\0')
+					CombineSignature(guild_roster_signature, pMember->Name);
+			}
+		}
+
+		CombineSignature(signature, guild_roster_signature);
+	}
+
+	return signature;
+}
+
+// returns true if the raid or guild membership changed since the last call
+static bool UpdateRoster()
+{
+	const size_t counters = GetRosterCounters();
+	const uint64_t now = GetTickCount64();
+
+	if (counters == roster_counters && now < roster_check)
+		return false;
+
+	roster_counters = counters;
+	roster_check = now + RAID_CHECK_INTERVAL;
+
+	const size_t signature = GetRosterSignature();
+	if (signature == roster_signature)
+		return false;
+
+	roster_signature = signature;
+	return true;
+}
+
+static void AddMemoizedReplacer(ci_unordered::map<std::string_view, std::unique_ptr<anon_replacer>>& memoization,
+	std::string_view name, Anonymization strategy)
+{
+	if (name.empty() || memoization.find(name) != memoization.end())
+		return;
+
+	// key on the replacer's own copy of the name so the key outlives the game's member list
+	auto replacer = std::make_unique<anon_replacer>(name, strategy);
+	const anon_replacer* pReplacer = replacer.get();
+	memoization.emplace(pReplacer->name, std::move(replacer));
+
+	matcher.add_replacer(pReplacer);
+}
+
+// collects every active name into the automaton, in the same priority order the replacers
+// used to be applied in: configured names, self, group, fellowship, guild and then raid.
+static void RebuildMatcher()
+{
+	matcher.clear();
+	group_memoization.clear();
+	fellowship_memoization.clear();
+	guild_memoization.clear();
+	raid_memoization.clear();
+
+	matcher_dirty = false;
+
+	for (const auto& replacer : replacers)
+	{
+		if (replacer)
+			matcher.add_replacer(replacer.get());
+	}
 
 	if (anon_self != Anonymization::None)
 	{
 		if (!self_replacer || ci_find_substr(self_replacer->name, pLocalPlayer->Name) != 0)
 			self_replacer = std::make_unique<anon_replacer>(pLocalPlayer, anon_self);
+		else
+			self_replacer->update_strategy(anon_self);
 
-		new_text = self_replacer->replace_text(new_text);
+		matcher.add_replacer(self_replacer.get());
 	}
 
 	if (anon_group != Anonymization::None && pLocalPC->Group)
 	{
 		for (const CGroupMember* pMember : *pLocalPC->Group)
 		{
-			if (pMember && pMember->Name[0] && ci_equals(new_text, pMember->Name, false))
-			{
-				auto memoized = group_memoization.find(pMember->Name);
-				if (memoized == group_memoization.end())
-				{
-					memoized = group_memoization.emplace(
-						pMember->Name, std::make_unique<anon_replacer>(pMember->Name, anon_group)).first;
-				}
-
-				new_text = memoized->second->replace_text(new_text);
-			}
+			if (pMember && pMember->Name[0])
+				AddMemoizedReplacer(group_memoization, pMember->Name, anon_group);
 		}
 	}
 
@@ -608,72 +987,65 @@ CXStr Anonymize(const CXStr& Text)
 	{
 		for (const SFellowshipMember& f : pLocalPlayer->Fellowship.FellowshipMember)
 		{
-			if (f.Name[0] && ci_equals(new_text, f.Name, false))
-			{
-				auto memoized = fellowship_memoization.find(f.Name);
-				if (memoized == fellowship_memoization.end())
-				{
-					memoized = fellowship_memoization.emplace(
-						f.Name, std::make_unique<anon_replacer>(f.Name, anon_fellowship)).first;
-				}
-
-				new_text = memoized->second->replace_text(new_text);
-			}
+			if (f.Name[0])
+				AddMemoizedReplacer(fellowship_memoization, f.Name, anon_fellowship);
 		}
 	}
 
 	if (anon_guild != Anonymization::None && pGuild)
 	{
-		const char* guild_name = pGuild->GetGuildName(pLocalPC->GuildID);
-		if (guild_name[0] != '\0' && ci_equals(new_text, guild_name, false))
-		{
-			auto memoized = guild_memoization.find(guild_name);
-			if (memoized == guild_memoization.end())
-				memoized = guild_memoization.emplace(
-					guild_name,
-					std::make_unique<anon_replacer>(guild_name, Anonymization::Asterisk)
-				).first;
-
-			new_text = memoized->second->replace_text(new_text);
-		}
+		AddMemoizedReplacer(guild_memoization, pGuild->GetGuildName(pLocalPC->GuildID), Anonymization::Asterisk);
 
 		for (GuildMember* pMember = pGuild->pFirstGuildMember; pMember; pMember = pMember->pNext)
 		{
-			if (pMember->Name[0] != '\0' && ci_equals(new_text, pMember->Name, false))
-			{
-				auto memoized = guild_memoization.find(pMember->Name);
-				if (memoized == guild_memoization.end())
-					memoized = guild_memoization.emplace(
-						pMember->Name,
-						std::make_unique<anon_replacer>(pMember->Name, anon_guild)
-					).first;
-
-				new_text = memoized->second->replace_text(new_text);
-			}
+			if (pMember->Name[0] != '\0')
+				AddMemoizedReplacer(guild_memoization, pMember->Name, anon_guild);
 		}
 	}
 
-	if (anon_raid != Anonymization::None)
+	if (anon_raid != Anonymization::None && pRaid)
 	{
-		for (RaidMember& pMember : pRaid->RaidMember)
+		for (const RaidMember& pMember : pRaid->RaidMember)
 		{
-			if (pMember.Name[0] != '\0' && ci_equals(new_text, pMember.Name, false))
-			{
-				auto memoized = raid_memoization.find(pMember.Name);
-				if (memoized == raid_memoization.end())
-					memoized = raid_memoization.emplace(
-						pMember.Name,
-						std::make_unique<anon_replacer>(pMember.Name, anon_raid)
-					).first;
-
-				new_text = memoized->second->replace_text(new_text);
-			}
+			if (pMember.Name[0] != '\0')
+				AddMemoizedReplacer(raid_memoization, pMember.Name, anon_raid);
 		}
 	}
 
+	matcher.build();
+}
+
+// process string to anonymize
+CXStr& PluginAnonymize(CXStr& Text)
+{
+	if (MaybeAnonymize(Text))
+		Text = Anonymize(Text);
+
+	return Text;
+}
+
+CXStr Anonymize(const CXStr& Text)
+{
+	if (!MaybeAnonymize(Text))
+		return Text;
+
+	if (!pLocalPlayer || !pLocalPC)
+		return Text;
+
+	EnterMQ2Benchmark(bmAnonymizer);
+
+	// both checks have to run every time so that they remember what the matcher is built from
+	const bool membersChanged = UpdateMemberNames();
+	const bool rosterChanged = UpdateRoster();
+	if (membersChanged || rosterChanged || matcher_dirty)
+		RebuildMatcher();
+
+	std::string new_text;
+	bool replaced = matcher.replace_text(std::string_view(Text), new_text);
+
 	ExitMQ2Benchmark(bmAnonymizer);
 
-	return CXStr(new_text);
+	return replaced ? CXStr(new_text) : Text;
 }
 
 DETOUR_TRAMPOLINE_DEF(float, GetGaugeValueFromEQ_Trampoline, (int, CXStr*, bool*, unsigned long*))
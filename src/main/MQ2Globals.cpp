@@ -120,6 +120,8 @@ uint64_t gRunning = 0;
 bool gbMoving = false;
 int gMaxTurbo = 80;
 int gTurboLimit = 240;
+int gTurboTimeBudget = 0;
+int gActorSharedMemory = 1024;
 bool gReturn = true;
 bool gTargetbuffs = false;
 bool gItemsReceived = false;
@@ -150,6 +150,8 @@ MQLIB_VAR uint64_t gRunning;
 MQLIB_VAR bool gbMoving;
 MQLIB_VAR int gMaxTurbo;
 MQLIB_VAR int gTurboLimit;
+MQLIB_VAR int gTurboTimeBudget;
+MQLIB_VAR int gActorSharedMemory;
 
 MQLIB_VAR bool gReturn;
 MQLIB_VAR bool gTargetbuffs;
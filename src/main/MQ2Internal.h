@@ -18,10 +18,12 @@
 #include "mq/api/Main.h"
 #include "mq/api/PluginAPI.h"
 #include "mq/base/PluginHandle.h"
+#include "mq/base/String.h"
 
 #include <map>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <variant>
 
@@ -235,6 +237,8 @@ struct MQWhoSort
 using WHOSORT DEPRECATE("Use MQWhoSort instead of WHOSORT") = MQWhoSort;
 using PWHOSORT DEPRECATE("Use MQWhoSort* instead PWHOSORT") = MQWhoSort*;
 
+struct MQCommand;
+
 struct MQMacroLine
 {
 	std::string Command;
@@ -246,6 +250,17 @@ struct MQMacroLine
 	std::string SourceFile;
 	int LineNumber = 0;
 
+	// Resolved once when the macro is loaded (see CompileMacroBlock) so that the executor
+	// doesn't need to re-inspect the command text every time the line runs.
+	int NextIndex = -1;                         // index of the following line, -1 if this is the last line
+	int SubIndex = 0;                           // index of the Sub this line belongs to, 0 if it precedes the first Sub
+	bool IsNoOp = false;                        // labels and opening braces
+	bool CanTriggerBind = false;                // queued binds only trigger after select commands
+
+	// Command dispatch cache, validated against the command table generation.
+	mutable MQCommand* ResolvedCommand = nullptr;
+	mutable uint32_t ResolvedCommandGeneration = 0;
+
 #ifdef MQ2_PROFILING
 	int ExecutionCount = 0;
 	uint64_t ExecutionTime = 0;
@@ -273,6 +288,9 @@ struct MQMacroBlock
 	std::map<int, MQMacroLine> Line;
 	bool Removed = false;
 
+	// Label lines of each Sub, keyed by the index of the Sub line. Built when the macro is loaded.
+	std::unordered_map<int, ci_unordered::map<std::string, int>> Labels;
+
 	MQMacroBlock(std::string name) : Name(std::move(name)) {}
 
 	MQMacroBlock(const MQMacroBlock&) = delete;
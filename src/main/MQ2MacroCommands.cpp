@@ -861,6 +861,215 @@ bool AddMacroLine(const char* FileName, char* szLine, size_t Linelen, int* LineN
 	return true;
 }
 
+// Returns the index of the line declaring label in the given Sub, or 0 if there is no such label.
+static int FindMacroLabel(const MQMacroBlock& block, int subIndex, std::string_view label)
+{
+	auto subIter = block.Labels.find(subIndex);
+	if (subIter == block.Labels.end())
+		return 0;
+
+	auto labelIter = subIter->second.find(label);
+	if (labelIter == subIter->second.end())
+		return 0;
+
+	return labelIter->second;
+}
+
+// Finds the closing brace of the /while block that starts at whileIter, using the same pairing
+// rules as the interpreter. Returns the index of the closing line, or 0 with an error message.
+static int FindWhileBlockEnd(const MQMacroBlock& block, std::map<int, MQMacroLine>::const_iterator whileIter,
+	std::string& error)
+{
+	auto lineIter = whileIter;
+	int Scope = 1;
+
+	while (++lineIter != block.Line.end())
+	{
+		if (lineIter->second.Command[0] == '}')
+		{
+			--Scope;
+			if (Scope == 0)
+				return lineIter->first;
+		}
+
+		if (lineIter->second.Command[lineIter->second.Command.size() - 1] == '{')
+		{
+			++Scope;
+		}
+		else if (!_strnicmp(lineIter->second.Command.c_str(), "sub ", 4))
+		{
+			error = "{} pairing ran into another subroutine";
+			return 0;
+		}
+	}
+
+	error = "No } found for /while";
+	return 0;
+}
+
+// Returns the command of a single line /if, given the text that follows "/if". The conditions
+// are the parenthesized text up to the matching close paren, as MacroIfCmd parses them.
+static const char* GetIfCommand(const char* szLine)
+{
+	while (*szLine == ' ')
+		++szLine;
+
+	if (*szLine != '(')
+		return nullptr;
+
+	int nParens = 0;
+	for (const char* pPos = szLine; *pPos; ++pPos)
+	{
+		if (*pPos == '(')
+		{
+			++nParens;
+		}
+		else if (*pPos == ')' && --nParens == 0)
+		{
+			if (pPos[1] != ' ')
+				return nullptr;
+
+			pPos += 2;
+			while (*pPos == ' ')
+				++pPos;
+
+			return pPos;
+		}
+	}
+
+	return nullptr;
+}
+
+// ***************************************************************************
+// Function:    CompileMacroBlock
+// Description: Resolves the per-line information that the executor would
+//              otherwise have to work out from the command text every time
+//              a line runs: line order, label locations and the boundaries
+//              of /while and /for loops. Problems with labels and loops are
+//              added to errors.
+// ***************************************************************************
+static bool CompileMacroBlock(MQMacroBlock& block, std::vector<std::string>& errors)
+{
+	char szArg1[MAX_STRING] = { 0 };
+	char szArg2[MAX_STRING] = { 0 };
+	MQMacroLine* pPrevLine = nullptr;
+	int subIndex = 0;
+
+	block.Labels.clear();
+
+	for (auto& [index, line] : block.Line)
+	{
+		if (pPrevLine)
+			pPrevLine->NextIndex = index;
+		pPrevLine = &line;
+
+		if (!_strnicmp(line.Command.c_str(), "Sub ", 4))
+			subIndex = index;
+		line.SubIndex = subIndex;
+
+		GetArg(szArg1, line.Command.c_str(), 1);
+		line.IsNoOp = szArg1[0] == ':' || szArg1[0] == '{';
+
+		// Only trigger queued bind on select commands
+		line.CanTriggerBind = ci_find_substr(line.Command, "/varset") == 0
+			|| ci_find_substr(line.Command, "/echo") == 0
+			|| ci_find_substr(line.Command, "Sub") == 0
+			|| ci_find_substr(line.Command, "/call") == 0
+			|| ci_find_substr(line.Command, "/invoke") == 0;
+
+		if (line.Command[0] == ':')
+		{
+			auto [labelIter, added] = block.Labels[subIndex].emplace(line.Command, index);
+			if (!added)
+			{
+				const MQMacroLine& first = block.Line.at(labelIter->second);
+				errors.push_back(fmt::format("Duplicate label {} at {}@{}, first declared at {}@{}",
+					line.Command, line.SourceFile, line.LineNumber, first.SourceFile, first.LineNumber));
+			}
+		}
+	}
+
+	// Now that every label is known, resolve the jumps.
+	for (auto iter = block.Line.begin(); iter != block.Line.end(); ++iter)
+	{
+		MQMacroLine& line = iter->second;
+
+		GetArg(szArg1, line.Command.c_str(), 1);
+
+		// /goto can also be the command of a single line /if
+		const char* gotoCommand = nullptr;
+		if (!_stricmp(szArg1, "/goto"))
+		{
+			gotoCommand = line.Command.c_str();
+		}
+		else if (!_stricmp(szArg1, "/if"))
+		{
+			const char* ifCommand = GetIfCommand(line.Command.c_str() + 3);
+			if (ifCommand && !_stricmp(GetArg(szArg2, ifCommand, 1), "/goto"))
+				gotoCommand = ifCommand;
+		}
+
+		if (gotoCommand)
+		{
+			GetArg(szArg2, gotoCommand, 2);
+
+			// Labels built from variables can only be checked when the /goto runs.
+			if (szArg2[0] != 0 && !strchr(szArg2, '$') && FindMacroLabel(block, line.SubIndex, szArg2) == 0)
+			{
+				errors.push_back(fmt::format("Couldn't find label {} for /goto at {}@{}",
+					szArg2, line.SourceFile, line.LineNumber));
+			}
+		}
+
+		if (!_stricmp(szArg1, "/while") && line.Command.back() == '{' && iter != block.Line.begin())
+		{
+			std::string error;
+			int endIndex = FindWhileBlockEnd(block, iter, error);
+			if (endIndex == 0)
+			{
+				errors.push_back(fmt::format("{} at {}@{}", error, line.SourceFile, line.LineNumber));
+				continue;
+			}
+
+			// The loop resumes at the line before the /while so that the condition is evaluated next.
+			const int firstLine = std::prev(iter)->first;
+
+			line.LoopStart = firstLine;
+			line.LoopEnd = endIndex;
+			block.Line.at(endIndex).LoopStart = firstLine;
+		}
+		else if (!_stricmp(szArg1, "/for"))
+		{
+			GetArg(szArg2, line.Command.c_str(), 2);
+			if (szArg2[0] == 0 || strchr(szArg2, '$'))
+				continue;
+
+			// Remember the matching /next so that /break and /continue don't need to search for it.
+			for (auto nextIter = std::next(iter); nextIter != block.Line.end(); ++nextIter)
+			{
+				const char* nextLine = nextIter->second.Command.c_str();
+
+				if (!_strnicmp(nextLine, "/next", 5))
+				{
+					GetArg(szArg1, nextLine, 2);
+
+					if (!_stricmp(szArg1, szArg2))
+					{
+						line.LoopEnd = nextIter->first;
+						break;
+					}
+				}
+				else if (!_strnicmp(nextLine, "Sub ", 4))
+				{
+					break;
+				}
+			}
+		}
+	}
+
+	return errors.empty();
+}
+
 static MQMacroBlockPtr AddMacroBlock(std::string Name)
 {
 	auto macroBlock = std::make_shared<MQMacroBlock>(Name);
@@ -1098,6 +1307,21 @@ void Macro(PlayerClient* pChar, const char* szLine)
 		pDefines = pDef;
 	}
 
+	std::vector<std::string> compileErrors;
+	if (!CompileMacroBlock(*gMacroBlock, compileErrors))
+	{
+		for (const std::string& error : compileErrors)
+		{
+			WriteChatColor(error.c_str(), CONCOLOR_RED);
+		}
+
+		FatalError("Unable to load macro %s", strMacroName.c_str());
+
+		gszMacroName[0] = 0;
+		gRunning = 0;
+		return;
+	}
+
 	strcpy_s(szTemp, "Main");
 	if (Params[0] != 0)
 	{
@@ -1207,54 +1431,16 @@ void Goto(PlayerClient* pChar, const char* szLine)
 	}
 
 	bRunNextCommand = true;
-	int FromIndex = gMacroBlock->CurrIndex;
 
-	const auto goto_line = gMacroBlock->Line.find(FromIndex);
-	if (goto_line->second.LoopEnd)
+	const MQMacroLine& gotoLine = gMacroBlock->Line.at(gMacroBlock->CurrIndex);
+	const int labelIndex = FindMacroLabel(*gMacroBlock, gotoLine.SubIndex, szLine);
+	if (labelIndex == 0)
 	{
-		gMacroBlock->CurrIndex = goto_line->second.LoopEnd;
+		FatalError("Couldn't find label %s", szLine);
 		return;
 	}
 
-	std::map<int, MQMacroLine>::reverse_iterator ri(goto_line);
-
-	// search up first we only search until we find a "Sub "
-	for (; ri != gMacroBlock->Line.rend(); ri++)
-	{
-		if (!_strnicmp(ri->second.Command.c_str(), "Sub ", 4))
-		{
-			ri--;
-			FromIndex = ri->first;
-			break;
-		}
-
-		if (!_stricmp(szLine, ri->second.Command.c_str()))
-		{
-			// Label found....
-			gMacroBlock->CurrIndex = ri->first;
-			goto_line->second.LoopEnd = ri->first;
-			return;
-		}
-	}
-
-	// now that we found our start lets look forward for the goto label:
-	for (auto iter = gMacroBlock->Line.find(FromIndex); iter != gMacroBlock->Line.end(); iter++)
-	{
-		if (!_strnicmp(iter->second.Command.c_str(), "Sub ", 4))
-		{
-			break;
-		}
-
-		if (!_stricmp(szLine, iter->second.Command.c_str()))
-		{
-			// Label found
-			gMacroBlock->CurrIndex = iter->first;
-			goto_line->second.LoopEnd = iter->first;
-			return;
-		}
-	}
-
-	FatalError("Couldn't find label %s", szLine);
+	gMacroBlock->CurrIndex = labelIndex;
 }
 
 char* GetSubFromLine(int Line, char* szSub, size_t Sublen)
@@ -2286,6 +2472,26 @@ void Next(PlayerClient* pChar, const char* szLine)
 	}
 }
 
+// Returns the /next line that was matched to a /for loop when the macro was loaded, or 0.
+static int GetMatchingNextLine(const MQLoop& loop)
+{
+	if (loop.type != MQLoop::Type::For)
+		return 0;
+
+	const MQMacroLine& forLine = gMacroBlock->Line.at(loop.firstLine);
+	if (forLine.LoopEnd == 0)
+		return 0;
+
+	// The /for line is parsed before it runs, so make sure it still names the same variable.
+	char szNextVar[MAX_STRING] = { 0 };
+	GetArg(szNextVar, gMacroBlock->Line.at(forLine.LoopEnd).Command.c_str(), 2);
+
+	if (_stricmp(szNextVar, loop.forVariable.c_str()) != 0)
+		return 0;
+
+	return forLine.LoopEnd;
+}
+
 // ***************************************************************************
 // Function:    Continue
 // Description: Our '/continue' command
@@ -2319,6 +2525,15 @@ void Continue(PlayerClient* pChar, const char* szLine)
 		gMacroBlock->CurrIndex = i->first;
 		return;
 	}
+	else if (const int nextLine = GetMatchingNextLine(loop))
+	{
+		loop.lastLine = nextLine;
+
+		auto i = gMacroBlock->Line.find(nextLine);
+		--i;
+		gMacroBlock->CurrIndex = i->first;
+		return;
+	}
 
 	auto i = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
 	while (++i != gMacroBlock->Line.end())
@@ -2370,6 +2585,9 @@ void Break(PlayerClient* pChar, const char* szLine)
 	}
 
 	auto& loop = gMacroStack->loopStack[size - 1];
+	if (!loop.lastLine)
+		loop.lastLine = GetMatchingNextLine(loop);
+
 	if (loop.lastLine) // takes care of /while and /for after 1st /next encountered
 	{
 		gMacroBlock->CurrIndex = loop.lastLine;
@@ -126,7 +126,8 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 			pBlock->BindStackIndex = -1;
 		}
 
-		gMacroStack->LocationIndex = pBlock->CurrIndex;
+		const int lineIndex = pBlock->CurrIndex;
+		gMacroStack->LocationIndex = lineIndex;
 #ifdef MQ2_PROFILING
 		LARGE_INTEGER BeforeCommand;
 		QueryPerformanceCounter(&BeforeCommand);
@@ -135,7 +136,7 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 
 		if (gbInZone && !gZoning)
 		{
-			DoCommand(ml.Command.c_str(), false);
+			pCommandAPI->DoMacroCommand(ml);
 			MQMacroBlockPtr pCurrentBlock = GetCurrentMacroBlock();
 
 			if (!pCurrentBlock)
@@ -143,12 +144,7 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 
 			if (!pCurrentBlock->BindCmd.empty() && pCurrentBlock->BindStackIndex == -1)
 			{
-				// Only trigger queued bind on select commands
-				if (ci_find_substr(ml.Command, "/varset") == 0
-					|| ci_find_substr(ml.Command, "/echo") == 0
-					|| ci_find_substr(ml.Command, "Sub") == 0
-					|| ci_find_substr(ml.Command, "/call") == 0
-					|| ci_find_substr(ml.Command, "/invoke") == 0)
+				if (ml.CanTriggerBind)
 				{
 					auto iter = pCurrentBlock->Line.find(pCurrentBlock->CurrIndex);
 					if (iter != pCurrentBlock->Line.end())
@@ -175,24 +171,33 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 			pCurrentBlock->Line[ThisMacroBlock].ExecutionTime += AfterCommand.QuadPart - BeforeCommand.QuadPart;
 #endif
 
-			const int lastindex = pCurrentBlock->Line.rbegin()->first;
-			if (pCurrentBlock->CurrIndex > lastindex)
+			if (pCurrentBlock == pBlock && pCurrentBlock->CurrIndex == lineIndex)
 			{
-				FatalError("Reached end of macro.");
+				// Nothing jumped, so we already know where the next line is.
+				if (ml.NextIndex != -1)
+					pCurrentBlock->CurrIndex = ml.NextIndex;
 			}
 			else
 			{
-				auto iter = pCurrentBlock->Line.find(pCurrentBlock->CurrIndex);
-				if (iter != pCurrentBlock->Line.end())
+				const int lastindex = pCurrentBlock->Line.rbegin()->first;
+				if (pCurrentBlock->CurrIndex > lastindex)
 				{
-					if (++iter != pCurrentBlock->Line.end())
-					{
-						pCurrentBlock->CurrIndex = iter->first;
-					}
+					FatalError("Reached end of macro.");
 				}
 				else
 				{
-					FatalError("Reached end of macro.");
+					auto iter = pCurrentBlock->Line.find(pCurrentBlock->CurrIndex);
+					if (iter != pCurrentBlock->Line.end())
+					{
+						if (++iter != pCurrentBlock->Line.end())
+						{
+							pCurrentBlock->CurrIndex = iter->first;
+						}
+					}
+					else
+					{
+						FatalError("Reached end of macro.");
+					}
 				}
 			}
 
@@ -725,6 +730,10 @@ static HeartbeatState Heartbeat()
 
 	int CurTurbo = 0;
 
+	// Optionally limit how much of the frame the macro is allowed to use, in milliseconds.
+	const auto turboStart = std::chrono::steady_clock::now();
+	const auto turboBudget = std::chrono::milliseconds(gTurboTimeBudget);
+
 	MQMacroBlockPtr pBlock = GetNextMacroBlock();
 	while (bRunNextCommand)
 	{
@@ -738,6 +747,8 @@ static HeartbeatState Heartbeat()
 			break;
 		if (++CurTurbo > gMaxTurbo)
 			break;
+		if (gTurboTimeBudget > 0 && std::chrono::steady_clock::now() - turboStart >= turboBudget)
+			break;
 
 		// re-fetch current macro block in case one of the previous instructions changed it
 		pBlock = GetCurrentMacroBlock();
@@ -15,6 +15,7 @@
 #include "pch.h"
 #include "MQ2Main.h"
 
+#include "ChatStrip.h"
 #include "MQ2Mercenaries.h"
 #include "MQ2Utilities.h"
 
@@ -483,32 +484,7 @@ char* GetEQPath(char* szBuffer, size_t len)
 
 void StripMQChat(std::string_view in, char* out)
 {
-	size_t i = 0;
-	int o = 0;
-	while (i < in.size() && in[i])
-	{
-		if (in[i] == '\a')
-		{
-			i++;
-			if (in[i] == '-')
-			{
-				// skip 1 after -
-				i++;
-			}
-			else if (in[i] == '#')
-			{
-				// skip 6 after #
-				i += 6;
-			}
-		}
-		else if (in[i] == '\n')
-		{
-		}
-		else
-			out[o++] = in[i];
-		i++;
-	}
-	out[o] = 0;
+	StripChatColors(in, out);
 }
 
 void StripMQChat(const char* in, char* out)
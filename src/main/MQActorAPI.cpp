@@ -69,18 +69,10 @@ static void OnPostUnloadPluginActorAPI(const char* pluginName)
 	}
 }
 
-void MQActorAPI::SendToActor(
-	postoffice::Dropbox* dropbox,
-	const postoffice::Address& address,
-	const std::string& data,
-	const postoffice::ResponseCallbackAPI& callback,
-	const MQPluginHandle& pluginHandle /* = mqplugin::ThisPluginHandle */)
+static proto::routing::Address BuildAddress(const postoffice::Address& address, MQPlugin* owner)
 {
 	proto::routing::Address addr;
 
-	// Treat Main plugin handle as having no owner.
-	MQPlugin* owner = GetPluginByHandle(pluginHandle, true);
-	
 	if (address.UUID)
 		addr.set_uuid(*address.UUID);
 
@@ -118,37 +110,58 @@ void MQActorAPI::SendToActor(
 		addr.set_mailbox(owner->name);
 	// else we have no mailbox or owner, so it must remain blank
 
+	return addr;
+}
+
+static postoffice::Address GetAddress(const proto::routing::Address& s)
+{
+	return postoffice::Address{
+		s.has_uuid() ? std::make_optional(s.uuid()) : std::nullopt,
+		s.has_process() ? std::make_optional(s.process().pid()) : std::nullopt,
+		s.has_peer() ? std::make_optional(postoffice::Peer{s.peer().ip(), static_cast<uint16_t>(s.peer().port())}) : std::nullopt,
+		s.has_name() ? std::make_optional(s.name()) : std::nullopt,
+		s.has_mailbox() ? std::make_optional(s.mailbox()) : std::nullopt,
+		s.has_client() && s.client().has_account() ? std::make_optional(s.client().account()) : std::nullopt,
+		s.has_client() && s.client().has_server() ? std::make_optional(s.client().server()) : std::nullopt,
+		s.has_client() && s.client().has_character() ? std::make_optional(s.client().character()) : std::nullopt,
+		true
+	};
+}
+
+// wraps a reply in a message that can't be replied to
+static std::shared_ptr<postoffice::Message> MakeReplyMessage(const proto::routing::Envelope& message)
+{
+	// no need to store this message in the message storage since we know it
+	// can't be replied to -- which means we also don't need the custom deleter
+	std::optional<postoffice::Address> sender;
+	if (message.has_return_address())
+		sender = GetAddress(message.return_address());
+
+	std::optional<std::string> data;
+	if (message.has_payload())
+		data = message.payload();
+
+	return std::make_shared<postoffice::Message>(postoffice::Message{ nullptr, sender, data });
+}
+
+void MQActorAPI::SendToActor(
+	postoffice::Dropbox* dropbox,
+	const postoffice::Address& address,
+	const std::string& data,
+	const postoffice::ResponseCallbackAPI& callback,
+	const MQPluginHandle& pluginHandle /* = mqplugin::ThisPluginHandle */)
+{
+	// Treat Main plugin handle as having no owner.
+	MQPlugin* owner = GetPluginByHandle(pluginHandle, true);
+
+	proto::routing::Address addr = BuildAddress(address, owner);
+
 	MessageResponseCallback pipe_callback = nullptr;
 	if (callback != nullptr)
 	{
-		pipe_callback = [callback, address](int status, MessagePtr message)
+		pipe_callback = [callback](int status, MessagePtr message)
 			{
-				// no need to store this message in the message storage since we know it
-				// can't be replied to -- which means we also don't need the custom deleter
-				// assume that the sender is the address we sent to
-				std::optional<postoffice::Address> sender;
-				if (message->has_return_address())
-				{
-					const auto& s = message->return_address();
-					sender = postoffice::Address{
-						s.has_uuid() ? std::make_optional(s.uuid()) : std::nullopt,
-						s.has_process() ? std::make_optional(s.process().pid()) : std::nullopt,
-						s.has_peer() ? std::make_optional(postoffice::Peer{s.peer().ip(), static_cast<uint16_t>(s.peer().port())}) : std::nullopt,
-						s.has_name() ? std::make_optional(s.name()) : std::nullopt,
-						s.has_mailbox() ? std::make_optional(s.mailbox()) : std::nullopt,
-						s.has_client() && s.client().has_account() ? std::make_optional(s.client().account()) : std::nullopt,
-						s.has_client() && s.client().has_server() ? std::make_optional(s.client().server()) : std::nullopt,
-						s.has_client() && s.client().has_character() ? std::make_optional(s.client().character()) : std::nullopt,
-						true
-					};
-				}
-
-				std::optional<std::string> data;
-				if (message->has_payload())
-					data = message->payload();
-
-				callback(status, std::make_shared<postoffice::Message>(
-					postoffice::Message{ nullptr, sender, data }));
+				callback(status, MakeReplyMessage(*message));
 			};
 	}
 
@@ -177,6 +190,46 @@ void MQActorAPI::SendToActor(
 	}
 }
 
+void MQActorAPI::GatherFromActors(
+	postoffice::Dropbox* dropbox,
+	const postoffice::Address& address,
+	const std::string& data,
+	std::chrono::milliseconds timeout,
+	const postoffice::GatherCallbackAPI& callback,
+	const MQPluginHandle& pluginHandle /* = mqplugin::ThisPluginHandle */)
+{
+	// replies are routed back to the dropbox, so there's nothing to gather without one
+	if (dropbox == nullptr || !dropbox->IsValid())
+	{
+		if (callback != nullptr)
+			callback(postoffice::GatherResponse{ MsgError_RoutingFailed });
+
+		return;
+	}
+
+	MQPlugin* owner = GetPluginByHandle(pluginHandle, true);
+
+	dropbox->Gather(BuildAddress(address, owner), data, timeout,
+		[callback](GatherResult&& result)
+		{
+			if (callback == nullptr)
+				return;
+
+			postoffice::GatherResponse response;
+			response.Status = result.status;
+
+			response.Replies.reserve(result.replies.size());
+			for (const MessagePtr& reply : result.replies)
+				response.Replies.push_back(postoffice::GatherReply{ reply->status(), MakeReplyMessage(*reply) });
+
+			response.TimedOut.reserve(result.timedOut.size());
+			for (const proto::routing::Address& recipient : result.timedOut)
+				response.TimedOut.push_back(GetAddress(recipient));
+
+			callback(response);
+		});
+}
+
 void MQActorAPI::ReplyToActor(
 	postoffice::Dropbox* dropbox,
 	const std::shared_ptr<postoffice::Message>& message,
@@ -201,30 +254,19 @@ void MQActorAPI::ReplyToActor(
 postoffice::Dropbox* MQActorAPI::AddActor(
 	const char* localAddress,
 	ReceiveCallbackAPI&& receive,
+	const MailboxOptionsAPI& options,
 	const MQPluginHandle& pluginHandle)
 {
 	MQPlugin* owner = GetPluginByHandle(pluginHandle, true);
 
+	const MailboxOptions mailbox_options{ options.Capacity, static_cast<MailboxOverflow>(options.Overflow) };
+
 	auto dropbox = std::make_unique<Dropbox>(GetPostOffice().RegisterAddress(localAddress,
 		[receive = std::move(receive)](MessagePtr message)
 		{
-			//auto sender = message->GetSender().value_or(proto::routing::Address());
 			std::optional<postoffice::Address> sender;
 			if (message->has_return_address())
-			{
-				proto::routing::Address s = message->return_address();
-				sender = postoffice::Address{
-					s.has_uuid() ? std::make_optional(s.uuid()) : std::nullopt,
-					s.has_process() ? std::make_optional(s.process().pid()) : std::nullopt,
-					s.has_peer() ? std::make_optional(postoffice::Peer{s.peer().ip(), static_cast<uint16_t>(s.peer().port())}) : std::nullopt,
-					s.has_name() ? std::make_optional(s.name()) : std::nullopt,
-					s.has_mailbox() ? std::make_optional(s.mailbox()) : std::nullopt,
-					s.has_client() && s.client().has_account() ? std::make_optional(s.client().account()) : std::nullopt,
-					s.has_client() && s.client().has_server() ? std::make_optional(s.client().server()) : std::nullopt,
-					s.has_client() && s.client().has_character() ? std::make_optional(s.client().character()) : std::nullopt,
-					true
-				};
-			}
+				sender = GetAddress(message->return_address());
 
 			std::optional<std::string> data;
 			if (message->has_payload() && message->payload().size() > 0)
@@ -240,7 +282,7 @@ postoffice::Dropbox* MQActorAPI::AddActor(
 					s_messageStorage.erase(message->Original);
 					delete message;
 				}));
-		}));
+		}, mailbox_options));
 
 	// return even if it's invalid so users don't have to null check
 	// note that owner can be nullptr here (which would be for mq2main)
@@ -274,4 +316,17 @@ void MQActorAPI::RemoveActor(
 	}
 }
 
+postoffice::MailboxStatsAPI MQActorAPI::GetActorStats(
+	postoffice::Dropbox* dropbox,
+	const MQPluginHandle& pluginHandle)
+{
+	if (dropbox != nullptr && dropbox->IsValid())
+	{
+		if (auto stats = GetPostOffice().GetMailboxStats(dropbox->GetAddress()))
+			return MailboxStatsAPI{ stats->Depth, stats->HighWater, stats->Capacity, stats->Dropped };
+	}
+
+	return MailboxStatsAPI{};
+}
+
 } // namespace mq
@@ -33,6 +33,14 @@ public:
 		const postoffice::ResponseCallbackAPI& callback,
 		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
 
+	void GatherFromActors(
+		postoffice::Dropbox* dropbox,
+		const postoffice::Address& address,
+		const std::string& data,
+		std::chrono::milliseconds timeout,
+		const postoffice::GatherCallbackAPI& callback,
+		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
+
 	void ReplyToActor(
 		postoffice::Dropbox* dropbox,
 		const std::shared_ptr<postoffice::Message>& message,
@@ -43,11 +51,16 @@ public:
 	postoffice::Dropbox* AddActor(
 		const char* localAddress,
 		postoffice::ReceiveCallbackAPI&& receive,
+		const postoffice::MailboxOptionsAPI& options = {},
 		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
 
 	void RemoveActor(
 		postoffice::Dropbox*& dropbox,
 		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
+
+	postoffice::MailboxStatsAPI GetActorStats(
+		postoffice::Dropbox* dropbox,
+		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
 };
 
 extern MQActorAPI* pActorAPI;
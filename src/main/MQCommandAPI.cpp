@@ -21,16 +21,6 @@
 
 namespace mq {
 
-struct MQTimedCommand
-{
-	uint64_t         time;
-	std::string      command;
-	MQPluginHandle   pluginHandle;
-
-	MQTimedCommand*  pLast;
-	MQTimedCommand*  pNext;
-};
-
 struct MQCommand
 {
 	std::string      command;
@@ -39,9 +29,15 @@ struct MQCommand
 	bool             eq;
 	bool             parse;
 	bool             inGameOnly;
+};
 
-	MQCommand*       pLast = nullptr;
-	MQCommand*       pNext = nullptr;
+// Orders the command table by name, case insensitively.
+struct MQCommandAPI::CommandLess
+{
+	bool operator()(const std::unique_ptr<MQCommand>& a, std::string_view b) const
+	{
+		return ci_string_compare(a->command, b) < 0;
+	}
 };
 
 void PopMacroLoop();
@@ -278,53 +274,31 @@ MQCommandAPI::~MQCommandAPI()
 {
 	RemoveDetour(CEverQuest__InterpretCmd);
 
-	while (m_pCommands)
-	{
-		MQCommand* pNext = m_pCommands->pNext;
-		delete m_pCommands;
-		m_pCommands = pNext;
-	}
+	m_commands.clear();
 
 	m_delayedCommands.clear();
-
-	while (m_pTimedCommands)
-	{
-		MQTimedCommand* pNext = m_pTimedCommands->pNext;
-		delete m_pTimedCommands;
-		m_pTimedCommands = pNext;
-	}
+	m_timedCommands.clear();
 
 	m_aliases.clear();
 }
 
 void MQCommandAPI::OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle)
 {
-	// Remove any commands that were created by this plugin.
-	MQCommand* pCommand = m_pCommands;
+	std::scoped_lock lock(m_commandMutex);
 
-	while (pCommand)
-	{
-		if (pCommand->pluginHandle == pluginHandle)
+	// Remove any commands that were created by this plugin.
+	size_t removed = std::erase_if(m_commands,
+		[&](const std::unique_ptr<MQCommand>& pCommand)
 		{
-			DebugSpew("Removing command left behind by %s: %s", plugin->name.c_str(), pCommand->command.c_str());
-
-			if (pCommand->pNext)
-				pCommand->pNext->pLast = pCommand->pLast;
-			if (pCommand->pLast)
-				pCommand->pLast->pNext = pCommand->pNext;
-			else
-				m_pCommands = pCommand->pNext;
+			if (pCommand->pluginHandle != pluginHandle)
+				return false;
 
-			MQCommand* thisCmd = pCommand;
-			pCommand = pCommand->pNext;
+			DebugSpew("Removing command left behind by %s: %s", plugin->name.c_str(), pCommand->command.c_str());
+			return true;
+		});
 
-			delete thisCmd;
-		}
-		else
-		{
-			pCommand = pCommand->pNext;
-		}
-	}
+	if (removed > 0)
+		++m_commandGeneration;
 }
 
 bool MQCommandAPI::InterpretCmd(const char* szFullLine, const MQCommandHandler& eqHandler)
@@ -375,55 +349,83 @@ bool MQCommandAPI::InterpretCmd(const char* szFullLine, const MQCommandHandler&
 	return false;
 }
 
-bool MQCommandAPI::DispatchCommand(char* szCommand, char* szArgs, const MQCommandHandler& eqHandler)
+MQCommand* MQCommandAPI::FindDispatchCommand(const char* szCommand) const
 {
-	std::unique_lock lock(m_commandMutex);
+	const std::string_view command{ szCommand };
 
-	MQCommand* pCommand = m_pCommands;
-	while (pCommand)
+	// Commands are dispatched to the first command that starts with what was typed. Everything
+	// that starts with it sorts at or after the typed text, so start searching from there.
+	for (auto iter = std::lower_bound(m_commands.begin(), m_commands.end(), command, CommandLess{});
+		iter != m_commands.end(); ++iter)
 	{
+		MQCommand* pCommand = iter->get();
+
 		if (pCommand->inGameOnly && gGameState != GAMESTATE_INGAME)
-		{
-			pCommand = pCommand->pNext;
 			continue;
-		}
 
-		// Substring search
-		int Pos = _strnicmp(szCommand, pCommand->command.c_str(), strlen(szCommand));
-		if (Pos < 0)
+		if (!ci_starts_with(pCommand->command, command))
 		{
 			// command not found
 			break;
 		}
 
-		if (Pos == 0)
-		{
-			lock.unlock();
+		return pCommand;
+	}
 
-			// the parser version is 2, or It's not version 2 and we're allowing command parses
-			if (pCommand->parse && (gParserVersion == 2 || (gParserVersion != 2 && bAllowCommandParse)))
-			{
-				ParseMacroParameter(szArgs, MAX_STRING);
-			}
+	return nullptr;
+}
 
-			if (pCommand->eq && eqHandler != nullptr)
-			{
-				strcat_s(szCommand, MAX_STRING, " ");
-				strcat_s(szCommand, MAX_STRING, szArgs);
+bool MQCommandAPI::DispatchCommand(char* szCommand, char* szArgs, const MQCommandHandler& eqHandler,
+	const MQMacroLine* macroLine /* = nullptr */)
+{
+	std::unique_lock lock(m_commandMutex);
 
-				eqHandler(pLocalPlayer, szCommand);
-			}
-			else
-			{
-				pCommand->handler(pLocalPlayer, szArgs);
-			}
+	MQCommand* pCommand;
 
-			return true;
+	// Macro lines remember which command they dispatched to. The result only depends on the command
+	// list, so it stays valid until a command is added or removed. Outside of the game the lookup
+	// skips inGameOnly commands, so the cache is only used while in game.
+	const bool useCache = macroLine != nullptr && gGameState == GAMESTATE_INGAME;
+
+	if (useCache && macroLine->ResolvedCommandGeneration == m_commandGeneration)
+	{
+		pCommand = macroLine->ResolvedCommand;
+	}
+	else
+	{
+		pCommand = FindDispatchCommand(szCommand);
+
+		if (useCache)
+		{
+			macroLine->ResolvedCommand = pCommand;
+			macroLine->ResolvedCommandGeneration = m_commandGeneration;
 		}
-		pCommand = pCommand->pNext;
 	}
 
-	return false;
+	if (pCommand == nullptr)
+		return false;
+
+	lock.unlock();
+
+	// the parser version is 2, or It's not version 2 and we're allowing command parses
+	if (pCommand->parse && (gParserVersion == 2 || (gParserVersion != 2 && bAllowCommandParse)))
+	{
+		ParseMacroParameter(szArgs, MAX_STRING);
+	}
+
+	if (pCommand->eq && eqHandler != nullptr)
+	{
+		strcat_s(szCommand, MAX_STRING, " ");
+		strcat_s(szCommand, MAX_STRING, szArgs);
+
+		eqHandler(pLocalPlayer, szCommand);
+	}
+	else
+	{
+		pCommand->handler(pLocalPlayer, szArgs);
+	}
+
+	return true;
 }
 
 bool MQCommandAPI::DispatchBind(char* szCommand, char* szArgs)
@@ -488,6 +490,26 @@ void MQCommandAPI::DoCommand(const char* szLine, bool delayed,
 		return;
 	}
 
+	ExecuteCommand(szLine, nullptr);
+}
+
+void MQCommandAPI::DoMacroCommand(const MQMacroLine& line)
+{
+	std::unique_lock lock(m_commandMutex);
+
+	// Labels and opening braces don't do anything other than advance to the next line.
+	if (line.IsNoOp)
+	{
+		WeDidStuff();
+		bRunNextCommand = true;
+		return;
+	}
+
+	ExecuteCommand(line.Command.c_str(), &line);
+}
+
+void MQCommandAPI::ExecuteCommand(const char* szLine, const MQMacroLine* macroLine)
+{
 	WeDidStuff();
 
 	// Update crash state with last known command in case something goes wrong
@@ -509,6 +531,9 @@ void MQCommandAPI::DoCommand(const char* szLine, bool delayed,
 		const RegisteredAlias& alias = findIter->second;
 
 		sprintf_s(szTheCmd, "%s%s", alias.replacement.c_str(), szOriginalLine + alias.match.size());
+
+		// The alias replaced the command the macro line was resolved against.
+		macroLine = nullptr;
 	}
 
 	GetArg(szArg1, szTheCmd, 1);
@@ -582,7 +607,7 @@ void MQCommandAPI::DoCommand(const char* szLine, bool delayed,
 		return;
 	}
 
-	if (DispatchCommand(szArg1, szParam, nullptr))
+	if (DispatchCommand(szArg1, szParam, nullptr, macroLine))
 	{
 		strcpy_s(szLastCommand, szOriginalLine);
 		return;
@@ -614,7 +639,20 @@ bool MQCommandAPI::AddCommand(std::string_view command, MQCommandHandler handler
 {
 	DebugSpew("AddCommand(%.*s)", command.length(), command.data());
 
-	MQCommand* pCommand = new MQCommand;
+	std::scoped_lock lock(m_commandMutex);
+
+	// Commands with the same name are only allowed to replace eq commands. The new command is
+	// placed in front of the existing one so that it is found first.
+	auto iter = std::lower_bound(m_commands.begin(), m_commands.end(), command, CommandLess{});
+	if (iter != m_commands.end() && ci_equals((*iter)->command, command) && !(*iter)->eq)
+	{
+		// Exact match. This command already exist, do not add it.
+		DebugSpew("AddCommand(%.*s): Failed to add command, already exists",
+			command.length(), command.data());
+		return false;
+	}
+
+	auto pCommand = std::make_unique<MQCommand>();
 	pCommand->command = command;
 	pCommand->pluginHandle = pluginHandle;
 	pCommand->eq = EQ;
@@ -622,51 +660,8 @@ bool MQCommandAPI::AddCommand(std::string_view command, MQCommandHandler handler
 	pCommand->handler = std::move(handler);
 	pCommand->inGameOnly = InGame;
 
-	// perform insertion sort
-	if (!m_pCommands)
-	{
-		m_pCommands = pCommand;
-		return true;
-	}
-
-	MQCommand* pSearch = m_pCommands;
-	MQCommand* pLast = nullptr;
-	while (pSearch)
-	{
-		int compare = ci_string_compare(pCommand->command, pSearch->command);
-		if (compare == 0 && !pSearch->eq)
-		{
-			// Exact match. This command already exist, do not add it.
-			DebugSpew("AddCommand(%.*s): Failed to add command, already exists",
-				command.length(), command.data());
-
-			delete pCommand;
-			return false;
-		}
-
-		// We already filtered out exact matches that we don't want, so the only exact match that we
-		// can get now are for eq commands.
-		if (compare <= 0)
-		{
-			// insert here.
-			if (pLast)
-				pLast->pNext = pCommand;
-			else
-				m_pCommands = pCommand;
-
-			pCommand->pLast = pLast;
-			pSearch->pLast = pCommand;
-			pCommand->pNext = pSearch;
-			return true;
-		}
-
-		pLast = pSearch;
-		pSearch = pSearch->pNext;
-	}
-
-	// End of list
-	pLast->pNext = pCommand;
-	pCommand->pLast = pLast;
+	m_commands.insert(iter, std::move(pCommand));
+	++m_commandGeneration;
 
 	return true;
 }
@@ -674,56 +669,51 @@ bool MQCommandAPI::AddCommand(std::string_view command, MQCommandHandler handler
 bool MQCommandAPI::RemoveCommand(std::string_view command,
 	const MQPluginHandle& pluginHandle /* = mqplugin::ThisPluginHandle */)
 {
-	MQCommand* pCommand = m_pCommands;
+	std::scoped_lock lock(m_commandMutex);
 
-	while (pCommand)
+	auto iter = std::lower_bound(m_commands.begin(), m_commands.end(), command, CommandLess{});
+	if (iter == m_commands.end() || !ci_equals((*iter)->command, command))
 	{
-		int pos = ci_string_compare(command, pCommand->command);
-		if (pos < 0)
-		{
-			DebugSpew("RemoveCommand: Command not found '%.*s'", command.length(), command.data());
-			return false;
-		}
+		DebugSpew("RemoveCommand: Command not found '%.*s'", command.length(), command.data());
+		return false;
+	}
 
-		if (pos == 0)
-		{
-			// Validate that we can remove this command
-			if (pCommand->pluginHandle != pluginHandle)
-			{
-				DebugSpew("RemoveCommand: Cannot remove command '%.*s': Plugin does not own this command",
-					command.length(), command.data());
-				return false;
-			}
+	// Validate that we can remove this command
+	if ((*iter)->pluginHandle != pluginHandle)
+	{
+		DebugSpew("RemoveCommand: Cannot remove command '%.*s': Plugin does not own this command",
+			command.length(), command.data());
+		return false;
+	}
 
-			if (pCommand->pNext)
-				pCommand->pNext->pLast = pCommand->pLast;
-			if (pCommand->pLast)
-				pCommand->pLast->pNext = pCommand->pNext;
-			else
-				m_pCommands = pCommand->pNext;
-			delete pCommand;
+	m_commands.erase(iter);
+	++m_commandGeneration;
 
-			return true;
-		}
+	return true;
+}
 
-		pCommand = pCommand->pNext;
-	}
+MQCommand* MQCommandAPI::FindCommand(std::string_view command) const
+{
+	auto iter = std::lower_bound(m_commands.begin(), m_commands.end(), command, CommandLess{});
+	if (iter != m_commands.end() && ci_equals((*iter)->command, command))
+		return iter->get();
 
-	return false;
+	return nullptr;
 }
 
-MQCommand* MQCommandAPI::FindCommand(std::string_view command) const
+std::vector<std::string> MQCommandAPI::GetCommandsWithPrefix(std::string_view prefix) const
 {
-	MQCommand* pCommand = m_pCommands;
-	while (pCommand)
-	{
-		if (ci_equals(command, pCommand->command))
-			return pCommand;
+	std::vector<std::string> commands;
 
-		pCommand = pCommand->pNext;
+	for (auto iter = std::lower_bound(m_commands.begin(), m_commands.end(), prefix, CommandLess{});
+		iter != m_commands.end() && ci_starts_with((*iter)->command, prefix); ++iter)
+	{
+		// eq commands can be shadowed by one of ours with the same name
+		if (commands.empty() || !ci_equals(commands.back(), (*iter)->command))
+			commands.push_back((*iter)->command);
 	}
 
-	return nullptr;
+	return commands;
 }
 
 bool MQCommandAPI::IsCommand(std::string_view command) const
@@ -863,9 +853,20 @@ void MQCommandAPI::LoadAliases()
 //============================================================================
 //============================================================================
 
+struct MQCommandAPI::TimedCommandLater
+{
+	bool operator()(const TimedCommandEntry& a, const TimedCommandEntry& b) const
+	{
+		if (a.time != b.time)
+			return a.time > b.time;
+
+		return a.sequence > b.sequence;
+	}
+};
+
 void MQCommandAPI::PulseCommands()
 {
-	if (m_delayedCommands.empty() && !m_pTimedCommands)
+	if (m_delayedCommands.empty() && m_timedCommands.empty())
 	{
 		return;
 	}
@@ -886,16 +887,25 @@ void MQCommandAPI::PulseCommands()
 		}
 	}
 
-	// handle timed commands
-	uint64_t Now = MQGetTickCount64();
+	// handle timed commands. Commands that get scheduled while we're doing this wait for the
+	// next pulse, even if they are already due.
+	const uint64_t Now = MQGetTickCount64();
+	const uint64_t lastSequence = m_timedCommandSequence;
 
-	while (m_pTimedCommands && m_pTimedCommands->time <= Now)
+	while (!m_timedCommands.empty()
+		&& m_timedCommands.front().time <= Now
+		&& m_timedCommands.front().sequence < lastSequence)
 	{
-		MQTimedCommand* pNext = m_pTimedCommands->pNext;
-		DoCommand(m_pTimedCommands->command.c_str(), false, m_pTimedCommands->pluginHandle);
+		std::pop_heap(m_timedCommands.begin(), m_timedCommands.end(), TimedCommandLater{});
+		TimedCommandEntry timedCommand = std::move(m_timedCommands.back());
+		m_timedCommands.pop_back();
 
-		delete m_pTimedCommands;
-		m_pTimedCommands = pNext;
+		const uint64_t lateness = Now - timedCommand.time;
+		m_timedCommandStats.executed++;
+		m_timedCommandStats.totalLateness += lateness;
+		m_timedCommandStats.maxLateness = std::max(m_timedCommandStats.maxLateness, lateness);
+
+		DoCommand(timedCommand.command.c_str(), false, timedCommand.pluginHandle);
 	}
 }
 
@@ -903,37 +913,18 @@ void MQCommandAPI::TimedCommand(const char* command, int msDelay, const MQPlugin
 {
 	std::scoped_lock lock(m_commandMutex);
 
-	MQTimedCommand* pNew = new MQTimedCommand;
-	pNew->time = msDelay + MQGetTickCount64();
-	pNew->command = command;
-	pNew->pluginHandle = pluginHandle;
-
-	// insert into list
-	if (!m_pTimedCommands || m_pTimedCommands->time >= pNew->time)
-	{
-		pNew->pNext = m_pTimedCommands;
-		pNew->pLast = nullptr;
-		m_pTimedCommands = pNew;
-		return;
-	}
+	m_timedCommands.push_back({ msDelay + MQGetTickCount64(), m_timedCommandSequence++, command, pluginHandle });
+	std::push_heap(m_timedCommands.begin(), m_timedCommands.end(), TimedCommandLater{});
 
-	MQTimedCommand* pLast = m_pTimedCommands;
-	MQTimedCommand* pNode = m_pTimedCommands->pNext;
-
-	while (pNode)
-	{
-		if (pNew->time <= pNode->time)
-		{
-			break;
-		}
+	m_timedCommandStats.peakQueued = std::max(m_timedCommandStats.peakQueued, m_timedCommands.size());
+}
 
-		pLast = pNode;
-		pNode = pNode->pNext;
-	}
+MQTimedCommandStats MQCommandAPI::GetTimedCommandStats() const
+{
+	MQTimedCommandStats stats = m_timedCommandStats;
+	stats.queued = m_timedCommands.size();
 
-	pLast->pNext = pNew;
-	pNew->pLast = pLast;
-	pNew->pNext = pNode;
+	return stats;
 }
 
 //============================================================================
@@ -951,8 +942,6 @@ void MQCommandAPI::Cmd_Help(const char* szLine) const
 	char szCmd[MAX_STRING] = { 0 };
 	char szArg[MAX_STRING] = { 0 };
 
-	MQCommand* pCmd = m_pCommands;
-
 	GetArg(szArg, szLine, 1);
 	if (szArg[0] == 0)
 	{
@@ -979,13 +968,12 @@ void MQCommandAPI::Cmd_Help(const char* szLine) const
 	WriteChatColor("List of commands", USERCOLOR_DEFAULT);
 	WriteChatColor("------------------------------------------", USERCOLOR_DEFAULT);
 
-	while (pCmd)
+	for (const auto& pCmd : m_commands)
 	{
-		if (pCmd->eq == 0)
+		if (!pCmd->eq)
 		{
 			WriteChatf("  %s", pCmd->command.c_str());
 		}
-		pCmd = pCmd->pNext;
 	}
 }
 
@@ -22,16 +22,27 @@
 #include "mq/base/String.h"
 #include "mq/api/CommandAPI.h"
 
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace mq {
 
 //============================================================================
 
-struct MQTimedCommand;
 struct MQCommand;
+struct MQMacroLine;
 struct MQPlugin;
 
+struct MQTimedCommandStats
+{
+	size_t queued = 0;                          // timed commands waiting to run
+	size_t peakQueued = 0;
+	uint64_t executed = 0;
+	uint64_t totalLateness = 0;                 // ms between when commands were due and when they ran
+	uint64_t maxLateness = 0;
+};
+
 class MQCommandAPI
 {
 public:
@@ -52,10 +63,17 @@ public:
 		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
 	void TimedCommand(const char* command, int msDelay,
 		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
+	MQTimedCommandStats GetTimedCommandStats() const;
+
+	// Execute a line of the running macro, reusing the command resolved the last time it ran.
+	void DoMacroCommand(const MQMacroLine& line);
 
 	bool IsCommand(std::string_view command) const;
 	MQCommand* FindCommand(std::string_view command) const;
 
+	// Names of all commands starting with prefix, in sorted order. Used for tab completion.
+	std::vector<std::string> GetCommandsWithPrefix(std::string_view prefix) const;
+
 	// Aliases
 	bool AddAlias(const std::string& shortCommand, const std::string& longCommand,
 		bool writeToIni, const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
@@ -75,7 +93,10 @@ private:
 	void LoadAliases();
 	void RewriteAliases();
 
-	bool DispatchCommand(char* szCommand, char* szArgs, const MQCommandHandler& eqHandler);
+	void ExecuteCommand(const char* szLine, const MQMacroLine* macroLine);
+	MQCommand* FindDispatchCommand(const char* szCommand) const;
+	bool DispatchCommand(char* szCommand, char* szArgs, const MQCommandHandler& eqHandler,
+		const MQMacroLine* macroLine = nullptr);
 	bool DispatchBind(char* szCommand, char* szArgs);
 
 	struct RegisteredAlias
@@ -103,8 +124,23 @@ private:
 	};
 	std::vector<DelayedCommand> m_delayedCommands;
 
-	MQCommand* m_pCommands = nullptr;
-	MQTimedCommand* m_pTimedCommands = nullptr;
+	struct TimedCommandEntry
+	{
+		uint64_t time;
+		uint64_t sequence;                      // commands due at the same time run in the order they were added
+		std::string command;
+		MQPluginHandle pluginHandle;
+	};
+	struct TimedCommandLater;
+
+	// Binary heap ordered by TimedCommandLater, so the next command to run is at the front.
+	std::vector<TimedCommandEntry> m_timedCommands;
+	uint64_t m_timedCommandSequence = 0;
+	MQTimedCommandStats m_timedCommandStats;
+
+	struct CommandLess;
+	std::vector<std::unique_ptr<MQCommand>> m_commands; // sorted by name, see CommandLess
+	uint32_t m_commandGeneration = 1;           // incremented whenever a command is added or removed
 
 	std::recursive_mutex m_commandMutex;
 };
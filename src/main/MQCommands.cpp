@@ -4044,13 +4044,26 @@ void DoTimedCmd(PlayerClient* pChar, const char* szLine)
 {
 	if (!szLine[0])
 	{
-		SyntaxError("Usage: /timed <deciseconds> <command>");
+		SyntaxError("Usage: /timed <deciseconds> <command>, or /timed stats");
 		return;
 	}
 
 	char szArg[MAX_STRING] = { 0 }; // delay
 	GetArg(szArg, szLine, 1);
 
+	if (!_stricmp(szArg, "stats"))
+	{
+		const MQTimedCommandStats stats = pCommandAPI->GetTimedCommandStats();
+
+		WriteChatf("Timed commands: %zu queued (peak %zu), %llu executed", stats.queued, stats.peakQueued, stats.executed);
+		if (stats.executed > 0)
+		{
+			WriteChatf("Lateness: %llu ms average, %llu ms max",
+				stats.totalLateness / stats.executed, stats.maxLateness);
+		}
+		return;
+	}
+
 	const char* szRest = GetNextArg(szLine);
 	if (!szRest[0])
 		return;
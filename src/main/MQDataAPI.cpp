@@ -29,11 +29,16 @@ namespace mq {
 std::vector<std::weak_ptr<MQTransient>> s_objectMap;
 std::mutex s_objectMapMutex;
 uint32_t bmParseMacroData;
+uint32_t bmParseDataPortion;
 
 static void SetGameStateDataAPI(int);
 static void OnPulseDataAPI();
 static void UnloadPluginDataAPI(const char*);
 
+namespace datatypes {
+	void ReleaseRetiredMemberTables();
+}
+
 static MQModule s_DataAPIModule = {
 	"DataAPI",                      // Name
 	false,                          // CanUnload
@@ -80,6 +85,8 @@ static void PruneObservedEQObjects()
 
 static void OnPulseDataAPI()
 {
+	datatypes::ReleaseRetiredMemberTables();
+
 	const auto now = std::chrono::steady_clock::now();
 	static std::chrono::steady_clock::time_point next_check = now + std::chrono::seconds(30);
 
@@ -124,6 +131,65 @@ void UnloadPluginDataAPI(const char* Name)
 	PruneObservedEQObjects();
 }
 
+//============================================================================
+// Member lookup hints
+
+// The expression evaluator resolves member names once per compiled expression. While it calls
+// GetMember, the resolved members are published here so that the FindMember/FindMethod call
+// inside the type's GetMember can skip the table lookup. Entries are for the evaluated type and
+// its parent, since many types forward unknown members to their parent's GetMember.
+struct MemberLookupHint
+{
+	const char* name = nullptr;
+
+	struct Entry
+	{
+		const MQ2Type* type = nullptr;
+		MQTypeMember* member = nullptr;
+		MQTypeMember* method = nullptr;
+	};
+	Entry entries[2];
+};
+
+static thread_local const MemberLookupHint* s_memberLookupHint = nullptr;
+
+static const MemberLookupHint::Entry* FindMemberLookupHint(const MQ2Type* type, const char* name)
+{
+	const MemberLookupHint* hint = s_memberLookupHint;
+	if (!hint || !name)
+		return nullptr;
+
+	for (const MemberLookupHint::Entry& entry : hint->entries)
+	{
+		if (entry.type == type)
+		{
+			if (hint->name == name || strcmp(hint->name, name) == 0)
+				return &entry;
+
+			return nullptr;
+		}
+	}
+
+	return nullptr;
+}
+
+class ScopedMemberLookupHint
+{
+public:
+	explicit ScopedMemberLookupHint(const MemberLookupHint* hint)
+		: m_previous(std::exchange(s_memberLookupHint, hint))
+	{
+	}
+
+	~ScopedMemberLookupHint()
+	{
+		s_memberLookupHint = m_previous;
+	}
+
+private:
+	const MemberLookupHint* m_previous;
+};
+
 //============================================================================
 //============================================================================
 
@@ -137,12 +203,14 @@ MQDataAPI* pDataAPI = nullptr;
 MQDataAPI::MQDataAPI()
 {
 	bmParseMacroData = AddMQ2Benchmark("ParseMacroParameter");
+	bmParseDataPortion = AddMQ2Benchmark("ParseMQ2DataPortion");
 }
 
 MQDataAPI::~MQDataAPI()
 {
 	datatypes::UnregisterDataTypes();
 	RemoveMQ2Benchmark(bmParseMacroData);
+	RemoveMQ2Benchmark(bmParseDataPortion);
 }
 
 void MQDataAPI::Initialize()
@@ -151,7 +219,7 @@ void MQDataAPI::Initialize()
 	datatypes::RegisterDataTypes();
 }
 
-bool MQDataAPI::IsReservedName(const std::string& name) const
+bool MQDataAPI::IsReservedName(std::string_view name) const
 {
 	std::scoped_lock lock(m_mutex);
 
@@ -368,10 +436,10 @@ bool MQDataAPI::FindMacroDataMember(MQ2Type* Type, const std::string& strMember)
 
 // -1 = no exists, 0 = fail, 1 = success
 MQDataAPI::EvaluateResult MQDataAPI::EvaluateMacroDataMember(MQ2Type* type, MQVarPtr&& VarPtr,
-	MQTypeVar& Result, const std::string& Member, char* pIndex, bool checkFirst) const
+	MQTypeVar& Result, const char* Member, char* pIndex, bool checkFirst) const
 {
 	// search for extensions on this type
-	auto extIter = m_typeExtensions.find(type->GetName());
+	auto extIter = m_typeExtensions.empty() ? m_typeExtensions.end() : m_typeExtensions.find(type->GetName());
 	if (extIter != m_typeExtensions.end())
 	{
 		// we have at least one extension. process each one until a match is found
@@ -397,11 +465,11 @@ MQDataAPI::EvaluateResult MQDataAPI::EvaluateMacroDataMember(MQ2Type* type, MQVa
 			return EvaluateResult::NotFound;
 		}
 
-		return type->GetMember(std::move(VarPtr), Member.c_str(), pIndex, Result)
+		return type->GetMember(std::move(VarPtr), Member, pIndex, Result)
 			? EvaluateResult::Success : EvaluateResult::Failure;
 	}
 
-	if (type->GetMember(std::move(VarPtr), Member.c_str(), pIndex, Result))
+	if (type->GetMember(std::move(VarPtr), Member, pIndex, Result))
 	{
 		return EvaluateResult::Success;
 	}
@@ -692,208 +760,130 @@ void MQDataAPI::RegisterTopLevelObjects()
 #endif // HAS_KEYRING_WINDOW
 }
 
-bool MQDataAPI::ParseMQ2DataPortion(char* szOriginal, MQTypeVar& Result) const
+std::shared_ptr<const MQDataAPI::CompiledExpression> MQDataAPI::GetCompiledExpression(std::string_view expression) const
 {
-	Result.Type = nullptr;
-	Result.Int64 = 0;
+	return m_expressionCache.Get(expression);
+}
 
-	char Index[MAX_STRING] = { 0 };
+// Resolves the member and method named by an Evaluate op on the given type and its parent. The result
+// is cached on the op and reused until the type or either member table changes.
+static void ResolveMemberLookup(MQ2Type* type, const MQDataAPI::CompiledExpression::Op& op, MemberLookupHint& hint)
+{
+	auto& resolved = op.resolved;
+	MQ2Type* parent = type->GetParent();
 
-	// Find [] before a . or null
-	char* pPos = &szOriginal[0];
-	char* pStart = pPos;
-	char* pIndex = &Index[0];
-	bool Quote = false;
-	bool functionAllowed = false;
+	const uint64_t serial = type->GetMemberTableSerial();
+	const uint64_t parentSerial = parent ? parent->GetMemberTableSerial() : 0;
 
-	while (true)
+	if (resolved.type != type || resolved.serial != serial
+		|| resolved.parent != parent || resolved.parentSerial != parentSerial)
 	{
-		if (*pPos == 0)
-		{
-			// end completely. process
-			if (pStart == pPos)
-			{
-				if (!Result.Type)
-				{
-					MQ2DataError("Nothing to parse");
-					return false;
-				}
+		resolved.type = type;
+		resolved.serial = serial;
+		resolved.parent = parent;
+		resolved.parentSerial = parentSerial;
+
+		resolved.member[0] = type->FindMember(op.name.c_str());
+		resolved.method[0] = type->FindMethod(op.name.c_str());
+		resolved.member[1] = parent ? parent->FindMember(op.name.c_str()) : nullptr;
+		resolved.method[1] = parent ? parent->FindMethod(op.name.c_str()) : nullptr;
+	}
 
-				return true;
-			}
+	hint.name = op.name.c_str();
+	hint.entries[0] = { type, resolved.member[0], resolved.method[0] };
+	hint.entries[1] = { parent, resolved.member[1], resolved.method[1] };
+}
 
-			if (!EvaluateDataExpression(Result, pStart, pIndex, functionAllowed))
-				return false;
+bool MQDataAPI::EvaluateCompiledExpression(const CompiledExpression& expression, MQTypeVar& Result) const
+{
+	using OpCode = CompiledExpression::OpCode;
 
-			// done processing
-			return true;
-		}
+	Result.Type = nullptr;
+	Result.Int64 = 0;
+
+	// Types are allowed to modify the index they are given, so each evaluation gets its own copy.
+	char Index[MAX_STRING];
 
-		if (*pPos == '(')
+	for (const CompiledExpression::Op& op : expression.ops)
+	{
+		switch (op.code)
 		{
-			*pPos = 0;
-			if (pStart == pPos)
-			{
-				if (!Result.Type)
-				{
-					MQ2DataError("Encountered typecast without object to cast");
-					return false;
-				}
+		case OpCode::Evaluate:
+			strncpy_s(Index, op.index.c_str(), _TRUNCATE);
 
-				return true;
-			}
-			else
+			if (Result.Type)
 			{
-				if (!EvaluateDataExpression(Result, pStart, pIndex))
+				// Member access: resolve the member once and let the type's GetMember pick it up.
+				MemberLookupHint hint;
+				ResolveMemberLookup(Result.Type, op, hint);
+				ScopedMemberLookupHint scopedHint(&hint);
+
+				if (!EvaluateDataExpression(Result, op.name.c_str(), Index, op.allowFunction))
 					return false;
 			}
-
-			if (!Result.Type)
+			else if (!EvaluateDataExpression(Result, op.name.c_str(), Index, op.allowFunction))
 			{
-				// error
 				return false;
 			}
+			break;
 
-			*pPos = 0;
-			++pPos;
-			char* pType = pPos;
+		case OpCode::RequireType:
+			if (!Result.Type)
+				return false;
+			break;
 
-			while (*pPos != ')')
+		case OpCode::Cast:
+			if (MQ2Type* pNewType = FindDataType(op.name.c_str()))
 			{
-				if (!*pPos)
+				if (pNewType == datatypes::pTypeType)
 				{
-					// error
-					MQ2DataError("Encountered unmatched parenthesis");
-					return false;
+					Result.Ptr = Result.Type;
+					Result.Type = datatypes::pTypeType;
+				}
+				else
+				{
+					Result.Type = pNewType;
 				}
-				++pPos;
-			}
-
-			*pPos = 0;
-
-			MQ2Type* pNewType = FindDataType(pType);
-			if (!pNewType)
-			{
-				// error
-				MQ2DataError("Unknown type '%s'", pType);
-				return false;
-			}
-
-			if (pNewType == datatypes::pTypeType)
-			{
-				Result.Ptr = Result.Type;
-				Result.Type = datatypes::pTypeType;
 			}
 			else
 			{
-				Result.Type = pNewType;
+				MQ2DataError("Unknown type '%s'", op.name.c_str());
+				return false;
 			}
+			break;
 
-			if (pPos[1] == '.')
-			{
-				++pPos;
-				pStart = &pPos[1];
-			}
-			else if (!pPos[1])
-			{
-				//Result.Type->ToString(Result.VarPtr,szCurrent);
-				return true;
-			}
-			else
+		case OpCode::Finish:
+			if (!Result.Type)
 			{
-				MQ2DataError("Invalid character found after typecast ')%s'", &pPos[1]);
+				MQ2DataError("%s", op.name.c_str());
 				return false;
 			}
-		}
-		else
-		{
-			if (*pPos == '[')
-			{
-				// index
-				*pPos = 0;
-				++pPos;
-				functionAllowed = true;
-				Quote = false;
-				bool BeginParam = true;
-
-				while (true)
-				{
-					if (*pPos == 0)
-					{
-						MQ2DataError("Unmatched bracket or invalid character following bracket found in index: '%s'", pIndex);
-						return false;
-					}
+			return true;
 
-					if (BeginParam)
-					{
-						BeginParam = false;
-						if (*pPos == '\"')
-						{
-							Quote = true;
-							++pPos;
-							continue;
-						}
-					}
+		case OpCode::Error:
+			MQ2DataError("%s", op.name.c_str());
+			return false;
 
-					if (Quote)
-					{
-						if (*pPos == '\"')
-						{
-							if (pPos[1] == ']' || pPos[1] == ',')
-							{
-								Quote = false;
-								++pPos;
-								continue;
-							}
-						}
-					}
-					else
-					{
-						if (*pPos == ']')
-						{
-							if (pPos[1] == '.' || pPos[1] == '(' || pPos[1] == 0)
-								break;// valid end
-						}
-						else if (*pPos == ',')
-							BeginParam = true;
-					}
+		case OpCode::Done:
+			return true;
+		}
+	}
 
-					*pIndex = *pPos;
-					++pIndex;
-					++pPos;
-				}
+	return true;
+}
 
-				*pIndex = 0;
-				pIndex = &Index[0];
-				*pPos = 0;
-			}
-			else
-			{
-				if (*pPos == '.')
-				{
-					// end of this one, but more to come!
-					*pPos = 0;
-					if (pStart == pPos)
-					{
-						if (!Result.Type)
-						{
-							MQ2DataError("Encountered member access without object");
-							return false;
-						}
+bool MQDataAPI::ParseMQ2DataPortion(std::string_view expression, MQTypeVar& Result) const
+{
+	MQScopedBenchmark bm(bmParseDataPortion);
 
-						return true;
-					}
+	std::shared_ptr<const CompiledExpression> compiled = GetCompiledExpression(expression);
 
-					if (!EvaluateDataExpression(Result, pStart, pIndex))
-						return false;
+	return EvaluateCompiledExpression(*compiled, Result);
+}
 
-					pStart = &pPos[1];
-					Index[0] = 0;
-				}
-			}
-		}
-		++pPos;
-	}
+bool MQDataAPI::ParseMQ2DataPortion(char* szOriginal, MQTypeVar& Result) const
+{
+	return ParseMQ2DataPortion(std::string_view{ szOriginal }, Result);
 }
 
 /**
@@ -1000,10 +990,9 @@ size_t FindMacroClosingBrace(std::string_view strOrigString, size_t iCurrentPosi
  *
  * @brief Wrapper for ParseMQ2DataPortion starting with a var string
  *
- * ParseMQ2DataPortion is used in other parts of the code and handles parsing using
- * a character array.  This function starts as a string since we're using
- * a string builder in other areas and just wraps that check so that we don't
- * have to modify ParseMQ2DataPortion.
+ * This function starts as a string since we're using a string builder in other
+ * areas. The data portion is passed to ParseMQ2DataPortion as a view, so it is
+ * neither copied nor modified.
  *
  * It also validates that it is actually a variable and strips ${ and } to prepare
  * it for ParseMQ2DataPortion.
@@ -1024,20 +1013,18 @@ std::string GetMacroVarData(std::string_view strVarToParse)
 		// Strip the ${ and } off of the variable to pass it to ParseMQ2DataPortion
 		strVarToParse = strVarToParse.substr(2, strVarToParse.length() - 3);
 
-		// TODO:  Check to see if this exceeds MAX_STRING and error.
-		// Create a place to hold our "current" string and make sure its long enough to pass on (these
-		// functions expect a string buffer of MAX_STRING length).
-		std::string currentStr{ strVarToParse };
-		currentStr.resize(MAX_STRING);
-
 		MQTypeVar Result;
 
 		// If the parse was successful and there is a result type and we could convert that type to a string
-		if (pDataAPI->ParseMQ2DataPortion(&currentStr[0], Result) && Result.Type && Result.Type->ToString(Result.VarPtr, &currentStr[0]))
+		if (pDataAPI->ParseMQ2DataPortion(strVarToParse, Result) && Result.Type)
 		{
-			// Set our return whatever szCurrent was modified to be (removing the additional null terminators
-			// due to the above resize)
-			strReturn = currentStr.erase(currentStr.find('\0'));
+			// ToString expects a buffer of MAX_STRING length.
+			char szCurrent[MAX_STRING] = { 0 };
+
+			if (Result.Type->ToString(Result.VarPtr, szCurrent))
+			{
+				strReturn = szCurrent;
+			}
 		}
 	}
 	return strReturn;
@@ -1670,6 +1657,202 @@ static bool ParseMacroDataImpl(char* szOriginal, size_t BufferSize)
 
 namespace datatypes {
 
+//============================================================================
+// MemberNameTable
+
+/**
+ * A perfect hash table of member names using hash and displace: names are distributed into
+ * small buckets by one part of the hash, and each bucket is assigned a displacement that
+ * places all of its names into unused slots. A lookup is one hash, one displacement read and
+ * one string compare.
+ */
+class MemberNameTable
+{
+public:
+	void Build(const std::vector<std::unique_ptr<MQTypeMember>>& members);
+	MQTypeMember* Find(std::string_view name) const;
+
+private:
+	struct Slot
+	{
+		std::string name;
+		MQTypeMember* member = nullptr;
+	};
+
+	struct HashParts
+	{
+		uint32_t bucket;
+		uint32_t first;
+		uint32_t step;
+	};
+
+	HashParts Hash(std::string_view name) const;
+	bool TryBuild(const std::vector<MQTypeMember*>& entries);
+
+	std::vector<Slot> m_slots;
+	std::vector<uint32_t> m_displacements;
+	uint64_t m_seed = 0;
+	uint32_t m_mask = 0;
+};
+
+MemberNameTable::HashParts MemberNameTable::Hash(std::string_view name) const
+{
+	// fnv1a, followed by a finalizer so that the upper and lower halves can be used independently.
+	uint64_t hash = 14695981039346656037ULL ^ m_seed;
+	for (char c : name)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ULL;
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+
+	const uint64_t hash2 = hash * 0x9e3779b97f4a7c15ULL;
+
+	HashParts parts;
+	parts.bucket = static_cast<uint32_t>(hash >> 32) % static_cast<uint32_t>(m_displacements.size());
+	parts.first = static_cast<uint32_t>(hash);
+	parts.step = static_cast<uint32_t>(hash2 >> 32) | 1;
+	return parts;
+}
+
+bool MemberNameTable::TryBuild(const std::vector<MQTypeMember*>& entries)
+{
+	std::vector<std::vector<MQTypeMember*>> buckets(m_displacements.size());
+	for (MQTypeMember* entry : entries)
+		buckets[Hash(entry->Name).bucket].push_back(entry);
+
+	// place the largest buckets first, while the table is still mostly empty.
+	std::vector<uint32_t> order(buckets.size());
+	for (uint32_t i = 0; i < static_cast<uint32_t>(order.size()); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(),
+		[&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+	std::vector<bool> occupied(m_slots.size(), false);
+	std::vector<uint32_t> positions;
+	const uint32_t maxDisplacement = static_cast<uint32_t>(m_slots.size()) * 4;
+
+	for (uint32_t bucketIndex : order)
+	{
+		const auto& bucket = buckets[bucketIndex];
+		if (bucket.empty())
+			break;
+
+		bool placed = false;
+		for (uint32_t displacement = 0; displacement < maxDisplacement && !placed; ++displacement)
+		{
+			positions.clear();
+			placed = true;
+
+			for (MQTypeMember* entry : bucket)
+			{
+				HashParts parts = Hash(entry->Name);
+				uint32_t position = (parts.first + displacement * parts.step) & m_mask;
+
+				if (occupied[position] || std::find(positions.begin(), positions.end(), position) != positions.end())
+				{
+					placed = false;
+					break;
+				}
+
+				positions.push_back(position);
+			}
+
+			if (placed)
+			{
+				m_displacements[bucketIndex] = displacement;
+
+				for (size_t i = 0; i < bucket.size(); ++i)
+				{
+					occupied[positions[i]] = true;
+					m_slots[positions[i]].name = bucket[i]->Name;
+					m_slots[positions[i]].member = bucket[i];
+				}
+			}
+		}
+
+		if (!placed)
+			return false;
+	}
+
+	return true;
+}
+
+void MemberNameTable::Build(const std::vector<std::unique_ptr<MQTypeMember>>& members)
+{
+	std::vector<MQTypeMember*> entries;
+	for (const auto& member : members)
+	{
+		if (member)
+			entries.push_back(member.get());
+	}
+
+	m_slots.clear();
+	m_displacements.clear();
+
+	if (entries.empty())
+		return;
+
+	uint32_t tableSize = 1;
+	while (tableSize < entries.size() + entries.size() / 2)
+		tableSize <<= 1;
+
+	uint32_t attempt = 0;
+	while (true)
+	{
+		m_seed = attempt * 0x9e3779b97f4a7c15ULL;
+		m_mask = tableSize - 1;
+		m_slots.assign(tableSize, Slot{});
+		m_displacements.assign((entries.size() + 2) / 3, 0);
+
+		if (TryBuild(entries))
+			return;
+
+		// Try a few seeds before giving the table more room.
+		if (++attempt % 8 == 0)
+			tableSize <<= 1;
+	}
+}
+
+MQTypeMember* MemberNameTable::Find(std::string_view name) const
+{
+	if (m_slots.empty())
+		return nullptr;
+
+	HashParts parts = Hash(name);
+	const Slot& slot = m_slots[(parts.first + m_displacements[parts.bucket] * parts.step) & m_mask];
+
+	return slot.name == name ? slot.member : nullptr;
+}
+
+struct MQ2Type::MemberTable
+{
+	MemberNameTable members;
+	MemberNameTable methods;
+	uint64_t serial = 0;
+};
+
+static std::atomic<uint64_t> s_memberTableSerial = 0;
+
+// Types holding tables that were replaced, and the pulse count used to tell when no lookup can still be using them.
+static std::mutex s_retiredTypesMutex;
+static std::vector<MQ2Type*> s_typesWithRetiredTables;
+static std::atomic<uint64_t> s_dataApiPulse = 1;
+
+void ReleaseRetiredMemberTables()
+{
+	const uint64_t pulse = s_dataApiPulse++;
+
+	std::scoped_lock lock(s_retiredTypesMutex);
+
+	s_typesWithRetiredTables.erase(std::remove_if(s_typesWithRetiredTables.begin(), s_typesWithRetiredTables.end(),
+		[pulse](MQ2Type* type) { return type->ReleaseRetiredMemberTables(pulse); }),
+		s_typesWithRetiredTables.end());
+}
+
 //============================================================================
 // MQ2Type
 
@@ -1685,6 +1868,11 @@ MQ2Type::~MQ2Type()
 	{
 		pDataAPI->RemoveDataType(*this);
 	}
+
+	std::scoped_lock lock(s_retiredTypesMutex);
+	s_typesWithRetiredTables.erase(
+		std::remove(s_typesWithRetiredTables.begin(), s_typesWithRetiredTables.end(), this),
+		s_typesWithRetiredTables.end());
 }
 
 void MQ2Type::InitializeMembers(MQTypeMember* memberArray)
@@ -1700,6 +1888,68 @@ const char* MQ2Type::GetName() const
 	return m_typeName.c_str();
 }
 
+const MQ2Type::MemberTable& MQ2Type::GetMemberTable() const
+{
+	if (const MemberTable* table = m_memberTable.load(std::memory_order_acquire))
+		return *table;
+
+	std::scoped_lock lock(m_mutex);
+
+	// Another thread may have built it while we were waiting
+	if (const MemberTable* table = m_memberTable.load(std::memory_order_relaxed))
+		return *table;
+
+	auto table = std::make_unique<MemberTable>();
+	table->members.Build(Members);
+	table->methods.Build(Methods);
+	table->serial = ++s_memberTableSerial;
+
+	// Previous tables are retained because lock-free readers may still be using them, until the pulse
+	// after they were retired. They are only replaced when members change, which is rare after initialization.
+	const MemberTable* result = table.get();
+	m_memberTables.push_back(std::move(table));
+	m_memberTable.store(result, std::memory_order_release);
+
+	return *result;
+}
+
+void MQ2Type::RetireMemberTable(std::unique_lock<std::mutex>& lock)
+{
+	m_memberTable.store(nullptr, std::memory_order_release);
+	m_retiredPulse = s_dataApiPulse;
+
+	// release the type lock first, the pulse takes the locks in the other order
+	lock.unlock();
+
+	std::scoped_lock retiredLock(s_retiredTypesMutex);
+	if (std::find(s_typesWithRetiredTables.begin(), s_typesWithRetiredTables.end(), this) == s_typesWithRetiredTables.end())
+		s_typesWithRetiredTables.push_back(this);
+}
+
+bool MQ2Type::ReleaseRetiredMemberTables(uint64_t pulse)
+{
+	std::scoped_lock lock(m_mutex);
+
+	// retired during this pulse, a lookup could still be using it
+	if (m_retiredPulse >= pulse)
+	{
+		return false;
+	}
+
+	const MemberTable* current = m_memberTable.load(std::memory_order_relaxed);
+	m_memberTables.erase(std::remove_if(m_memberTables.begin(), m_memberTables.end(),
+		[current](const std::unique_ptr<MemberTable>& table) { return table.get() != current; }),
+		m_memberTables.end());
+
+	m_retiredMembers.clear();
+	return true;
+}
+
+uint64_t MQ2Type::GetMemberTableSerial() const
+{
+	return GetMemberTable().serial;
+}
+
 const char* MQ2Type::GetMemberName(int ID) const
 {
 	for (const auto& pMember : Members)
@@ -1715,14 +1965,11 @@ const char* MQ2Type::GetMemberName(int ID) const
 
 bool MQ2Type::GetMemberID(const char* Name, int& result) const
 {
-	std::scoped_lock lock(m_mutex);
-
-	auto iter = MemberMap.find(Name);
-	if (iter == MemberMap.end())
+	MQTypeMember* member = GetMemberTable().members.Find(Name);
+	if (!member)
 		return false;
 
-	int index = iter->second;
-	result = Members[index]->ID;
+	result = member->ID;
 	return true;
 }
 
@@ -1741,76 +1988,51 @@ const char* MQ2Type::GetMethodName(int ID) const
 
 bool MQ2Type::GetMethodID(const char* Name, int& result) const
 {
-	std::scoped_lock lock(m_mutex);
-
-	auto iter = MethodMap.find(Name);
-	if (iter == MethodMap.end())
+	MQTypeMember* method = GetMemberTable().methods.Find(Name);
+	if (!method)
 		return false;
 
-	int index = iter->second;
-	result = Methods[index]->ID;
+	result = method->ID;
 	return true;
 }
 
 mq::MQTypeMember* MQ2Type::FindMember(const char* Name)
 {
-	std::scoped_lock lock(m_mutex);
-
-	auto iter = MemberMap.find(Name);
-	if (iter == MemberMap.end())
-		return nullptr;
+	if (const MemberLookupHint::Entry* hint = FindMemberLookupHint(this, Name))
+		return hint->member;
 
-	int index = MemberMap[Name];
-	return Members[index].get();
+	return GetMemberTable().members.Find(Name);
 }
 
 mq::MQTypeMember* MQ2Type::FindMember(const std::string& Name)
 {
-	std::scoped_lock lock(m_mutex);
-
-	auto iter = MemberMap.find(Name);
-	if (iter == MemberMap.end())
-		return nullptr;
-
-	int index = MemberMap[Name];
-	return Members[index].get();
+	return FindMember(Name.c_str());
 }
 
 mq::MQTypeMember* MQ2Type::FindMethod(const char* Name)
 {
-	std::scoped_lock lock(m_mutex);
-
-	auto iter = MethodMap.find(Name);
-	if (iter == MethodMap.end())
-		return nullptr;
+	if (const MemberLookupHint::Entry* hint = FindMemberLookupHint(this, Name))
+		return hint->method;
 
-	int index = iter->second;
-	return Methods[index].get();
+	return GetMemberTable().methods.Find(Name);
 }
 
 mq::MQTypeMember* MQ2Type::FindMethod(const std::string& Name)
 {
-	std::scoped_lock lock(m_mutex);
-
-	auto iter = MethodMap.find(Name);
-	if (iter == MethodMap.end())
-		return nullptr;
-
-	int index = iter->second;
-	return Methods[index].get();
+	return FindMethod(Name.c_str());
 }
 
 bool MQ2Type::CanEvaluateMethodOrMember(const std::string& Name)
 {
-	std::scoped_lock lock(m_mutex);
+	const MemberTable& table = GetMemberTable();
 
 	// exists in method map?
-	return MemberMap.count(Name) != 0 || MethodMap.count(Name) != 0;
+	return table.members.Find(Name) != nullptr || table.methods.Find(Name) != nullptr;
 }
 
 bool MQ2Type::AddMember(int id, const char* Name)
 {
-	std::scoped_lock lock(m_mutex);
+	std::unique_lock lock(m_mutex);
 
 	if (MemberMap.find(Name) != MemberMap.end())
 		return false;
@@ -1834,12 +2056,13 @@ bool MQ2Type::AddMember(int id, const char* Name)
 
 	Members[index] = std::make_unique<MQTypeMember>(id, Name, 0);
 	MemberMap[Name] = index;
+	RetireMemberTable(lock);
 	return true;
 }
 
 bool MQ2Type::RemoveMember(const char* Name)
 {
-	std::scoped_lock lock(m_mutex);
+	std::unique_lock lock(m_mutex);
 
 	auto iter = MemberMap.find(Name);
 	if (iter == MemberMap.end())
@@ -1850,13 +2073,16 @@ bool MQ2Type::RemoveMember(const char* Name)
 
 	if (index < 0)
 		return false;
-	Members[index].reset();
+
+	// The member is referenced by the current table, so it stays alive until that table is freed.
+	m_retiredMembers.push_back(std::move(Members[index]));
+	RetireMemberTable(lock);
 	return true;
 }
 
 bool MQ2Type::AddMethod(int ID, const char* Name)
 {
-	std::scoped_lock lock(m_mutex);
+	std::unique_lock lock(m_mutex);
 
 	if (MethodMap.find(Name) != MethodMap.end())
 		return false;
@@ -1880,12 +2106,13 @@ bool MQ2Type::AddMethod(int ID, const char* Name)
 
 	Methods[index] = std::make_unique<MQTypeMember>(ID, Name, 1);
 	MethodMap[Name] = index;
+	RetireMemberTable(lock);
 	return true;
 }
 
 bool MQ2Type::RemoveMethod(const char* Name)
 {
-	std::scoped_lock lock(m_mutex);
+	std::unique_lock lock(m_mutex);
 
 	auto iter = MethodMap.find(Name);
 	if (iter == MethodMap.end())
@@ -1896,7 +2123,9 @@ bool MQ2Type::RemoveMethod(const char* Name)
 
 	if (index < 0)
 		return false;
-	Methods[index].reset();
+
+	m_retiredMembers.push_back(std::move(Methods[index]));
+	RetireMemberTable(lock);
 	return true;
 }
 
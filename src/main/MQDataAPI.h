@@ -22,7 +22,10 @@
 #include "mq/base/PluginHandle.h"
 #include "mq/api/MacroAPI.h"
 
+#include "DataExpression.h"
+
 #include <memory>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -65,7 +68,7 @@ public:
 		NotFound,
 	};
 	EvaluateResult EvaluateMacroDataMember(MQ2Type* type, MQVarPtr&& VarPtr, MQTypeVar& Result,
-		const std::string& Member, char* pIndex, bool checkFirst) const;
+		const char* Member, char* pIndex, bool checkFirst) const;
 
 	bool EvaluateDataExpression(MQTypeVar& Result, const char* pStart, char* pIndex, bool allowFunction = false) const;
 
@@ -83,36 +86,52 @@ public:
 		}
 	}
 
-	// TODO: Change to string_view when we have c++20 support for transparent containers
-	bool IsReservedName(const std::string& name) const;
+	bool IsReservedName(std::string_view name) const;
 
+	// Evaluates the data portion of a ${...} expression. The input is not modified.
+	bool ParseMQ2DataPortion(std::string_view expression, MQTypeVar& Result) const;
 	bool ParseMQ2DataPortion(char* szOriginal, MQTypeVar& Result) const;
 
+	using CompiledExpression = mq::CompiledExpression;
+
+	std::shared_ptr<const CompiledExpression> GetCompiledExpression(std::string_view expression) const;
+	bool EvaluateCompiledExpression(const CompiledExpression& expression, MQTypeVar& Result) const;
+
 private:
 	void RegisterTopLevelObjects();
 
+	// Allows lookups by const char* and string_view without constructing a std::string
+	struct StringHash
+	{
+		using is_transparent = void;
+
+		size_t operator()(std::string_view str) const noexcept { return std::hash<std::string_view>{}(str); }
+	};
+
 	struct TLORec
 	{
 		std::unique_ptr<MQTopLevelObject> tlo;
 		MQPluginHandle owner;
 	};
-	std::unordered_map<std::string, TLORec> m_tloMap;
+	std::unordered_map<std::string, TLORec, StringHash, std::equal_to<>> m_tloMap;
 
 	struct TypeRec
 	{
 		MQ2Type* type;
 		MQPluginHandle owner;
 	};
-	std::unordered_map<std::string, TypeRec> m_dataTypeMap;
+	std::unordered_map<std::string, TypeRec, StringHash, std::equal_to<>> m_dataTypeMap;
 
 	struct ExtensionRec
 	{
 		MQ2Type* extentionType;
 		MQPluginHandle owner;
 	};
-	std::unordered_map<std::string, std::vector<ExtensionRec>> m_typeExtensions;
+	std::unordered_map<std::string, std::vector<ExtensionRec>, StringHash, std::equal_to<>> m_typeExtensions;
 
 	mutable std::recursive_mutex m_mutex;
+
+	mutable CompiledExpressionCache m_expressionCache;
 };
 
 extern MQDataAPI* pDataAPI;
@@ -16,6 +16,7 @@
 
 #include "MQ2DeveloperTools.h"
 #include "MQ2ImGuiTools.h"
+#include "MQCommandAPI.h"
 #include "ImGuiManager.h"
 #include "mq/zep/ImGuiZepEditor.h"
 #include "mq/zep/ImGuiZepConsole.h"
@@ -669,6 +670,15 @@ public:
 					candidates.push_back(m_commands[i]);
 			}
 
+			std::vector<std::string> slashCommands;
+			if (!word.empty() && word[0] == '/')
+			{
+				slashCommands = pCommandAPI->GetCommandsWithPrefix(word);
+
+				for (const std::string& command : slashCommands)
+					candidates.push_back(command.c_str());
+			}
+
 			if (candidates.Size == 0)
 			{
 				// No match
@@ -75,6 +75,7 @@ static std::string s_pluginLoadFailure;
 //----------------------------------------------------------------------------
 
 uint32_t bmWriteChatColor = 0;
+uint32_t bmStripMQChat = 0;
 uint32_t bmPluginsIncomingChat = 0;
 uint32_t bmPluginsPulse = 0;
 uint32_t bmPluginsOnZoned = 0;
@@ -821,10 +822,18 @@ void PluginsWriteChatColor(const char* Line, int Color, int Filter)
 
 	if (size_t len = strlen(Line))
 	{
-		std::unique_ptr<char[]> plainText = std::make_unique<char[]>(len + 1);
+		// Reused between lines. CheckChatForEvent makes its own copy before it does anything
+		// that could write more chat.
+		thread_local std::vector<char> plainText;
+		if (plainText.size() < len + 1)
+			plainText.resize(len + 1);
 
-		StripMQChat(Line, plainText.get());
-		CheckChatForEvent(plainText.get());
+		{
+			MQScopedBenchmark bmStrip(bmStripMQChat);
+			StripMQChat(std::string_view{ Line, len }, plainText.data());
+		}
+
+		CheckChatForEvent(plainText.data());
 
 		DebugSpew("WriteChatColor(%s)", Line);
 	}
@@ -1511,6 +1520,7 @@ void InitializePlugins()
 	AddCommand("/plugin", PluginCommand, false, true, false);
 
 	bmWriteChatColor = AddMQ2Benchmark("WriteChatColor");
+	bmStripMQChat = AddMQ2Benchmark("StripMQChat");
 	bmPluginsIncomingChat = AddMQ2Benchmark("PluginsIncomingChat");
 	bmPluginsPulse = AddMQ2Benchmark("PluginsPulse");
 	bmPluginsOnZoned = AddMQ2Benchmark("PluginsOnZoned");
@@ -280,6 +280,7 @@ void InitializePostOffice()
 	if (s_postOffice == nullptr)
 	{
 		s_postOffice = new MQPostOffice();
+		s_postOffice->SetSharedMemoryCapacity(static_cast<uint32_t>(std::max(gActorSharedMemory, 0)) * 1024);
 		s_postOffice->Initialize();
 	}
 }
@@ -441,6 +441,8 @@ bool ParseINIFile(const std::string& iniFile)
 	gbIgnoreAlertRecursion   = GetPrivateProfileBool("MacroQuest", "IgnoreAlertRecursion", gbIgnoreAlertRecursion, iniFile);
 	gbShowCurrentCamera      = GetPrivateProfileBool("MacroQuest", "ShowCurrentCamera", gbShowCurrentCamera, iniFile);
 	gTurboLimit              = GetPrivateProfileInt("MacroQuest", "TurboLimit", gTurboLimit, iniFile);
+	gTurboTimeBudget         = GetPrivateProfileInt("MacroQuest", "TurboTimeBudget", gTurboTimeBudget, iniFile);
+	gActorSharedMemory       = GetPrivateProfileInt("MacroQuest", "ActorSharedMemory", gActorSharedMemory, iniFile); // KB per direction, 0 = named pipe only
 	gCreateMQ2NewsWindow     = GetPrivateProfileBool("MacroQuest", "CreateMQ2NewsWindow", gCreateMQ2NewsWindow, iniFile);
 	gNetStatusXPos           = GetPrivateProfileInt("MacroQuest", "NetStatusXPos", gNetStatusXPos, iniFile);
 	gNetStatusYPos           = GetPrivateProfileInt("MacroQuest", "NetStatusYPos", gNetStatusYPos, iniFile);
@@ -476,6 +478,8 @@ bool ParseINIFile(const std::string& iniFile)
 		WritePrivateProfileBool("MacroQuest", "IgnoreAlertRecursion", gbIgnoreAlertRecursion, iniFile);
 		WritePrivateProfileBool("MacroQuest", "ShowCurrentCamera", gbShowCurrentCamera, iniFile);
 		WritePrivateProfileInt("MacroQuest", "TurboLimit", gTurboLimit, iniFile);
+		WritePrivateProfileInt("MacroQuest", "TurboTimeBudget", gTurboTimeBudget, iniFile);
+		WritePrivateProfileInt("MacroQuest", "ActorSharedMemory", gActorSharedMemory, iniFile);
 		WritePrivateProfileBool("MacroQuest", "CreateMQ2NewsWindow", gCreateMQ2NewsWindow, iniFile);
 		WritePrivateProfileInt("MacroQuest", "NetStatusXPos", gNetStatusXPos, iniFile);
 		WritePrivateProfileInt("MacroQuest", "NetStatusYPos", gNetStatusYPos, iniFile);
@@ -1278,6 +1282,17 @@ void MacroQuest::SendToActor(
 	pActorAPI->SendToActor(dropbox, address, data, callback, pluginHandle);
 }
 
+void MacroQuest::GatherFromActors(
+	postoffice::Dropbox* dropbox,
+	const postoffice::Address& address,
+	const std::string& data,
+	std::chrono::milliseconds timeout,
+	const postoffice::GatherCallbackAPI& callback,
+	const MQPluginHandle& pluginHandle)
+{
+	pActorAPI->GatherFromActors(dropbox, address, data, timeout, callback, pluginHandle);
+}
+
 void MacroQuest::ReplyToActor(
 	postoffice::Dropbox* dropbox,
 	const std::shared_ptr<postoffice::Message>& message,
@@ -1291,9 +1306,10 @@ void MacroQuest::ReplyToActor(
 postoffice::Dropbox* MacroQuest::AddActor(
 	const char* localAddress,
 	postoffice::ReceiveCallbackAPI&& receive,
+	const postoffice::MailboxOptionsAPI& options,
 	const MQPluginHandle& pluginHandle)
 {
-	return pActorAPI->AddActor(localAddress, std::move(receive), pluginHandle);
+	return pActorAPI->AddActor(localAddress, std::move(receive), options, pluginHandle);
 }
 
 void MacroQuest::RemoveActor(postoffice::Dropbox*& dropbox, const MQPluginHandle& pluginHandle)
@@ -1301,6 +1317,11 @@ void MacroQuest::RemoveActor(postoffice::Dropbox*& dropbox, const MQPluginHandle
 	pActorAPI->RemoveActor(dropbox, pluginHandle);
 }
 
+postoffice::MailboxStatsAPI MacroQuest::GetActorStats(postoffice::Dropbox* dropbox, const MQPluginHandle& pluginHandle)
+{
+	return pActorAPI->GetActorStats(dropbox, pluginHandle);
+}
+
 #pragma endregion
 
 #pragma region CommandAPI Functions
@@ -53,11 +53,14 @@ public:
 	// Actors
 	virtual void SendToActor(postoffice::Dropbox* dropbox, const postoffice::Address& address, const std::string& data,
 		const postoffice::ResponseCallbackAPI& callback, const MQPluginHandle& pluginHandle) override;
+	virtual void GatherFromActors(postoffice::Dropbox* dropbox, const postoffice::Address& address, const std::string& data,
+		std::chrono::milliseconds timeout, const postoffice::GatherCallbackAPI& callback, const MQPluginHandle& pluginHandle) override;
 	virtual void ReplyToActor(postoffice::Dropbox* dropbox, const std::shared_ptr<postoffice::Message>& message,
 		const std::string& data, uint8_t status, const MQPluginHandle& pluginHandle) override;
 	virtual postoffice::Dropbox* AddActor(const char* localAddress, postoffice::ReceiveCallbackAPI&& receive,
-		const MQPluginHandle& pluginHandle) override;
+		const postoffice::MailboxOptionsAPI& options, const MQPluginHandle& pluginHandle) override;
 	virtual void RemoveActor(postoffice::Dropbox*& dropbox, const MQPluginHandle& pluginHandle) override;
+	virtual postoffice::MailboxStatsAPI GetActorStats(postoffice::Dropbox* dropbox, const MQPluginHandle& pluginHandle) override;
 
 	// Commands
 	virtual bool AddCommand(std::string_view command, MQCommandHandler handler, bool eq, bool parse, bool inGame,
@@ -21,6 +21,7 @@
 #include "Actor.pb.h"
 
 #include "LuaActor.h"
+#include "LuaActorCodec.h"
 #include "LuaThread.h"
 #include "LuaCoroutine.h"
 
@@ -155,6 +156,62 @@ messaging::Variant SerializeProto(const sol::object& data)
 	return variant;
 }
 
+// lua to lua traffic uses the binary codec, a header can ask for the protobuf encoding when the
+// receiver isn't a lua script. The returned buffer is reused by the next call.
+static const std::string& SerializePayload(const sol::object& payload, bool useProto)
+{
+	static LuaActorCodec s_codec;
+	static std::string s_protoBuffer;
+
+	if (useProto)
+	{
+		SerializeProto(payload).SerializeToString(&s_protoBuffer);
+		return s_protoBuffer;
+	}
+
+	sol::stack::push(payload.lua_state(), payload);
+	const std::string& data = s_codec.Encode(payload.lua_state(), -1);
+	lua_pop(payload.lua_state(), 1);
+
+	return data;
+}
+
+static const std::string& SerializePayload(const sol::table& header, const sol::object& payload)
+{
+	return SerializePayload(payload, header.get_or<std::string_view>("encoding", "") == "proto");
+}
+
+static sol::object DeserializePayload(const std::string& data, sol::state_view s)
+{
+	if (LuaActorCodec::IsEncoded(data))
+	{
+		if (LuaActorCodec::Decode(s.lua_state(), data))
+			return sol::stack::pop<sol::object>(s.lua_state());
+
+		return sol::lua_nil;
+	}
+
+	messaging::Variant variant;
+	if (variant.ParseFromString(data))
+		return DeserializeProto(variant, s);
+
+	return sol::lua_nil;
+}
+
+static sol::table AddressTable(const Address& address, sol::state_view s)
+{
+	sol::table table = s.create_table();
+	if (address.UUID) table["uuid"] = *address.UUID;
+	if (address.PID) table["pid"] = *address.PID;
+	if (address.Name) table["name"] = *address.Name;
+	if (address.Mailbox) table["mailbox"] = *address.Mailbox;
+	if (address.Account) table["account"] = *address.Account;
+	if (address.Server) table["server"] = *address.Server;
+	if (address.Character) table["character"] = *address.Character;
+	table["absolute_mailbox"] = address.AbsoluteMailbox;
+
+	return table;
+}
 
 void Send(sol::object payload);
 void Send(sol::table header, sol::object payload);
@@ -166,20 +223,19 @@ struct LuaMessage
 {
 	const LuaDropbox* const dropbox;
 	std::shared_ptr<Message> message;
-	messaging::Variant data;
-	bool has_data = false;
+	int status = 0; // the status of a reply
 
-	LuaMessage(const LuaDropbox* const dropbox_, const std::shared_ptr<Message>& message_)
+	LuaMessage(const LuaDropbox* const dropbox_, const std::shared_ptr<Message>& message_, int status_ = 0)
 		: dropbox(dropbox_)
 		, message(message_)
+		, status(status_)
 	{
-		has_data = message && message->Payload && data.ParseFromString(*message->Payload);
 	}
 
 	sol::object Get(sol::this_state s)
 	{
-		if (has_data)
-			return DeserializeProto(data, s);
+		if (message && message->Payload)
+			return DeserializePayload(*message->Payload, s);
 
 		return sol::lua_nil;
 	}
@@ -187,19 +243,7 @@ struct LuaMessage
 	sol::table Sender(sol::this_state s)
 	{
 		if (message && message->Sender)
-		{
-			sol::table table = sol::state_view(s).create_table();
-			if (message->Sender->UUID) table["uuid"] = *message->Sender->UUID;
-			if (message->Sender->PID) table["pid"] = *message->Sender->PID;
-			if (message->Sender->Name) table["name"] = *message->Sender->Name;
-			if (message->Sender->Mailbox) table["mailbox"] = *message->Sender->Mailbox;
-			if (message->Sender->Account) table["account"] = *message->Sender->Account;
-			if (message->Sender->Server) table["server"] = *message->Sender->Server;
-			if (message->Sender->Character) table["character"] = *message->Sender->Character;
-			table["absolute_mailbox"] = message->Sender->AbsoluteMailbox;
-
-			return table;
-		}
+			return AddressTable(*message->Sender, s);
 
 		return sol::lua_nil;
 	}
@@ -218,6 +262,7 @@ struct CallbackInstance
 
 	int m_status = 0;
 	LuaMessage m_message;
+	std::optional<GatherResponse> m_gather; // set when this is the callback of a gather
 
 	// the thread lifetime is necessarily longer than this CallbackInstance because if the thread goes
 	// down, the dropboxes will be closed
@@ -237,11 +282,19 @@ struct CallbackInstance
 
 	void Run()
 	{
+		std::shared_ptr<LuaThread> thread = LuaThread::get_from(m_thread.state());
+
+		// the script might be parked waiting on a condition that this callback satisfies
+		if (thread)
+			thread->Wake();
+
 		try
 		{
-			ScopedYieldDisabler disableYield(LuaThread::get_from(m_thread.state()));
+			ScopedYieldDisabler disableYield(thread);
 
-			sol::function_result result = m_coroutine(m_status, m_message);
+			sol::function_result result = m_gather
+				? m_coroutine(m_status, GatherReplies(), GatherTimedOut())
+				: m_coroutine(m_status, m_message);
 			if (!result.valid())
 			{
 				LuaError("Lua Actor Failure:\n%s", sol::stack::get<std::string>(result.lua_state(), result.stack_index()).c_str());
@@ -253,6 +306,27 @@ struct CallbackInstance
 			LuaError("Lua Actor Failure:\n%s", e.what());
 		}
 	}
+
+private:
+	sol::table GatherReplies() const
+	{
+		sol::state_view s(m_thread.state());
+		sol::table replies = s.create_table(static_cast<int>(m_gather->Replies.size()), 0);
+		for (const GatherReply& reply : m_gather->Replies)
+			replies.add(LuaMessage(m_message.dropbox, reply.Reply, reply.Status));
+
+		return replies;
+	}
+
+	sol::table GatherTimedOut() const
+	{
+		sol::state_view s(m_thread.state());
+		sol::table timed_out = s.create_table(static_cast<int>(m_gather->TimedOut.size()), 0);
+		for (const Address& recipient : m_gather->TimedOut)
+			timed_out.add(AddressTable(recipient, s));
+
+		return timed_out;
+	}
 };
 
 // global callbacks for anonymous sends
@@ -267,8 +341,12 @@ class LuaDropbox
 {
 public:
 	static std::shared_ptr<LuaDropbox> RegisterWithName(const std::string& name, const sol::function& callback, sol::this_state s);
+	static std::shared_ptr<LuaDropbox> RegisterWithName(const std::string& name, const sol::function& callback, sol::table options, sol::this_state s);
 	static std::shared_ptr<LuaDropbox> Register(const sol::function& callback, sol::this_state s);
+	static std::shared_ptr<LuaDropbox> Register(const sol::function& callback, sol::table options, sol::this_state s);
+	static MailboxOptionsAPI ParseOptions(sol::table options);
 	void Unregister();
+	sol::table Stats(sol::this_state s) const;
 
 	Address ParseHeader(sol::table header) const;
 	static Address ParseHeader(sol::table header, const std::shared_ptr<LuaThread>& thread, std::string_view script_name);
@@ -276,13 +354,16 @@ public:
 	void Send(sol::table header, sol::object payload) const;
 	void Send(sol::object payload, sol::function response_callback);
 	void Send(sol::table header, sol::object payload, sol::function response_callback);
+	void Gather(sol::object payload, int timeout, sol::function gather_callback);
+	void Gather(sol::table header, sol::object payload, int timeout, sol::function gather_callback);
 	void Reply(const std::shared_ptr<Message>& message, const sol::object& reply, int status) const;
 	void Receive(const std::shared_ptr<Message>& message);
 	void Process();
 
 	const std::string& GetName() { return m_name; }
 
-	LuaDropbox(std::string_view name, const sol::function& callback, const sol::thread& parent_thread);
+	LuaDropbox(std::string_view name, const sol::function& callback, const sol::thread& parent_thread,
+		const MailboxOptionsAPI& options = {});
 	~LuaDropbox();
 
 private:
@@ -318,11 +399,16 @@ void LuaMessage::Send(sol::object reply, sol::this_state s)
 }
 
 std::shared_ptr<LuaDropbox> LuaDropbox::RegisterWithName(const std::string& name, const sol::function& callback, sol::this_state s)
+{
+	return RegisterWithName(name, callback, sol::state_view(s).create_table(), s);
+}
+
+std::shared_ptr<LuaDropbox> LuaDropbox::RegisterWithName(const std::string& name, const sol::function& callback, sol::table options, sol::this_state s)
 {
 	if (auto thread = LuaThread::get_from(s))
 	{
 		auto full_name = fmt::format("{}:{}", thread->GetName(), name);
-		auto dropbox = std::make_shared<LuaDropbox>(full_name, callback, thread->GetLuaThread());
+		auto dropbox = std::make_shared<LuaDropbox>(full_name, callback, thread->GetLuaThread(), ParseOptions(options));
 
 		// if we can't place the dropbox in the map for some reason, then return a nullptr
 		if (!s_dropboxes.emplace(full_name, dropbox).second)
@@ -335,10 +421,15 @@ std::shared_ptr<LuaDropbox> LuaDropbox::RegisterWithName(const std::string& name
 }
 
 std::shared_ptr<LuaDropbox> LuaDropbox::Register(const sol::function& callback, sol::this_state s)
+{
+	return Register(callback, sol::state_view(s).create_table(), s);
+}
+
+std::shared_ptr<LuaDropbox> LuaDropbox::Register(const sol::function& callback, sol::table options, sol::this_state s)
 {
 	if (auto thread = LuaThread::get_from(s))
 	{
-		auto dropbox = std::make_shared<LuaDropbox>(thread->GetName(), callback, thread->GetLuaThread());
+		auto dropbox = std::make_shared<LuaDropbox>(thread->GetName(), callback, thread->GetLuaThread(), ParseOptions(options));
 
 		if (!s_dropboxes.emplace(thread->GetName(), dropbox).second)
 			dropbox.reset();
@@ -349,16 +440,55 @@ std::shared_ptr<LuaDropbox> LuaDropbox::Register(const sol::function& callback,
 	return nullptr;
 }
 
+MailboxOptionsAPI LuaDropbox::ParseOptions(sol::table options)
+{
+	MailboxOptionsAPI parsed;
+
+	auto maybe_capacity = options.get<std::optional<int>>("capacity");
+	if (maybe_capacity && *maybe_capacity > 0)
+		parsed.Capacity = static_cast<size_t>(*maybe_capacity);
+
+	std::optional<std::string_view> maybe_overflow = options["overflow"];
+	if (maybe_overflow)
+	{
+		if (ci_equals(*maybe_overflow, "drop_oldest"))
+			parsed.Overflow = MailboxOverflowAPI::DropOldest;
+		else if (ci_equals(*maybe_overflow, "drop_newest"))
+			parsed.Overflow = MailboxOverflowAPI::DropNewest;
+		else if (ci_equals(*maybe_overflow, "reject"))
+			parsed.Overflow = MailboxOverflowAPI::Reject;
+		else
+			LuaError("Unknown actor mailbox overflow policy '%.*s', using 'reject'",
+				static_cast<int>(maybe_overflow->size()), maybe_overflow->data());
+	}
+
+	return parsed;
+}
+
 void LuaDropbox::Unregister()
 {
 	s_dropboxes.erase(m_name);
 }
 
-LuaDropbox::LuaDropbox(std::string_view name, const sol::function& callback, const sol::thread& parent_thread)
+sol::table LuaDropbox::Stats(sol::this_state s) const
+{
+	const MailboxStatsAPI stats = m_dropbox.GetStats();
+
+	sol::table table = sol::state_view(s).create_table();
+	table["depth"] = stats.Depth;
+	table["high_water"] = stats.HighWater;
+	table["capacity"] = stats.Capacity;
+	table["dropped"] = stats.Dropped;
+
+	return table;
+}
+
+LuaDropbox::LuaDropbox(std::string_view name, const sol::function& callback, const sol::thread& parent_thread,
+	const MailboxOptionsAPI& options)
 	: m_name(name)
 	, m_callback(callback)
 	, m_parentThread(parent_thread)
-	, m_dropbox(AddActor(m_name.c_str(), [this](const std::shared_ptr<Message>& message) { Receive(message); }))
+	, m_dropbox(AddActor(m_name.c_str(), [this](const std::shared_ptr<Message>& message) { Receive(message); }, options))
 {
 	m_thread = sol::thread::create(parent_thread.state());
 	m_coroutine = sol::coroutine(m_thread.state(), m_callback);
@@ -430,7 +560,7 @@ void LuaDropbox::Send(sol::object payload) const
 
 void LuaDropbox::Send(sol::table header, sol::object payload) const
 {
-	m_dropbox.Post(ParseHeader(header), SerializeProto(payload));
+	m_dropbox.Post(ParseHeader(header), SerializePayload(header, payload));
 }
 
 void LuaDropbox::Send(sol::object payload, sol::function response_callback)
@@ -442,26 +572,50 @@ void LuaDropbox::Send(sol::table header, sol::object payload, sol::function resp
 {
 	// need to create the callback instance before response_callback goes out of scope in lua
 	auto callback = std::make_unique<CallbackInstance>(m_parentThread, response_callback, LuaMessage(this, nullptr));
-	m_dropbox.Post(ParseHeader(header), SerializeProto(payload),
+	m_dropbox.Post(ParseHeader(header), SerializePayload(header, payload),
 		[callback = callback.release(), this](int status, const std::shared_ptr<Message>& message)
 		{
 			callback->m_status = status;
 			callback->m_message.message = message;
-			callback->m_message.has_data = message && message->Payload && callback->m_message.data.ParseFromString(*message->Payload);
+			callback->m_message.status = status;
+			m_queue.push_back(std::unique_ptr<CallbackInstance>(callback));
+		});
+}
+
+void LuaDropbox::Gather(sol::object payload, int timeout, sol::function gather_callback)
+{
+	Gather(sol::state_view(payload.lua_state()).create_table(), payload, timeout, gather_callback);
+}
+
+void LuaDropbox::Gather(sol::table header, sol::object payload, int timeout, sol::function gather_callback)
+{
+	// need to create the callback instance before gather_callback goes out of scope in lua
+	auto callback = std::make_unique<CallbackInstance>(m_parentThread, gather_callback, LuaMessage(this, nullptr));
+	m_dropbox.Gather(ParseHeader(header), SerializePayload(header, payload), std::chrono::milliseconds(std::max(timeout, 0)),
+		[callback = callback.release(), this](const GatherResponse& response)
+		{
+			callback->m_status = response.Status;
+			callback->m_gather = response;
 			m_queue.push_back(std::unique_ptr<CallbackInstance>(callback));
 		});
 }
 
 void LuaDropbox::Reply(const std::shared_ptr<Message>& message, const sol::object& reply, int status) const
 {
-	m_dropbox.PostReply(message, SerializeProto(reply), static_cast<uint8_t>(status));
+	// reply in the same encoding the request was sent with
+	const bool useProto = message && message->Payload && !LuaActorCodec::IsEncoded(*message->Payload);
+	m_dropbox.PostReply(message, SerializePayload(reply, useProto), static_cast<uint8_t>(status));
 }
 
 void LuaDropbox::Receive(const std::shared_ptr<Message>& message)
 {
+	std::shared_ptr<LuaThread> thread = LuaThread::get_from(m_thread.state());
+	if (thread)
+		thread->Wake();
+
 	try
 	{
-		ScopedYieldDisabler disableYield(LuaThread::get_from(m_thread.state()));
+		ScopedYieldDisabler disableYield(thread);
 
 		sol::function_result result = m_coroutine(LuaMessage(this, message));
 		if (!result.valid())
@@ -499,7 +653,7 @@ void Send(sol::object payload)
 void Send(sol::table header, sol::object payload)
 {
 	auto thread = LuaThread::get_from(header.lua_state());
-	postoffice::SendToActor(LuaDropbox::ParseHeader(header, thread, thread ? thread->GetName() : ""), SerializeProto(payload));
+	postoffice::SendToActor(LuaDropbox::ParseHeader(header, thread, thread ? thread->GetName() : ""), SerializePayload(header, payload));
 }
 
 void Send(sol::object payload, sol::function response_callback)
@@ -514,12 +668,12 @@ void Send(sol::table header, sol::object payload, sol::function response_callbac
 	if (thread)
 	{
 		auto callback = std::make_unique<CallbackInstance>(thread->GetLuaThread(), response_callback, LuaMessage(nullptr, nullptr));
-		postoffice::SendToActor(LuaDropbox::ParseHeader(header, thread, thread->GetName()), SerializeProto(payload),
+		postoffice::SendToActor(LuaDropbox::ParseHeader(header, thread, thread->GetName()), SerializePayload(header, payload),
 			[callback = callback.release()](int status, const std::shared_ptr<Message>& message)
 			{
 				callback->m_status = status;
 				callback->m_message.message = message;
-				callback->m_message.has_data = message && message->Payload && callback->m_message.data.ParseFromString(*message->Payload);
+				callback->m_message.status = status;
 				s_queue.push_back(std::unique_ptr<CallbackInstance>(callback));
 			});
 	}
@@ -582,6 +736,10 @@ sol::table LuaActors::RegisterLua(sol::state_view s)
 			sol::resolve<void(sol::object, sol::function)>(&LuaDropbox::Send),
 			sol::resolve<void(sol::table, sol::object) const>(&LuaDropbox::Send),
 			sol::resolve<void(sol::table, sol::object, sol::function)>(&LuaDropbox::Send)),
+		"gather", sol::overload(
+			sol::resolve<void(sol::object, int, sol::function)>(&LuaDropbox::Gather),
+			sol::resolve<void(sol::table, sol::object, int, sol::function)>(&LuaDropbox::Gather)),
+		"stats", &LuaDropbox::Stats,
 		"unregister", &LuaDropbox::Unregister);
 
 	actors.new_usertype<LuaMessage>(
@@ -591,10 +749,15 @@ sol::table LuaActors::RegisterLua(sol::state_view s)
 			sol::resolve<void(sol::object)>(&LuaMessage::Reply),
 			sol::resolve<void(int, sol::object)>(&LuaMessage::Reply)),
 		"sender", sol::property(&LuaMessage::Sender),
+		"status", sol::readonly(&LuaMessage::status),
 		"send", &LuaMessage::Send,
 		sol::meta_function::call, &LuaMessage::Get);
 
-	actors.set_function("register", sol::overload(&LuaDropbox::RegisterWithName, &LuaDropbox::Register));
+	actors.set_function("register", sol::overload(
+		sol::resolve<std::shared_ptr<LuaDropbox>(const std::string&, const sol::function&, sol::table, sol::this_state)>(&LuaDropbox::RegisterWithName),
+		sol::resolve<std::shared_ptr<LuaDropbox>(const std::string&, const sol::function&, sol::this_state)>(&LuaDropbox::RegisterWithName),
+		sol::resolve<std::shared_ptr<LuaDropbox>(const sol::function&, sol::table, sol::this_state)>(&LuaDropbox::Register),
+		sol::resolve<std::shared_ptr<LuaDropbox>(const sol::function&, sol::this_state)>(&LuaDropbox::Register)));
 	actors.set_function("iter", &Iterator);
 	actors.set_function("send", sol::overload(
 		sol::resolve<void(sol::object)>(&Send),
@@ -606,7 +769,8 @@ sol::table LuaActors::RegisterLua(sol::state_view s)
 		"ConnectionClosed", postoffice::ResponseStatus::ConnectionClosed,
 		"NoConnection", postoffice::ResponseStatus::NoConnection,
 		"RoutingFailed", postoffice::ResponseStatus::RoutingFailed,
-		"AmbiguousRecipient", postoffice::ResponseStatus::AmbiguousRecipient);
+		"AmbiguousRecipient", postoffice::ResponseStatus::AmbiguousRecipient,
+		"MailboxFull", postoffice::ResponseStatus::MailboxFull);
 
 	return actors;
 }
@@ -0,0 +1,491 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "LuaActorCodec.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace mq::lua {
+
+// the payload starts with a zero byte (an invalid protobuf tag) followed by the format version
+static constexpr char PAYLOAD_MAGIC[] = { '\0', 'L', 1 };
+
+// tables nested deeper than this are sent as nil
+static constexpr int MAX_DEPTH = 64;
+
+enum PayloadTag : uint8_t
+{
+	Tag_Nil = 0,
+	Tag_False = 1,
+	Tag_True = 2,
+	Tag_Integer = 3,   // zigzag varint
+	Tag_Double = 4,    // 8 bytes
+	Tag_String = 5,    // varint length, bytes
+	Tag_Table = 6,     // 2 byte array size hint, 2 byte hash size hint, entries, Tag_End
+	Tag_End = 7,       // ends a table, in the place of a key
+	Tag_NewKey = 8,    // varint length, bytes. Adds the key to the key table
+	Tag_KeyRef = 9,    // varint index into the key table
+	Tag_ImVec2 = 10,   // 2 floats
+	Tag_ImVec4 = 11,   // 4 floats
+};
+
+static int AbsoluteIndex(lua_State* L, int index)
+{
+	return index < 0 && index > LUA_REGISTRYINDEX ? lua_gettop(L) + index + 1 : index;
+}
+
+static bool IsSendable(lua_State* L, int index)
+{
+	switch (lua_type(L, index))
+	{
+	case LUA_TBOOLEAN:
+	case LUA_TNUMBER:
+	case LUA_TSTRING:
+	case LUA_TTABLE:
+		return true;
+	case LUA_TUSERDATA:
+		return sol::stack::check<ImVec2>(L, index, sol::no_panic) || sol::stack::check<ImVec4>(L, index, sol::no_panic);
+	default:
+		return false;
+	}
+}
+
+bool LuaActorCodec::IsEncoded(std::string_view data)
+{
+	return data.size() >= sizeof(PAYLOAD_MAGIC) && data.compare(0, sizeof(PAYLOAD_MAGIC),
+		std::string_view(PAYLOAD_MAGIC, sizeof(PAYLOAD_MAGIC))) == 0;
+}
+
+const std::string& LuaActorCodec::Encode(lua_State* L, int index)
+{
+	m_buffer.assign(PAYLOAD_MAGIC, sizeof(PAYLOAD_MAGIC));
+	m_keys.clear();
+	m_path.clear();
+
+	WriteValue(L, AbsoluteIndex(L, index), 0);
+
+	// key strings are owned by the tables we just encoded, don't hold on to them
+	m_keys.clear();
+
+	return m_buffer;
+}
+
+void LuaActorCodec::WriteVarint(uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		m_buffer.push_back(static_cast<char>(value | 0x80));
+		value >>= 7;
+	}
+
+	m_buffer.push_back(static_cast<char>(value));
+}
+
+void LuaActorCodec::WriteNumber(double number)
+{
+	// most numbers in scripts are integers, which are much smaller as varints
+	constexpr double MAX_EXACT_INTEGER = 9007199254740992.0; // 2^53
+	if (std::floor(number) == number && std::fabs(number) <= MAX_EXACT_INTEGER && !(number == 0 && std::signbit(number)))
+	{
+		const int64_t integer = static_cast<int64_t>(number);
+
+		WriteTag(Tag_Integer);
+		WriteVarint((static_cast<uint64_t>(integer) << 1) ^ static_cast<uint64_t>(integer >> 63));
+	}
+	else
+	{
+		WriteTag(Tag_Double);
+		m_buffer.append(reinterpret_cast<const char*>(&number), sizeof(number));
+	}
+}
+
+bool LuaActorCodec::WriteKey(lua_State* L, int index)
+{
+	switch (lua_type(L, index))
+	{
+	case LUA_TSTRING:
+	{
+		// don't use lua_tolstring on anything but strings here, it would change the key under lua_next
+		size_t length = 0;
+		const char* str = lua_tolstring(L, index, &length);
+
+		auto [key_it, added] = m_keys.emplace(std::string_view(str, length), static_cast<uint32_t>(m_keys.size()));
+		if (added)
+		{
+			WriteTag(Tag_NewKey);
+			WriteVarint(length);
+			m_buffer.append(str, length);
+		}
+		else
+		{
+			WriteTag(Tag_KeyRef);
+			WriteVarint(key_it->second);
+		}
+
+		return true;
+	}
+	case LUA_TNUMBER:
+		WriteNumber(lua_tonumber(L, index));
+		return true;
+	case LUA_TBOOLEAN:
+		WriteTag(lua_toboolean(L, index) ? Tag_True : Tag_False);
+		return true;
+	default:
+		return false;
+	}
+}
+
+void LuaActorCodec::WriteValue(lua_State* L, int index, int depth)
+{
+	switch (lua_type(L, index))
+	{
+	case LUA_TBOOLEAN:
+		WriteTag(lua_toboolean(L, index) ? Tag_True : Tag_False);
+		break;
+
+	case LUA_TNUMBER:
+		WriteNumber(lua_tonumber(L, index));
+		break;
+
+	case LUA_TSTRING:
+	{
+		size_t length = 0;
+		const char* str = lua_tolstring(L, index, &length);
+
+		WriteTag(Tag_String);
+		WriteVarint(length);
+		m_buffer.append(str, length);
+		break;
+	}
+
+	case LUA_TTABLE:
+	{
+		// a table that is already being written is a cycle, which would otherwise be written out until
+		// MAX_DEPTH, once for every path through it
+		const void* table = lua_topointer(L, index);
+		if (depth >= MAX_DEPTH || !lua_checkstack(L, 3) || std::find(m_path.begin(), m_path.end(), table) != m_path.end())
+		{
+			WriteTag(Tag_Nil);
+			break;
+		}
+
+		m_path.push_back(table);
+		WriteTag(Tag_Table);
+
+		// the size hints let the reader create the table at its final size, they get filled in at the end
+		const size_t hints = m_buffer.size();
+		m_buffer.append(4, '\0');
+		uint32_t arraySize = 0;
+		uint32_t hashSize = 0;
+
+		lua_pushnil(L);
+		while (lua_next(L, index) != 0)
+		{
+			if (IsSendable(L, -1))
+			{
+				const bool arrayKey = lua_type(L, -2) == LUA_TNUMBER && lua_tonumber(L, -2) >= 1;
+				if (WriteKey(L, -2))
+				{
+					WriteValue(L, lua_gettop(L), depth + 1);
+					++(arrayKey ? arraySize : hashSize);
+				}
+			}
+
+			lua_pop(L, 1);
+		}
+
+		WriteTag(Tag_End);
+		m_path.pop_back();
+
+		const uint16_t sizes[] = {
+			static_cast<uint16_t>(std::min<uint32_t>(arraySize, UINT16_MAX)),
+			static_cast<uint16_t>(std::min<uint32_t>(hashSize, UINT16_MAX))
+		};
+		memcpy(&m_buffer[hints], sizes, sizeof(sizes));
+		break;
+	}
+
+	case LUA_TUSERDATA:
+		if (sol::stack::check<ImVec2>(L, index, sol::no_panic))
+		{
+			const ImVec2& vec = sol::stack::get<ImVec2>(L, index);
+
+			WriteTag(Tag_ImVec2);
+			m_buffer.append(reinterpret_cast<const char*>(&vec.x), sizeof(float));
+			m_buffer.append(reinterpret_cast<const char*>(&vec.y), sizeof(float));
+		}
+		else if (sol::stack::check<ImVec4>(L, index, sol::no_panic))
+		{
+			const ImVec4& vec = sol::stack::get<ImVec4>(L, index);
+
+			WriteTag(Tag_ImVec4);
+			m_buffer.append(reinterpret_cast<const char*>(&vec.x), sizeof(float));
+			m_buffer.append(reinterpret_cast<const char*>(&vec.y), sizeof(float));
+			m_buffer.append(reinterpret_cast<const char*>(&vec.z), sizeof(float));
+			m_buffer.append(reinterpret_cast<const char*>(&vec.w), sizeof(float));
+		}
+		else
+		{
+			WriteTag(Tag_Nil);
+		}
+		break;
+
+	default:
+		WriteTag(Tag_Nil);
+		break;
+	}
+}
+
+//----------------------------------------------------------------------------
+
+namespace {
+
+class PayloadReader
+{
+public:
+	PayloadReader(lua_State* L, std::string_view data)
+		: m_L(L)
+		, m_pos(data.data())
+		, m_end(data.data() + data.size())
+	{
+	}
+
+	// pushes the next value, returns false on malformed data (the stack may have extra values on it)
+	bool ReadValue(int depth)
+	{
+		uint8_t tag;
+		if (!ReadByte(tag))
+			return false;
+
+		switch (tag)
+		{
+		case Tag_Nil:
+			lua_pushnil(m_L);
+			return true;
+
+		case Tag_False:
+		case Tag_True:
+			lua_pushboolean(m_L, tag == Tag_True);
+			return true;
+
+		case Tag_Integer:
+		case Tag_Double:
+			return ReadNumber(tag);
+
+		case Tag_String:
+		{
+			std::string_view str;
+			if (!ReadString(str))
+				return false;
+
+			lua_pushlstring(m_L, str.data(), str.size());
+			return true;
+		}
+
+		case Tag_Table:
+			return ReadTable(depth);
+
+		case Tag_ImVec2:
+		{
+			float values[2];
+			if (!ReadBytes(values, sizeof(values)))
+				return false;
+
+			sol::stack::push(m_L, ImVec2(values[0], values[1]));
+			return true;
+		}
+
+		case Tag_ImVec4:
+		{
+			float values[4];
+			if (!ReadBytes(values, sizeof(values)))
+				return false;
+
+			sol::stack::push(m_L, ImVec4(values[0], values[1], values[2], values[3]));
+			return true;
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	bool AtEnd() const { return m_pos == m_end; }
+
+private:
+	bool ReadTable(int depth)
+	{
+		uint16_t sizes[2];
+		if (depth >= MAX_DEPTH || !lua_checkstack(m_L, 3) || !ReadBytes(sizes, sizeof(sizes)))
+			return false;
+
+		lua_createtable(m_L, sizes[0], sizes[1]);
+		const int table = lua_gettop(m_L);
+
+		while (true)
+		{
+			uint8_t tag;
+			if (!ReadByte(tag))
+				return false;
+
+			if (tag == Tag_End)
+				return true;
+
+			if (!ReadKey(tag) || !ReadValue(depth + 1))
+				return false;
+
+			lua_rawset(m_L, table);
+		}
+	}
+
+	bool ReadKey(uint8_t tag)
+	{
+		switch (tag)
+		{
+		case Tag_NewKey:
+		{
+			std::string_view key;
+			if (!ReadString(key))
+				return false;
+
+			m_keys.push_back(key);
+			lua_pushlstring(m_L, key.data(), key.size());
+			return true;
+		}
+
+		case Tag_KeyRef:
+		{
+			uint64_t index;
+			if (!ReadVarint(index) || index >= m_keys.size())
+				return false;
+
+			lua_pushlstring(m_L, m_keys[index].data(), m_keys[index].size());
+			return true;
+		}
+
+		case Tag_Integer:
+		case Tag_Double:
+			// nan keys can't be set, and the writer never produces them
+			return ReadNumber(tag) && !std::isnan(lua_tonumber(m_L, -1));
+
+		case Tag_False:
+		case Tag_True:
+			lua_pushboolean(m_L, tag == Tag_True);
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	bool ReadNumber(uint8_t tag)
+	{
+		if (tag == Tag_Integer)
+		{
+			uint64_t value;
+			if (!ReadVarint(value))
+				return false;
+
+			const int64_t integer = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+			lua_pushnumber(m_L, static_cast<lua_Number>(integer));
+			return true;
+		}
+
+		double number;
+		if (!ReadBytes(&number, sizeof(number)))
+			return false;
+
+		lua_pushnumber(m_L, number);
+		return true;
+	}
+
+	bool ReadByte(uint8_t& value)
+	{
+		if (m_pos == m_end)
+			return false;
+
+		value = static_cast<uint8_t>(*m_pos++);
+		return true;
+	}
+
+	bool ReadBytes(void* out, size_t length)
+	{
+		if (static_cast<size_t>(m_end - m_pos) < length)
+			return false;
+
+		memcpy(out, m_pos, length);
+		m_pos += length;
+		return true;
+	}
+
+	bool ReadVarint(uint64_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t byte;
+			if (!ReadByte(byte))
+				return false;
+
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+
+		return false;
+	}
+
+	bool ReadString(std::string_view& str)
+	{
+		uint64_t length;
+		if (!ReadVarint(length) || static_cast<uint64_t>(m_end - m_pos) < length)
+			return false;
+
+		str = std::string_view(m_pos, static_cast<size_t>(length));
+		m_pos += length;
+		return true;
+	}
+
+	lua_State* m_L;
+	const char* m_pos;
+	const char* m_end;
+	std::vector<std::string_view> m_keys;
+};
+
+} // namespace
+
+bool LuaActorCodec::Decode(lua_State* L, std::string_view data)
+{
+	if (!IsEncoded(data) || !lua_checkstack(L, 3))
+		return false;
+
+	const int top = lua_gettop(L);
+
+	PayloadReader reader(L, data.substr(sizeof(PAYLOAD_MAGIC)));
+	if (!reader.ReadValue(0) || !reader.AtEnd())
+	{
+		lua_settop(L, top);
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace mq::lua
@@ -0,0 +1,70 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "LuaCommon.h"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mq::lua {
+
+/**
+ * The binary encoding used for lua actor payloads. Values are written straight from the lua stack
+ * and read straight back into lua tables, without building protobuf objects in between. Table keys
+ * are interned per payload, so arrays of records only spell out each key once.
+ *
+ * Encoded payloads start with a zero byte, which a protobuf message can never start with, so they
+ * can be told apart from the protobuf (Actor.proto) encoding that other languages use.
+ */
+class LuaActorCodec
+{
+public:
+	// true if data was written by Encode
+	static bool IsEncoded(std::string_view data);
+
+	/**
+	 * Encodes the value at the given stack index. Functions, threads and other values that can't be
+	 * sent are skipped (as table entries) or encoded as nil. A table that contains itself, directly
+	 * or through other tables, has the reference back to itself encoded as nil.
+	 *
+	 * @return the encoded payload, this buffer is reused by the next call to Encode
+	 */
+	const std::string& Encode(lua_State* L, int index);
+
+	/**
+	 * Decodes a payload written by Encode and pushes the value onto the stack
+	 *
+	 * @return false if the payload is malformed, in which case nothing is pushed
+	 */
+	static bool Decode(lua_State* L, std::string_view data);
+
+private:
+	void WriteValue(lua_State* L, int index, int depth);
+	bool WriteKey(lua_State* L, int index);
+	void WriteNumber(double number);
+	void WriteVarint(uint64_t value);
+	void WriteTag(uint8_t tag) { m_buffer.push_back(static_cast<char>(tag)); }
+
+	std::string m_buffer;
+	std::unordered_map<std::string_view, uint32_t> m_keys;
+
+	// the tables that are being written, from the outermost in
+	std::vector<const void*> m_path;
+};
+
+} // namespace mq::lua
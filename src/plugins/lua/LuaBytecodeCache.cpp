@@ -0,0 +1,268 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "LuaBytecodeCache.h"
+
+#include <luajit.h>
+
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace mq::lua {
+
+// Bytecode is only valid for the LuaJIT build that wrote it, so the version is part of the header. The whole
+// file is checksummed because LuaJIT doesn't verify bytecode, and a truncated file must not reach the loader.
+static constexpr char CACHE_MAGIC[] = "MQ2LuaBytecode1";
+
+static uint64_t Checksum(std::string_view data)
+{
+	// fnv-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (char c : data)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static int WriteBytecode(lua_State*, const void* data, size_t size, void* userData)
+{
+	static_cast<std::string*>(userData)->append(static_cast<const char*>(data), size);
+	return 0;
+}
+
+LuaBytecodeCache& GetLuaBytecodeCache()
+{
+	static LuaBytecodeCache s_cache;
+	return s_cache;
+}
+
+int LuaBytecodeCache::LoadFile(lua_State* L, const std::string& path)
+{
+	std::error_code ec;
+	const fs::path filePath{ path };
+
+	const auto modified = fs::last_write_time(filePath, ec);
+	const uint64_t size = ec ? 0 : fs::file_size(filePath, ec);
+	if (ec)
+	{
+		// let lua report the problem the way it usually does
+		return luaL_loadfile(L, path.c_str());
+	}
+
+	fs::path canonical = fs::weakly_canonical(filePath, ec);
+	const std::string key = ec ? path : canonical.string();
+	const std::string chunkName = "@" + path;
+
+	Entry& entry = m_entries[key];
+	const int64_t modifiedTime = modified.time_since_epoch().count();
+
+	if (!entry.bytecode.empty() && entry.modified == modifiedTime && entry.size == size)
+	{
+		int status = luaL_loadbuffer(L, entry.bytecode.data(), entry.bytecode.size(), chunkName.c_str());
+		if (status == 0)
+		{
+			++m_hits;
+			return status;
+		}
+
+		// shouldn't happen with a checksummed file, but compiling it again fixes it
+		lua_pop(L, 1);
+	}
+
+	++m_misses;
+	entry.bytecode.clear();
+
+	std::ifstream file(filePath, std::ios::binary);
+	std::string source{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	if (!file.good() && !file.eof())
+	{
+		m_entries.erase(key);
+		return luaL_loadfile(L, path.c_str());
+	}
+
+	int status = luaL_loadbuffer(L, source.data(), source.size(), chunkName.c_str());
+	if (status != 0)
+	{
+		m_entries.erase(key);
+		return status;
+	}
+
+	if (lua_dump(L, WriteBytecode, &entry.bytecode) != 0)
+	{
+		m_entries.erase(key);
+		return status;
+	}
+
+	entry.modified = modifiedTime;
+	entry.size = size;
+	m_dirty = true;
+
+	return status;
+}
+
+void LuaBytecodeCache::Clear()
+{
+	m_dirty = m_dirty || !m_entries.empty();
+	m_entries.clear();
+}
+
+LuaBytecodeCache::Stats LuaBytecodeCache::GetStats() const
+{
+	Stats stats;
+	stats.files = m_entries.size();
+	stats.hits = m_hits;
+	stats.misses = m_misses;
+
+	for (const auto& [_, entry] : m_entries)
+		stats.bytes += entry.bytecode.size();
+
+	return stats;
+}
+
+// File layout: magic, luajit version, checksum of everything after it, entry count, then for each entry the
+// path, modified time, file size and bytecode. Strings are a 32 bit length followed by the bytes.
+
+template <typename T>
+static void WriteValue(std::string& out, T value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void WriteString(std::string& out, std::string_view value)
+{
+	WriteValue(out, static_cast<uint32_t>(value.size()));
+	out.append(value);
+}
+
+template <typename T>
+static bool ReadValue(std::string_view& in, T& value)
+{
+	if (in.size() < sizeof(T))
+		return false;
+
+	memcpy(&value, in.data(), sizeof(T));
+	in.remove_prefix(sizeof(T));
+	return true;
+}
+
+static bool ReadString(std::string_view& in, std::string_view& value)
+{
+	uint32_t length = 0;
+	if (!ReadValue(in, length) || in.size() < length)
+		return false;
+
+	value = in.substr(0, length);
+	in.remove_prefix(length);
+	return true;
+}
+
+bool LuaBytecodeCache::Save(const fs::path& file)
+{
+	std::string body;
+	WriteValue(body, static_cast<uint32_t>(m_entries.size()));
+
+	for (const auto& [path, entry] : m_entries)
+	{
+		WriteString(body, path);
+		WriteValue(body, entry.modified);
+		WriteValue(body, entry.size);
+		WriteString(body, entry.bytecode);
+	}
+
+	std::string header;
+	WriteString(header, CACHE_MAGIC);
+	WriteString(header, LUAJIT_VERSION);
+	WriteValue(header, Checksum(body));
+
+	// several clients can share the file, so write a private copy and swap it in
+	std::error_code ec;
+	fs::path tempFile = file;
+	tempFile += fmt::format(".{}.tmp", GetCurrentProcessId());
+
+	{
+		std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+		out.write(header.data(), header.size());
+		out.write(body.data(), body.size());
+
+		if (!out.good())
+		{
+			out.close();
+			fs::remove(tempFile, ec);
+			return false;
+		}
+	}
+
+	fs::rename(tempFile, file, ec);
+	if (ec)
+	{
+		fs::remove(tempFile, ec);
+		return false;
+	}
+
+	m_dirty = false;
+	return true;
+}
+
+bool LuaBytecodeCache::Load(const fs::path& file)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+
+	const std::string contents{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+	std::string_view data = contents;
+
+	std::string_view magic, version;
+	uint64_t checksum = 0;
+	if (!ReadString(data, magic) || magic != CACHE_MAGIC
+		|| !ReadString(data, version) || version != LUAJIT_VERSION
+		|| !ReadValue(data, checksum) || checksum != Checksum(data))
+	{
+		return false;
+	}
+
+	uint32_t count = 0;
+	if (!ReadValue(data, count))
+		return false;
+
+	ci_unordered::map<std::string, Entry> entries;
+	entries.reserve(count);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		std::string_view path, bytecode;
+		Entry entry;
+
+		if (!ReadString(data, path) || !ReadValue(data, entry.modified) || !ReadValue(data, entry.size)
+			|| !ReadString(data, bytecode))
+		{
+			return false;
+		}
+
+		entry.bytecode = bytecode;
+		entries.emplace(path, std::move(entry));
+	}
+
+	m_entries = std::move(entries);
+	m_dirty = false;
+	return true;
+}
+
+} // namespace mq::lua
@@ -0,0 +1,77 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "LuaCommon.h"
+
+#include <mq/base/String.h>
+
+#include <filesystem>
+#include <string>
+
+namespace mq::lua {
+
+/**
+ * Compiled lua files, shared by every script. A file is compiled the first time a script runs or requires it,
+ * and everything that loads it after that gets the cached bytecode until the file's modification time or size
+ * changes. The cache can be saved to disk so the next session starts with everything that hasn't changed
+ * already compiled.
+ */
+class LuaBytecodeCache
+{
+public:
+	/**
+	 * Loads a lua file as a chunk and pushes it onto the stack, like luaL_loadfile.
+	 *
+	 * @return the lua load status. On failure the error message is pushed instead of the chunk.
+	 */
+	int LoadFile(lua_State* L, const std::string& path);
+
+	void Clear();
+
+	// replaces the contents of the cache with a file written by Save, returns false if the file isn't usable
+	bool Load(const std::filesystem::path& file);
+	bool Save(const std::filesystem::path& file);
+
+	// true when there are changes that haven't been saved
+	bool IsDirty() const { return m_dirty; }
+
+	struct Stats
+	{
+		size_t files = 0;
+		size_t bytes = 0;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+	Stats GetStats() const;
+
+private:
+	struct Entry
+	{
+		int64_t modified = 0;
+		uint64_t size = 0;
+		std::string bytecode;
+	};
+
+	// keyed by canonical path
+	ci_unordered::map<std::string, Entry> m_entries;
+	bool m_dirty = false;
+	uint64_t m_hits = 0;
+	uint64_t m_misses = 0;
+};
+
+LuaBytecodeCache& GetLuaBytecodeCache();
+
+} // namespace mq::lua
@@ -39,8 +39,6 @@ static unsigned int CALLBACK LuaVarProcess(char* VarName, char* Value, size_t Va
 
 LuaEventProcessor::LuaEventProcessor(LuaThread* thread)
 	: m_thread(thread)
-	, m_blech(std::make_unique<Blech>('#', '|', LuaVarProcess))
-	, m_blechStripped(std::make_unique<Blech>('#', '|', LuaVarProcess))
 {
 }
 
@@ -117,87 +115,20 @@ bool LuaEventProcessor::RemoveBind(std::string_view name)
 	return false;
 }
 
-void LuaEventProcessor::Process(std::string_view line)
+bool LuaEventProcessor::HasPendingWork() const
 {
-	if (!m_thread->IsValid())
-		return;
-	if (m_eventDefinitions.empty())
-		return;
-	if (line.size() >= MAX_STRING)
-		return;
-
-	char line_char[MAX_STRING] = { 0 };
-	char line_char_stripped[MAX_STRING] = { 0 };
-
-	m_currentLineStripped = nullptr;
-	m_currentLine = nullptr;
-
-	// Split event handling by whether we have links in the string or not. If there are no links in
-	// the string then this is much simpler.
-	if (line.find_first_of('\x12') == std::string::npos)
-	{
-		StripMQChat(line, line_char);
-
-		m_currentLineStripped = line_char;
-		m_currentLine = line_char;
-	}
-	else
-	{
-		// We have links in the string. Do the minimal amount of work required based on what kinds of
-		// events have been registered.
-
-		// Check if we need to keep both the stripped and unstripped links.
-		if (!m_blech->IsEmpty() && !m_blechStripped->IsEmpty())
-		{
-			StripMQChat(line, line_char);
-			m_currentLine = line_char;
-
-			CXStr line_str(line);
-			line_str = CleanItemTags(line_str, false);
-			StripMQChat(line_str, line_char_stripped);
-			m_currentLineStripped = line_char_stripped;
-		}
-		else if (!m_blech->IsEmpty())
-		{
-			StripMQChat(line, line_char);
-
-			m_currentLine = line_char;
-			m_currentLineStripped = line_char;
-		}
-		else if (!m_blechStripped->IsEmpty())
-		{
-			CXStr line_str(line);
-			line_str = CleanItemTags(line_str, false);
-			StripMQChat(line_str, line_char_stripped);
-
-			m_currentLineStripped = line_char_stripped;
-			m_currentLine = line_char_stripped;
-		}
-	}
-
-	// since we initialized to 0, we know that any remaining members will be 0, so just in case we
-	// get an overflow, re-set the last character to 0
-	line_char[MAX_STRING - 1] = 0;
-	line_char_stripped[MAX_STRING - 1] = 0;
-
-	if (!m_blech->IsEmpty() && m_currentLine != nullptr)
-	{
-		m_blech->Feed(m_currentLine, MAX_STRING);
-	}
-	if (!m_blechStripped->IsEmpty() && m_currentLineStripped != nullptr)
-	{
-		m_blechStripped->Feed(m_currentLineStripped, MAX_STRING);
-	}
-
-	m_currentLineStripped = nullptr;
-	m_currentLine = nullptr;
+	return !m_bindsPending.empty() || !m_bindsRunning.empty() || !m_eventsRunning.empty() || !m_deferredDoEvents.empty();
 }
 
 void LuaEventProcessor::HandleBlechEvent(LuaEvent* pEvent, BLECHVALUE* pValues)
 {
+	// Events are matched for all scripts at once, so skip the ones that aren't listening right now.
+	if (!m_thread->IsValid() || m_thread->IsPaused())
+		return;
+
 	std::vector<std::pair<uint32_t, std::string>> args;
 
-	const char* line = pEvent->KeepLinks() ? m_currentLine : m_currentLineStripped;
+	const char* line = LuaEventMatcher::Get().GetCurrentLine(pEvent->KeepLinks());
 	args.emplace_back(0, line ? line : "");
 
 	auto value = pValues;
@@ -223,6 +154,9 @@ void LuaEventProcessor::HandleBlechEvent(LuaEvent* pEvent, BLECHVALUE* pValues)
 
 		m_eventsPending.emplace_back(pEvent, std::move(ordered_args));
 	}
+
+	// the script might be waiting on a condition that checks for this event
+	m_thread->Wake();
 }
 
 struct ProcessingGuard
@@ -374,6 +308,8 @@ void LuaEventProcessor::HandleBindCallback(LuaBind* bind, const char* args)
 		std::vector<std::string> args_vector(args_view.begin(), args_view.end());
 		m_bindsPending.emplace_back(bind, std::move(args_vector));
 	}
+
+	m_thread->Wake();
 }
 
 //============================================================================
@@ -403,13 +339,114 @@ LuaEvent::LuaEvent(std::string_view name, std::string_view expression,
 		m_keepLinks = optionsTable.get_or("keepLinks", false);
 	}
 
-	m_blech = m_keepLinks ? &processor->GetBlech() : &processor->GetBlechStripped();
-	m_id = m_blech->AddEvent(m_expression.c_str(), LuaEventCallback, this);
+	m_id = LuaEventMatcher::Get().AddEvent(m_expression.c_str(), this);
 }
 
 LuaEvent::~LuaEvent()
 {
-	m_blech->RemoveEvent(m_id);
+	LuaEventMatcher::Get().RemoveEvent(m_id, m_keepLinks);
+}
+
+//============================================================================
+
+LuaEventMatcher& LuaEventMatcher::Get()
+{
+	static LuaEventMatcher s_matcher;
+	return s_matcher;
+}
+
+LuaEventMatcher::LuaEventMatcher()
+	: m_blech(std::make_unique<Blech>('#', '|', LuaVarProcess))
+	, m_blechStripped(std::make_unique<Blech>('#', '|', LuaVarProcess))
+{
+}
+
+uint32_t LuaEventMatcher::AddEvent(const char* expression, LuaEvent* event)
+{
+	Blech& blech = event->KeepLinks() ? *m_blech : *m_blechStripped;
+
+	return blech.AddEvent(expression, LuaEventCallback, event);
+}
+
+void LuaEventMatcher::RemoveEvent(uint32_t id, bool keepLinks)
+{
+	Blech& blech = keepLinks ? *m_blech : *m_blechStripped;
+
+	blech.RemoveEvent(id);
+}
+
+void LuaEventMatcher::Process(std::string_view line)
+{
+	if (m_blech->IsEmpty() && m_blechStripped->IsEmpty())
+		return;
+	if (line.size() >= MAX_STRING)
+		return;
+
+	char line_char[MAX_STRING] = { 0 };
+	char line_char_stripped[MAX_STRING] = { 0 };
+
+	m_currentLineStripped = nullptr;
+	m_currentLine = nullptr;
+
+	// Split event handling by whether we have links in the string or not. If there are no links in
+	// the string then this is much simpler.
+	if (line.find_first_of('\x12') == std::string::npos)
+	{
+		StripMQChat(line, line_char);
+
+		m_currentLineStripped = line_char;
+		m_currentLine = line_char;
+	}
+	else
+	{
+		// We have links in the string. Do the minimal amount of work required based on what kinds of
+		// events have been registered.
+
+		// Check if we need to keep both the stripped and unstripped links.
+		if (!m_blech->IsEmpty() && !m_blechStripped->IsEmpty())
+		{
+			StripMQChat(line, line_char);
+			m_currentLine = line_char;
+
+			CXStr line_str(line);
+			line_str = CleanItemTags(line_str, false);
+			StripMQChat(line_str, line_char_stripped);
+			m_currentLineStripped = line_char_stripped;
+		}
+		else if (!m_blech->IsEmpty())
+		{
+			StripMQChat(line, line_char);
+
+			m_currentLine = line_char;
+			m_currentLineStripped = line_char;
+		}
+		else if (!m_blechStripped->IsEmpty())
+		{
+			CXStr line_str(line);
+			line_str = CleanItemTags(line_str, false);
+			StripMQChat(line_str, line_char_stripped);
+
+			m_currentLineStripped = line_char_stripped;
+			m_currentLine = line_char_stripped;
+		}
+	}
+
+	// since we initialized to 0, we know that any remaining members will be 0, so just in case we
+	// get an overflow, re-set the last character to 0
+	line_char[MAX_STRING - 1] = 0;
+	line_char_stripped[MAX_STRING - 1] = 0;
+
+	if (!m_blech->IsEmpty() && m_currentLine != nullptr)
+	{
+		m_blech->Feed(m_currentLine, MAX_STRING);
+	}
+	if (!m_blechStripped->IsEmpty() && m_currentLineStripped != nullptr)
+	{
+		m_blechStripped->Feed(m_currentLineStripped, MAX_STRING);
+	}
+
+	m_currentLineStripped = nullptr;
+	m_currentLine = nullptr;
 }
 
 //============================================================================
@@ -49,13 +49,38 @@ private:
 	const std::string m_expression;
 	const sol::function m_function;
 	LuaEventProcessor* m_processor;
-	Blech* m_blech = nullptr;
 	uint32_t m_id;
 	bool m_keepLinks = false;
 };
 
 //----------------------------------------------------------------------------
 
+// Matches chat against the events of every running script. Each line is cleaned up and fed
+// to the matcher once, and matches are handed to the processor that owns the event.
+class LuaEventMatcher
+{
+public:
+	static LuaEventMatcher& Get();
+
+	uint32_t AddEvent(const char* expression, LuaEvent* event);
+	void RemoveEvent(uint32_t id, bool keepLinks);
+
+	void Process(std::string_view line);
+
+	// The line currently being processed, for events with and without links.
+	const char* GetCurrentLine(bool keepLinks) const { return keepLinks ? m_currentLine : m_currentLineStripped; }
+
+private:
+	LuaEventMatcher();
+
+	std::unique_ptr<Blech> m_blech;
+	std::unique_ptr<Blech> m_blechStripped;
+	const char* m_currentLineStripped = nullptr;
+	const char* m_currentLine = nullptr;
+};
+
+//----------------------------------------------------------------------------
+
 class LuaBind
 {
 public:
@@ -122,8 +147,6 @@ public:
 	bool AddBind(std::string_view name, const sol::function& function);
 	bool RemoveBind(std::string_view name);
 
-	void Process(std::string_view line);
-
 	// this is guaranteed to always run at the exact same time, so we can run binds and events in it
 	void RunEvents(LuaThread& thread);
 
@@ -135,18 +158,14 @@ public:
 
 	LuaThread* GetThread() const { return m_thread; }
 
+	// true when there are binds or events that need the thread to run next frame
+	bool HasPendingWork() const;
+
 	void HandleBlechEvent(LuaEvent* event, BLECHVALUE* pValues);
 	void HandleBindCallback(LuaBind* bind, const char* args);
 
-	Blech& GetBlech() { return *m_blech; }
-	Blech& GetBlechStripped() { return *m_blechStripped; }
-
 private:
 	LuaThread* m_thread;
-	std::unique_ptr<Blech> m_blech;
-	std::unique_ptr<Blech> m_blechStripped;
-	const char* m_currentLineStripped = nullptr;
-	const char* m_currentLine = nullptr;
 
 	// Events
 	std::vector<std::unique_ptr<LuaEvent>> m_eventDefinitions;
@@ -15,6 +15,7 @@
 #include "pch.h"
 #include "LuaImGui.h"
 #include "LuaThread.h"
+#include "LuaProfiler.h"
 
 #include "bindings/lua_Bindings.h"
 #include "imgui/implot/implot.h"
@@ -98,7 +99,14 @@ void LuaImGuiProcessor::Pulse()
 
 	// remove any existing hooks, they will be re-installed when running in onpulse
 	// this is to help prevent us from yielding from the thread while we're running imgui stuff.
-	lua_sethook(m_thread->GetLuaThread().lua_state(), nullptr, 0, 0);
+	// A profiled script gets a hook that only samples.
+	LuaProfiler* profiler = m_thread->GetProfiler();
+	if (profiler && profiler->IsRunning())
+		lua_sethook(m_thread->GetLuaThread().lua_state(), &LuaProfiler::lua_sampleHook, LUA_MASKCOUNT, LuaProfiler::HOOK_INSTRUCTIONS);
+	else
+		lua_sethook(m_thread->GetLuaThread().lua_state(), nullptr, 0, 0);
+
+	LuaProfiler::ScopedActivation profile(profiler, nullptr, "[ImGui callbacks]");
 
 	for (std::unique_ptr<LuaImGui>& im : m_imguis)
 	{
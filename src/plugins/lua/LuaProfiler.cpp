@@ -0,0 +1,325 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "LuaProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace mq::lua {
+
+// deeper stacks are cut off at the root end, the frames closest to the running code are the interesting ones
+static constexpr int MAX_STACK_DEPTH = 64;
+
+// frames that the time spent in each kind of binding is recorded under, in the order of LuaProfiler::Binding
+static constexpr std::string_view BINDING_FRAMES[] = { ";[TLO]", ";[ImGui]" };
+static_assert(std::size(BINDING_FRAMES) == static_cast<size_t>(LuaProfiler::Binding::Count));
+
+LuaProfiler* LuaProfiler::s_active = nullptr;
+
+LuaProfiler::LuaProfiler(std::string name)
+	: m_name(std::move(name))
+{
+	// ';' separates frames in the output
+	std::replace(m_name.begin(), m_name.end(), ';', ':');
+}
+
+void LuaProfiler::Start()
+{
+	m_stacks.clear();
+	m_samples = 0;
+	m_running = true;
+}
+
+void LuaProfiler::Stop()
+{
+	m_running = false;
+}
+
+int LuaProfiler::SetYieldCount(int count)
+{
+	m_yieldInstructions = count;
+	m_hookInstructions = std::min(count, HOOK_INSTRUCTIONS);
+	m_instructionsLeft = count;
+
+	return m_hookInstructions;
+}
+
+bool LuaProfiler::CountInstructions()
+{
+	m_instructionsLeft -= m_hookInstructions;
+	if (m_instructionsLeft > 0)
+		return false;
+
+	m_instructionsLeft = m_yieldInstructions;
+	return true;
+}
+
+static void AppendFrame(std::string& out, const lua_Debug& ar)
+{
+	const size_t start = out.size();
+	auto it = std::back_inserter(out);
+
+	if (strcmp(ar.what, "C") == 0)
+		fmt::format_to(it, "{} [C]", ar.name ? ar.name : "?");
+	else if (strcmp(ar.what, "main") == 0)
+		fmt::format_to(it, "main chunk ({}:{})", ar.short_src, ar.currentline);
+	else if (ar.name)
+		fmt::format_to(it, "{} ({}:{})", ar.name, ar.short_src, ar.currentline);
+	else
+		fmt::format_to(it, "function <{}:{}> ({}:{})", ar.short_src, ar.linedefined, ar.short_src, ar.currentline);
+
+	std::replace(out.begin() + start, out.end(), ';', ':');
+}
+
+void LuaProfiler::BuildStack(lua_State* L)
+{
+	lua_Debug frames[MAX_STACK_DEPTH];
+
+	int depth = 0;
+	while (depth < MAX_STACK_DEPTH && lua_getstack(L, depth, &frames[depth]))
+	{
+		lua_getinfo(L, "Sln", &frames[depth]);
+		++depth;
+	}
+
+	m_stack = m_root;
+	for (int i = depth - 1; i >= 0; --i)
+	{
+		m_stack.push_back(';');
+		AppendFrame(m_stack, frames[i]);
+	}
+}
+
+void LuaProfiler::Record(std::chrono::nanoseconds elapsed)
+{
+	// bindings don't run the vm, so all of their time since the last sample goes to the line that is running now
+	for (size_t i = 0; i < m_pendingBinding.size(); ++i)
+	{
+		const std::chrono::nanoseconds binding = std::min(m_pendingBinding[i], elapsed);
+		m_pendingBinding[i] = std::chrono::nanoseconds{ 0 };
+
+		if (binding.count() > 0)
+		{
+			std::string stack;
+			stack.reserve(m_stack.size() + BINDING_FRAMES[i].size());
+			stack.append(m_stack).append(BINDING_FRAMES[i]);
+
+			m_stacks[stack] += binding.count();
+			elapsed -= binding;
+		}
+	}
+
+	if (elapsed.count() > 0)
+		m_stacks[m_stack] += elapsed.count();
+}
+
+void LuaProfiler::Sample(lua_State* L)
+{
+	const auto now = std::chrono::steady_clock::now();
+	m_pending += now - m_last;
+	m_last = now;
+
+	if (m_pending < SAMPLE_INTERVAL)
+		return;
+
+	BuildStack(L);
+	Record(m_pending);
+
+	m_pending = std::chrono::nanoseconds{ 0 };
+	++m_samples;
+}
+
+/*static*/ void LuaProfiler::lua_sampleHook(lua_State* L, lua_Debug* D)
+{
+	if (D->event == LUA_HOOKCOUNT && s_active != nullptr)
+		s_active->Sample(L);
+}
+
+void LuaProfiler::Activate(const char* category)
+{
+	m_root = m_name;
+	if (category != nullptr)
+		m_root.append(";").append(category);
+
+	m_stack = m_root;
+	m_last = std::chrono::steady_clock::now();
+	m_pending = std::chrono::nanoseconds{ 0 };
+	m_pendingBinding.fill(std::chrono::nanoseconds{ 0 });
+	m_bindingDepth = 0;
+
+	s_active = this;
+}
+
+void LuaProfiler::Deactivate(lua_State* L)
+{
+	s_active = nullptr;
+
+	m_pending += std::chrono::steady_clock::now() - m_last;
+	if (m_pending.count() == 0)
+		return;
+
+	// whatever ran since the last sample is charged to where the script stopped. That's where a coroutine yielded,
+	// and a script that runs too briefly to ever reach the hook is still accounted for.
+	lua_Debug ar;
+	if (L != nullptr && lua_getstack(L, 0, &ar))
+		BuildStack(L);
+
+	Record(m_pending);
+	m_pending = std::chrono::nanoseconds{ 0 };
+	++m_samples;
+}
+
+LuaProfiler::Stats LuaProfiler::GetStats(size_t topLines) const
+{
+	Stats stats;
+	stats.samples = m_samples;
+
+	std::unordered_map<std::string_view, uint64_t> lines;
+	uint64_t script = 0, tlo = 0, imgui = 0;
+
+	for (const auto& [stack, time] : m_stacks)
+	{
+		std::string_view view = stack;
+
+		auto endsWith = [view](std::string_view frame)
+			{ return view.size() >= frame.size() && view.substr(view.size() - frame.size()) == frame; };
+
+		if (endsWith(BINDING_FRAMES[static_cast<size_t>(Binding::TLO)]))
+		{
+			tlo += time;
+			continue;
+		}
+
+		if (endsWith(BINDING_FRAMES[static_cast<size_t>(Binding::ImGui)]))
+		{
+			imgui += time;
+			continue;
+		}
+
+		script += time;
+
+		size_t pos = view.rfind(';');
+		lines[pos == std::string_view::npos ? view : view.substr(pos + 1)] += time;
+	}
+
+	using std::chrono::duration_cast;
+	stats.script = duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(script));
+	stats.tlo = duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(tlo));
+	stats.imgui = duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(imgui));
+
+	std::vector<std::pair<std::string_view, uint64_t>> sorted(lines.begin(), lines.end());
+	const size_t count = std::min(topLines, sorted.size());
+	std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end(),
+		[](const auto& a, const auto& b) { return a.second > b.second; });
+
+	stats.topLines.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		stats.topLines.emplace_back(std::string(sorted[i].first),
+			duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(sorted[i].second)));
+	}
+
+	return stats;
+}
+
+bool LuaProfiler::Dump(const std::filesystem::path& file) const
+{
+	std::ofstream out(file, std::ios::trunc);
+	if (!out)
+		return false;
+
+	for (const auto& [stack, time] : m_stacks)
+	{
+		const uint64_t microseconds = time / 1000;
+		if (microseconds > 0)
+			out << stack << ' ' << microseconds << '\n';
+	}
+
+	return out.good();
+}
+
+//============================================================================
+
+LuaProfiler::ScopedActivation::ScopedActivation(LuaProfiler* profiler, lua_State* L, const char* category)
+	: m_L(L)
+{
+	if (profiler != nullptr && profiler->IsRunning())
+	{
+		m_profiler = profiler;
+		m_profiler->Activate(category);
+	}
+}
+
+LuaProfiler::ScopedActivation::~ScopedActivation()
+{
+	if (m_profiler != nullptr)
+		m_profiler->Deactivate(m_L);
+}
+
+LuaProfiler::ScopedBinding::ScopedBinding(Binding binding)
+	: m_profiler(s_active)
+	, m_binding(binding)
+{
+	if (m_profiler != nullptr && m_profiler->m_bindingDepth++ == 0)
+		m_start = std::chrono::steady_clock::now();
+}
+
+LuaProfiler::ScopedBinding::~ScopedBinding()
+{
+	// a binding that calls another one is charged as a whole to the outer one
+	if (m_profiler != nullptr && --m_profiler->m_bindingDepth == 0)
+		m_profiler->m_pendingBinding[static_cast<size_t>(m_binding)] += std::chrono::steady_clock::now() - m_start;
+}
+
+// calls the binding in upvalue 1 with all of the arguments, measured as the kind of binding in upvalue 2
+static int lua_measuredBinding(lua_State* L)
+{
+	LuaProfiler::ScopedBinding profile(static_cast<LuaProfiler::Binding>(lua_tointeger(L, lua_upvalueindex(2))));
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+
+	return lua_gettop(L);
+}
+
+/*static*/ void LuaProfiler::WrapBindings(sol::table table, Binding binding)
+{
+	lua_State* L = table.lua_state();
+
+	// collected first, so the table isn't changed while sol iterates over it
+	std::vector<std::pair<sol::object, sol::object>> functions;
+	for (const auto& [key, value] : table)
+	{
+		if (value.get_type() == sol::type::function)
+			functions.emplace_back(key, value);
+	}
+
+	table.push(L);
+	for (const auto& [key, function] : functions)
+	{
+		key.push(L);
+		function.push(L);
+		lua_pushinteger(L, static_cast<lua_Integer>(binding));
+		lua_pushcclosure(L, &lua_measuredBinding, 2);
+		lua_rawset(L, -3);
+	}
+	lua_pop(L, 1);
+}
+
+} // namespace mq::lua
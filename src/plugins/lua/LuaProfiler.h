@@ -0,0 +1,157 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "LuaCommon.h"
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mq::lua {
+
+/**
+ * Sampling profiler for a single script. While a profiled script runs, its debug hook fires every few instructions
+ * and the profiler records the lua call stack, weighted by the time the script ran since the last sample. Stacks
+ * are aggregated by function and line and written out as collapsed stacks that flamegraph tools understand.
+ *
+ * Time spent in TLO and ImGui bindings is measured directly and shows up as a [TLO] or [ImGui] frame under the line
+ * that called it. ImGui callbacks are recorded under an [ImGui callbacks] frame, separate from the script's main loop.
+ */
+class LuaProfiler
+{
+public:
+	// how often the debug hook fires while profiling, in vm instructions
+	static constexpr int HOOK_INSTRUCTIONS = 100;
+
+	// the least amount of running time that each sample covers
+	static constexpr std::chrono::microseconds SAMPLE_INTERVAL{ 250 };
+
+	explicit LuaProfiler(std::string name);
+
+	void Start();
+	void Stop();
+	bool IsRunning() const { return m_running; }
+
+	/**
+	 * Writes the collapsed stacks to a file, one line per stack with the frames separated by semicolons and the
+	 * time spent in microseconds.
+	 */
+	bool Dump(const std::filesystem::path& file) const;
+
+	// each kind of binding has a frame of its own
+	enum class Binding
+	{
+		TLO,
+		ImGui,
+		Count
+	};
+
+	// the time is split up by where it was spent, so the parts add up to the total
+	struct Stats
+	{
+		uint64_t samples = 0;
+		std::chrono::microseconds script{ 0 };   // running lua code, including ImGui callbacks
+		std::chrono::microseconds tlo{ 0 };      // in TLO bindings
+		std::chrono::microseconds imgui{ 0 };    // in ImGui bindings
+
+		// the lines that spent the most time themselves, most expensive first
+		std::vector<std::pair<std::string, std::chrono::microseconds>> topLines;
+	};
+	Stats GetStats(size_t topLines) const;
+
+	// the hook fires more often while profiling, this keeps the turbo count intact. Returns the hook count to use.
+	int SetYieldCount(int count);
+
+	// called from the turbo hook, true once the turbo count is used up and the script should yield
+	bool CountInstructions();
+
+	// records a sample if enough time has passed, called from the debug hook
+	void Sample(lua_State* L);
+
+	// hook for code that must not yield, it only samples
+	static void lua_sampleHook(lua_State* L, lua_Debug* D);
+
+	// the profiler of the script that is running right now, only set while it is being profiled
+	static LuaProfiler* GetActive() { return s_active; }
+
+	// makes a profiler the active one for a scope. Does nothing with a null or stopped profiler. L is the coroutine
+	// whose stack gets the time left over at the end of the scope, if it still has one.
+	class ScopedActivation
+	{
+	public:
+		ScopedActivation(LuaProfiler* profiler, lua_State* L, const char* category = nullptr);
+		~ScopedActivation();
+
+		ScopedActivation(const ScopedActivation&) = delete;
+		ScopedActivation& operator=(const ScopedActivation&) = delete;
+
+	private:
+		LuaProfiler* m_profiler = nullptr;
+		lua_State* m_L = nullptr;
+	};
+
+	// measures time spent in a binding, put it at the entry points of the bindings that are attributed separately
+	class ScopedBinding
+	{
+	public:
+		explicit ScopedBinding(Binding binding = Binding::TLO);
+		~ScopedBinding();
+
+		ScopedBinding(const ScopedBinding&) = delete;
+		ScopedBinding& operator=(const ScopedBinding&) = delete;
+
+	private:
+		LuaProfiler* m_profiler = nullptr;
+		Binding m_binding;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	// replaces the functions in a table of bindings with ones that measure their time. Used for bindings that have no
+	// entry point of their own, and only for scripts that are profiled so that the others don't pay for it.
+	static void WrapBindings(sol::table table, Binding binding);
+
+private:
+	void Activate(const char* category);
+	void Deactivate(lua_State* L);
+	void Record(std::chrono::nanoseconds elapsed);
+	void BuildStack(lua_State* L);
+
+	static LuaProfiler* s_active;
+
+	std::string m_name;
+	bool m_running = false;
+	uint64_t m_samples = 0;
+
+	// collapsed stack -> nanoseconds
+	std::unordered_map<std::string, uint64_t> m_stacks;
+
+	// state of the current activation
+	std::string m_root;
+	std::string m_stack;
+	std::chrono::steady_clock::time_point m_last;
+	std::chrono::nanoseconds m_pending{ 0 };
+	std::array<std::chrono::nanoseconds, static_cast<size_t>(Binding::Count)> m_pendingBinding{};
+	int m_bindingDepth = 0;
+
+	int m_hookInstructions = HOOK_INSTRUCTIONS;
+	int m_yieldInstructions = 0;
+	int m_instructionsLeft = 0;
+};
+
+} // namespace mq::lua
@@ -14,6 +14,8 @@
 
 #include "pch.h"
 #include "LuaThread.h"
+#include "LuaBytecodeCache.h"
+#include "LuaProfiler.h"
 #include "LuaCoroutine.h"
 #include "LuaEvent.h"
 #include "LuaImGui.h"
@@ -29,6 +31,7 @@
 #include <lauxlib.h>
 #include <luajit.h>
 #include <chrono>
+#include <limits>
 #include <fmt/format.h>
 
 #if _M_AMD64
@@ -85,6 +88,9 @@ static uint32_t NextID()
 	return ++current;
 }
 
+// when the running thread has a time slice, this is when it runs out. Only one thread runs at a time.
+static std::chrono::steady_clock::time_point s_sliceDeadline;
+
 std::shared_ptr<mq::lua::LuaThread> GetLuaThreadByPID(int pid);
 void OnLuaThreadDestroyed(LuaThread* thread);
 void OnLuaTLORemoved(MQTopLevelObject* tlo, int pidOwner);
@@ -388,6 +394,15 @@ void LuaThread::Initialize()
 	bindings::RegisterBindings_Bit32(m_globalState);
 
 	m_globalState.add_package_loader(LuaThread::lua_PackageLoader);
+
+	// lua files are loaded through the bytecode cache, so this goes ahead of the standard lua file loader
+	sol::table package = m_globalState["package"];
+	sol::optional<sol::table> loaders = package.get<sol::optional<sol::table>>("searchers");
+	if (!loaders)
+		loaders = package.get<sol::optional<sol::table>>("loaders");
+
+	if (loaders)
+		m_globalState["table"]["insert"](*loaders, 2, &LuaThread::lua_FileLoader);
 }
 
 void LuaThread::EnableImGui()
@@ -418,6 +433,7 @@ void LuaThread::Exit(LuaThreadExitReason reason)
 
 	m_exitReason = reason;
 	YieldAt(0);
+	Wake();
 
 	OnLuaThreadDestroyed(this);
 	m_coroutine->thread.abandon();
@@ -551,6 +567,33 @@ int LuaThread::PackageLoader(const std::string& pkg, lua_State* L)
 	return 0;
 }
 
+// Finds a module on package.path like the standard lua file loader, but loads it through the bytecode cache
+/*static*/ int LuaThread::lua_FileLoader(lua_State* L)
+{
+	const char* name = luaL_checkstring(L, 1);
+
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchpath");
+	if (!lua_isfunction(L, -1))
+		return 0;
+
+	lua_pushstring(L, name);
+	lua_getfield(L, -3, "path");
+	lua_call(L, 2, 1);
+
+	// not found, the standard loader will list the paths that were searched
+	if (!lua_isstring(L, -1))
+		return 0;
+
+	std::string path = lua_tostring(L, -1);
+	if (GetLuaBytecodeCache().LoadFile(L, path) != 0)
+	{
+		return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, path.c_str(), lua_tostring(L, -1));
+	}
+
+	return 1;
+}
+
 //============================================================================
 //============================================================================
 
@@ -605,7 +648,10 @@ std::optional<LuaThreadInfo> LuaThread::StartFile(
 	m_name = locationInfo.canonicalName;
 	m_path = locationInfo.fullPath;
 
-	auto co = m_coroutine->thread.state().load_file(m_path);
+	lua_State* L = m_coroutine->thread.state();
+	int status = GetLuaBytecodeCache().LoadFile(L, m_path);
+
+	sol::load_result co(L, sol::absolute_index(L, -1), 1, 1, static_cast<sol::load_status>(status));
 	if (!co.valid())
 	{
 		sol::error err = co;
@@ -706,12 +752,52 @@ LuaThread::RunResult LuaThread::Run()
 {
 	if (m_coroutine->coroutine.status() == sol::call_status::yielded)
 	{
-		return RunOnce();
+		auto start = std::chrono::steady_clock::now();
+
+		// the hook checks this deadline, it only applies while this thread is running
+		s_sliceDeadline = m_timeSlice.count() > 0 ? start + m_timeSlice : std::chrono::steady_clock::time_point{};
+		RunResult result;
+		{
+			LuaProfiler::ScopedActivation profile(m_profiler.get(), m_coroutine->thread.state());
+			result = RunOnce();
+		}
+		s_sliceDeadline = {};
+
+		AddRunTime(start, std::chrono::steady_clock::now());
+		return result;
 	}
 
 	return { static_cast<sol::thread_status>(m_coroutine->coroutine.status()), std::nullopt };
 }
 
+std::chrono::microseconds LuaThread::GetRunTimeLastSecond() const
+{
+	// a script that has been parked for a while hasn't rolled its numbers over
+	auto elapsed = std::chrono::steady_clock::now() - m_secondStart;
+	if (elapsed >= std::chrono::seconds(2))
+		return std::chrono::microseconds{ 0 };
+
+	if (elapsed >= std::chrono::seconds(1))
+		return m_runTimeThisSecond;
+
+	return m_runTimeLastSecond;
+}
+
+void LuaThread::AddRunTime(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	m_lastRunTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+	m_totalRunTime += m_lastRunTime;
+
+	if (end - m_secondStart >= std::chrono::seconds(1))
+	{
+		m_runTimeLastSecond = m_runTimeThisSecond;
+		m_runTimeThisSecond = std::chrono::microseconds{ 0 };
+		m_secondStart = end;
+	}
+
+	m_runTimeThisSecond += m_lastRunTime;
+}
+
 sol::thread_status LuaThread::GetThreadStatus() const
 {
 	if (!m_coroutine->thread.valid())
@@ -777,6 +863,8 @@ LuaThread::RunResult LuaThread::RunOnce()
 
 LuaThreadStatus LuaThread::Pause()
 {
+	Wake();
+
 	if (m_paused)
 	{
 		YieldAt(m_turboNum);
@@ -796,6 +884,32 @@ LuaThreadStatus LuaThread::Pause()
 	return LuaThreadStatus::Paused;
 }
 
+void LuaThread::Park(uint64_t now, uint64_t conditionInterval)
+{
+	m_wakeTime = 0;
+
+	// binds and events that are still running are their own coroutines, keep running them every frame
+	if (m_eventProcessor && m_eventProcessor->HasPendingWork())
+		return;
+
+	if (m_paused)
+	{
+		// nothing runs until the script is resumed, which wakes it
+		m_wakeTime = std::numeric_limits<uint64_t>::max();
+		return;
+	}
+
+	// a script that ran out of instructions (or yielded without a delay) continues next frame
+	if (m_coroutine->m_delayTime <= now)
+		return;
+
+	m_wakeTime = m_coroutine->m_delayTime;
+
+	// conditions can change at any time, so check them periodically instead of every frame
+	if (m_coroutine->m_delayCondition)
+		m_wakeTime = std::min(m_wakeTime, now + conditionInterval);
+}
+
 void LuaThread::SetAllowYield(bool allowYield, YieldDisabledReason reason)
 {
 	m_allowYield = allowYield;
@@ -805,6 +919,25 @@ void LuaThread::SetAllowYield(bool allowYield, YieldDisabledReason reason)
 // this is the special sauce that lets us execute everything on the main thread without blocking
 /*static*/ void LuaThread::lua_forceYield(lua_State* L, lua_Debug* D)
 {
+	if (D->event == LUA_HOOKCOUNT)
+	{
+		if (LuaProfiler* profiler = LuaProfiler::GetActive())
+		{
+			profiler->Sample(L);
+
+			// the hook fires more often while profiling, only go on once the turbo count is used up
+			if (!profiler->CountInstructions())
+				return;
+		}
+	}
+
+	// with a time budget the turbo count only says when to check the time, so keep going if the slice isn't used up
+	if (D->event == LUA_HOOKCOUNT && s_sliceDeadline != std::chrono::steady_clock::time_point{}
+		&& std::chrono::steady_clock::now() < s_sliceDeadline)
+	{
+		return;
+	}
+
 	if (lua_isyieldable(L))
 	{
 		if (std::shared_ptr<LuaThread> thread_ptr = get_from(L))
@@ -825,8 +958,26 @@ void LuaThread::YieldAt(int count) const
 {
 	if (m_allowYield)
 	{
-		lua_sethook(m_coroutine->thread.state(), &LuaThread::lua_forceYield, count == 0 ? LUA_MASKLINE : LUA_MASKCOUNT, count);
+		int hookCount = count;
+		if (count > 0 && m_profiler && m_profiler->IsRunning())
+			hookCount = m_profiler->SetYieldCount(count);
+
+		lua_sethook(m_coroutine->thread.state(), &LuaThread::lua_forceYield, count == 0 ? LUA_MASKLINE : LUA_MASKCOUNT, hookCount);
+	}
+}
+
+LuaProfiler& LuaThread::StartProfiler()
+{
+	if (!m_profiler)
+	{
+		m_profiler = std::make_unique<LuaProfiler>(m_name);
+
+		// ImGui is only registered when a script asks for it, after this it measures itself
+		bindings::ProfileBindings_ImGui(m_globalState);
 	}
+
+	m_profiler->Start();
+	return *m_profiler;
 }
 
 //============================================================================
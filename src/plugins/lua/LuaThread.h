@@ -23,6 +23,7 @@
 
 #include <sol/sol.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <stack>
 
@@ -39,6 +40,7 @@ namespace mq::lua {
 
 class LuaEventProcessor;
 class LuaImGuiProcessor;
+class LuaProfiler;
 class LuaActors;
 class LuaThread;
 struct LuaCoroutine;
@@ -60,6 +62,11 @@ enum class LuaThreadExitReason
 	DependencyRemoved = 2,
 };
 
+// weights used to split the lua time budget between scripts, see LuaThread::SetTimeSlice
+constexpr uint32_t LUA_PRIORITY_MIN = 1;
+constexpr uint32_t LUA_PRIORITY_DEFAULT = 5;
+constexpr uint32_t LUA_PRIORITY_MAX = 10;
+
 enum class YieldDisabledReason
 {
 	Default,
@@ -130,6 +137,17 @@ public:
 
 	void InjectMQNamespace();
 	void SetTurbo(uint32_t turboVal) { m_turboNum = turboVal; }
+
+	// When a time slice is set, the turbo hook only yields once the slice is used up, turbo is then just how often
+	// the time is checked. A zero slice yields every turbo instructions.
+	void SetTimeSlice(std::chrono::microseconds slice) { m_timeSlice = slice; }
+	uint32_t GetPriority() const { return m_priority; }
+	void SetPriority(uint32_t priority) { m_priority = std::clamp(priority, LUA_PRIORITY_MIN, LUA_PRIORITY_MAX); }
+
+	// time spent running this script
+	std::chrono::microseconds GetLastRunTime() const { return m_lastRunTime; }
+	std::chrono::microseconds GetTotalRunTime() const { return m_totalRunTime; }
+	std::chrono::microseconds GetRunTimeLastSecond() const;
 	void SetEvaluateResult(bool evaluate) { m_evaluateResult = evaluate; }
 	bool GetEvaluateResult() const { return m_evaluateResult; }
 
@@ -149,6 +167,11 @@ public:
 
 	LuaThreadStatus Pause();
 
+	// Scripts waiting in mq.delay are parked and skipped by the pulse until they are due or woken
+	bool IsParked(uint64_t now) const { return m_wakeTime > now; }
+	void Park(uint64_t now, uint64_t conditionInterval);
+	void Wake() { m_wakeTime = 0; }
+
 	void SetAllowYield(bool allowYield, YieldDisabledReason reason = YieldDisabledReason::Default);
 
 	bool GetAllowYield() const { return m_allowYield; }
@@ -164,6 +187,10 @@ public:
 	LuaImGuiProcessor* GetImGuiProcessor() const { return m_imguiProcessor.get(); }
 	LuaEventProcessor* GetEventProcessor() const { return m_eventProcessor.get(); }
 
+	// the sampling profiler is created the first time the script is profiled, and keeps its samples after it stops
+	LuaProfiler* GetProfiler() const { return m_profiler.get(); }
+	LuaProfiler& StartProfiler();
+
 	const std::string& GetLuaDir() const { return m_luaEnvironmentSettings->luaDir; }
 	const std::string& GetModuleDir() const { return m_luaEnvironmentSettings->moduleDir; }
 
@@ -201,6 +228,7 @@ public:
 
 private:
 	RunResult RunOnce();
+	void AddRunTime(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
 
 	sol::table RegisterMQNamespace(sol::this_state L);
 	void Initialize();
@@ -210,6 +238,7 @@ private:
 	int PackageLoader(const std::string& pkg, lua_State* L);
 
 	static int lua_PackageLoader(lua_State* L);
+	static int lua_FileLoader(lua_State* L);
 	static void lua_forceYield(lua_State* L, lua_Debug* D);
 
 private:
@@ -226,7 +255,15 @@ private:
 	std::string m_path;
 	uint32_t m_pid = 0;
 	uint32_t m_turboNum = 500;
+	uint32_t m_priority = LUA_PRIORITY_DEFAULT;
+	std::chrono::microseconds m_timeSlice{ 0 };
+	std::chrono::microseconds m_lastRunTime{ 0 };
+	std::chrono::microseconds m_totalRunTime{ 0 };
+	std::chrono::microseconds m_runTimeThisSecond{ 0 };
+	std::chrono::microseconds m_runTimeLastSecond{ 0 };
+	std::chrono::steady_clock::time_point m_secondStart;
 	bool m_yieldToFrame = false;
+	uint64_t m_wakeTime = 0;
 	bool m_isString = false;
 	bool m_paused = false;
 	bool m_evaluateResult = false;
@@ -238,6 +275,7 @@ private:
 
 	std::unique_ptr<LuaEventProcessor> m_eventProcessor;
 	std::unique_ptr<LuaImGuiProcessor> m_imguiProcessor;
+	std::unique_ptr<LuaProfiler> m_profiler;
 	LuaCoroutine* m_currentCoroutine = nullptr;
 
 	// datatypes
@@ -19,8 +19,10 @@
 #include "LuaThread.h"
 #include "LuaEvent.h"
 #include "LuaActor.h"
+#include "LuaBytecodeCache.h"
 #include "LuaImGui.h"
 #include "LuaModuleRegistry.h"
+#include "LuaProfiler.h"
 #include "bindings/lua_Bindings.h"
 #include "bindings/lua_MQBindings.h"
 #include "imgui/ImGuiUtils.h"
@@ -50,6 +52,8 @@ namespace mq::lua {
 
 // provide option strings here
 static const std::string KEY_TURBO_NUM = "turboNum";
+static const std::string KEY_CONDITION_INTERVAL = "conditionInterval";
+static const std::string KEY_TIME_BUDGET = "timeBudget";
 static const std::string KEY_LUA_DIR = "luaDir";
 static const std::string KEY_MODULE_DIR = "moduleDir";
 static const std::string KEY_LUA_REQUIRE_PATHS = "luaRequirePaths";
@@ -57,18 +61,23 @@ static const std::string KEY_DLL_REQUIRE_PATHS = "dllRequirePaths";
 static const std::string KEY_INFO_GC = "infoGC";
 static const std::string KEY_SQUELCH_STATUS = "squelchStatus";
 static const std::string KEY_SHOW_MENU = "showMenu";
+static const std::string KEY_PERSIST_BYTECODE = "persistBytecode";
 
 // configurable options, defaults provided where needed
 static uint32_t s_turboNum = 500;
+static uint32_t s_conditionInterval = 50; // ms between checks of an mq.delay condition
+static uint32_t s_timeBudget = 0; // ms of lua per frame shared by all scripts, 0 to only use turbo
 static std::string s_luaDirName = "lua";
 static std::string s_moduleDirName = "modules";
 static LuaEnvironmentSettings s_environment;
 static std::chrono::milliseconds s_infoGC = 3600s; // 1 hour
 static bool s_squelchStatus = false;
+static bool s_persistBytecode = false;
 bool g_verboseErrors = true;
 
 // this is static and will never change
 static std::string s_configPath = (std::filesystem::path(gPathConfig) / "MQ2Lua.yaml").string();
+static std::filesystem::path s_bytecodeCachePath = std::filesystem::path(gPathResources) / "MQ2Lua.bytecode";
 static YAML::Node s_configNode;
 
 // this is for the imgui menu display
@@ -953,6 +962,9 @@ static void ReadSettings()
 		}
 	}
 
+	s_conditionInterval = s_configNode[KEY_CONDITION_INTERVAL].as<uint32_t>(s_conditionInterval);
+	s_timeBudget = s_configNode[KEY_TIME_BUDGET].as<uint32_t>(s_timeBudget);
+
 	g_verboseErrors = s_configNode["verboseErrors"].as<bool>(false);
 
 	std::string tempDirName = s_luaDirName;
@@ -1022,6 +1034,7 @@ static void ReadSettings()
 	}
 
 	s_squelchStatus = s_configNode[KEY_SQUELCH_STATUS].as<bool>(s_squelchStatus);
+	s_persistBytecode = s_configNode[KEY_PERSIST_BYTECODE].as<bool>(s_persistBytecode);
 	s_showMenu = s_configNode[KEY_SHOW_MENU].as<bool>(s_showMenu);
 }
 
@@ -1167,6 +1180,91 @@ static void LuaInfoCommand(const std::optional<std::string>& script = std::nullo
 	}
 }
 
+static void WriteProfileSummary(const LuaThread& thread, const LuaProfiler& profiler)
+{
+	LuaProfiler::Stats stats = profiler.GetStats(5);
+
+	WriteChatStatus("Profile of lua script '%s' with PID %d: %llu samples, script %.1f ms, TLO %.1f ms, ImGui %.1f ms",
+		thread.GetName().c_str(), thread.GetPID(), stats.samples, stats.script.count() / 1000.0,
+		stats.tlo.count() / 1000.0, stats.imgui.count() / 1000.0);
+
+	for (const auto& [line, time] : stats.topLines)
+	{
+		WriteChatStatus("  %8.1f ms  %s", time.count() / 1000.0, line.c_str());
+	}
+}
+
+static void LuaProfileCommand(const std::string& scriptName, const std::string& action, const std::optional<std::string>& file)
+{
+	uint32_t pid = GetIntFromString(scriptName, 0UL);
+
+	auto script_iter = std::ranges::find_if(s_globalState->runningScripts,
+		[&](const RunningScript& script)
+		{
+			return !script.dead && (pid > 0UL ? script.pid == pid : ci_equals(script.name, scriptName));
+		});
+
+	if (script_iter == s_globalState->runningScripts.end())
+	{
+		WriteChatStatus("No lua script '%s' running", scriptName.c_str());
+		return;
+	}
+
+	const std::shared_ptr<LuaThread>& thread = script_iter->mainThread;
+
+	if (ci_equals(action, "start"))
+	{
+		thread->StartProfiler();
+		WriteChatStatus("Profiling lua script '%s' with PID %d", thread->GetName().c_str(), thread->GetPID());
+		return;
+	}
+
+	LuaProfiler* profiler = thread->GetProfiler();
+	if (!ci_equals(action, "stop") && !ci_equals(action, "dump"))
+	{
+		WriteChatStatus("Unknown profile action '%s', expected start, stop or dump", action.c_str());
+		return;
+	}
+
+	if (profiler == nullptr)
+	{
+		WriteChatStatus("Lua script '%s' with PID %d hasn't been profiled", thread->GetName().c_str(), thread->GetPID());
+		return;
+	}
+
+	if (ci_equals(action, "stop"))
+	{
+		profiler->Stop();
+		WriteProfileSummary(*thread, *profiler);
+		return;
+	}
+
+	std::filesystem::path path;
+	if (file)
+	{
+		path = *file;
+		if (path.is_relative())
+			path = std::filesystem::path(gPathLogs) / path;
+	}
+	else
+	{
+		std::string name = thread->GetName();
+		std::replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == '\\' || c == ':'; }, '_');
+
+		path = std::filesystem::path(gPathLogs) / fmt::format("lua-profile-{}-{}.folded", name, thread->GetPID());
+	}
+
+	if (profiler->Dump(path))
+	{
+		WriteProfileSummary(*thread, *profiler);
+		WriteChatStatus("Wrote lua profile to %s", path.string().c_str());
+	}
+	else
+	{
+		LuaError("Failed to write lua profile to %s", path.string().c_str());
+	}
+}
+
 static void LuaGuiCommand()
 {
 	s_showMenu = !s_showMenu;
@@ -1286,6 +1384,20 @@ void LuaCommand(SPAWNINFO* pChar, char* Buffer)
 			else LuaInfoCommand();
 		});
 
+	args::Command profile(commands, "profile", "sample the call stacks of a running lua script, dump writes collapsed stacks for flamegraph tools",
+		[](args::Subparser& parser)
+		{
+			args::Group arguments(parser, "", args::Group::Validators::DontCare);
+			args::Positional<std::string> script(arguments, "process", "PID or name of the script to profile");
+			args::Positional<std::string> action(arguments, "action", "start, stop or dump");
+			args::Positional<std::string> file(arguments, "file", "optional file for dump, relative to the logs folder. Defaults to lua-profile-<name>-<pid>.folded");
+			auto h = HelpFlag(parser);
+			parser.Parse();
+
+			if (script && action) LuaProfileCommand(script.Get(), action.Get(), file ? std::make_optional(file.Get()) : std::nullopt);
+			else WriteChatStatus("Usage: /lua profile <process> start|stop|dump [file]");
+		});
+
 	args::Command gui(commands, "gui", "toggle the lua GUI",
 		[](args::Subparser& parser)
 		{
@@ -1633,6 +1745,22 @@ static void DrawLuaSettings()
 		s_configNode["verboseErrors"] = g_verboseErrors;
 	}
 
+	bool persistBytecode = s_configNode[KEY_PERSIST_BYTECODE].as<bool>(s_persistBytecode);
+	if (ImGui::Checkbox("Save Compiled Scripts Between Sessions", &persistBytecode))
+	{
+		s_persistBytecode = persistBytecode;
+		s_configNode[KEY_PERSIST_BYTECODE] = s_persistBytecode;
+	}
+
+	LuaBytecodeCache::Stats bytecodeStats = GetLuaBytecodeCache().GetStats();
+	ImGui::Text("Compiled scripts: %d (%.1f KB), %llu loaded from cache, %llu compiled", static_cast<int>(bytecodeStats.files),
+		bytecodeStats.bytes / 1024.f, bytecodeStats.hits, bytecodeStats.misses);
+	ImGui::SameLine();
+	if (ImGui::SmallButton("Clear"))
+	{
+		GetLuaBytecodeCache().Clear();
+	}
+
 	ImGui::NewLine();
 
 	ImGui::Text("Turbo Num:");
@@ -1644,6 +1772,25 @@ static void DrawLuaSettings()
 		s_configNode[KEY_TURBO_NUM] = s_turboNum;
 	}
 
+	ImGui::Text("Delay Condition Interval:");
+	uint32_t interval_selected = s_configNode[KEY_CONDITION_INTERVAL].as<uint32_t>(s_conditionInterval), interval_min = 0U, interval_max = 1000U;
+	ImGui::SetNextItemWidth(-1.0f);
+	if (ImGui::SliderScalar("##conditionIntervalslider", ImGuiDataType_U32, &interval_selected, &interval_min, &interval_max, "%u ms between mq.delay condition checks", ImGuiSliderFlags_None))
+	{
+		s_conditionInterval = interval_selected;
+		s_configNode[KEY_CONDITION_INTERVAL] = s_conditionInterval;
+	}
+
+	ImGui::Text("Time Budget:");
+	uint32_t budget_selected = s_configNode[KEY_TIME_BUDGET].as<uint32_t>(s_timeBudget), budget_min = 0U, budget_max = 20U;
+	ImGui::SetNextItemWidth(-1.0f);
+	if (ImGui::SliderScalar("##timeBudgetslider", ImGuiDataType_U32, &budget_selected, &budget_min, &budget_max,
+		budget_selected == 0 ? "Off (Turbo Num only)" : "%u ms per Frame for all Scripts", ImGuiSliderFlags_None))
+	{
+		s_timeBudget = budget_selected;
+		s_configNode[KEY_TIME_BUDGET] = s_timeBudget;
+	}
+
 
 	ImGui::Text("Lua Directory:");
 	auto dirDisplay = s_configNode[KEY_LUA_DIR].as<std::string>(s_luaDirName);
@@ -1904,6 +2051,11 @@ PLUGIN_API void InitializePlugin()
 
 	ReadSettings();
 
+	if (s_persistBytecode)
+	{
+		GetLuaBytecodeCache().Load(s_bytecodeCachePath);
+	}
+
 	AddCommand("/lua", LuaCommand);
 
 	pLuaInfoType = new MQ2LuaInfoType;
@@ -1927,7 +2079,10 @@ PLUGIN_API void ShutdownPlugin()
 
 	LuaActors::Stop();
 
-	bindings::ShutdownBindings_MQMacroData();
+	if (s_persistBytecode && GetLuaBytecodeCache().IsDirty())
+	{
+		GetLuaBytecodeCache().Save(s_bytecodeCachePath);
+	}
 
 	RemoveCommand("/lua");
 
@@ -1947,6 +2102,9 @@ PLUGIN_API void ShutdownPlugin()
 
 	delete s_globalState;
 	s_globalState = nullptr;
+
+	// closing the scripts can still run lua code, so the bindings go after them
+	bindings::ShutdownBindings_MQMacroData();
 }
 
 PLUGIN_API void OnPulse()
@@ -1967,6 +2125,24 @@ PLUGIN_API void OnPulse()
 		s_globalState->pendingScripts.clear();
 	}
 
+	// Scripts waiting in mq.delay are parked until they are due. With a few dozen scripts a single comparison each
+	// is cheaper than keeping them in a timer queue, and anything that wakes a script just clears its wake time.
+	const uint64_t now = MQGetTickCount64();
+
+	// The time budget is split between the scripts that run this frame by priority, and whatever a script doesn't
+	// use is left for the ones after it. Once it is used up, scripts still get their turbo instructions.
+	std::chrono::microseconds budgetLeft = std::chrono::milliseconds{ s_timeBudget };
+	uint32_t priorityLeft = 0;
+
+	if (budgetLeft.count() > 0)
+	{
+		for (const RunningScript& script : s_globalState->runningScripts)
+		{
+			if (!script.dead && script.mainThread != nullptr && !script.mainThread->IsParked(now))
+				priorityLeft += script.mainThread->GetPriority();
+		}
+	}
+
 	bool hasDeadScripts = false;
 	for (RunningScript& script : s_globalState->runningScripts)
 	{
@@ -1977,7 +2153,22 @@ PLUGIN_API void OnPulse()
 		}
 
 		const std::shared_ptr<LuaThread>& thread = script.mainThread;
+		if (thread->IsParked(now))
+			continue;
+
+		if (priorityLeft > 0)
+		{
+			const uint32_t priority = std::min(thread->GetPriority(), priorityLeft);
+			thread->SetTimeSlice(budgetLeft * priority / priorityLeft);
+			priorityLeft -= priority;
+		}
+		else
+		{
+			thread->SetTimeSlice(std::chrono::microseconds{ 0 });
+		}
+
 		LuaThread::RunResult result = thread->Run();
+		budgetLeft = std::max(budgetLeft - thread->GetLastRunTime(), std::chrono::microseconds{ 0 });
 
 		if (result.first != sol::thread_status::yielded)
 		{
@@ -1986,6 +2177,10 @@ PLUGIN_API void OnPulse()
 			hasDeadScripts = true;
 			script.dead = true;
 		}
+		else
+		{
+			thread->Park(now, s_conditionInterval);
+		}
 	}
 
 	if (hasDeadScripts)
@@ -2236,6 +2431,22 @@ PLUGIN_API void OnUpdateImGui()
 			std::string_view status = info.status_string();
 			ImGui::LabelText("Status", "%.*s", status.size(), status.data());
 
+			if (info.status != LuaThreadStatus::Exited)
+			{
+				if (std::shared_ptr<LuaThread> thread = GetLuaThreadByPID(info.pid))
+				{
+					using fmilliseconds = std::chrono::duration<float, std::milli>;
+					const float lastSecond = std::chrono::duration_cast<fmilliseconds>(thread->GetRunTimeLastSecond()).count();
+
+					ImGui::LabelText("CPU Time", "%.1f s", std::chrono::duration_cast<std::chrono::duration<float>>(thread->GetTotalRunTime()).count());
+					ImGui::LabelText("Last Second", "%.2f ms (%.1f%%)", lastSecond, lastSecond / 10.f);
+
+					int priority = static_cast<int>(thread->GetPriority());
+					if (ImGui::SliderInt("Priority", &priority, static_cast<int>(LUA_PRIORITY_MIN), static_cast<int>(LUA_PRIORITY_MAX)))
+						thread->SetPriority(static_cast<uint32_t>(priority));
+				}
+			}
+
 			if (!info.returnValues.empty())
 			{
 				ImGui::LabelText("Return Values", "%s", join(info.returnValues, ", ").c_str());
@@ -2399,40 +2610,12 @@ PLUGIN_API void OnUpdateImGui()
 
 PLUGIN_API void OnWriteChatColor(const char* Line, int Color, int Filter)
 {
-	using namespace mq::lua;
-
-	for (RunningScript& script : s_globalState->runningScripts)
-	{
-		if (script.dead)
-			continue;
-
-		const std::shared_ptr<LuaThread>& thread = script.mainThread;
-
-		if (!thread->IsPaused())
-		{
-			if (LuaEventProcessor* events = thread->GetEventProcessor())
-				events->Process(Line);
-		}
-	}
+	mq::lua::LuaEventMatcher::Get().Process(Line);
 }
 
 PLUGIN_API bool OnIncomingChat(const char* Line, DWORD Color)
 {
-	using namespace mq::lua;
-
-	for (RunningScript& script : s_globalState->runningScripts)
-	{
-		if (script.dead)
-			continue;
-
-		const std::shared_ptr<LuaThread>& thread = script.mainThread;
-
-		if (!thread->IsPaused())
-		{
-			if (LuaEventProcessor* events = thread->GetEventProcessor())
-				events->Process(Line);
-		}
-	}
+	mq::lua::LuaEventMatcher::Get().Process(Line);
 
 	return false;
 }
@@ -2468,4 +2651,6 @@ PLUGIN_API void OnUnloadPlugin(const char* pluginName)
 			script.mainThread.reset();
 		}
 	}
+
+	bindings::UnloadPluginBindings_MQMacroData();
 }
@@ -22,6 +22,7 @@ void RegisterBindings_EQ(LuaThread* thread, sol::table& mq);
 void RegisterBindings_Globals(LuaThread* thread, sol::state_view sv);
 void RegisterBindings_MQ(LuaThread* thread, sol::table& mq);
 sol::table RegisterBindings_ImGui(sol::state_view sv);
+void ProfileBindings_ImGui(sol::state_view sv); // measures the ImGui bindings once they're registered
 void RegisterBindings_Bit32(sol::state_view sv);
 
 sol::table RegisterBindings_ImAnim(sol::this_state L);
@@ -30,6 +31,7 @@ sol::table RegisterBindings_Zep(sol::this_state L);
 
 void RegisterBindings_MQMacroData(sol::table& lua);
 void InitializeBindings_MQMacroData();
+void UnloadPluginBindings_MQMacroData(); // the datatypes of a plugin are about to be removed
 void ShutdownBindings_MQMacroData();
 
 } // namespace mq::lua::bindings
@@ -14,6 +14,8 @@
 
 #include "pch.h"
 #include "lua_Bindings.h"
+#include "LuaProfiler.h"
+#include "LuaThread.h"
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_internal.h"
@@ -374,6 +376,15 @@ static unsigned int ColorConvertFloat4ToU32(const sol::table& rgba)
 }
 #pragma endregion
 
+void ProfileBindings_ImGui(sol::state_view state)
+{
+	if (!state.get_or("_imgui_registered", false) || state.get_or("_imgui_profiled", false))
+		return;
+	state["_imgui_profiled"] = true;
+
+	LuaProfiler::WrapBindings(state.get<sol::table>("ImGui"), LuaProfiler::Binding::ImGui);
+}
+
 sol::table RegisterBindings_ImGui(sol::state_view state)
 {
 	bool imguiRegistered = state.get_or("_imgui_registered", false);
@@ -1013,6 +1024,10 @@ sol::table RegisterBindings_ImGui(sol::state_view state)
 	// Helpers
 	state.set_function("ImHashStr", [](std::string_view sv, std::optional<ImGuiID> seed) { return ImHashStr(sv.data(), sv.size(), seed.value_or(0)); });
 
+	// scripts that are being profiled measure the time spent in here
+	if (const auto thread = LuaThread::get_from(state); thread && thread->GetProfiler() != nullptr)
+		ProfileBindings_ImGui(state);
+
 	return ImGui;
 }
 
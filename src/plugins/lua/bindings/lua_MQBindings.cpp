@@ -121,6 +121,20 @@ void lua_exit(sol::this_state s)
 	}
 }
 
+// gets and optionally sets the weight of this script's share of the lua time budget
+static uint32_t lua_priority(std::optional<uint32_t> priority, sol::this_state s)
+{
+	if (std::shared_ptr<LuaThread> thread_ptr = LuaThread::get_from(s))
+	{
+		if (priority)
+			thread_ptr->SetPriority(*priority);
+
+		return thread_ptr->GetPriority();
+	}
+
+	return LUA_PRIORITY_DEFAULT;
+}
+
 #pragma endregion
 
 //============================================================================
@@ -531,6 +545,7 @@ void RegisterBindings_MQ(LuaThread* thread, sol::table& mq)
 	// thread bindings
 	mq.set_function("delay",                     &lua_delay);
 	mq.set_function("exit",                      &lua_exit);
+	mq.set_function("priority",                  &lua_priority);
 
 	// event bindings
 	mq.set_function("doevents",                  &lua_doevents);
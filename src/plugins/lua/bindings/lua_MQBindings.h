@@ -64,18 +64,21 @@ public:
 	bool operator==(const lua_MQTypeVar& right) const;
 	bool EqualData(const lua_MQTopLevelObject& right) const;
 	bool EqualNil(const sol::lua_nil_t&) const;
-	MQTypeVar EvaluateMember(const char* index = nullptr) const;
-	static std::string ToString(const lua_MQTypeVar& obj);
-	sol::object Call(std::string index, sol::this_state L) const;
-	sol::object CallInt(int index, sol::this_state L) const;
-	sol::object CallVA(sol::this_state L, sol::variadic_args args) const;
+	MQTypeVar EvaluateMember(char* index = nullptr) const;
+
+	// the string is only valid until the next call
+	static const char* ToString(const lua_MQTypeVar& obj);
+
+	lua_MQTypeVar Call(std::string_view index) const;
+	lua_MQTypeVar CallInt(int index) const;
+	lua_MQTypeVar CallVA(sol::variadic_args args) const;
 	sol::object CallEmpty(sol::this_state L) const;
-	sol::object Get(sol::stack_object key, sol::this_state L) const;
+	std::optional<lua_MQTypeVar> Get(sol::stack_object key) const;
 	datatypes::MQ2Type* GetType() const;
 
 private:
 	MQTypeVar m_self;
-	std::string m_member;
+	const char* m_member = nullptr; // interned, see FindMemberName
 };
 
 //----------------------------------------------------------------------------
@@ -94,13 +97,14 @@ public:
 	bool EqualVar(const lua_MQTypeVar& right) const;
 	bool EqualNil(const sol::lua_nil_t&) const;
 
-	static std::string ToString(const lua_MQTopLevelObject& data);
+	// the string is only valid until the next call
+	static const char* ToString(const lua_MQTopLevelObject& data);
 
-	sol::object Call(const std::string& index, sol::this_state L) const;
-	sol::object CallInt(int index, sol::this_state L) const;
-	sol::object CallVA(sol::this_state L, sol::variadic_args args) const;
+	lua_MQTypeVar Call(std::string_view index) const;
+	lua_MQTypeVar CallInt(int index) const;
+	lua_MQTypeVar CallVA(sol::variadic_args args) const;
 	sol::object CallEmpty(sol::this_state L) const;
-	sol::object Get(sol::stack_object key, sol::this_state L) const;
+	std::optional<lua_MQTypeVar> Get(sol::stack_object key) const;
 
 	datatypes::MQ2Type* GetType() const;
 
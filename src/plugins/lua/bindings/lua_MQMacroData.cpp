@@ -15,11 +15,15 @@
 #include "pch.h"
 #include "lua_MQBindings.h"
 
+#include "LuaProfiler.h"
 #include "LuaThread.h"
 
 #include <mq/Plugin.h>
 #include <mq/api/MacroAPI.h>
 
+#include <charconv>
+#include <cmath>
+
 namespace mq::lua {
 
 std::tuple<const std::string&, const std::string&, int, bool> GetArgInfo(sol::function func)
@@ -150,7 +154,8 @@ static sol::object ConvertTypeVarToLua(sol::this_state L, const MQTypeVar& resul
 
 	// by default run it through the tostring conversion because we are assuming calling with empty parens means
 	// to actualize the data in the native lua space
-	char buf[MAX_STRING] = { 0 };
+	char buf[MAX_STRING];
+	buf[0] = 0;
 	if (result.Type->ToString(result.GetVarPtr(), buf))
 		return sol::object(L, sol::in_place, buf);
 
@@ -282,6 +287,97 @@ static bool CreateMacroTypeFromLua(sol::object object, MQTypeVar& Dest)
 
 #pragma region Macro Data Bindings
 
+// Member names are interned per type the first time a script uses them. A member access then only has to find the
+// name it was given here, instead of checking the type and its extensions, and every link in a chain shares the
+// interned string instead of holding its own copy. Only members that exist are remembered, because an extension
+// can add a member later. A member that goes away just evaluates to nil, like any member that fails.
+//
+// Links hold on to the strings, so they stay in the pool until shutdown. The names known for each type are
+// forgotten when the type goes away, so that a type created at the same address doesn't inherit them.
+static ci_unordered::set<std::string> s_memberNamePool;
+static std::unordered_map<MQ2Type*, ci_unordered::set<std::string_view>> s_memberNames;
+
+static const char* FindMemberName(MQ2Type* type, std::string_view name)
+{
+	ci_unordered::set<std::string_view>& names = s_memberNames[type];
+
+	auto iter = names.find(name);
+	if (iter != names.end())
+		return iter->data();
+
+	std::string member(name);
+	if (!FindMacroDataMember(type, member))
+		return nullptr;
+
+	const std::string& interned = *s_memberNamePool.emplace(std::move(member)).first;
+	return names.emplace(interned).first->data();
+}
+
+// Types are allowed to modify the index they are given, so indexes are copied into a buffer owned by the caller
+static void CopyIndex(std::string_view index, char* buffer, size_t size)
+{
+	const size_t length = std::min(index.size(), size - 1);
+	memcpy(buffer, index.data(), length);
+	buffer[length] = 0;
+}
+
+static void FormatIndex(int index, char* buffer, size_t size)
+{
+	auto [end, ec] = std::to_chars(buffer, buffer + size - 1, index);
+	*end = 0;
+}
+
+// Joins call arguments with commas like lua_join does, without building a string. Integers are formatted directly
+// instead of going through a lua string.
+static void JoinIndex(sol::variadic_args args, char* buffer, size_t size)
+{
+	size_t length = 0;
+	buffer[0] = 0;
+
+	for (const auto& arg : args)
+	{
+		lua_State* L = arg.lua_state();
+		const int stackIndex = arg.stack_index();
+
+		char number[32];
+		const char* value = nullptr;
+		size_t valueLength = 0;
+		bool pushed = false;
+
+		const bool isNumber = lua_type(L, stackIndex) == LUA_TNUMBER;
+		const lua_Number numberValue = isNumber ? lua_tonumber(L, stackIndex) : 0;
+
+		if (isNumber && std::abs(numberValue) < 1e15 && std::floor(numberValue) == numberValue)
+		{
+			auto [end, ec] = std::to_chars(number, number + lengthof(number), static_cast<int64_t>(numberValue));
+			value = number;
+			valueLength = end - number;
+		}
+		else
+		{
+			value = luaL_tolstring(L, stackIndex, &valueLength);
+			pushed = true;
+		}
+
+		if (value != nullptr && valueLength > 0)
+		{
+			if (length > 0 && length + 1 < size)
+				buffer[length++] = ',';
+
+			const size_t count = std::min(valueLength, size - length - 1);
+			memcpy(buffer + length, value, count);
+			length += count;
+			buffer[length] = 0;
+		}
+
+		if (pushed)
+			lua_pop(L, 1);
+	}
+}
+
+// tostring results are copied into lua as soon as they are returned, so one buffer is enough
+static char s_toStringBuffer[MAX_STRING];
+
 lua_MQTypeVar::lua_MQTypeVar(const std::string& str)
 {
 	auto* const type = FindMQ2DataType(str.c_str());
@@ -309,17 +405,19 @@ bool lua_MQTypeVar::EqualNil(const sol::lua_nil_t&) const
 	return EvaluateMember().Type == nullptr;
 }
 
-MQTypeVar lua_MQTypeVar::EvaluateMember(const char* index) const
+MQTypeVar lua_MQTypeVar::EvaluateMember(char* index) const
 {
-	if (m_self.Type == nullptr || m_member.empty())
+	if (m_self.Type == nullptr || m_member == nullptr)
 		return m_self;
 
+	LuaProfiler::ScopedBinding profile;
+
 	// the ternary in index is because datatypes are all over the place on whether or not they can
 	// accept null pointers. They all seem to agree that an empty string is the same thing, though.
 	char buffer[1] = "";
 	MQTypeVar var;
 
-	if (EvaluateMacroDataMember(m_self.Type, m_self.GetVarPtr(), var, m_member.c_str(), const_cast<char*>(index ? index : buffer)) == 1)
+	if (EvaluateMacroDataMember(m_self.Type, m_self.GetVarPtr(), var, m_member, index ? index : buffer) == 1)
 		return var;
 
 	// can't guarantee result didn't Get modified, but we want to return nil if GetMember was false
@@ -331,33 +429,43 @@ MQ2Type* lua_MQTypeVar::GetType() const
 	return EvaluateMember().Type;
 }
 
-std::string lua_MQTypeVar::ToString(const lua_MQTypeVar& obj)
+const char* lua_MQTypeVar::ToString(const lua_MQTypeVar& obj)
 {
+	LuaProfiler::ScopedBinding profile;
 	MQTypeVar var = obj.EvaluateMember();
 
 	if (var.Type != nullptr)
 	{
-		char buf[MAX_STRING] = { 0 };
-		if (var.Type->ToString(var, buf))
-			return std::string(buf);
+		s_toStringBuffer[0] = 0;
+		if (var.Type->ToString(var, s_toStringBuffer))
+			return s_toStringBuffer;
 	}
 
 	return "NULL";
 }
 
-sol::object lua_MQTypeVar::Call(std::string index, sol::this_state L) const
+lua_MQTypeVar lua_MQTypeVar::Call(std::string_view index) const
 {
-	return sol::object(L, sol::in_place, lua_MQTypeVar(EvaluateMember(index.c_str())));
+	char buffer[MAX_STRING];
+	CopyIndex(index, buffer, lengthof(buffer));
+
+	return lua_MQTypeVar(EvaluateMember(buffer));
 }
 
-sol::object lua_MQTypeVar::CallInt(int index, sol::this_state L) const
+lua_MQTypeVar lua_MQTypeVar::CallInt(int index) const
 {
-	return Call(std::to_string(index), L);
+	char buffer[16];
+	FormatIndex(index, buffer, lengthof(buffer));
+
+	return lua_MQTypeVar(EvaluateMember(buffer));
 }
 
-sol::object lua_MQTypeVar::CallVA(sol::this_state L, sol::variadic_args args) const
+lua_MQTypeVar lua_MQTypeVar::CallVA(sol::variadic_args args) const
 {
-	return Call(lua_join(L, ",", args), L);
+	char buffer[MAX_STRING];
+	JoinIndex(args, buffer, lengthof(buffer));
+
+	return lua_MQTypeVar(EvaluateMember(buffer));
 }
 
 sol::object lua_MQTypeVar::CallEmpty(sol::this_state L) const
@@ -367,7 +475,7 @@ sol::object lua_MQTypeVar::CallEmpty(sol::this_state L) const
 	return ConvertTypeVarToLua(L, result);
 }
 
-sol::object lua_MQTypeVar::Get(sol::stack_object key, sol::this_state L) const
+std::optional<lua_MQTypeVar> lua_MQTypeVar::Get(sol::stack_object key) const
 {
 	lua_MQTypeVar var = EvaluateMember();
 
@@ -379,7 +487,7 @@ sol::object lua_MQTypeVar::Get(sol::stack_object key, sol::this_state L) const
 			// we have an integer -- let's just assume single extent for now
 			// TODO: will need to keep track of extents to allow for access like this: arr[2][1]
 			// would rather return an array with a subset, but that would require slicing and copying the underlying array data
-			var.m_member = "";
+			var.m_member = nullptr;
 			var.m_self.Type = arr->GetType();
 			var.m_self.SetVarPtr(arr->GetData(*maybe_index));
 		}
@@ -388,25 +496,28 @@ sol::object lua_MQTypeVar::Get(sol::stack_object key, sol::this_state L) const
 			// we have a string, so we can use the array's internal string index parsing here
 			if (!arr->GetElement(*maybe_index, var.m_self))
 			{
-				return sol::object(L, sol::in_place, sol::lua_nil);
+				return std::nullopt;
 			}
 
-			var.m_member = "";
+			var.m_member = nullptr;
 		}
 	}
 	else if (auto maybe_key = key.as<std::optional<std::string_view>>())
 	{
-		// the nominal case is that the index is the key to the type member
-		var.m_member = *maybe_key;
-
-		// make sure that the macro data member even exists if we have the type info
-		if (var.m_self.Type && !FindMacroDataMember(var.m_self.Type, var.m_member))
+		// the nominal case is that the index is the key to the type member. Without type info there is nothing
+		// to look up and the member is never evaluated.
+		if (var.m_self.Type)
 		{
-			return sol::object(L, sol::in_place, sol::lua_nil);
+			// make sure that the macro data member even exists
+			var.m_member = FindMemberName(var.m_self.Type, *maybe_key);
+			if (var.m_member == nullptr)
+			{
+				return std::nullopt;
+			}
 		}
 	}
 
-	return sol::object(L, sol::in_place, std::move(var));
+	return var;
 }
 
 //----------------------------------------------------------------------------
@@ -437,6 +548,7 @@ lua_MQTopLevelObject::lua_MQTopLevelObject(sol::this_state L, const MQTopLevelOb
 
 lua_MQTypeVar lua_MQTopLevelObject::EvaluateSelf() const
 {
+	LuaProfiler::ScopedBinding profile;
 	MQTypeVar result;
 	if (self != nullptr)
 		self->Function("", result);
@@ -459,7 +571,7 @@ bool lua_MQTopLevelObject::EqualNil(const sol::lua_nil_t&) const
 	return EvaluateSelf().m_self.Type == nullptr;
 }
 
-std::string lua_MQTopLevelObject::ToString(const lua_MQTopLevelObject& data)
+const char* lua_MQTopLevelObject::ToString(const lua_MQTopLevelObject& data)
 {
 	return lua_MQTypeVar::ToString(data.EvaluateSelf());
 }
@@ -469,27 +581,43 @@ MQ2Type* lua_MQTopLevelObject::GetType() const
 	return EvaluateSelf().m_self.Type;
 }
 
-sol::object lua_MQTopLevelObject::Call(const std::string& index, sol::this_state L) const
+static lua_MQTypeVar CallTopLevelObject(const MQTopLevelObject* tlo, const char* index)
 {
+	LuaProfiler::ScopedBinding profile;
 	MQTypeVar result;
-	if (self != nullptr && self->Function(index.c_str(), result))
-		return sol::object(L, sol::in_place, lua_MQTypeVar(result));
+	if (tlo != nullptr && tlo->Function(index, result))
+		return lua_MQTypeVar(result);
+
+	return lua_MQTypeVar(MQTypeVar());
+}
+
+lua_MQTypeVar lua_MQTopLevelObject::Call(std::string_view index) const
+{
+	char buffer[MAX_STRING];
+	CopyIndex(index, buffer, lengthof(buffer));
 
-	return sol::object(L, sol::in_place, lua_MQTypeVar(MQTypeVar()));
+	return CallTopLevelObject(self, buffer);
 }
 
-sol::object lua_MQTopLevelObject::CallInt(int index, sol::this_state L) const
+lua_MQTypeVar lua_MQTopLevelObject::CallInt(int index) const
 {
-	return Call(std::to_string(index), L);
+	char buffer[16];
+	FormatIndex(index, buffer, lengthof(buffer));
+
+	return CallTopLevelObject(self, buffer);
 }
 
-sol::object lua_MQTopLevelObject::CallVA(sol::this_state L, sol::variadic_args args) const
+lua_MQTypeVar lua_MQTopLevelObject::CallVA(sol::variadic_args args) const
 {
-	return Call(lua_join(L, ",", args), L);
+	char buffer[MAX_STRING];
+	JoinIndex(args, buffer, lengthof(buffer));
+
+	return CallTopLevelObject(self, buffer);
 }
 
 sol::object lua_MQTopLevelObject::CallEmpty(sol::this_state L) const
 {
+	LuaProfiler::ScopedBinding profile;
 	MQTypeVar result;
 	if (self != nullptr && self->Function("", result))
 		return lua_MQTypeVar(result).CallEmpty(L);
@@ -497,13 +625,14 @@ sol::object lua_MQTopLevelObject::CallEmpty(sol::this_state L) const
 	return sol::object(L, sol::in_place, sol::lua_nil);
 }
 
-sol::object lua_MQTopLevelObject::Get(sol::stack_object key, sol::this_state L) const
+std::optional<lua_MQTypeVar> lua_MQTopLevelObject::Get(sol::stack_object key) const
 {
+	LuaProfiler::ScopedBinding profile;
 	MQTypeVar result;
 	if (self != nullptr && self->Function("", result))
-		return lua_MQTypeVar(result).Get(key, L);
+		return lua_MQTypeVar(result).Get(key);
 
-	return sol::object(L, sol::in_place, lua_MQTypeVar(MQTypeVar()));
+	return lua_MQTypeVar(MQTypeVar());
 }
 
 template <typename Handler>
@@ -584,15 +713,6 @@ struct lua_MQTLO
 	}
 };
 
-std::string to_string(const lua_MQTopLevelObject& item)
-{
-	return lua_MQTopLevelObject::ToString(item);
-}
-
-std::string to_string(const lua_MQTypeVar& item)
-{
-	return lua_MQTypeVar::ToString(item);
-}
 
 std::string to_string(const lua_MQTLO& item)
 {
@@ -767,6 +887,7 @@ LuaProxyType::LuaProxyType(const std::string& typeName, LuaAbstractDataType* lua
 LuaProxyType::~LuaProxyType()
 {
 	remove_sorted(s_proxyTypes, this);
+	s_memberNames.erase(this);
 }
 
 bool LuaProxyType::FromData(MQVarPtr& VarPtr, const MQTypeVar& Source)
@@ -1101,6 +1222,7 @@ void RegisterBindings_MQMacroData(sol::table& mq)
 			                                         &lua_MQTypeVar::CallEmpty,
 			                                         &lua_MQTypeVar::CallVA),
 		sol::meta_function::index,               &lua_MQTypeVar::Get,
+		sol::meta_function::to_string,           &lua_MQTypeVar::ToString,
 		sol::meta_function::equal_to,            sol::overload(
 			                                         &lua_MQTypeVar::operator==,
 			                                         &lua_MQTypeVar::EqualData,
@@ -1115,6 +1237,7 @@ void RegisterBindings_MQMacroData(sol::table& mq)
 			                                         &lua_MQTopLevelObject::CallEmpty,
 			                                         &lua_MQTopLevelObject::CallVA),
 		sol::meta_function::index,               &lua_MQTopLevelObject::Get,
+		sol::meta_function::to_string,           &lua_MQTopLevelObject::ToString,
 		sol::meta_function::equal_to,            sol::overload(
 			                                         &lua_MQTopLevelObject::operator==,
 			                                         &lua_MQTopLevelObject::EqualVar,
@@ -1145,10 +1268,19 @@ void InitializeBindings_MQMacroData()
 	s_luaTableType = new LuaTableType();
 }
 
+void UnloadPluginBindings_MQMacroData()
+{
+	// there is no telling which types belong to the plugin, and they are all cheap to look up again
+	s_memberNames.clear();
+}
+
 void ShutdownBindings_MQMacroData()
 {
 	delete s_luaTableType;
 	s_luaTableType = nullptr;
+
+	s_memberNames.clear();
+	s_memberNamePool.clear();
 }
 
 } // namespace mq::lua::bindings
@@ -92,24 +92,35 @@ void mq::postoffice::DropboxAPI::Post(const mq::postoffice::Address& address, co
 	mqplugin::MainInterface->SendToActor(Dropbox, address, data, callback, mqplugin::ThisPluginHandle);
 }
 
+void mq::postoffice::DropboxAPI::Gather(const mq::postoffice::Address& address, const std::string& data, std::chrono::milliseconds timeout,
+	const GatherCallbackAPI& callback) const
+{
+	mqplugin::MainInterface->GatherFromActors(Dropbox, address, data, timeout, callback, mqplugin::ThisPluginHandle);
+}
+
 void mq::postoffice::DropboxAPI::PostReply(const std::shared_ptr<mq::postoffice::Message>& message, const std::string& data, uint8_t status) const
 {
 	mqplugin::MainInterface->ReplyToActor(Dropbox, message, data, status, mqplugin::ThisPluginHandle);
 }
 
+mq::postoffice::MailboxStatsAPI mq::postoffice::DropboxAPI::GetStats() const
+{
+	return mqplugin::MainInterface->GetActorStats(Dropbox, mqplugin::ThisPluginHandle);
+}
+
 void mq::postoffice::DropboxAPI::Remove()
 {
 	mqplugin::MainInterface->RemoveActor(Dropbox, mqplugin::ThisPluginHandle);
 }
 
-mq::postoffice::DropboxAPI mq::postoffice::AddActor(ReceiveCallbackAPI&& receive)
+mq::postoffice::DropboxAPI mq::postoffice::AddActor(ReceiveCallbackAPI&& receive, const MailboxOptionsAPI& options)
 {
 	return mq::postoffice::DropboxAPI{
-		mqplugin::MainInterface->AddActor(mqplugin::ThisPlugin->name.c_str(), std::move(receive), mqplugin::ThisPluginHandle)
+		mqplugin::MainInterface->AddActor(mqplugin::ThisPlugin->name.c_str(), std::move(receive), options, mqplugin::ThisPluginHandle)
 	};
 }
 
-mq::postoffice::DropboxAPI mq::postoffice::AddActor(const char* localAddress, ReceiveCallbackAPI&& receive)
+mq::postoffice::DropboxAPI mq::postoffice::AddActor(const char* localAddress, ReceiveCallbackAPI&& receive, const MailboxOptionsAPI& options)
 {
 	fmt::memory_buffer buffer;
 	auto appender = fmt::appender(buffer);
@@ -118,7 +129,7 @@ mq::postoffice::DropboxAPI mq::postoffice::AddActor(const char* localAddress, Re
 	*appender = 0;
 
 	return mq::postoffice::DropboxAPI{
-		mqplugin::MainInterface->AddActor(buffer.data(), std::move(receive), mqplugin::ThisPluginHandle)
+		mqplugin::MainInterface->AddActor(buffer.data(), std::move(receive), options, mqplugin::ThisPluginHandle)
 	};
 }
 
@@ -87,7 +87,9 @@ void ClientPostOffice::RouteMessage(MessagePtr message)
 		const auto& address = message->address();
 		auto uuid = address.uuid();
 
-		if (uuid.empty() || uuid != m_id.container.uuid) // either ambiguous clients, or explicitly not this client
+		// gathers always go through the router, it's the one that reports who the message went to
+		if (uuid.empty() || uuid != m_id.container.uuid // either ambiguous clients, or explicitly not this client
+			|| message->mode() == static_cast<uint32_t>(MQRequestMode::Gather))
 			m_pipeClient.SendMessage(std::move(msg));
 		else // uuid matches this client
 			m_pipeClient.DispatchMessage(std::move(msg));
@@ -132,7 +134,9 @@ void ClientPostOffice::Shutdown()
 void ClientPostOffice::ProcessPipeClient()
 {
 	m_pipeClient.Process();
-	Process(1000); // make this large just to prevent overflows
+
+	// a flood of messages is left queued for the next frame rather than stalling this one
+	Process(std::chrono::milliseconds(2));
 }
 
 void ClientPostOffice::OnIncomingMessage(PipeMessagePtr message)
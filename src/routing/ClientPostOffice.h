@@ -41,6 +41,9 @@ public:
 	void Shutdown();
 	void ProcessPipeClient();
 
+	// Size in bytes of the shared memory used to talk to the launcher, zero to only use the named pipe
+	void SetSharedMemoryCapacity(uint32_t capacity) { m_pipeClient.SetSharedMemoryCapacity(capacity); }
+
 protected:
 	virtual void OnIncomingMessage(PipeMessagePtr message);
 	virtual void OnClientConnected();
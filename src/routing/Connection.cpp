@@ -38,6 +38,19 @@ void Connection::RequestProcessEvents()
 	m_postOffice->RequestProcessEvents();
 }
 
+void Connection::SyncIdentities(const ActorContainer& process, const proto::routing::IdentitySync& sync) const
+{
+	// the whole table always included the post office itself before there were syncs
+	if (sync.full() && sync.has_sender())
+		SendIdentification(process, ActorIdentification(sync.sender()));
+
+	for (const auto& id : sync.added())
+		SendIdentification(process, ActorIdentification(id));
+
+	for (const auto& id : sync.dropped())
+		DropIdentification(process, ActorIdentification(id));
+}
+
 //-----------------------------------------------------------------------------
 
 class LocalConnectionPipeEventsHandler : public mq::NamedPipeEvents
@@ -130,6 +143,37 @@ bool LocalConnection::SendMessage(const ActorContainer& process, MessagePtr mess
 	return false;
 }
 
+bool LocalConnection::SendMessage(const ActorContainer& process, MessagePtr header, const SharedPayload& payload)
+{
+	if (process.uuid == m_uuid)
+	{
+		// messages to self are dispatched directly and need to be contiguous, this isn't the common case
+		header->set_payload(*payload.Data);
+		return SendMessage(process, std::move(header));
+	}
+
+	if (const auto& connection = GetConnection(process.uuid))
+	{
+		SPDLOG_TRACE("PostOffice {{{}}}: Pipe found connection, dispatching shared payload {} seq={}",
+			m_postOffice->GetName(), process, header->sequence());
+
+		const std::string serialized = payload.SerializeHeader(*header);
+
+		auto msg = std::make_unique<PipeMessage>(MQMessageId::MSG_ROUTE, serialized.data(), serialized.size());
+		msg->SetTail(payload.Data);
+
+		connection->SendMessage(std::move(msg));
+		return true;
+	}
+
+	SPDLOG_WARN("PostOffice {{{}}}: Unable to get connection for {}, message route failed. seq={}",
+		m_postOffice->GetName(), process, header->sequence());
+
+	header->set_payload(*payload.Data);
+	m_postOffice->RoutingFailed(MsgError_NoConnection, std::move(header), "Could not find connection");
+	return false;
+}
+
 void LocalConnection::SendIdentification(const ActorContainer& process, const ActorIdentification& identity) const
 {
 	if (const auto& connection = GetConnection(process.uuid))
@@ -306,6 +350,22 @@ bool PeerConnection::SendMessage(const ActorContainer& peer, MessagePtr message)
 	}, peer.value);
 }
 
+bool PeerConnection::SendMessage(const ActorContainer& peer, MessagePtr header, const SharedPayload& payload)
+{
+	if (const auto network = std::get_if<ActorContainer::Network>(&peer.value))
+	{
+		if (m_network->HasHost(network->IP, network->Port))
+		{
+			m_network->SendRouted(network->IP, network->Port, payload.SerializeHeader(*header), payload.Network);
+			return true;
+		}
+	}
+
+	// the failure paths all need the whole message back, so just take the normal route for them
+	header->set_payload(*payload.Data);
+	return SendMessage(peer, std::move(header));
+}
+
 void PeerConnection::SendIdentification(const ActorContainer& peer, const ActorIdentification& identity) const
 {
 	std::visit(overload{
@@ -367,6 +427,15 @@ void PeerConnection::RequestIdentities(const ActorContainer& peer) const
 			{
 				auto outbound = std::make_unique<peernetwork::NetworkMessage>();
 				proto::routing::RequestIdentities& req = *outbound->mutable_request();
+				req.set_identity_sync(true);
+
+				// ask for only what changed since the copy we have
+				auto sync_it = m_peerSync.find(NetworkAddress{ p.IP, p.Port });
+				if (sync_it != m_peerSync.end())
+				{
+					req.set_epoch(sync_it->second.GetMirror().GetEpoch());
+					req.set_version(sync_it->second.GetMirror().GetVersion());
+				}
 
 				m_network->Send(p.IP, p.Port, std::move(outbound));
 			}
@@ -384,6 +453,36 @@ void PeerConnection::RequestIdentities(const ActorContainer& peer) const
 	}, peer.value);
 }
 
+void PeerConnection::SyncIdentities(const ActorContainer& peer, const proto::routing::IdentitySync& sync) const
+{
+	const auto network = std::get_if<ActorContainer::Network>(&peer.value);
+	if (network == nullptr)
+	{
+		SPDLOG_WARN("PostOffice {{{}}}: Attempted to send a message to process {}, identity sync failed.",
+			m_postOffice->GetName(), peer);
+		return;
+	}
+
+	auto sync_it = m_peerSync.find(NetworkAddress{ network->IP, network->Port });
+	if (sync_it == m_peerSync.end() || !sync_it->second.IsSyncCapable())
+	{
+		// peers that haven't asked for syncs get the changes one at a time
+		Connection::SyncIdentities(peer, sync);
+	}
+	else if (m_network->HasHost(network->IP, network->Port))
+	{
+		auto outbound = std::make_unique<peernetwork::NetworkMessage>();
+		*outbound->mutable_sync() = sync;
+
+		m_network->Send(network->IP, network->Port, std::move(outbound));
+	}
+	else
+	{
+		SPDLOG_WARN("PostOffice {{{}}}: Unable to find peer for address {}, identity sync failed.",
+			m_postOffice->GetName(), network->ToString());
+	}
+}
+
 void PeerConnection::BroadcastMessage(MessagePtr message)
 {
 	auto outbound = std::make_unique<peernetwork::NetworkMessage>();
@@ -427,6 +526,11 @@ uint16_t PeerConnection::GetPort() const
 	return m_network->GetPort();
 }
 
+NetworkCompressionStats PeerConnection::GetCompressionStats() const
+{
+	return m_network->GetCompressionStats();
+}
+
 NetworkAddress PeerConnection::GetConnectionAddress(const std::string& uuid) const
 {
 	auto it = m_connections.find(uuid);
@@ -471,6 +575,7 @@ void PeerConnection::PeerMessageHandler(const NetworkAddress& address, NetworkMe
 	switch (message->contents_case())  // NOLINT(clang-diagnostic-switch-enum)
 	{
 	case NetworkMessage::kAdd:
+		m_peerSync[address].OnAdd(message->add().id());
 		UpdateConnection(message->add().id().uuid(), NetworkAddress{ source_addr.IP, source_addr.Port });
 		m_postOffice->AddIdentity(ActorIdentification(
 			ActorContainer(std::move(source_addr), message->add().id().uuid()),
@@ -478,14 +583,25 @@ void PeerConnection::PeerMessageHandler(const NetworkAddress& address, NetworkMe
 		break;
 
 	case NetworkMessage::kDrop:
-		DropConnection(message->add().id().uuid());
+		m_peerSync[address].OnDrop(message->drop().id());
+		DropConnection(message->drop().id().uuid());
 		m_postOffice->DropIdentity(ActorIdentification(
 			ActorContainer(std::move(source_addr), message->drop().id().uuid()),
 			ActorIdentification::GetAddress(message->drop().id())));
 		break;
 
 	case NetworkMessage::kRequest:
-		m_postOffice->SendIdentities(ActorContainer(std::move(source_addr), message->request().uuid()));
+	{
+		const proto::routing::RequestIdentities& request = message->request();
+		m_peerSync[address].OnRequest(request.identity_sync());
+
+		m_postOffice->SendIdentities(ActorContainer(std::move(source_addr), request.uuid()),
+			request.epoch(), request.version());
+		break;
+	}
+
+	case NetworkMessage::kSync:
+		HandleIdentitySync(address, message->sync());
 		break;
 
 	case NetworkMessage::kRouted:
@@ -517,14 +633,72 @@ void PeerConnection::PeerMessageHandler(const NetworkAddress& address, NetworkMe
 	}
 }
 
+void PeerConnection::HandleIdentitySync(const NetworkAddress& address, const proto::routing::IdentitySync& sync)
+{
+	PeerIdentitySync& state = m_peerSync[address];
+
+	auto to_identity = [&address](const proto::routing::Identification& id)
+		{
+			return ActorIdentification(ActorContainer(ActorContainer::Network{ address.IP, address.Port }, id.uuid()),
+				ActorIdentification::GetAddress(id));
+		};
+
+	UpdateConnection(sync.sender().uuid(), address);
+	m_postOffice->AddIdentity(to_identity(sync.sender()));
+
+	std::vector<proto::routing::Identification> added;
+	std::vector<proto::routing::Identification> dropped;
+
+	switch (state.OnSync(sync, added, dropped))
+	{
+	case IdentityMirror::Result::Applied:
+		SPDLOG_TRACE("PostOffice {{{}}}: Synced identities from {}:{} to version {} ({} added, {} dropped)",
+			m_postOffice->GetName(), address.IP, address.Port, sync.version(), added.size(), dropped.size());
+
+		for (const auto& id : added)
+			m_postOffice->AddIdentity(to_identity(id));
+
+		for (const auto& id : dropped)
+			m_postOffice->DropIdentity(to_identity(id));
+		break;
+
+	case IdentityMirror::Result::Gap:
+		// we missed some changes, ask for everything since the version we have (once)
+		if (state.StartRequest())
+		{
+			SPDLOG_DEBUG("PostOffice {{{}}}: Identity sync from {}:{} doesn't follow version {}, requesting changes",
+				m_postOffice->GetName(), address.IP, address.Port, state.GetMirror().GetVersion());
+
+			RequestIdentities(ActorContainer(ActorContainer::Network{ address.IP, address.Port }, ""));
+		}
+		break;
+
+	case IdentityMirror::Result::Stale:
+		break;
+	}
+}
+
 void PeerConnection::OnSessionConnectedHandler(const NetworkAddress& address)
 {
-	// once the connect attempt is successful, send all known identities to the remote to sync
-	m_postOffice->SendIdentities(ActorContainer(ActorContainer::Network{ address.IP, address.Port }, ""));
+	ActorContainer peer(ActorContainer::Network{ address.IP, address.Port }, "");
+
+	// peers that haven't asked for a sync yet might never ask, so they get all of our identities pushed
+	// the way they always have
+	if (m_peerSync[address].OnConnected())
+		m_postOffice->SendIdentities(peer);
+
+	// once the connect attempt is successful, ask the remote for the identities that changed since we
+	// last saw it. It asks the same of us, so this syncs both ways.
+	RequestIdentities(peer);
 }
 
 void PeerConnection::OnSessionDisconnectedHandler(const NetworkAddress& address)
 {
+	// the mirror is kept for when the peer comes back
+	auto sync_it = m_peerSync.find(address);
+	if (sync_it != m_peerSync.end())
+		sync_it->second.OnDisconnected();
+
 	auto uuid = GetConnectionUUID(address);
 	DropConnection(uuid);
 	m_postOffice->DropContainer(ActorContainer(ActorContainer::Network{ address.IP, address.Port }, uuid));
@@ -0,0 +1,273 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "IdentitySync.h"
+
+#include <algorithm>
+
+namespace mq::postoffice {
+
+static bool IsSameIdentity(const proto::routing::Identification& a, const proto::routing::Identification& b)
+{
+	return a.SerializeAsString() == b.SerializeAsString();
+}
+
+//=============================================================================
+
+IdentityTable::IdentityTable(std::string epoch, size_t maxTombstones)
+	: m_epoch(std::move(epoch))
+	, m_maxTombstones(maxTombstones)
+{
+}
+
+bool IdentityTable::Add(const proto::routing::Identification& id)
+{
+	auto [it, inserted] = m_entries.try_emplace(id.uuid());
+	Entry& entry = it->second;
+
+	if (!inserted)
+	{
+		if (!entry.Dropped && IsSameIdentity(entry.Id, id))
+			return false;
+
+		if (entry.Dropped)
+			--m_tombstones;
+	}
+
+	entry.Version = ++m_version;
+	entry.Dropped = false;
+	entry.Id = id;
+	return true;
+}
+
+bool IdentityTable::Drop(const std::string& uuid)
+{
+	auto it = m_entries.find(uuid);
+	if (it == m_entries.end() || it->second.Dropped)
+		return false;
+
+	it->second.Version = ++m_version;
+	it->second.Dropped = true;
+	++m_tombstones;
+
+	TrimTombstones();
+	return true;
+}
+
+void IdentityTable::TrimTombstones()
+{
+	if (m_tombstones <= m_maxTombstones)
+		return;
+
+	// forget the older half at once so this doesn't happen on every drop
+	std::vector<uint64_t> versions;
+	versions.reserve(m_tombstones);
+	for (const auto& [_, entry] : m_entries)
+	{
+		if (entry.Dropped)
+			versions.push_back(entry.Version);
+	}
+
+	auto middle = versions.begin() + versions.size() / 2;
+	std::nth_element(versions.begin(), middle, versions.end());
+	const uint64_t cutoff = *middle;
+
+	for (auto it = m_entries.begin(); it != m_entries.end();)
+	{
+		if (it->second.Dropped && it->second.Version < cutoff)
+		{
+			it = m_entries.erase(it);
+			--m_tombstones;
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	// a peer at a version before the cutoff could have missed one of those drops
+	m_floor = std::max(m_floor, cutoff - 1);
+}
+
+void IdentityTable::BuildSync(const std::string& epoch, uint64_t version, proto::routing::IdentitySync& sync) const
+{
+	const bool full = epoch != m_epoch || version < m_floor || version > m_version;
+
+	sync.set_epoch(m_epoch);
+	sync.set_version(m_version);
+	sync.set_full(full);
+	sync.set_from_version(full ? 0 : version);
+
+	for (const auto& [uuid, entry] : m_entries)
+	{
+		if (full)
+		{
+			if (!entry.Dropped)
+				*sync.add_added() = entry.Id;
+		}
+		else if (entry.Version > version)
+		{
+			if (entry.Dropped)
+				*sync.add_dropped() = entry.Id;
+			else
+				*sync.add_added() = entry.Id;
+		}
+	}
+}
+
+//=============================================================================
+
+IdentityMirror::Result IdentityMirror::Apply(const proto::routing::IdentitySync& sync,
+	std::vector<proto::routing::Identification>& added, std::vector<proto::routing::Identification>& dropped)
+{
+	if (sync.full())
+	{
+		if (sync.epoch() == m_epoch && sync.version() <= m_version && !m_epoch.empty())
+			return Result::Stale;
+
+		std::unordered_map<std::string, proto::routing::Identification> identities;
+		identities.reserve(sync.added_size());
+
+		for (const auto& id : sync.added())
+		{
+			auto it = m_identities.find(id.uuid());
+			if (it == m_identities.end() || !IsSameIdentity(it->second, id))
+				added.push_back(id);
+
+			identities.emplace(id.uuid(), id);
+		}
+
+		// anything the full table doesn't have is gone
+		for (auto& [uuid, id] : m_identities)
+		{
+			if (identities.find(uuid) == identities.end())
+				dropped.push_back(std::move(id));
+		}
+
+		m_identities = std::move(identities);
+	}
+	else
+	{
+		if (sync.epoch() != m_epoch)
+			return Result::Gap;
+
+		if (sync.version() <= m_version)
+			return Result::Stale;
+
+		if (sync.from_version() > m_version)
+			return Result::Gap;
+
+		// the changes since an older version include the ones we have, which just don't change anything
+		for (const auto& id : sync.added())
+		{
+			auto [it, inserted] = m_identities.try_emplace(id.uuid(), id);
+			if (inserted)
+			{
+				added.push_back(id);
+			}
+			else if (!IsSameIdentity(it->second, id))
+			{
+				it->second = id;
+				added.push_back(id);
+			}
+		}
+
+		for (const auto& id : sync.dropped())
+		{
+			auto it = m_identities.find(id.uuid());
+			if (it != m_identities.end())
+			{
+				dropped.push_back(std::move(it->second));
+				m_identities.erase(it);
+			}
+		}
+	}
+
+	m_epoch = sync.epoch();
+	m_version = sync.version();
+	return Result::Applied;
+}
+
+void IdentityMirror::Add(const proto::routing::Identification& id)
+{
+	m_identities[id.uuid()] = id;
+}
+
+void IdentityMirror::Drop(const std::string& uuid)
+{
+	m_identities.erase(uuid);
+}
+
+//=============================================================================
+
+bool PeerIdentitySync::OnConnected()
+{
+	m_requested = true;
+	return !m_syncCapable;
+}
+
+void PeerIdentitySync::OnDisconnected()
+{
+	// whatever was asked for went with the session
+	m_requested = false;
+}
+
+void PeerIdentitySync::OnRequest(bool identitySync)
+{
+	// a peer that went back to a version without syncs stops getting them
+	m_syncCapable = identitySync;
+}
+
+void PeerIdentitySync::OnAdd(const proto::routing::Identification& id)
+{
+	m_mirror.Add(id);
+}
+
+void PeerIdentitySync::OnDrop(const proto::routing::Identification& id)
+{
+	m_mirror.Drop(id.uuid());
+}
+
+IdentityMirror::Result PeerIdentitySync::OnSync(const proto::routing::IdentitySync& sync,
+	std::vector<proto::routing::Identification>& added, std::vector<proto::routing::Identification>& dropped)
+{
+	m_syncCapable = true;
+
+	const IdentityMirror::Result result = m_mirror.Apply(sync, added, dropped);
+	if (result == IdentityMirror::Result::Applied)
+	{
+		m_requested = false;
+
+		// the sender is pushed along with its identities, but it is never part of the table
+		if (sync.has_sender())
+		{
+			dropped.erase(std::remove_if(dropped.begin(), dropped.end(),
+				[&sync](const proto::routing::Identification& id) { return id.uuid() == sync.sender().uuid(); }),
+				dropped.end());
+		}
+	}
+
+	return result;
+}
+
+bool PeerIdentitySync::StartRequest()
+{
+	if (m_requested)
+		return false;
+
+	m_requested = true;
+	return true;
+}
+
+} // namespace mq::postoffice
@@ -0,0 +1,164 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "Routing.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mq::postoffice {
+
+/**
+ * The identities that a post office owns (the ones in its local containers), with a version number
+ * for every change. Peers remember the epoch and version of the table they last saw, so after a
+ * reconnect they only need the changes since then instead of the whole table.
+ *
+ * Dropped identities are kept as tombstones so that drops can be part of a delta. Once there are too
+ * many the oldest are forgotten, and peers that are further behind than that get the whole table.
+ */
+class IdentityTable
+{
+public:
+	static constexpr size_t DefaultMaxTombstones = 1024;
+
+	/**
+	 * @param epoch identifies this instance of the table, it has to change whenever the table starts over
+	 * @param maxTombstones how many drops to remember for building deltas
+	 */
+	explicit IdentityTable(std::string epoch, size_t maxTombstones = DefaultMaxTombstones);
+
+	const std::string& GetEpoch() const { return m_epoch; }
+	uint64_t GetVersion() const { return m_version; }
+	size_t GetCount() const { return m_entries.size() - m_tombstones; }
+
+	// adds or updates an identity, returns false if the table already had it as-is
+	bool Add(const proto::routing::Identification& id);
+
+	// drops the identity with the uuid, returns false if the table didn't have it
+	bool Drop(const std::string& uuid);
+
+	/**
+	 * Fills sync with what a peer needs to catch up to the current version. That is the changes after
+	 * the version the peer has if it has seen this epoch and the tombstones still cover that version,
+	 * otherwise it's the whole table.
+	 *
+	 * @param epoch the epoch the peer has, empty if it hasn't seen this table before
+	 * @param version the version the peer has
+	 * @param sync the message to fill, the sender isn't set
+	 */
+	void BuildSync(const std::string& epoch, uint64_t version, proto::routing::IdentitySync& sync) const;
+
+private:
+	struct Entry
+	{
+		uint64_t Version = 0;
+		bool Dropped = false;
+		proto::routing::Identification Id;
+	};
+
+	void TrimTombstones();
+
+	const std::string m_epoch;
+	const size_t m_maxTombstones;
+	uint64_t m_version = 0;
+	uint64_t m_floor = 0; // the oldest version a delta can be built from
+	size_t m_tombstones = 0;
+	std::unordered_map<std::string, Entry> m_entries;
+};
+
+/**
+ * A copy of a peer's IdentityTable, built from the syncs the peer sends
+ */
+class IdentityMirror
+{
+public:
+	enum class Result
+	{
+		Applied,     // the mirror is now at the version of the sync
+		Stale,       // the mirror already had everything in the sync
+		Gap,         // the sync doesn't follow on from the mirror, ask the peer for the changes since GetVersion()
+	};
+
+	/**
+	 * Applies a sync from the peer. Nothing is applied unless the result is Applied.
+	 *
+	 * @param sync the sync to apply
+	 * @param added gets the identities that are new or changed
+	 * @param dropped gets the identities that are gone
+	 */
+	Result Apply(const proto::routing::IdentitySync& sync, std::vector<proto::routing::Identification>& added,
+		std::vector<proto::routing::Identification>& dropped);
+
+	// identities the peer pushed one at a time instead of in a sync. The version doesn't change, but the next full
+	// sync drops them again if the peer doesn't have them anymore.
+	void Add(const proto::routing::Identification& id);
+	void Drop(const std::string& uuid);
+
+	const std::string& GetEpoch() const { return m_epoch; }
+	uint64_t GetVersion() const { return m_version; }
+	const std::unordered_map<std::string, proto::routing::Identification>& GetIdentities() const { return m_identities; }
+
+private:
+	std::string m_epoch;
+	uint64_t m_version = 0;
+	std::unordered_map<std::string, proto::routing::Identification> m_identities;
+};
+
+/**
+ * The identity sync with one peer, as seen from this side. It outlives the session so that a reconnect only needs
+ * the changes since the mirror.
+ *
+ * Peers from before identity syncs never ask for them. They push their whole table when a session comes up and
+ * expect the same from the other side, and after that every change is sent on its own. A peer is treated like that
+ * until it asks for a sync, and it is remembered once it has.
+ */
+class PeerIdentitySync
+{
+public:
+	/**
+	 * A session to the peer came up, the caller asks it for the changes since the mirror.
+	 *
+	 * @return true if the whole table also has to be pushed to the peer
+	 */
+	bool OnConnected();
+	void OnDisconnected();
+
+	// the peer asked for our identities, identitySync is set by peers that take syncs
+	void OnRequest(bool identitySync);
+
+	// identities the peer pushed on their own
+	void OnAdd(const proto::routing::Identification& id);
+	void OnDrop(const proto::routing::Identification& id);
+
+	// applies a sync from the peer, see IdentityMirror::Apply. The sender is never in dropped.
+	IdentityMirror::Result OnSync(const proto::routing::IdentitySync& sync,
+		std::vector<proto::routing::Identification>& added, std::vector<proto::routing::Identification>& dropped);
+
+	// true if the caller should ask the peer for the changes since the mirror, false if that is already outstanding
+	bool StartRequest();
+
+	bool IsSyncCapable() const { return m_syncCapable; }
+	const IdentityMirror& GetMirror() const { return m_mirror; }
+
+private:
+	IdentityMirror m_mirror;
+	bool m_requested = false;     // a request for identities is outstanding
+	bool m_syncCapable = false;   // the peer understands IdentitySync messages
+};
+
+} // namespace mq::postoffice
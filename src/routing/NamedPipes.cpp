@@ -37,6 +37,10 @@ namespace mq {
 constexpr int BUFFER_SIZE = 4096;
 constexpr int PIPE_TIMEOUT = 5000;
 
+// Servers that can take a shared memory channel say so before the offer is made, so this only runs
+// out if the server stops answering.
+constexpr auto SHARED_MEMORY_OFFER_TIMEOUT = 5s;
+
 //============================================================================
 // PipeMessage
 //============================================================================
@@ -155,6 +159,19 @@ void PipeMessage::Init(const MQMessageHeader& header, const void* data, size_t l
 	m_valid = true;
 }
 
+void PipeMessage::SetTail(std::shared_ptr<const std::string> tail)
+{
+	if (m_header && tail)
+	{
+		if (m_tail)
+			m_header->messageLength -= static_cast<uint32_t>(m_tail->size());
+
+		m_header->messageLength += static_cast<uint32_t>(tail->size());
+	}
+
+	m_tail = std::move(tail);
+}
+
 int PipeMessage::GetConnectionId() const
 {
 	if (auto connection = m_connection.lock())
@@ -459,6 +476,21 @@ void PipeConnection::InternalSendMessage(PipeMessagePtr message,
 		m_rpcRequests.emplace(request.sequenceId, std::move(request));
 	}
 
+	if (m_heldForOffer && message->GetSequenceId() != m_offerSequenceId)
+	{
+		// we don't know which way this goes until the server answers the offer
+		m_heldMessages.push_back(std::move(message));
+		return;
+	}
+
+	if (m_channelActive)
+	{
+		const auto& tail = message->tail();
+		m_channel->Send(message->buffer(), message->buffer_size(),
+			tail ? reinterpret_cast<const uint8_t*>(tail->data()) : nullptr, tail ? tail->size() : 0);
+		return;
+	}
+
 	auto queuedOp = std::make_unique<QueuedOp>();
 	queuedOp->message = std::move(message);
 
@@ -480,7 +512,20 @@ void PipeConnection::InternalBeginSend()
 	op->overlapped.hEvent = reinterpret_cast<HANDLE>(op);
 	m_pendingWrite = true;
 
-	bool writeStarted = ::WriteFileEx(m_hPipe.get(), op->message->buffer(), static_cast<DWORD>(op->message->buffer_size()), &op->overlapped,
+	const uint8_t* writeData = op->message->buffer();
+	size_t writeLength = op->message->buffer_size();
+
+	if (const auto& tail = op->message->tail())
+	{
+		m_writeBuffer.resize(writeLength + tail->size());
+		memcpy(m_writeBuffer.data(), writeData, writeLength);
+		memcpy(m_writeBuffer.data() + writeLength, tail->data(), tail->size());
+
+		writeData = m_writeBuffer.data();
+		writeLength = m_writeBuffer.size();
+	}
+
+	bool writeStarted = ::WriteFileEx(m_hPipe.get(), writeData, static_cast<DWORD>(writeLength), &op->overlapped,
 		[](DWORD dwErrorCode, DWORD dwNumberOfBytesTransferred, LPOVERLAPPED lpOverlapped)
 	{
 		QueuedOp* op = reinterpret_cast<QueuedOp*>(lpOverlapped->hEvent);
@@ -509,7 +554,7 @@ void PipeConnection::HandleWriteComplete(QueuedOp* op, uint32_t dwErrorCode, uin
 	assert(op == m_writeQueue[0].get());
 
 	const auto& reply = op->message;
-	size_t bytesWritten = reply->buffer_size();
+	size_t bytesWritten = reply->buffer_size() + (reply->tail() ? reply->tail()->size() : 0);
 
 	// this will delete the op
 	m_writeQueue.pop_front();
@@ -555,6 +600,14 @@ bool PipeConnection::InternalClose(bool disconnect)
 
 	m_rpcRequests.clear();
 	m_hPipe.reset();
+
+	// stops the channel thread, nothing else is delivered from it
+	m_channel.reset();
+	m_channelActive = false;
+	m_offerSequenceId = 0;
+	m_expiredOfferSequenceId = 0;
+	m_heldForOffer = false;
+	m_heldMessages.clear();
 	return true;
 }
 
@@ -564,6 +617,18 @@ void PipeConnection::InternalReceiveMessage(PipeMessagePtr message)
 
 	if (message->GetRequestMode() == MQRequestMode::MessageReply)
 	{
+		if (m_offerSequenceId != 0 && message->GetSequenceId() == m_offerSequenceId)
+		{
+			HandleSharedMemoryReply(message->GetHeader()->status);
+			return;
+		}
+
+		if (m_expiredOfferSequenceId != 0 && message->GetSequenceId() == m_expiredOfferSequenceId)
+		{
+			HandleLateSharedMemoryReply(message->GetHeader()->status);
+			return;
+		}
+
 		// Check if sequence id is in our map
 		auto iter = m_rpcRequests.find(message->GetHeader()->sequenceId);
 		if (iter != m_rpcRequests.end())
@@ -580,11 +645,220 @@ void PipeConnection::InternalReceiveMessage(PipeMessagePtr message)
 			return;
 		}
 	}
+	else if (message->GetMessageId() == MQMessageId::MSG_SHARED_MEMORY_OFFER
+		&& message->GetRequestMode() == MQRequestMode::CallAndResponse)
+	{
+		InternalAcceptSharedMemory(message);
+		return;
+	}
+	else if (message->GetMessageId() == MQMessageId::MSG_HELLO)
+	{
+		InternalReceiveHello(message);
+		return;
+	}
 
 	// if we get here with a reply, we didn't have a callback -- so it needs to be routed
 	m_parent->DispatchMessage(std::move(message));
 }
 
+void PipeConnection::InternalSendHello()
+{
+	MQMessageHello hello = {};
+	hello.sharedMemoryVersion = SHARED_MEMORY_CHANNEL_VERSION;
+
+	InternalSendMessage(MakeSimpleMessageV0(MQMessageId::MSG_HELLO, &hello, sizeof(hello)));
+}
+
+void PipeConnection::InternalReceiveHello(const PipeMessagePtr& message)
+{
+	if (message->size() < sizeof(MQMessageHello))
+		return;
+
+	const MQMessageHello* hello = message->get<MQMessageHello>();
+	if (hello->sharedMemoryVersion != SHARED_MEMORY_CHANNEL_VERSION)
+	{
+		SPDLOG_DEBUG("{}: Server takes shared memory channel version {}, using the named pipe", m_connectionId,
+			hello->sharedMemoryVersion);
+		return;
+	}
+
+	// only offer once per connection
+	if (m_sharedMemoryCapacity > 0 && !m_channel && m_offerSequenceId == 0 && m_expiredOfferSequenceId == 0)
+		InternalOfferSharedMemory();
+}
+
+void PipeConnection::InternalOfferSharedMemory()
+{
+	const std::string name = fmt::format("mq-pipe-{}-{}-{}", ::GetCurrentProcessId(), m_connectionId, ::GetTickCount64());
+
+	m_channel = SharedMemoryChannel::Create(name, m_sharedMemoryCapacity);
+	if (!m_channel)
+		return;
+
+	MQMessageSharedMemoryOffer offer = {};
+	offer.version = SHARED_MEMORY_CHANNEL_VERSION;
+	offer.capacity = m_channel->GetCapacity();
+	strcpy_s(offer.name, name.c_str());
+
+	auto message = MakeCallResponseMessageV0(MQMessageId::MSG_SHARED_MEMORY_OFFER, &offer, sizeof(offer));
+	m_offerSequenceId = m_nextSequenceId++;
+	message->SetSequenceId(m_offerSequenceId);
+
+	m_heldForOffer = true;
+	m_offerExpires = std::chrono::steady_clock::now() + SHARED_MEMORY_OFFER_TIMEOUT;
+
+	SPDLOG_DEBUG("{}: Offering shared memory channel {}", m_connectionId, name);
+	InternalSendMessage(std::move(message));
+}
+
+void PipeConnection::InternalAcceptSharedMemory(const PipeMessagePtr& message)
+{
+	uint8_t status = 1;
+
+	if (!m_channel && message->size() >= sizeof(MQMessageSharedMemoryOffer))
+	{
+		const MQMessageSharedMemoryOffer* offer = message->get<MQMessageSharedMemoryOffer>();
+		const std::string name(offer->name, strnlen(offer->name, lengthof(offer->name)));
+
+		if (offer->version == SHARED_MEMORY_CHANNEL_VERSION)
+		{
+			m_channel = SharedMemoryChannel::Open(name, offer->capacity);
+			if (m_channel)
+				status = 0;
+		}
+		else
+		{
+			SPDLOG_DEBUG("{}: Declined shared memory channel {} with version {}", m_connectionId, name, offer->version);
+		}
+	}
+
+	// the client only starts reading the channel once it sees this, so it has to go over the pipe
+	InternalSendMessage(MakeCallResponseReplyV0(MQMessageId::MSG_NULL, nullptr, 0, message->GetSequenceId(), status));
+
+	if (m_channel)
+	{
+		StartChannel();
+		m_channelActive = true;
+
+		SPDLOG_INFO("Using shared memory channel {} for connectionId={} pid={}", m_channel->GetName(),
+			m_connectionId, m_processId);
+	}
+}
+
+void PipeConnection::HandleSharedMemoryReply(uint8_t status)
+{
+	m_offerSequenceId = 0;
+
+	if (status == 0 && m_channel)
+	{
+		// the server has it open, so nothing else needs to find it by name
+		m_channel->Unlink();
+
+		StartChannel();
+		m_channelActive = true;
+
+		SPDLOG_DEBUG("{}: Shared memory channel {} accepted", m_connectionId, m_channel->GetName());
+	}
+	else
+	{
+		SPDLOG_DEBUG("{}: Shared memory channel declined, using the named pipe", m_connectionId);
+		m_channel.reset();
+	}
+
+	ReleaseHeldMessages();
+}
+
+void PipeConnection::HandleLateSharedMemoryReply(uint8_t status)
+{
+	m_expiredOfferSequenceId = 0;
+
+	if (status != 0)
+	{
+		SPDLOG_DEBUG("{}: Shared memory channel declined after the offer expired", m_connectionId);
+		return;
+	}
+
+	// The server has switched to a channel that we already closed, so whatever it sends from here on
+	// would be lost. Drop the connection and start over on a fresh pipe.
+	SPDLOG_WARN("{}: Shared memory channel accepted after the offer expired, reconnecting", m_connectionId);
+	m_parent->CloseConnection(this);
+}
+
+void PipeConnection::ReleaseHeldMessages()
+{
+	m_heldForOffer = false;
+
+	std::deque<PipeMessagePtr> messages;
+	std::swap(messages, m_heldMessages);
+
+	for (auto& message : messages)
+		InternalSendMessage(std::move(message));
+}
+
+uint32_t PipeConnection::CheckSharedMemoryOffer()
+{
+	if (!m_heldForOffer)
+		return INFINITE;
+
+	const auto now = std::chrono::steady_clock::now();
+	if (now < m_offerExpires)
+	{
+		return static_cast<uint32_t>(
+			std::chrono::duration_cast<std::chrono::milliseconds>(m_offerExpires - now).count()) + 1;
+	}
+
+	// Give up on the channel. Everything goes over the pipe from here, and a late answer is only
+	// remembered so that it isn't taken for a reply to something else.
+	SPDLOG_WARN("{}: Timed out waiting for an answer to the shared memory offer, using the named pipe", m_connectionId);
+
+	m_expiredOfferSequenceId = m_offerSequenceId;
+	m_offerSequenceId = 0;
+	m_channel.reset();
+
+	ReleaseHeldMessages();
+
+	return INFINITE;
+}
+
+void PipeConnection::StartChannel()
+{
+	std::weak_ptr<PipeConnection> weakPtr = shared_from_this();
+	NamedPipeEndpointBase* parent = m_parent;
+
+	m_channel->Start(
+		[weakPtr, parent](std::vector<SharedMemoryMessage>&& messages)
+		{
+			auto received = std::make_shared<std::vector<PipeMessagePtr>>();
+			received->reserve(messages.size());
+
+			for (auto& [data, length] : messages)
+			{
+				auto message = std::make_unique<PipeMessage>();
+				if (message->Parse(std::move(data), length))
+					received->push_back(std::move(message));
+				else
+					SPDLOG_ERROR("Failed to parse message from shared memory channel, dropping it");
+			}
+
+			parent->PostToPipeThread([weakPtr, received]()
+				{
+					if (auto ptr = weakPtr.lock())
+					{
+						for (auto& message : *received)
+							ptr->InternalReceiveMessage(std::move(message));
+					}
+				});
+		},
+		[weakPtr, parent]()
+		{
+			parent->PostToPipeThread([weakPtr]()
+				{
+					if (auto ptr = weakPtr.lock(); ptr && ptr->m_channel)
+						ptr->m_channel->Flush();
+				});
+		});
+}
+
 //============================================================================
 // NamedPipeThreadBase
 //============================================================================
@@ -797,6 +1071,7 @@ void NamedPipeServer::NamedPipeThread()
 				// create new connection object and pass the pipe off to it.
 				auto connection = std::make_shared<PipeConnection>(this, std::move(m_hPipe));
 				connection->StartRead();
+				connection->InternalSendHello();
 
 				std::scoped_lock<std::mutex> lock(m_mutex);
 				m_connections.push_back(connection);
@@ -1056,12 +1331,16 @@ void NamedPipeServer::SendMessage(int connectionId, MQMessageId messageId, const
 
 void NamedPipeServer::BroadcastMessage(const PipeMessagePtr& message)
 {
+	// every connection gets its own header (the sequence id is per connection) but they all share
+	// a single copy of the data
+	auto data = std::make_shared<const std::string>(message->get<const char>(), message->size());
+
 	for (const auto& connection : m_connections)
 	{
-		// force the copy here instead of downstream (because we only want to do this in broadcast)
-		connection->SendMessage(
-			std::make_unique<PipeMessage>(*message->GetHeader(), message->get(), message->size())
-		);
+		auto copy = std::make_unique<PipeMessage>(*message->GetHeader(), nullptr, 0);
+		copy->SetTail(data);
+
+		connection->SendMessage(std::move(copy));
 	}
 }
 
@@ -1123,6 +1402,7 @@ void NamedPipeClient::NamedPipeThread()
 				else
 				{
 					m_connection = std::make_shared<PipeConnection>(this, std::move(hPipe));
+					m_connection->SetSharedMemoryCapacity(m_sharedMemoryCapacity);
 					m_connection->StartRead();
 
 					if (m_handler)
@@ -1195,7 +1475,9 @@ void NamedPipeClient::NamedPipeThread()
 		// Second loop will try to process events on the connection
 		while (m_connection && IsRunning())
 		{
-			DWORD dwWait = WaitForMultipleObjectsEx(static_cast<DWORD>(lengthof(waitEvents)), waitEvents, FALSE, INFINITE, TRUE);
+			// wake up in time to stop waiting on an unanswered shared memory offer
+			DWORD timeout = m_connection->CheckSharedMemoryOffer();
+			DWORD dwWait = WaitForMultipleObjectsEx(static_cast<DWORD>(lengthof(waitEvents)), waitEvents, FALSE, timeout, TRUE);
 
 			switch (dwWait)
 			{
@@ -1205,6 +1487,7 @@ void NamedPipeClient::NamedPipeThread()
 				break;
 
 			case WAIT_IO_COMPLETION:
+			case WAIT_TIMEOUT:
 				break;
 
 			default:
@@ -15,6 +15,7 @@
 #pragma once
 
 #include "NamedPipesProtocol.h"
+#include "SharedMemory.h"
 
 #include <wil/resource.h>
 #include <atomic>
@@ -22,6 +23,7 @@
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -99,6 +101,13 @@ public:
 	template <typename T = void>
 	const T* get() const { return reinterpret_cast<T*>(m_buffer.get() + m_dataOffset); }
 
+	// Appends shared bytes to the end of the message data without copying them, so that the same
+	// payload can be queued to many connections. The tail is only joined with the rest of the
+	// message when it is written to the pipe, which means get() does not include it. Only use this
+	// for messages that are sent directly over a connection.
+	void SetTail(std::shared_ptr<const std::string> tail);
+	bool HasTail() const { return m_tail != nullptr; }
+
 	size_t size() const { return m_header ? m_header->messageLength : 0; }
 
 	uint32_t GetSequenceId() const { return m_header ? m_header->sequenceId : 0; }
@@ -117,12 +126,14 @@ private:
 
 	const uint8_t* buffer() const { return m_buffer.get(); }
 	size_t buffer_size() const { return m_bufferLength; }
+	const std::shared_ptr<const std::string>& tail() const { return m_tail; }
 
 private:
 	std::unique_ptr<uint8_t[]> m_buffer;
 	size_t m_bufferLength = 0;
 	MQMessageHeader* m_header = nullptr;
 	size_t m_dataOffset = 0;
+	std::shared_ptr<const std::string> m_tail;
 	bool m_valid = false;
 	bool m_replied = false;
 
@@ -207,6 +218,25 @@ private:
 
 	bool InternalClose(bool disconnect);
 
+	// Shared memory channel negotiation. The server sends a hello when a client connects, and a client
+	// that wants a channel offers one once the hello says the server can take it. Older servers never
+	// send the hello, so the client just stays on the pipe. The client holds on to anything it sends
+	// until the server answers the offer, so nothing arrives out of order. The server opens the
+	// channel and replies over the pipe, after which both sides send everything over the channel. The
+	// pipe is still read, and is used as-is if the channel can't be set up.
+	void SetSharedMemoryCapacity(uint32_t capacity) { m_sharedMemoryCapacity = capacity; }
+	void InternalSendHello();
+	void InternalReceiveHello(const PipeMessagePtr& message);
+	void InternalOfferSharedMemory();
+	void InternalAcceptSharedMemory(const PipeMessagePtr& message);
+	void HandleSharedMemoryReply(uint8_t status);
+	void HandleLateSharedMemoryReply(uint8_t status);
+	void ReleaseHeldMessages();
+	void StartChannel();
+
+	// returns the time to wait until the offer expires, or INFINITE if there is no offer
+	uint32_t CheckSharedMemoryOffer();
+
 private:
 	wil::unique_hfile m_hPipe;
 	NamedPipeEndpointBase* m_parent = nullptr;
@@ -227,8 +257,22 @@ private:
 	std::deque<std::unique_ptr<QueuedOp>> m_writeQueue;
 	bool m_pendingWrite = false;
 
+	// message mode pipes need each message in a single write, so messages with a shared tail are
+	// joined here. Only one write is ever pending, so the buffer is reused between writes.
+	std::vector<uint8_t> m_writeBuffer;
+
 	// mapping of sequence id to callbacks
 	std::unordered_map<uint32_t, RpcRequest<PipeMessageResponseCb>> m_rpcRequests;
+
+	// shared memory channel that carries messages instead of the pipe once it is active
+	std::unique_ptr<SharedMemoryChannel> m_channel;
+	bool m_channelActive = false;
+	uint32_t m_sharedMemoryCapacity = 0;
+	uint32_t m_offerSequenceId = 0;
+	uint32_t m_expiredOfferSequenceId = 0;
+	bool m_heldForOffer = false;
+	std::chrono::steady_clock::time_point m_offerExpires;
+	std::deque<PipeMessagePtr> m_heldMessages;
 };
 using PipeConnectionPtr = std::shared_ptr<PipeConnection>;
 
@@ -380,12 +424,17 @@ public:
 
 	PipeConnectionPtr GetConnection() const { return m_connection; }
 
+	// Size in bytes of each ring of the shared memory channel offered to servers that support it. Zero
+	// keeps all traffic on the pipe. Takes effect on the next connection.
+	void SetSharedMemoryCapacity(uint32_t capacity) { m_sharedMemoryCapacity = capacity; }
+
 private:
 	virtual void NamedPipeThread() override;
 	virtual void CloseConnection(PipeConnection* connection) override;
 
 private:
 	std::shared_ptr<PipeConnection> m_connection;
+	std::atomic<uint32_t> m_sharedMemoryCapacity{ 0 };
 };
 
 } // namespace mq
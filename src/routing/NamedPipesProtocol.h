@@ -27,6 +27,8 @@ enum class MQMessageId : uint16_t
 	MSG_ROUTE                              = 2,     // Route a message to a mailbox in a client
 	MSG_IDENTIFICATION                     = 3,     // Update routing information in server/client or request ID list
 	MSG_DROPPED                            = 4,     // Notify clients that an address is no longer connected
+	MSG_SHARED_MEMORY_OFFER                = 5,     // Offer a shared memory channel to carry the rest of the traffic on a connection
+	MSG_HELLO                              = 6,     // Sent by the server to a new connection to say what it supports
 
 	// FIXME: We really should have message ids separated by plugins or services. For now we will use a single enum
 	// and just change it later.
@@ -68,6 +70,21 @@ struct MQMessageHeader
 
 #pragma pack(pop)
 
+// MSG_HELLO -> from server, right after a client connects. Older servers don't send it.
+struct MQMessageHello
+{
+	uint32_t            sharedMemoryVersion;  // SHARED_MEMORY_CHANNEL_VERSION the server accepts, 0 if none
+};
+
+// MSG_SHARED_MEMORY_OFFER -> from client, only after a hello that names its version. The reply status is 0
+// if the channel was opened.
+struct MQMessageSharedMemoryOffer
+{
+	uint32_t            version;       // SHARED_MEMORY_CHANNEL_VERSION of the client
+	uint32_t            capacity;      // size of each ring in bytes
+	char                name[64];      // name of the shared memory
+};
+
 // MSG_MAIN_PROCESS_LOADED
 struct MQMessageProcessLoadedFromMQ
 {
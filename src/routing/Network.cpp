@@ -22,15 +22,25 @@
 #include "Network.pb.h"
 
 #include "asio.hpp"
+#include "google/protobuf/io/coded_stream.h"
 #include "spdlog/spdlog.h"
+#include "zstd.h"
 
-#include <queue>
+#include <deque>
+#include <fstream>
 #include <map>
 #include <atomic>
-#include <iphlpapi.h>
 #include <optional>
 
+#if defined(_WIN32)
+#include <iphlpapi.h>
+
 #pragma comment(lib, "Iphlpapi.lib")
+#else
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <pthread.h>
+#endif
 
 // Some stubbing for leader work has been done if it is desirable to implement it later
 //	-- leader gets PAT from router
@@ -45,46 +55,305 @@ using namespace mq;
 class NetworkSession;
 using InternalMessageHandler = std::function<void(const peernetwork::Header&, NetworkSession*, std::unique_ptr<uint8_t[]>, uint32_t)>;
 
-template <typename T>
-class LockedQueue
+// a non-owning view over a buffer sequence that outlives the write it is used for. Handing this to
+// async_write instead of the vector avoids copying the whole sequence into the write operation.
+struct ConstBufferView
+{
+	using value_type = asio::const_buffer;
+	using const_iterator = const asio::const_buffer*;
+
+	const_iterator first = nullptr;
+	const_iterator last = nullptr;
+
+	const_iterator begin() const { return first; }
+	const_iterator end() const { return last; }
+};
+
+// Compresses and decompresses session payloads with zstd. A peer owns one of these and shares it
+// with all of its sessions, which is safe because sessions only read and write on the ASIO thread.
+// That also lets every session reuse the same compression contexts.
+class PayloadCompressor
 {
 public:
-	void Push(T value)
+	explicit PayloadCompressor(const NetworkConfiguration& configuration)
+		: m_enabled(configuration.Compression)
+		, m_threshold(configuration.CompressionThreshold)
+		, m_cctx(ZSTD_createCCtx())
+		, m_dctx(ZSTD_createDCtx())
 	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		m_queue.push(std::move(value));
+		ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_compressionLevel, configuration.CompressionLevel);
+
+		if (m_enabled && !configuration.CompressionDictionary.empty())
+			LoadDictionary(configuration.CompressionDictionary, configuration.CompressionLevel);
 	}
 
-	T Pop()
+	~PayloadCompressor()
 	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		T value;
-		std::swap(value, m_queue.front());
-		m_queue.pop();
-		return value;
+		ZSTD_freeCDict(m_cdict);
+		ZSTD_freeDDict(m_ddict);
+		ZSTD_freeCCtx(m_cctx);
+		ZSTD_freeDCtx(m_dctx);
 	}
 
-	bool Empty()
+	PayloadCompressor(const PayloadCompressor&) = delete;
+	PayloadCompressor& operator=(const PayloadCompressor&) = delete;
+	PayloadCompressor(PayloadCompressor&&) = delete;
+	PayloadCompressor& operator=(PayloadCompressor&&) = delete;
+
+	// fills in the compression this peer is willing to receive
+	void Advertise(peernetwork::Identity& id) const
 	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		return m_queue.empty();
+		if (m_enabled)
+		{
+			id.add_compression(peernetwork::CompressionZstd);
+			if (m_dictionaryId != 0)
+			{
+				id.add_compression(peernetwork::CompressionZstdDictionary);
+				id.set_dictionary_id(m_dictionaryId);
+			}
+		}
+	}
+
+	// chooses the compression to send with, given what the remote peer advertised
+	peernetwork::Compression Negotiate(const peernetwork::Identity& id) const
+	{
+		if (!m_enabled)
+			return peernetwork::CompressionNone;
+
+		auto supports = [&id](peernetwork::Compression compression)
+		{
+			return std::find(id.compression().begin(), id.compression().end(), compression) != id.compression().end();
+		};
+
+		if (m_dictionaryId != 0 && id.dictionary_id() == m_dictionaryId && supports(peernetwork::CompressionZstdDictionary))
+			return peernetwork::CompressionZstdDictionary;
+
+		if (supports(peernetwork::CompressionZstd))
+			return peernetwork::CompressionZstd;
+
+		return peernetwork::CompressionNone;
+	}
+
+	// replaces the payload and the shared tail with compressed bytes if the message is large enough and
+	// actually gets smaller. The payload and the tail are compressed as separate frames, which decompress
+	// as one, so that the compressed tail can be kept with the shared payload and reused by every session
+	// that sends it. Returns true if the message was compressed.
+	bool Compress(peernetwork::Compression compression, peernetwork::Header& header,
+		std::unique_ptr<uint8_t[]>& payload, uint32_t& length, NetworkSharedPayload* shared,
+		std::shared_ptr<const std::string>& tail)
+	{
+		const size_t payloadLength = payload ? length : 0;
+		const size_t tailLength = tail ? tail->size() : 0;
+		const size_t rawLength = payloadLength + tailLength;
+		if (compression == peernetwork::CompressionNone || rawLength < m_threshold)
+			return false;
+
+		std::shared_ptr<const std::string> compressedTail;
+		if (tailLength > 0)
+		{
+			compressedTail = CompressShared(compression, *shared);
+			if (!compressedTail)
+				return false;
+		}
+
+		std::unique_ptr<uint8_t[]> compressedPayload;
+		size_t compressedLength = 0;
+		if (payloadLength > 0)
+		{
+			const size_t bound = ZSTD_compressBound(payloadLength);
+			compressedPayload = std::make_unique<uint8_t[]>(bound);
+
+			compressedLength = CompressFrame(compression, payload.get(), payloadLength, compressedPayload.get(), bound);
+			if (compressedLength == 0)
+				return false;
+		}
+
+		// incompressible data goes out as is
+		const size_t totalLength = compressedLength + (compressedTail ? compressedTail->size() : 0);
+		if (totalLength >= rawLength)
+			return false;
+
+		header.set_compression(compression);
+		header.set_raw_length(static_cast<uint32_t>(rawLength));
+
+		payload = std::move(compressedPayload);
+		length = static_cast<uint32_t>(compressedLength);
+		tail = std::move(compressedTail);
+
+		m_messagesCompressed.fetch_add(1, std::memory_order_relaxed);
+		m_bytesBeforeCompression.fetch_add(rawLength, std::memory_order_relaxed);
+		m_bytesAfterCompression.fetch_add(totalLength, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// replaces a compressed payload with its original bytes. Uncompressed payloads are left alone.
+	// Returns false if the payload can't be decompressed.
+	bool Decompress(const peernetwork::Header& header, std::unique_ptr<uint8_t[]>& payload, uint32_t& length)
+	{
+		const auto compression = header.compression();
+		if (compression == peernetwork::CompressionNone)
+			return true;
+
+		const ZSTD_DDict* ddict = nullptr;
+		if (compression == peernetwork::CompressionZstdDictionary)
+		{
+			if (m_ddict == nullptr)
+			{
+				SPDLOG_WARN("Got dictionary compressed payload without a dictionary loaded");
+				return false;
+			}
+
+			ddict = m_ddict;
+		}
+		else if (compression != peernetwork::CompressionZstd)
+		{
+			SPDLOG_WARN("Got payload with unknown compression {}", static_cast<int>(compression));
+			return false;
+		}
+
+		const uint32_t rawLength = header.raw_length();
+		if (rawLength > MAX_DECOMPRESSED_LENGTH)
+		{
+			SPDLOG_WARN("Compressed payload claims {} bytes, dropping it", rawLength);
+			return false;
+		}
+
+		auto decompressed = std::make_unique<uint8_t[]>(rawLength);
+		const size_t result = ZSTD_decompress_usingDDict(m_dctx, decompressed.get(), rawLength, payload.get(), length, ddict);
+		if (ZSTD_isError(result) || result != rawLength)
+		{
+			SPDLOG_WARN("Failed to decompress {} byte payload: {}", length,
+				ZSTD_isError(result) ? ZSTD_getErrorName(result) : "length mismatch");
+			return false;
+		}
+
+		m_messagesDecompressed.fetch_add(1, std::memory_order_relaxed);
+		m_bytesBeforeDecompression.fetch_add(length, std::memory_order_relaxed);
+		m_bytesAfterDecompression.fetch_add(rawLength, std::memory_order_relaxed);
+
+		payload = std::move(decompressed);
+		length = rawLength;
+
+		return true;
+	}
+
+	NetworkCompressionStats GetStats() const
+	{
+		NetworkCompressionStats stats;
+		stats.MessagesCompressed = m_messagesCompressed.load(std::memory_order_relaxed);
+		stats.BytesBeforeCompression = m_bytesBeforeCompression.load(std::memory_order_relaxed);
+		stats.BytesAfterCompression = m_bytesAfterCompression.load(std::memory_order_relaxed);
+		stats.MessagesDecompressed = m_messagesDecompressed.load(std::memory_order_relaxed);
+		stats.BytesBeforeDecompression = m_bytesBeforeDecompression.load(std::memory_order_relaxed);
+		stats.BytesAfterDecompression = m_bytesAfterDecompression.load(std::memory_order_relaxed);
+
+		return stats;
 	}
 
 private:
-	std::mutex m_mutex;
-	std::queue<T> m_queue;
+	// compresses the shared bytes the first time they are sent with this compression, later sends reuse the
+	// cached frame. Returns null if they don't get any smaller.
+	std::shared_ptr<const std::string> CompressShared(peernetwork::Compression compression, NetworkSharedPayload& shared)
+	{
+		for (const auto& [cachedCompression, compressed] : shared.Compressed)
+		{
+			if (cachedCompression == compression)
+				return compressed;
+		}
+
+		const std::string& data = *shared.Data;
+		std::string compressed(ZSTD_compressBound(data.size()), '\0');
+
+		std::shared_ptr<const std::string> result;
+		const size_t compressedLength = CompressFrame(compression, data.data(), data.size(), compressed.data(), compressed.size());
+		if (compressedLength > 0 && compressedLength < data.size())
+		{
+			compressed.resize(compressedLength);
+			result = std::make_shared<const std::string>(std::move(compressed));
+		}
+
+		shared.Compressed.emplace_back(compression, result);
+		return result;
+	}
+
+	// compresses a single zstd frame, returns its length or 0 if it failed
+	size_t CompressFrame(peernetwork::Compression compression, const void* data, size_t length, void* out, size_t capacity)
+	{
+		ZSTD_CCtx_reset(m_cctx, ZSTD_reset_session_only);
+		ZSTD_CCtx_refCDict(m_cctx, compression == peernetwork::CompressionZstdDictionary ? m_cdict : nullptr);
+
+		const size_t result = ZSTD_compress2(m_cctx, out, capacity, data, length);
+		if (ZSTD_isError(result))
+		{
+			SPDLOG_WARN("Failed to compress {} byte payload: {}", length, ZSTD_getErrorName(result));
+			return 0;
+		}
+
+		return result;
+	}
+
+	void LoadDictionary(const std::string& path, int level)
+	{
+		std::ifstream file(path, std::ios::binary);
+		const std::string dictionary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (dictionary.empty())
+		{
+			SPDLOG_WARN("Unable to read compression dictionary {}", path);
+			return;
+		}
+
+		// raw content dictionaries have no id to negotiate with, so only trained dictionaries are accepted
+		m_dictionaryId = ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size());
+		if (m_dictionaryId == 0)
+		{
+			SPDLOG_WARN("Compression dictionary {} is not a trained zstd dictionary", path);
+			return;
+		}
+
+		m_cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(), level);
+		m_ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+		if (m_cdict == nullptr || m_ddict == nullptr)
+		{
+			SPDLOG_WARN("Failed to load compression dictionary {}", path);
+
+			ZSTD_freeCDict(m_cdict);
+			ZSTD_freeDDict(m_ddict);
+			m_cdict = nullptr;
+			m_ddict = nullptr;
+			m_dictionaryId = 0;
+		}
+	}
+
+	// nothing we send comes close to this, it just stops a bad header from allocating the world
+	static constexpr uint32_t MAX_DECOMPRESSED_LENGTH = 64 * 1024 * 1024;
+
+	const bool m_enabled;
+	const uint32_t m_threshold;
+
+	ZSTD_CCtx* m_cctx;
+	ZSTD_DCtx* m_dctx;
+	ZSTD_CDict* m_cdict = nullptr;
+	ZSTD_DDict* m_ddict = nullptr;
+	uint32_t m_dictionaryId = 0;
+
+	std::atomic<uint64_t> m_messagesCompressed{ 0 };
+	std::atomic<uint64_t> m_bytesBeforeCompression{ 0 };
+	std::atomic<uint64_t> m_bytesAfterCompression{ 0 };
+	std::atomic<uint64_t> m_messagesDecompressed{ 0 };
+	std::atomic<uint64_t> m_bytesBeforeDecompression{ 0 };
+	std::atomic<uint64_t> m_bytesAfterDecompression{ 0 };
 };
 
 class NetworkMessage
 {
 public:
-	// outgoing message
-	NetworkMessage(peernetwork::Header header, std::unique_ptr<uint8_t[]> payload, uint32_t length)
-		: m_parsedHeader(std::move(header))
-		, m_length(length)
-		, m_payload(std::move(payload))
+	// outgoing message. The tail is shared bytes that are written after the payload without being
+	// copied, and count towards the length of the message.
+	NetworkMessage(peernetwork::Header header, std::unique_ptr<uint8_t[]> payload, uint32_t length,
+		std::shared_ptr<const std::string> tail = nullptr)
 	{
-		InitHeader();
+		Set(std::move(header), std::move(payload), length, std::move(tail));
 	}
 
 	// incoming message
@@ -97,6 +366,18 @@ public:
 	NetworkMessage(NetworkMessage&&) = delete;
 	NetworkMessage& operator=(NetworkMessage&&) = delete;
 
+	// (re)initializes an outgoing message, this lets a message be reused after it has been written
+	void Set(peernetwork::Header header, std::unique_ptr<uint8_t[]> payload, uint32_t length,
+		std::shared_ptr<const std::string> tail = nullptr)
+	{
+		m_parsedHeader = std::move(header);
+		m_length = length + (tail ? static_cast<uint32_t>(tail->size()) : 0);
+		m_payload = std::move(payload);
+		m_tail = std::move(tail);
+
+		InitHeader();
+	}
+
 	void InitHeader()
 	{
 		m_parsedHeader.set_length(m_length);
@@ -104,35 +385,44 @@ public:
 		m_headerLengthNetwork = htonl(m_headerLength);
 
 		AllocateHeader();
-		m_parsedHeader.SerializeToArray(m_header.get(), static_cast<int>(m_headerLength));
+		m_parsedHeader.SerializeToArray(m_header.data(), static_cast<int>(m_headerLength));
 	}
 
+	// the header storage keeps its capacity through Reset, so reused messages don't reallocate it
 	void AllocateHeader()
 	{
-		m_header = std::make_unique<uint8_t[]>(m_headerLength);
+		m_header.resize(m_headerLength);
 	}
 
 	void Init()
 	{
-		m_parsedHeader.ParseFromArray(m_header.get(), static_cast<int>(m_headerLength));
+		m_parsedHeader.ParseFromArray(m_header.data(), static_cast<int>(m_headerLength));
 		m_length = m_parsedHeader.length();
 
 		if (m_length > 0)
 			m_payload = std::make_unique<uint8_t[]>(m_length);
 	}
 
-	std::vector<asio::const_buffer> Buffers() const
+	// appends the buffers that make up this message on the wire, returning the number of bytes added
+	size_t AppendBuffers(std::vector<asio::const_buffer>& buffers) const
 	{
 		// This assumes a header will always exist, ensure that the asio read assumes that as well!
-		std::vector<asio::const_buffer> buffers{
-			asio::buffer(&m_headerLengthNetwork, sizeof(uint32_t)),
-			asio::buffer(m_header.get(), m_headerLength)
-		};
+		buffers.emplace_back(asio::buffer(&m_headerLengthNetwork, sizeof(uint32_t)));
+		buffers.emplace_back(asio::buffer(m_header.data(), m_headerLength));
 
-		if (m_payload && m_length > 0)
-			buffers.emplace_back(asio::buffer(m_payload.get(), m_length));
+		const uint32_t tailLength = m_tail ? static_cast<uint32_t>(m_tail->size()) : 0;
+		if (m_payload && m_length > tailLength)
+			buffers.emplace_back(asio::buffer(m_payload.get(), m_length - tailLength));
 
-		return buffers;
+		if (tailLength > 0)
+			buffers.emplace_back(asio::buffer(m_tail->data(), tailLength));
+
+		return sizeof(uint32_t) + m_headerLength + m_length;
+	}
+
+	bool Decompress(PayloadCompressor& compressor)
+	{
+		return compressor.Decompress(m_parsedHeader, m_payload, m_length);
 	}
 
 	void Receive(NetworkSession* session, const InternalMessageHandler& handler)
@@ -144,7 +434,7 @@ public:
 
 	uint32_t& HeaderLength() { return m_headerLength; }
 	uint32_t& HeaderLengthNetwork() { return m_headerLengthNetwork; }
-	uint8_t* Header() const { return m_header.get(); }
+	uint8_t* Header() { return m_header.data(); }
 	const peernetwork::Header& ParsedHeader() { return m_parsedHeader; }
 
 	uint32_t& Length() { return m_length; }
@@ -154,35 +444,38 @@ public:
 	{
 		m_headerLength = 0;
 		m_headerLengthNetwork = 0;
-		m_header.reset();
+		m_header.clear();
 
 		m_parsedHeader.Clear();
 
 		m_length = 0;
 		m_payload.reset();
+		m_tail.reset();
 	}
 
 private:
 	uint32_t m_headerLength = 0;
 	uint32_t m_headerLengthNetwork = 0;
-	std::unique_ptr<uint8_t[]> m_header;
+	std::vector<uint8_t> m_header;
 
 	peernetwork::Header m_parsedHeader;
 
 	uint32_t m_length = 0;
 	std::unique_ptr<uint8_t[]> m_payload;
+	std::shared_ptr<const std::string> m_tail;
 };
 
 class NetworkSession
 {
 public:
-	NetworkSession(uint16_t peer_port, tcp::socket socket, InternalMessageHandler receiveHandler)
+	NetworkSession(uint16_t peer_port, tcp::socket socket, PayloadCompressor& compressor, InternalMessageHandler receiveHandler)
 		: m_socket(std::move(socket))
 		, m_peerPort(peer_port)
 		, m_address({m_socket.remote_endpoint().address().to_string(), m_socket.remote_endpoint().port()})
 		, m_knownAddress(m_address)
 		, m_active(true)
 		, m_messageBuffer(std::make_unique<NetworkMessage>())
+		, m_compressor(compressor)
 		, m_receiveHandler(std::move(receiveHandler))
 	{
 		SPDLOG_TRACE("{}: Session created ({}:{})", m_peerPort, m_knownAddress.IP, m_knownAddress.Port);
@@ -203,7 +496,7 @@ public:
 		if (m_active)
 		{
 			SPDLOG_TRACE("{}: Shutting down connection {}:{} ({}:{})", m_peerPort, m_address.IP, m_address.Port, m_knownAddress.IP, m_knownAddress.Port);
-			std::error_code ec;
+			asio::error_code ec;
 
 			// only shutdown writes. shutting down both will cause forced socket closures on the other end
 			if (m_socket.shutdown(asio::socket_base::shutdown_send, ec))
@@ -223,7 +516,7 @@ public:
 	{
 		if (m_socket.is_open() && !m_reading && !m_writing)
 		{
-			std::error_code ec;
+			asio::error_code ec;
 			if (m_socket.close(ec))
 				SPDLOG_WARN("{}: Received error when closing down socket {}: {}", m_peerPort, ec.value(), ec.message());
 		}
@@ -236,15 +529,35 @@ public:
 		Read();
 	}
 
-	void Write(peernetwork::Header header, std::unique_ptr<uint8_t[]> payload, uint32_t length)
+	void Write(peernetwork::Header header, std::unique_ptr<uint8_t[]> payload, uint32_t length,
+		std::shared_ptr<NetworkSharedPayload> shared = nullptr)
 	{
 		// don't start writes on sessions that are closing down
 		if (m_active)
 		{
+			std::shared_ptr<const std::string> tail = shared ? shared->Data : nullptr;
+
 			// this function should only ever get called from the ASIO thread
 			// to ensure that we don't have multiple write loops happening at
-			// once
-			m_outgoing.Push(std::make_unique<NetworkMessage>(std::move(header), std::move(payload), length));
+			// once. That also means the outgoing queue doesn't need a lock.
+			// Only routed messages are compressed, bookkeeping messages like the handshake have to be
+			// readable before anything is negotiated.
+			if (header.type() == peernetwork::Route)
+				m_compressor.Compress(m_compression, header, payload, length, shared.get(), tail);
+
+			std::unique_ptr<NetworkMessage> message;
+			if (!m_messagePool.empty())
+			{
+				message = std::move(m_messagePool.back());
+				m_messagePool.pop_back();
+				message->Set(std::move(header), std::move(payload), length, std::move(tail));
+			}
+			else
+			{
+				message = std::make_unique<NetworkMessage>(std::move(header), std::move(payload), length, std::move(tail));
+			}
+
+			m_outgoing.push_back(std::move(message));
 
 			// kick off the loop if it's not running and there are messages
 			if (!m_writing)
@@ -267,10 +580,13 @@ public:
 		m_peerUuid = uuid;
 	}
 
+	// set from the remote peer's handshake, until then everything is sent uncompressed
+	void SetCompression(peernetwork::Compression compression) { m_compression = compression; }
+
 	const std::string& UUID() { return m_peerUuid; }
 
 private:
-	void CloseWithMessage(const std::error_code& ec, std::string_view step)
+	void CloseWithMessage(const asio::error_code& ec, std::string_view step)
 	{
 		// see if the EC is a normal operation that shouldn't throw an error message
 		// if the EC is a continuable error, just warn
@@ -295,7 +611,7 @@ private:
 			m_socket,
 			asio::buffer(&m_messageBuffer->HeaderLengthNetwork(), sizeof(uint32_t)),
 			asio::transfer_exactly(sizeof(uint32_t)),
-			[this](const std::error_code& ec, size_t)
+			[this](const asio::error_code& ec, size_t)
 			{
 				SPDLOG_TRACE("{}: reading message from socket {}", m_peerPort, m_socket.local_endpoint().port());
 				if (!ec)
@@ -325,7 +641,7 @@ private:
 				m_socket,
 				asio::buffer(m_messageBuffer->Header(), m_messageBuffer->HeaderLength()),
 				asio::transfer_exactly(m_messageBuffer->HeaderLength()),
-				[this](const std::error_code& ec, size_t)
+				[this](const asio::error_code& ec, size_t)
 				{
 					if (!ec)
 						ReadPayload();
@@ -354,7 +670,7 @@ private:
 				m_socket,
 				asio::buffer(m_messageBuffer->Payload(), m_messageBuffer->Length()),
 				asio::transfer_exactly(m_messageBuffer->Length()),
-				[this](const std::error_code& ec, size_t)
+				[this](const asio::error_code& ec, size_t)
 				{
 					if (!ec)
 						ReceiveMessage();
@@ -377,7 +693,12 @@ private:
 		SPDLOG_TRACE("{}: Received message from {}:{} ({} bytes)",
 			m_peerPort, m_knownAddress.IP, m_knownAddress.Port, m_messageBuffer->Length());
 
-		if (m_receiveHandler != nullptr)
+		if (!m_messageBuffer->Decompress(m_compressor))
+		{
+			SPDLOG_WARN("{}: Dropping message from {}:{} that could not be decompressed",
+				m_peerPort, m_knownAddress.IP, m_knownAddress.Port);
+		}
+		else if (m_receiveHandler != nullptr)
 		{
 			m_messageBuffer->Receive(this, m_receiveHandler);
 		}
@@ -389,27 +710,38 @@ private:
 
 	void InternalWrite()
 	{
-		if (m_outgoing.Empty())
+		if (m_outgoing.empty())
 		{
 			m_writing = false;
 		}
 		else
 		{
 			m_writing = true;
-			m_currentOutgoing = m_outgoing.Pop();
 
-			SPDLOG_TRACE("{}: writing message to socket {}", m_peerPort, m_socket.remote_endpoint().port());
+			// drain as much of the queue as we reasonably can into a single gather write
+			m_writeBuffers.clear();
+			size_t batchBytes = 0;
+			while (!m_outgoing.empty()
+				&& m_currentOutgoing.size() < MAX_WRITE_BATCH_MESSAGES
+				&& batchBytes < MAX_WRITE_BATCH_BYTES)
+			{
+				batchBytes += m_outgoing.front()->AppendBuffers(m_writeBuffers);
+				m_currentOutgoing.push_back(std::move(m_outgoing.front()));
+				m_outgoing.pop_front();
+			}
+
+			SPDLOG_TRACE("{}: writing {} messages to socket {}", m_peerPort, m_currentOutgoing.size(), m_socket.remote_endpoint().port());
 
 			asio::async_write(
 				m_socket,
-				m_currentOutgoing->Buffers(),
-				[this](const std::error_code& ec, size_t size)
+				ConstBufferView{ m_writeBuffers.data(), m_writeBuffers.data() + m_writeBuffers.size() },
+				[this](const asio::error_code& ec, size_t size)
 				{
-					SPDLOG_TRACE("{}: Writing message of size {} to {}:{}",
+					SPDLOG_TRACE("{}: Writing messages of size {} to {}:{}",
 						m_peerPort, size, m_socket.remote_endpoint().address().to_string(), m_socket.remote_endpoint().port());
 
-					// always reset the pointer, error or not
-					m_currentOutgoing.reset();
+					// always release the batch, error or not
+					RecycleOutgoing();
 
 					if (!ec)
 						InternalWrite();
@@ -422,7 +754,25 @@ private:
 		}
 	}
 
+	void RecycleOutgoing()
+	{
+		for (auto& message : m_currentOutgoing)
+		{
+			if (m_messagePool.size() < MAX_POOLED_MESSAGES)
+			{
+				message->Reset();
+				m_messagePool.push_back(std::move(message));
+			}
+		}
+
+		m_currentOutgoing.clear();
+	}
+
 private:
+	static constexpr size_t MAX_WRITE_BATCH_MESSAGES = 64;
+	static constexpr size_t MAX_WRITE_BATCH_BYTES = 256 * 1024;
+	static constexpr size_t MAX_POOLED_MESSAGES = 32;
+
 	tcp::socket m_socket;
 	const uint16_t m_peerPort;
 	const NetworkAddress m_address;
@@ -432,9 +782,14 @@ private:
 
 	const std::unique_ptr<NetworkMessage> m_messageBuffer;
 
+	PayloadCompressor& m_compressor;
+	peernetwork::Compression m_compression = peernetwork::CompressionNone;
+
 	InternalMessageHandler m_receiveHandler;
-	LockedQueue<std::unique_ptr<NetworkMessage>> m_outgoing;
-	std::unique_ptr<NetworkMessage> m_currentOutgoing;
+	std::deque<std::unique_ptr<NetworkMessage>> m_outgoing;
+	std::vector<std::unique_ptr<NetworkMessage>> m_currentOutgoing;
+	std::vector<std::unique_ptr<NetworkMessage>> m_messagePool;
+	std::vector<asio::const_buffer> m_writeBuffers;
 
 	bool m_writing = false;
 	bool m_reading = false;
@@ -474,7 +829,7 @@ private:
 		else
 		{
 			m_timer.expires_from_now(m_period);
-			m_timer.async_wait([this](const std::error_code& _ec)
+			m_timer.async_wait([this](const asio::error_code& _ec)
 			{
 				this->HandleTimeout(_ec);
 			});
@@ -671,6 +1026,7 @@ public:
 		: m_acceptor(m_ioContext, tcp::endpoint(tcp::v4(), configuration.Port))
 		, m_port(m_acceptor.local_endpoint().port())
 		, m_uuid(CreateUUID())
+		, m_compressor(configuration)
 		, m_selfHosts(GetAdaptersAddresses())
 		, m_announcer(m_ioContext, m_port, configuration.MulticastPeriod, configuration.MulticastPort,
 			asio::ip::address::from_string(configuration.MulticastAddress))
@@ -712,6 +1068,7 @@ public:
 				{
 					try
 					{
+#if defined(_WIN32)
 						using fSetThreadDescription = HRESULT(WINAPI*)(HANDLE, PCWSTR);
 						fSetThreadDescription SetThreadDescription = nullptr;
 						if (auto kernel = GetModuleHandleA("kernel32.dll"))
@@ -719,6 +1076,9 @@ public:
 
 						if (SetThreadDescription)
 							SetThreadDescription(GetCurrentThread(), L"Network ASIO");
+#else
+						pthread_setname_np(pthread_self(), "Network ASIO");
+#endif
 
 						SPDLOG_TRACE("{}: Initializing peer", m_port);
 
@@ -753,13 +1113,14 @@ public:
 		peernetwork::MessageType message_type,
 		const NetworkAddress& address,
 		std::unique_ptr<uint8_t[]> payload,
-		uint32_t length)
+		uint32_t length,
+		std::shared_ptr<NetworkSharedPayload> shared = nullptr)
 	{
 		if (m_running)
 		{
 			std::unique_lock lock(m_processMutex);
 
-			m_writeQueue.emplace_back(message_type, address, std::move(payload), length);
+			m_writeQueue.emplace_back(message_type, address, std::move(payload), length, std::move(shared));
 			m_ioContext.post([this] { ProcessWrites(); });
 		}
 	}
@@ -876,6 +1237,11 @@ public:
 		return m_port;
 	}
 
+	NetworkCompressionStats GetCompressionStats() const
+	{
+		return m_compressor.GetStats();
+	}
+
 private:
 
 	void Handshake(peernetwork::MessageType messageType, NetworkSession* session, const NetworkAddress& address)
@@ -886,6 +1252,7 @@ private:
 		peernetwork::Identity id;
 		id.set_uuid(m_uuid);
 		id.set_port(m_port);
+		m_compressor.Advertise(id);
 
 		auto payload = std::make_unique<uint8_t[]>(id.ByteSizeLong());
 		id.SerializeToArray(payload.get(), static_cast<uint32_t>(id.ByteSizeLong()));
@@ -906,7 +1273,7 @@ private:
 
 		socket->async_connect(
 			endpoint,
-			[this, address = address, socket](const std::error_code& ec)
+			[this, address = address, socket](const asio::error_code& ec)
 			{
 				if (m_running && !ec)
 				{
@@ -948,7 +1315,7 @@ private:
 	void Accept()
 	{
 		m_acceptor.async_accept(
-			[this](const std::error_code& ec, tcp::socket socket)
+			[this](const asio::error_code& ec, tcp::socket socket)
 			{
 				if (m_running && !ec)
 				{
@@ -980,7 +1347,7 @@ private:
 
 	NetworkSession* AddSession(tcp::socket socket)
 	{
-		auto session = std::make_unique<NetworkSession>(m_port, std::move(socket),
+		auto session = std::make_unique<NetworkSession>(m_port, std::move(socket), m_compressor,
 			[this](
 				const peernetwork::Header& header,
 				NetworkSession* session,
@@ -1007,6 +1374,7 @@ private:
 					{
 						peernetwork::Identity id;
 						id.ParseFromArray(payload.get(), length);
+						session->SetCompression(m_compressor.Negotiate(id));
 						ResolveHandshake(session->Address(), id.uuid(), id.port());
 						Handshake(peernetwork::MessageType::Response, session, NetworkAddress{ session->Address().IP, static_cast<uint16_t>(id.port()) });
 						break;
@@ -1015,6 +1383,7 @@ private:
 					{
 						peernetwork::Identity id;
 						id.ParseFromArray(payload.get(), length);
+						session->SetCompression(m_compressor.Negotiate(id));
 						ResolveHandshake(session->Address(), id.uuid(), id.port());
 						break;
 					}
@@ -1242,7 +1611,7 @@ private:
 			PruneSessions();
 			auto timer = asio::steady_timer(m_ioContext);
 			timer.expires_from_now(std::chrono::milliseconds(50));
-			timer.async_wait([this](const std::error_code&) { DrainSessions(); });
+			timer.async_wait([this](const asio::error_code&) { DrainSessions(); });
 		}
 		else
 			m_ioContext.stop();
@@ -1276,12 +1645,12 @@ private:
 
 		if (!m_writeQueue.empty())
 		{
-			std::vector<std::tuple<peernetwork::MessageType, NetworkAddress, std::unique_ptr<uint8_t[]>, uint32_t>> writes;
+			std::vector<std::tuple<peernetwork::MessageType, NetworkAddress, std::unique_ptr<uint8_t[]>, uint32_t, std::shared_ptr<NetworkSharedPayload>>> writes;
 			std::swap(writes, m_writeQueue);
 
 			lock.unlock();
 
-			for (auto& [message_type, address, payload, length] : writes)
+			for (auto& [message_type, address, payload, length, shared] : writes)
 			{
 				peernetwork::Header header;
 				header.set_type(message_type);
@@ -1291,11 +1660,11 @@ private:
 
 				if (auto session = m_connectingSessions.find(address); session != m_connectingSessions.end())
 				{
-					session->second->Write(std::move(header), std::move(payload), length);
+					session->second->Write(std::move(header), std::move(payload), length, std::move(shared));
 				}
 				else if (auto session = m_sessions.find(address); session != m_sessions.end())
 				{
-					session->second->Write(std::move(header), std::move(payload), length);
+					session->second->Write(std::move(header), std::move(payload), length, std::move(shared));
 				}
 				else
 				{
@@ -1306,7 +1675,7 @@ private:
 						{
 							header.set_address(address.IP);
 							header.set_port(address.Port);
-							session->second->Write(std::move(header), std::move(payload), length);
+							session->second->Write(std::move(header), std::move(payload), length, std::move(shared));
 						}
 						else
 						{
@@ -1335,15 +1704,16 @@ private:
 
 			for (auto& [message_type, payload, length] : broadcasts)
 			{
+				// every session writes the same bytes, so share them instead of copying (or compressing) per session
+				auto shared = std::make_shared<NetworkSharedPayload>(
+					std::make_shared<const std::string>(reinterpret_cast<const char*>(payload.get()), length));
+
 				for (const auto& [_, session] : m_sessions)
 				{
 					peernetwork::Header header;
 					header.set_type(message_type);
 
-					auto payload_copy = std::make_unique<uint8_t[]>(length);
-					memcpy(payload_copy.get(), payload.get(), length);
-
-					session->Write(std::move(header), std::move(payload_copy), length);
+					session->Write(std::move(header), nullptr, 0, shared);
 				}
 			}
 		}
@@ -1367,6 +1737,7 @@ private:
 
 	static std::unordered_set<std::string> GetAdaptersAddresses()
 	{
+#if defined(_WIN32)
 		DWORD outLen = 1 << 12; // start with 4k
 		IP_ADAPTER_ADDRESSES* addresses = nullptr;
 		DWORD retVal = 0;
@@ -1435,6 +1806,37 @@ private:
 		}
 
 		return addrs;
+#else
+		std::unordered_set<std::string> addrs;
+
+		ifaddrs* addresses = nullptr;
+		if (getifaddrs(&addresses) != 0)
+			return addrs;
+
+		for (ifaddrs* a = addresses; a != nullptr; a = a->ifa_next)
+		{
+			if (a->ifa_addr == nullptr || (a->ifa_flags & IFF_UP) == 0)
+				continue;
+
+			if (a->ifa_addr->sa_family == AF_INET)
+			{
+				auto* si = reinterpret_cast<sockaddr_in*>(a->ifa_addr);
+				char str[INET_ADDRSTRLEN] = {};
+				if (inet_ntop(AF_INET, &si->sin_addr, str, sizeof(str)) != nullptr)
+					addrs.insert(str);
+			}
+			else if (a->ifa_addr->sa_family == AF_INET6)
+			{
+				auto* si = reinterpret_cast<sockaddr_in6*>(a->ifa_addr);
+				char str[INET6_ADDRSTRLEN] = {};
+				if (inet_ntop(AF_INET6, &si->sin6_addr, str, sizeof(str)) != nullptr)
+					addrs.insert(str);
+			}
+		}
+
+		freeifaddrs(addresses);
+		return addrs;
+#endif
 	}
 
 	asio::io_context m_ioContext{};
@@ -1443,6 +1845,7 @@ private:
 
 	const uint16_t m_port;
 	const std::string m_uuid;
+	PayloadCompressor m_compressor;
 
 	std::vector<NetworkAddress> m_queuedConnects;
 	std::unordered_set<NetworkAddress> m_pendingConnects;
@@ -1473,7 +1876,7 @@ private:
 
 	std::vector<std::function<void()>> m_processQueue;
 	std::vector<std::pair<NetworkAddress, NetworkMessagePtr>> m_receiveQueue;
-	std::vector<std::tuple<peernetwork::MessageType, NetworkAddress, std::unique_ptr<uint8_t[]>, uint32_t>> m_writeQueue;
+	std::vector<std::tuple<peernetwork::MessageType, NetworkAddress, std::unique_ptr<uint8_t[]>, uint32_t, std::shared_ptr<NetworkSharedPayload>>> m_writeQueue;
 	std::vector<std::tuple<peernetwork::MessageType, std::unique_ptr<uint8_t[]>, uint32_t>> m_broadcastQueue;
 	std::mutex m_processMutex;
 };
@@ -1551,6 +1954,40 @@ void NetworkPeerAPI::Send(const std::string& address, uint16_t port, NetworkMess
 	}
 }
 
+void NetworkPeerAPI::SendRouted(const std::string& address, uint16_t port, const std::string& routedHead,
+	std::shared_ptr<NetworkSharedPayload> routedTail) const
+{
+	const auto peer = s_peers.find(m_port);
+	if (peer != s_peers.end())
+	{
+		// this is the encoding of a peernetwork::NetworkMessage with only the routed field set, written
+		// out by hand so that the tail can be sent as its own buffer
+		const uint32_t routedLength = static_cast<uint32_t>(routedHead.size() + (routedTail ? routedTail->Data->size() : 0));
+
+		uint8_t prefix[16];
+		uint8_t* prefixEnd = google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(
+			(peernetwork::NetworkMessage::kRoutedFieldNumber << 3) | 2 /* length delimited */, prefix);
+		prefixEnd = google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(routedLength, prefixEnd);
+		const size_t prefixLength = prefixEnd - prefix;
+
+		const uint32_t length = static_cast<uint32_t>(prefixLength + routedHead.size());
+		auto payload = std::make_unique<uint8_t[]>(length);
+		memcpy(payload.get(), prefix, prefixLength);
+		memcpy(payload.get() + prefixLength, routedHead.data(), routedHead.size());
+
+		peer->second->Send(
+			peernetwork::Route,
+			NetworkAddress{ address, port },
+			std::move(payload),
+			length,
+			std::move(routedTail));
+	}
+	else
+	{
+		SPDLOG_WARN("{}: Attempting to send message with an uninitialized peer", m_port);
+	}
+}
+
 void NetworkPeerAPI::Broadcast(NetworkMessagePtr message) const
 {
 	SPDLOG_TRACE("{}: Attempting to broadcast message with peer", m_port);
@@ -1610,3 +2047,12 @@ bool NetworkPeerAPI::HasHost(const std::string& address, uint16_t port) const
 	const auto peer = s_peers.find(m_port);
 	return peer != s_peers.end() && peer->second->HasHost(NetworkAddress{ address, port });
 }
+
+NetworkCompressionStats NetworkPeerAPI::GetCompressionStats() const
+{
+	const auto peer = s_peers.find(m_port);
+	if (peer != s_peers.end())
+		return peer->second->GetCompressionStats();
+
+	return {};
+}
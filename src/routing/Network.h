@@ -20,6 +20,9 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "Routing.h"
 
@@ -53,6 +56,41 @@ struct NetworkConfiguration
 	uint16_t MulticastPort = 30000 + DEFAULT_NETWORK_PEER_PORT; // port the udp multicast sender sends to
 	std::string MulticastAddress = "239.255.77.81"; // multicast address to use (http://en.wikipedia.org/wiki/Multicast_address)
 	std::string MulticastListenAddress = "0.0.0.0"; // multicast address to listen on
+	bool Compression = true; // offer zstd payload compression to peers during the handshake
+	uint32_t CompressionThreshold = 512; // payloads smaller than this many bytes are always sent uncompressed
+	int CompressionLevel = 3; // zstd compression level
+	std::string CompressionDictionary; // optional trained zstd dictionary, only used with peers that load the same one
+};
+
+// running totals of compressed peer traffic, in payload bytes
+struct NetworkCompressionStats
+{
+	uint64_t MessagesCompressed = 0;
+	uint64_t BytesBeforeCompression = 0;
+	uint64_t BytesAfterCompression = 0;
+
+	uint64_t MessagesDecompressed = 0;
+	uint64_t BytesBeforeDecompression = 0;
+	uint64_t BytesAfterDecompression = 0;
+
+	uint64_t SentBytesSaved() const { return BytesBeforeCompression - BytesAfterCompression; }
+	uint64_t ReceivedBytesSaved() const { return BytesAfterDecompression - BytesBeforeDecompression; }
+};
+
+// bytes that are sent unchanged to one or more peers. Sessions that compress them keep the compressed
+// bytes here, so a payload that goes out to several peers is only compressed once per compression mode.
+// The cache is only touched on the network thread.
+struct NetworkSharedPayload
+{
+	explicit NetworkSharedPayload(std::shared_ptr<const std::string> data)
+		: Data(std::move(data))
+	{
+	}
+
+	std::shared_ptr<const std::string> Data;
+
+	// compressed frame of Data for each compression it was sent with, null if it didn't get any smaller
+	std::vector<std::pair<peernetwork::Compression, std::shared_ptr<const std::string>>> Compressed;
 };
 
 // this serves as the signature for sending and receiving messages
@@ -83,6 +121,10 @@ public:
 	NetworkPeerAPI& operator=(NetworkPeerAPI&&) = default;
 
 	void Send(const std::string& address, uint16_t port, NetworkMessagePtr message) const;
+
+	// sends a routed message made of routedHead followed by routedTail, without copying the tail
+	void SendRouted(const std::string& address, uint16_t port, const std::string& routedHead,
+		std::shared_ptr<NetworkSharedPayload> routedTail) const;
 	void Broadcast(NetworkMessagePtr message) const;
 	void Process() const;
 
@@ -93,6 +135,8 @@ public:
 	void RemoveHost(const std::string& address, uint16_t port) const;
 	bool HasHost(const std::string& address, uint16_t port) const;
 
+	NetworkCompressionStats GetCompressionStats() const;
+
 	uint16_t GetPort() const { return m_port; }
 
 private:
@@ -56,34 +56,78 @@ std::string ActorIdentification::ToString() const
 	return fmt::format("{} ({})", name, container);
 }
 
-void Mailbox::Deliver(MessagePtr message) const
+void MessageRing::push(MessagePtr message)
+{
+	if (m_size == m_slots.size())
+	{
+		// out of storage but not at capacity, so grow and unroll the ring while we're at it
+		std::vector<MessagePtr> slots(std::min(m_capacity, std::max<size_t>(8, m_slots.size() * 2)));
+		for (size_t i = 0; i < m_size; ++i)
+			slots[i] = std::move(m_slots[(m_head + i) % m_slots.size()]);
+
+		m_slots = std::move(slots);
+		m_head = 0;
+	}
+
+	m_slots[(m_head + m_size) % m_slots.size()] = std::move(message);
+	++m_size;
+}
+
+MessagePtr MessageRing::pop()
+{
+	MessagePtr message = std::move(m_slots[m_head]);
+	m_head = (m_head + 1) % m_slots.size();
+	--m_size;
+
+	return message;
+}
+
+MessagePtr Mailbox::Deliver(MessagePtr message) const
 {
 	SPDLOG_TRACE("Mailbox {{{}}}: Delivering message to address {}",
 		m_localAddress, message->address().ShortDebugString());
 
+	MessagePtr dropped;
+	if (m_receiveQueue.full())
+	{
+		++m_dropped;
+		if (m_overflow != MailboxOverflow::DropOldest)
+			return message;
+
+		dropped = m_receiveQueue.pop();
+	}
+
 	m_receiveQueue.push(std::move(message));
+	m_highWater = std::max(m_highWater, m_receiveQueue.size());
+
+	return dropped;
 }
 
-void Mailbox::Process(size_t howMany) const
+bool Mailbox::ProcessOne() const
 {
-	if (howMany > 0 && !m_receiveQueue.empty())
+	if (!m_receiveQueue.empty())
 	{
 		SPDLOG_TRACE("Mailbox {{{}}}: Processing queue", m_localAddress);
 
-		m_receive(std::move(m_receiveQueue.front()));
-		m_receiveQueue.pop();
-
-		Process(howMany - 1);
+		m_receive(m_receiveQueue.pop());
 	}
+
+	return !m_receiveQueue.empty();
+}
+
+MailboxStats Mailbox::GetStats() const
+{
+	return MailboxStats{ m_receiveQueue.size(), m_highWater, m_receiveQueue.capacity(), m_dropped };
 }
 
 Dropbox::Dropbox()
 {
 }
 
-Dropbox::Dropbox(std::string localAddress, PostCallback&& post, DropboxDropper&& unregister)
+Dropbox::Dropbox(std::string localAddress, PostCallback&& post, GatherPostCallback&& gather, DropboxDropper&& unregister)
 	: m_localAddress(std::move(localAddress))
 	, m_post(std::move(post))
+	, m_gather(std::move(gather))
 	, m_unregister(std::move(unregister))
 	, m_valid(true)
 {
@@ -92,6 +136,7 @@ Dropbox::Dropbox(std::string localAddress, PostCallback&& post, DropboxDropper&&
 Dropbox::Dropbox(Dropbox&& other) noexcept
 	: m_localAddress(std::move(other.m_localAddress))
 	, m_post(std::move(other.m_post))
+	, m_gather(std::move(other.m_gather))
 	, m_unregister(std::move(other.m_unregister))
 	, m_valid(other.m_valid)
 {
@@ -105,6 +150,7 @@ Dropbox& Dropbox::operator=(Dropbox&& other) noexcept
 {
 	m_localAddress = std::move(other.m_localAddress);
 	m_post = std::move(other.m_post);
+	m_gather = std::move(other.m_gather);
 	m_unregister = std::move(other.m_unregister);
 	m_valid = other.m_valid;
 	return *this;
@@ -167,6 +213,11 @@ PostOffice::~PostOffice()
 
 	m_rpcRequests.clear();
 
+	for (auto& [_, request] : m_gatherRequests)
+		request.Complete(MsgError_ConnectionClosed);
+
+	m_gatherRequests.clear();
+
 	// after the mailbox is removed from the post office, it won't get any more messages, and let's
 	// make sure all remaining messages get discarded by dropping the last reference, so we stop
 	// processing
@@ -188,14 +239,15 @@ void PostOffice::RouteMessage(const proto::routing::Address& address, const std:
 void PostOffice::RoutingFailed(int status, MessagePtr message, std::string_view what)
 {
 	// don't do anything if this isn't an RPC, nothing else will expect a response
-	if (message->mode() == static_cast<uint32_t>(MQRequestMode::CallAndResponse))
+	if (message->mode() == static_cast<uint32_t>(MQRequestMode::CallAndResponse)
+		|| message->mode() == static_cast<uint32_t>(MQRequestMode::Gather))
 	{
 		auto data = fmt::format("{} at address {}", what, message->address().ShortDebugString());
 		m_dropbox.PostReply(std::move(message), std::move(data), status);
 	}
 }
 
-Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCallback&& receive)
+Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCallback&& receive, const MailboxOptions& options)
 {
 	auto [mailbox, added] = m_mailboxes.emplace(
 		localAddress, std::make_unique<Mailbox>(localAddress,
@@ -215,17 +267,31 @@ Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCall
 
 						m_rpcRequests.erase(request);
 					}
+					else if (m_gatherRequests.find(message->sequence()) != m_gatherRequests.end())
+					{
+						OnGatherReply(std::move(message));
+					}
+					else if (m_finishedGathers.count(message->sequence()) > 0)
+					{
+						// a recipient that answered after the gather was already done, nobody is waiting for it
+						SPDLOG_TRACE("Mailbox {{{}}}: Dropping late reply to gather seq={} from {}",
+							m_id, message->sequence(), message->return_address().ShortDebugString());
+					}
 					else
 					{
 						SPDLOG_WARN("Mailbox {{{}}}: Failed to find RPC seq={} in post office on message reply at address {}",
 							m_id, message->sequence(), message->address().ShortDebugString());
 					}
 				}
+				else if (message->mode() == static_cast<uint32_t>(MQRequestMode::GatherManifest))
+				{
+					OnGatherManifest(std::move(message));
+				}
 				else
 				{
 					receive(std::move(message));
 				}
-			}));
+			}, options));
 
 	if (added)
 	{
@@ -235,13 +301,7 @@ Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCall
 			{
 				// the post callback -- this will always be called on the generation side of messages so we need
 				// to set initial values
-				if (message->sequence() == 0)
-					message->set_sequence(++m_nextSequence);
-
-				// set the specific return address
-				proto::routing::Address& ret = *message->mutable_return_address();
-				m_id.BuildAddress(ret);
-				ret.set_mailbox(localAddress);
+				StampMessage(*message, localAddress);
 
 				SPDLOG_TRACE("Dropbox {{{}}}}: posting message to address {} seq={}",
 					m_id, message->address().ShortDebugString(), message->sequence());
@@ -261,6 +321,21 @@ Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCall
 
 				RouteMessage(std::move(message));
 			},
+			[this, localAddress](MessagePtr message, std::chrono::milliseconds timeout, const GatherCallback& callback)
+			{
+				StampMessage(*message, localAddress);
+
+				SPDLOG_TRACE("Dropbox {{{}}}: gathering from address {} seq={}",
+					m_id, message->address().ShortDebugString(), message->sequence());
+
+				// the router sends the manifest back after fanning the message out, and the request
+				// completes once everyone in it has replied or the deadline passes (see Process)
+				message->set_mode(static_cast<uint32_t>(MQRequestMode::Gather));
+				m_gatherRequests.emplace(message->sequence(),
+					GatherRequest{ callback, std::chrono::steady_clock::now() + timeout });
+
+				RouteMessage(std::move(message));
+			},
 			[this](const std::string& localAddress)
 			{
 				RemoveMailbox(localAddress);
@@ -270,6 +345,133 @@ Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCall
 	return Dropbox();
 }
 
+void PostOffice::StampMessage(proto::routing::Envelope& message, const std::string& localAddress)
+{
+	if (message.sequence() == 0)
+		message.set_sequence(++m_nextSequence);
+
+	// set the specific return address
+	proto::routing::Address& ret = *message.mutable_return_address();
+	m_id.BuildAddress(ret);
+	ret.set_mailbox(localAddress);
+}
+
+bool PostOffice::GatherRequest::IsComplete() const
+{
+	return recipients && std::all_of(recipients->begin(), recipients->end(),
+		[this](const proto::routing::Address& recipient) { return replied.count(recipient.uuid()) > 0; });
+}
+
+void PostOffice::GatherRequest::Complete(int status)
+{
+	GatherResult result;
+	result.status = status;
+	result.replies = std::move(replies);
+
+	if (recipients)
+	{
+		for (auto& recipient : *recipients)
+		{
+			if (replied.count(recipient.uuid()) == 0)
+				result.timedOut.push_back(std::move(recipient));
+		}
+	}
+
+	if (callback)
+		callback(std::move(result));
+}
+
+void PostOffice::OnGatherManifest(MessagePtr message)
+{
+	auto request = m_gatherRequests.find(message->sequence());
+	if (request == m_gatherRequests.end())
+	{
+		// the deadline passed before the router answered
+		SPDLOG_DEBUG("PostOffice {{{}}}: Received manifest for unknown gather seq={}", m_id, message->sequence());
+		return;
+	}
+
+	proto::routing::GatherManifest manifest;
+	if (!manifest.ParseFromString(message->payload()))
+	{
+		SPDLOG_WARN("PostOffice {{{}}}: Failed to parse manifest for gather seq={}", m_id, message->sequence());
+		return;
+	}
+
+	request->second.recipients.emplace(
+		std::make_move_iterator(manifest.mutable_recipients()->begin()),
+		std::make_move_iterator(manifest.mutable_recipients()->end()));
+
+	if (request->second.IsComplete())
+	{
+		// take the request out of the map first, the callback is free to start another gather
+		GatherRequest completed = std::move(request->second);
+		m_gatherRequests.erase(request);
+		FinishGather(message->sequence());
+
+		completed.Complete(0);
+	}
+}
+
+void PostOffice::OnGatherReply(MessagePtr message)
+{
+	auto request = m_gatherRequests.find(message->sequence());
+	if (request == m_gatherRequests.end())
+		return;
+
+	const uint32_t sequence = message->sequence();
+	request->second.replied.insert(message->return_address().uuid());
+	request->second.replies.push_back(std::move(message));
+
+	if (request->second.IsComplete())
+	{
+		GatherRequest completed = std::move(request->second);
+		m_gatherRequests.erase(request);
+		FinishGather(sequence);
+
+		completed.Complete(0);
+	}
+}
+
+void PostOffice::FinishGather(uint32_t sequence, std::chrono::steady_clock::time_point now)
+{
+	if (m_finishedGathers.insert(sequence).second)
+		m_finishedGatherOrder.emplace_back(sequence, now);
+}
+
+void PostOffice::ProcessGatherTimeouts()
+{
+	if (m_gatherRequests.empty() && m_finishedGatherOrder.empty())
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+
+	while (!m_finishedGatherOrder.empty() && m_finishedGatherOrder.front().second + FINISHED_GATHER_WINDOW <= now)
+	{
+		m_finishedGathers.erase(m_finishedGatherOrder.front().first);
+		m_finishedGatherOrder.pop_front();
+	}
+
+	std::vector<GatherRequest> expired;
+	for (auto it = m_gatherRequests.begin(); it != m_gatherRequests.end();)
+	{
+		if (it->second.deadline <= now)
+		{
+			expired.push_back(std::move(it->second));
+			FinishGather(it->first, now);
+			it = m_gatherRequests.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	// without a manifest there's no telling who was supposed to reply
+	for (auto& request : expired)
+		request.Complete(request.recipients ? 0 : MsgError_RoutingFailed);
+}
+
 bool PostOffice::RemoveMailbox(const std::string& localAddress)
 {
 	return m_mailboxes.erase(localAddress) == 1;
@@ -281,7 +483,15 @@ bool PostOffice::DeliverTo(const std::string& localAddress, MessagePtr message)
 	if (mailbox_it != m_mailboxes.end())
 	{
 		OnDeliver(localAddress, message);
-		mailbox_it->second->Deliver(std::move(message));
+		if (MessagePtr dropped = mailbox_it->second->Deliver(std::move(message)))
+		{
+			SPDLOG_DEBUG("{}: Mailbox {} is full, dropped message seq={}",
+				m_id, localAddress, dropped->sequence());
+
+			// whichever message the policy discarded, an RPC sender is still waiting for its reply
+			RoutingFailed(MsgError_MailboxFull, std::move(dropped), "Mailbox is full");
+		}
+
 		return true;
 	}
 
@@ -289,13 +499,43 @@ bool PostOffice::DeliverTo(const std::string& localAddress, MessagePtr message)
 	return false;
 }
 
-void PostOffice::Process(size_t howMany)
+bool PostOffice::Process(std::chrono::microseconds budget)
 {
-	size_t messages_per_mailbox = std::max(1, (int)std::round(howMany / m_mailboxes.size()));
-	for (const auto& [_, mailbox] : m_mailboxes)
+	ProcessGatherTimeouts();
+
+	// take one message from each mailbox per round so that a busy mailbox can't starve the others
+	auto deadline = std::chrono::steady_clock::now() + budget;
+	bool pending;
+	do
 	{
-		mailbox->Process(messages_per_mailbox);
-	}
+		pending = false;
+		for (const auto& [_, mailbox] : m_mailboxes)
+		{
+			if (mailbox->ProcessOne())
+				pending = true;
+		}
+	} while (pending && std::chrono::steady_clock::now() < deadline);
+
+	return pending;
+}
+
+std::optional<MailboxStats> PostOffice::GetMailboxStats(const std::string& localAddress) const
+{
+	auto mailbox_it = m_mailboxes.find(localAddress);
+	if (mailbox_it != m_mailboxes.end())
+		return mailbox_it->second->GetStats();
+
+	return std::nullopt;
+}
+
+std::vector<std::pair<std::string, MailboxStats>> PostOffice::GetMailboxStats() const
+{
+	std::vector<std::pair<std::string, MailboxStats>> stats;
+	stats.reserve(m_mailboxes.size());
+	for (const auto& [address, mailbox] : m_mailboxes)
+		stats.emplace_back(address, mailbox->GetStats());
+
+	return stats;
 }
 
 } // namespace postoffice
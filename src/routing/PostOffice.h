@@ -18,12 +18,17 @@
 
 #include "fmt/format.h"
 
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include <memory>
 #include <variant>
 #include <optional>
+#include <vector>
 
 namespace mq::postoffice {
 
@@ -37,6 +42,24 @@ using ReceiveCallback = std::function<void(MessagePtr)>;
 using PostCallback = std::function<void(MessagePtr, const MessageResponseCallback&) > ;
 using DropboxDropper = std::function<void(const std::string&)>;
 
+/**
+ * The collected replies of a gather request
+ */
+struct GatherResult
+{
+	/** 0 if the router reported the recipients of the request, otherwise the reason it didn't */
+	int status = 0;
+
+	/** every reply in the order it arrived, each one carries its own status */
+	std::vector<MessagePtr> replies;
+
+	/** the recipients that hadn't replied when the deadline passed */
+	std::vector<proto::routing::Address> timedOut;
+};
+
+using GatherCallback = std::function<void(GatherResult&&)>;
+using GatherPostCallback = std::function<void(MessagePtr, std::chrono::milliseconds, const GatherCallback&)>;
+
 struct ActorContainer
 {
 	struct Process
@@ -524,12 +547,70 @@ struct ActorIdentification
 	std::string ToString() const;
 };
 
+/**
+ * What a mailbox does with a message that is delivered while its queue is full. Under every policy,
+ * a discarded RPC is failed back to its sender with MsgError_MailboxFull.
+ */
+enum class MailboxOverflow : uint8_t
+{
+	DropOldest,      // discard the oldest queued message to make room
+	DropNewest,      // discard the delivered message
+	Reject,          // discard the delivered message
+};
+
+struct MailboxOptions
+{
+	/** the most messages the mailbox queues before the overflow policy applies */
+	size_t Capacity = 4096;
+
+	MailboxOverflow Overflow = MailboxOverflow::Reject;
+};
+
+struct MailboxStats
+{
+	size_t Depth = 0;
+	size_t HighWater = 0;      // the deepest the queue has been
+	size_t Capacity = 0;
+	uint64_t Dropped = 0;      // messages discarded by the overflow policy, rejected ones included
+};
+
+/**
+ * A bounded FIFO of messages. The storage grows as needed up to the capacity and is reused after
+ * that, so a mailbox that keeps up with its traffic doesn't allocate on delivery.
+ */
+class MessageRing
+{
+public:
+	explicit MessageRing(size_t capacity)
+		: m_capacity(std::max<size_t>(capacity, 1))
+	{}
+
+	bool empty() const { return m_size == 0; }
+	bool full() const { return m_size == m_capacity; }
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_capacity; }
+
+	// the ring must not be full
+	void push(MessagePtr message);
+
+	// the ring must not be empty
+	MessagePtr pop();
+
+private:
+	std::vector<MessagePtr> m_slots;
+	size_t m_head = 0;
+	size_t m_size = 0;
+	const size_t m_capacity;
+};
+
 class Mailbox
 {
 public:
-	Mailbox(std::string localAddress, ReceiveCallback&& receive)
+	Mailbox(std::string localAddress, ReceiveCallback&& receive, const MailboxOptions& options = {})
 		: m_localAddress(std::move(localAddress))
 		, m_receive(std::move(receive))
+		, m_overflow(options.Overflow)
+		, m_receiveQueue(options.Capacity)
 	{}
 
 	~Mailbox() {}
@@ -541,25 +622,39 @@ public:
 	 */
 	const std::string& GetAddress() const { return m_localAddress; }
 
+	/**
+	 * Gets what happens to messages delivered while the queue is full
+	 */
+	MailboxOverflow GetOverflow() const { return m_overflow; }
+
 	/**
 	 * Delivers a message to this mailbox to be handled by the receive callback
 	 *
 	 * @param message the message to deliver
+	 * @return the message the overflow policy discarded, if the queue was full
 	 */
-	void Deliver(MessagePtr message) const;
+	MessagePtr Deliver(MessagePtr message) const;
 
 	/**
-	 * Process some messages that have been delivered
+	 * Processes the oldest message that has been delivered
 	 *
-	 * @param howMany how many messages to process off the queue
+	 * @return true if there are more messages waiting
+	 */
+	bool ProcessOne() const;
+
+	/**
+	 * Gets the queue depth statistics of this mailbox
 	 */
-	void Process(size_t howMany) const;
+	MailboxStats GetStats() const;
 
 private:
 	const std::string m_localAddress;
 	const ReceiveCallback m_receive;
+	const MailboxOverflow m_overflow;
 
-	mutable std::queue<MessagePtr> m_receiveQueue;
+	mutable MessageRing m_receiveQueue;
+	mutable size_t m_highWater = 0;
+	mutable uint64_t m_dropped = 0;
 };
 
 class Dropbox
@@ -570,7 +665,7 @@ public:
 	Dropbox();
 	~Dropbox();
 
-	Dropbox(std::string localAddress, PostCallback&& post, DropboxDropper&& unregister);
+	Dropbox(std::string localAddress, PostCallback&& post, GatherPostCallback&& gather, DropboxDropper&& unregister);
 
 	Dropbox(Dropbox&& other) noexcept;
 	Dropbox& operator=(Dropbox&& other) noexcept;
@@ -601,6 +696,24 @@ public:
 		if (IsValid()) m_post(Stuff(address, std::string()), callback);
 	}
 
+	/**
+	 * Sends a message to every actor that matches an address and collects their replies. This is
+	 * the multi-recipient form of an RPC, an ambiguous address is not an error here.
+	 *
+	 * @tparam T the message being sent, usually some kind of proto
+	 *
+	 * @param address the address to send the message, it can match any number of recipients
+	 * @param obj the message (as an object)
+	 * @param timeout how long to wait for the recipients to reply
+	 * @param callback called once, when every recipient has replied or the timeout has passed
+	 */
+	template <typename T>
+	void Gather(const proto::routing::Address& address, const T& obj, std::chrono::milliseconds timeout,
+		const GatherCallback& callback)
+	{
+		if (IsValid()) m_gather(Stuff(address, obj), timeout, callback);
+	}
+
 	/**
 	 * Sends a reply to the sender of a message -- the message can be anything
 	 * because we make no assumption about what is wrapped in the envelope
@@ -619,6 +732,11 @@ public:
 
 	void PostReply(MessagePtr message, const std::string& data, int status = 0);
 
+	/**
+	 * Gets the local address of the mailbox this dropbox sends from
+	 */
+	const std::string& GetAddress() const { return m_localAddress; }
+
 	/**
 	 * Checks if the dropbox has a post callback and an address
 	 *
@@ -653,6 +771,7 @@ private:
 
 	std::string m_localAddress;
 	PostCallback m_post;
+	GatherPostCallback m_gather;
 	DropboxDropper m_unregister;
 	bool m_valid = false;
 };
@@ -715,16 +834,17 @@ public:
 	 * @param message the originating message that failed to route, used to build the response
 	 * @param what a string message that prepends to the address to print out at the source
 	 */
-	void RoutingFailed(int status, MessagePtr message, std::string_view what);
+	virtual void RoutingFailed(int status, MessagePtr message, std::string_view what);
 
 	/**
 	 * Creates and registers a mailbox with the post office
 	 *
 	 * @param localAddress the string address to create the address at
 	 * @param receive a callback rvalue that will process messages as they are received in this mailbox
+	 * @param options the queue limits of the mailbox
 	 * @return a dropbox that the creator can use to send addressed messages. will be invalid if it failed to add
 	 */
-	Dropbox RegisterAddress(const std::string& localAddress, ReceiveCallback&& receive);
+	Dropbox RegisterAddress(const std::string& localAddress, ReceiveCallback&& receive, const MailboxOptions& options = {});
 
 	/**
 	 * Removes a mailbox from the post office
@@ -752,11 +872,26 @@ public:
 	bool DeliverTo(const std::string& localAddress, MessagePtr message);
 
 	/**
-	 * Processes messages waiting in the queue
+	 * Processes messages waiting in the mailboxes. Every mailbox with waiting messages processes at
+	 * least one, then the mailboxes take turns until they are empty or the time budget is used up.
+	 *
+	 * @param budget how long to keep processing messages for
+	 * @return true if there are messages left to process
+	 */
+	bool Process(std::chrono::microseconds budget);
+
+	/**
+	 * Gets the queue depth statistics of a mailbox
 	 *
-	 * @param howMany how many messages to process (up to)
+	 * @param localAddress the local address of the mailbox
+	 * @return the statistics, or nothing if there is no mailbox at that address
+	 */
+	std::optional<MailboxStats> GetMailboxStats(const std::string& localAddress) const;
+
+	/**
+	 * Gets the queue depth statistics of every mailbox
 	 */
-	void Process(size_t howMany);
+	std::vector<std::pair<std::string, MailboxStats>> GetMailboxStats() const;
 
 	/**
 	 * Get the local post office identification
@@ -766,12 +901,49 @@ public:
 	const ActorIdentification& GetID() { return m_id; }
 
 protected:
+	/**
+	 * Sets the sequence and the return address of a message posted from a local mailbox
+	 */
+	void StampMessage(proto::routing::Envelope& message, const std::string& localAddress);
+
+	void OnGatherManifest(MessagePtr message);
+	void OnGatherReply(MessagePtr message);
+	void ProcessGatherTimeouts();
+
+	// remembers a gather that is done, so that replies that show up after it completed or timed out
+	// can be told apart from replies to requests we never made
+	void FinishGather(uint32_t sequence, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+	// how long the sequence of a finished gather is remembered for
+	static constexpr std::chrono::seconds FINISHED_GATHER_WINDOW{ 60 };
+
+	/**
+	 * Bookkeeping for a gather request. The recipients aren't known until the router sends the
+	 * manifest back, replies that arrive before it are kept and matched up when it does.
+	 */
+	struct GatherRequest
+	{
+		GatherCallback callback;
+		std::chrono::steady_clock::time_point deadline;
+		std::optional<std::vector<proto::routing::Address>> recipients;
+		std::unordered_set<std::string> replied; // uuids
+		std::vector<MessagePtr> replies;
+
+		bool IsComplete() const;
+		void Complete(int status);
+	};
+
 	MailboxMap m_mailboxes;
 	Dropbox m_dropbox;
 	ActorIdentification m_id;
 
 	uint32_t m_nextSequence = 0;
 	std::unordered_map<uint32_t, RpcRequest<MessageResponseCallback>> m_rpcRequests;
+	std::unordered_map<uint32_t, GatherRequest> m_gatherRequests;
+
+	// finished gathers in the order they finished, for expiring them, and the same sequences for lookup
+	std::deque<std::pair<uint32_t, std::chrono::steady_clock::time_point>> m_finishedGatherOrder;
+	std::unordered_set<uint32_t> m_finishedGathers;
 };
 
 } // namespace mq::postoffice
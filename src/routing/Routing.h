@@ -31,6 +31,8 @@ enum class MQRequestMode : uint8_t
 	SimpleMessage   = 0,          // (Default) This is a simple message. There is no reply.
 	CallAndResponse = 1,          // This is an RPC style message with a reply.
 	MessageReply    = 2,          // This is an RPC style message reply.
+	Gather          = 3,          // This is an RPC sent to every matching recipient, the sender collects the replies.
+	GatherManifest  = 4,          // This is the list of recipients a Gather message was sent to, from the router.
 };
 
 // Error Codes that can be delivered in a message callback. These are negative, because positive error
@@ -39,6 +41,7 @@ constexpr int MsgError_ConnectionClosed        = -1;                  // connect
 constexpr int MsgError_NoConnection            = -2;                  // no connection established
 constexpr int MsgError_RoutingFailed           = -3;                  // message routing failed
 constexpr int MsgError_AmbiguousRecipient      = -4;                  // RPC message couldn't determine single recipient
+constexpr int MsgError_MailboxFull             = -5;                  // the receiving mailbox is full and rejected the message
 
 // mapping of sequence id to callbacks -- these need to be maintained independently for each connection
 // and the post office if there is more than one connection, so provide a universal method for handling them
@@ -20,12 +20,217 @@
 #include "routing/ProtoPipes.h"
 #include "mq/base/String.h"
 
+#include "google/protobuf/io/coded_stream.h"
 #include "spdlog/spdlog.h"
 
 namespace mq::postoffice {
 
 //=============================================================================
 
+std::string SharedPayload::SerializeHeader(const proto::routing::Envelope& header) const
+{
+	std::string result = header.SerializeAsString();
+
+	uint8_t prefix[16];
+	uint8_t* prefixEnd = google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(
+		(proto::routing::Envelope::kPayloadFieldNumber << 3) | 2 /* length delimited */, prefix);
+	prefixEnd = google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(
+		static_cast<uint32_t>(Data->size()), prefixEnd);
+
+	result.append(reinterpret_cast<const char*>(prefix), prefixEnd - prefix);
+	return result;
+}
+
+//=============================================================================
+
+void ActorStatsCounters::AddLatency(std::chrono::steady_clock::duration latency)
+{
+	const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(latency).count();
+	const auto bucket = std::find_if(LatencyLimits.begin(), LatencyLimits.end(),
+		[ms](uint32_t limit) { return ms < limit; });
+
+	++RpcLatency[std::distance(LatencyLimits.begin(), bucket)];
+}
+
+uint32_t ActorStatsCounters::RpcCount() const
+{
+	uint32_t count = 0;
+	for (uint32_t bucket : RpcLatency)
+		count += bucket;
+
+	return count;
+}
+
+ActorStatsCounters& ActorStatsCounters::operator+=(const ActorStatsCounters& other)
+{
+	Received += other.Received;
+	Sent += other.Sent;
+	ReceivedBytes += other.ReceivedBytes;
+	SentBytes += other.SentBytes;
+	RoutingFailures += other.RoutingFailures;
+
+	for (size_t i = 0; i < LatencyBuckets; ++i)
+		RpcLatency[i] += other.RpcLatency[i];
+
+	return *this;
+}
+
+ActorStatsCounters& ActorStatsWindow::At(int64_t second)
+{
+	const size_t slot = static_cast<size_t>(second % MaxSeconds);
+	if (m_seconds[slot] != second)
+	{
+		m_seconds[slot] = second;
+		m_counters[slot] = ActorStatsCounters{};
+	}
+
+	return m_counters[slot];
+}
+
+const ActorStatsCounters* ActorStatsWindow::Find(int64_t second) const
+{
+	const size_t slot = static_cast<size_t>(second % MaxSeconds);
+	return m_seconds[slot] == second ? &m_counters[slot] : nullptr;
+}
+
+ActorStatsCounters ActorStatsWindow::Sum(int64_t now, uint32_t seconds) const
+{
+	ActorStatsCounters total;
+	for (int64_t second = now - std::min(seconds, MaxSeconds) + 1; second <= now; ++second)
+	{
+		if (auto counters = Find(second))
+			total += *counters;
+	}
+
+	return total;
+}
+
+static int64_t GetStatSecond(std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now())
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+static void FillTrafficCounters(const ActorStatsCounters& counters, proto::routing::TrafficCounters& out)
+{
+	out.set_received(counters.Received);
+	out.set_sent(counters.Sent);
+	out.set_received_bytes(counters.ReceivedBytes);
+	out.set_sent_bytes(counters.SentBytes);
+	out.set_routing_failures(counters.RoutingFailures);
+
+	for (uint32_t bucket : counters.RpcLatency)
+		out.add_rpc_latency(bucket);
+}
+
+static void FillTrafficStats(const ActorStatsWindow& window, int64_t now, uint32_t seconds,
+	proto::routing::TrafficStats& out)
+{
+	FillTrafficCounters(window.Sum(now, seconds), *out.mutable_totals());
+
+	for (int64_t second = now - seconds + 1; second <= now; ++second)
+	{
+		auto counters = window.Find(second);
+		FillTrafficCounters(counters != nullptr ? *counters : ActorStatsCounters{}, *out.add_seconds());
+	}
+}
+
+//=============================================================================
+
+const IdentityIndex::UUIDSet IdentityIndex::s_empty;
+
+void IdentityIndex::Add(const ActorIdentification& id)
+{
+	const std::string& uuid = id.container.uuid;
+
+	std::visit(overload{
+		[this, &uuid](const ActorContainer::Process& process) { Insert(m_byProcess, process.PID, uuid); },
+		[this, &uuid](const ActorContainer::Network& network) { Insert(m_byPeer, NetworkAddress{ network.IP, network.Port }, uuid); }
+	}, id.container.value);
+
+	std::visit(overload{
+		[this, &uuid](const std::string& name) { Insert(m_byName, name, uuid); },
+		[this, &uuid](const ActorIdentification::Client& client)
+		{
+			Insert(m_byAccount, client.account, uuid);
+			Insert(m_byServer, client.server, uuid);
+			Insert(m_byCharacter, client.character, uuid);
+		}
+	}, id.address);
+}
+
+void IdentityIndex::Remove(const ActorIdentification& id)
+{
+	const std::string& uuid = id.container.uuid;
+
+	std::visit(overload{
+		[this, &uuid](const ActorContainer::Process& process) { Erase(m_byProcess, process.PID, uuid); },
+		[this, &uuid](const ActorContainer::Network& network) { Erase(m_byPeer, NetworkAddress{ network.IP, network.Port }, uuid); }
+	}, id.container.value);
+
+	std::visit(overload{
+		[this, &uuid](const std::string& name) { Erase(m_byName, name, uuid); },
+		[this, &uuid](const ActorIdentification::Client& client)
+		{
+			Erase(m_byAccount, client.account, uuid);
+			Erase(m_byServer, client.server, uuid);
+			Erase(m_byCharacter, client.character, uuid);
+		}
+	}, id.address);
+}
+
+void IdentityIndex::Clear()
+{
+	m_byProcess.clear();
+	m_byPeer.clear();
+	m_byName.clear();
+	m_byAccount.clear();
+	m_byServer.clear();
+	m_byCharacter.clear();
+}
+
+bool IdentityIndex::GetCandidates(const proto::routing::Address& address, const UUIDSet*& out) const
+{
+	// every index that applies to the address is a superset of the identities that match it,
+	// so the smallest one is the best place to start testing
+	bool found = false;
+	auto narrow = [&out, &found](const UUIDSet* candidates)
+	{
+		if (candidates == nullptr)
+			candidates = &s_empty;
+
+		if (!found || candidates->size() < out->size())
+			out = candidates;
+
+		found = true;
+	};
+
+	// an address that has both a process and a peer can match either kind of container, so
+	// only narrow by container when there is exactly one of them
+	if (address.has_process() && !address.has_peer())
+		narrow(FindProcess(address.process().pid()));
+	else if (address.has_peer() && !address.has_process())
+		narrow(FindPeer(NetworkAddress{ address.peer().ip(), static_cast<uint16_t>(address.peer().port()) }));
+
+	if (address.has_name())
+	{
+		narrow(Find(m_byName, address.name()));
+	}
+	else if (address.has_client())
+	{
+		const auto& client = address.client();
+		if (client.has_character())
+			narrow(Find(m_byCharacter, client.character()));
+		if (client.has_account())
+			narrow(Find(m_byAccount, client.account()));
+		if (client.has_server())
+			narrow(Find(m_byServer, client.server()));
+	}
+
+	return found;
+}
+
+//=============================================================================
+
 static void SetThreadName(const wchar_t* threadName)
 {
 	using fSetThreadDescription = HRESULT(WINAPI*)(HANDLE, PCWSTR);
@@ -46,6 +251,7 @@ ServerPostOffice::ServerPostOffice(const std::string& name, const std::string& p
 	, m_pipeName(pipeName)
 	, m_localConnection(std::make_unique<LocalConnection>(this))
 	, m_peerConnection(std::make_unique<PeerConnection>(this))
+	, m_identityTable(m_id.container.uuid)
 {
 	// Port will be selected by connection
 	m_peerPort = m_peerConnection->GetPort();
@@ -101,8 +307,8 @@ void ServerPostOffice::ThreadProc()
 {
 	SetThreadName(L"PostOffice");
 
-	m_stats.emplace(m_id.container.uuid, ActorStats{ m_id });
-	m_identities.emplace(m_id.container.uuid, m_id);
+	AddStats(m_id);
+	InsertIdentity(m_id);
 
 	AddConfiguredHosts();
 
@@ -126,6 +332,8 @@ void ServerPostOffice::ThreadProc()
 
 		ProcessIdentities(); // handles all identification maintenance
 
+		ProcessIdentitySync(); // sends this tick's changes to the local identities to peers
+
 		ProcessOutgoing(); // handles any messages posted from the internal dropbox
 
 		// It's important that this call is the only trigger for the connections incoming messages
@@ -136,12 +344,34 @@ void ServerPostOffice::ThreadProc()
 
 		ProcessReconnects();
 
-		Process(10); // processes the messages waiting in the internal dropbox (shouldn't happen often)
+		// processes the messages waiting in the internal dropbox (shouldn't happen often)
+		if (Process(std::chrono::milliseconds(5)))
+			RequestProcessEvents();
+
+		PublishMailboxStats();
 	}
 
 	StopConnections();
 }
 
+void ServerPostOffice::PublishMailboxStats()
+{
+	if (!m_mailboxStatsRequested.load(std::memory_order_relaxed))
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+	if (now - m_mailboxStatsPublished < MAILBOX_STATS_INTERVAL)
+		return;
+
+	m_mailboxStatsRequested.store(false, std::memory_order_relaxed);
+	m_mailboxStatsPublished = now;
+
+	// the mailboxes belong to this thread, so hand a copy of their stats to the UI
+	auto mailbox_stats = GetMailboxStats();
+	std::unique_lock lock(m_statsMutex);
+	m_mailboxStats = std::move(mailbox_stats);
+}
+
 //-----------------------------------------------------------------------------
 
 bool ServerPostOffice::IsRecipient(const proto::routing::Address& address, const ActorIdentification& id)
@@ -193,6 +423,67 @@ bool ServerPostOffice::IsRecipient(const proto::routing::Address& address, const
 	}, id.address);
 }
 
+template <typename F>
+void ServerPostOffice::ForEachRecipient(const proto::routing::Address& address, F&& callback)
+{
+	auto visit = [&address, &callback, this](const ActorIdentification& identity)
+	{
+		return !IsRecipient(address, identity) || callback(identity);
+	};
+
+	// a uuid is unique, so there is at most one identity to test
+	if (!address.uuid().empty())
+	{
+		auto it = m_identities.find(address.uuid());
+		if (it != m_identities.end())
+			visit(it->second);
+
+		return;
+	}
+
+	const IdentityIndex::UUIDSet* candidates = nullptr;
+	if (m_identityIndex.GetCandidates(address, candidates))
+	{
+		for (const std::string& uuid : *candidates)
+		{
+			auto it = m_identities.find(uuid);
+			if (it != m_identities.end() && !visit(it->second))
+				return;
+		}
+	}
+	else
+	{
+		for (const auto& [_, identity] : m_identities)
+		{
+			if (!visit(identity))
+				return;
+		}
+	}
+}
+
+void ServerPostOffice::InsertIdentity(const ActorIdentification& id)
+{
+	auto [it, inserted] = m_identities.emplace(id.container.uuid, id);
+	if (inserted)
+		m_identityIndex.Add(it->second);
+}
+
+IdentitiesMap::iterator ServerPostOffice::EraseIdentity(IdentitiesMap::iterator it)
+{
+	if (it->second.container.IsLocal())
+		m_identityTable.Drop(it->first);
+
+	{
+		std::unique_lock lock(m_statsMutex);
+		auto stat_it = m_stats.find(it->first);
+		if (stat_it != m_stats.end())
+			stat_it->second.Dropped = true;
+	}
+
+	m_identityIndex.Remove(it->second);
+	return m_identities.erase(it);
+}
+
 static MessagePtr FillAddress(MessagePtr message, const ActorIdentification& identity)
 {
 	proto::routing::Address& address = *message->mutable_address();
@@ -242,30 +533,45 @@ void ServerPostOffice::ProcessOutgoingMessage(MessagePtr message)
 	SPDLOG_TRACE("PostOffice {{{}}}: Routing message to=[{}] seq={}",
 		GetName(), message->address().ShortDebugString(), message->sequence());
 
-	// if we have a PID here, we could still have multiple names on the same PID, so we can't
-	// avoid the loop
+	TrackRpcStat(*message);
+
+	// if we have a PID here, we could still have multiple names on the same PID, so we still
+	// need to test every identity the indexes give back
 	if (message->mode() == static_cast<uint32_t>(MQRequestMode::CallAndResponse))
 	{
-		const auto identity = FindIdentity(message->address(), m_identities.begin());
+		// finding a second recipient is enough to know the address is ambiguous
+		const ActorIdentification* identity = nullptr;
+		size_t count = 0;
+		ForEachRecipient(message->address(),
+			[&identity, &count](const ActorIdentification& id)
+			{
+				identity = &id;
+				return ++count < 2;
+			});
 
-		if (identity == m_identities.end())
+		if (count == 0)
 			RoutingFailed(MsgError_RoutingFailed, std::move(message), "Failed to find identity in post office");
-		else if (FindIdentity(message->address(), std::next(identity)) != m_identities.end())
+		else if (count > 1)
 			RoutingFailed(MsgError_AmbiguousRecipient, std::move(message), "Multiple recipients match identity");
 		else
-			SendMessage(identity->second.container, std::move(message));
+			SendMessage(identity->container, std::move(message));
 	}
 	else
 	{
 		// we don't have a PID or a name and this is not an RPC, so we will send this message to 
 		// all clients that match the address -- it's important to copy these messages
-		for (const auto& [_, identity] : m_identities)
-		{
-			if (IsRecipient(message->address(), identity))
+		std::vector<const ActorIdentification*> identities;
+		ForEachRecipient(message->address(),
+			[&identities](const ActorIdentification& id)
 			{
-				SendMessage(identity.container, FillAddress(std::make_unique<proto::routing::Envelope>(*message), identity));
-			}
-		}
+				identities.push_back(&id);
+				return true;
+			});
+
+		if (message->mode() == static_cast<uint32_t>(MQRequestMode::Gather))
+			message = StartGather(std::move(message), identities);
+
+		SendToAll(std::move(message), identities);
 	}
 }
 
@@ -342,13 +648,11 @@ void ServerPostOffice::ProcessAddIdentity(const ActorIdentification& id)
 			SPDLOG_TRACE("PostOffice {{{}}}: Got Updated identification new=[{}] old=[{}]",
 				GetName(), id, ident_it->second);
 
-			auto stat_it = m_stats.find(id.container.uuid);
-			if (stat_it == m_stats.end())
-				m_stats.emplace(id.container.uuid, ActorStats{ id });
-			else
-				stat_it->second.Identity = id;
+			AddStats(id);
 
+			m_identityIndex.Remove(ident_it->second);
 			ident_it->second = id;
+			m_identityIndex.Add(ident_it->second);
 		}
 		else
 		{
@@ -361,22 +665,13 @@ void ServerPostOffice::ProcessAddIdentity(const ActorIdentification& id)
 	{
 		SPDLOG_TRACE("PostOffice {{{}}}: Got New identification from [{}]", GetName(), id);
 
-		m_stats.emplace(id.container.uuid, ActorStats{ id });
-		m_identities.emplace(id.container.uuid, id);
+		AddStats(id);
+		InsertIdentity(id);
 	}
 
-	if (send_updates && id.container.IsLocal())
-	{
-		for (const auto& [uuid, identity] : m_identities)
-		{
-			if (identity.address == m_id.address
-				&& uuid != m_id.container.uuid
-				&& uuid != id.container.uuid)
-			{
-				SendIdentification(identity.container, id);
-			}
-		}
-	}
+	// peers get the change with the rest of this tick's changes in ProcessIdentitySync
+	if (send_updates && id.container.IsLocal() && id.container.uuid != m_id.container.uuid)
+		m_identityTable.Add(id.GetProto());
 }
 
 void ServerPostOffice::DropIdentity(const ActorIdentification& id)
@@ -407,21 +702,27 @@ void ServerPostOffice::ProcessDropIdentity(const ActorIdentification& id)
 {
 	SPDLOG_TRACE("PostOffice {{{}}}: Processing Drop Identity {}", GetName(), id);
 
-	for (auto ident_it = m_identities.begin(); ident_it != m_identities.end();)
+	// only identities that share the uuid, the process or the client can be duplicates of id. Copy
+	// the candidates out because erasing updates the indexes they come from.
+	std::vector<std::string> candidates{ id.container.uuid };
+
+	if (const auto process = std::get_if<ActorContainer::Process>(&id.container.value))
 	{
-		if (ident_it->second.IsDuplicate(id))
-			ident_it = m_identities.erase(ident_it);
-		else
-			++ident_it;
+		if (const auto uuids = m_identityIndex.FindProcess(process->PID))
+			candidates.insert(candidates.end(), uuids->begin(), uuids->end());
 	}
 
-	if (id.container.IsLocal())
+	if (const auto client = std::get_if<ActorIdentification::Client>(&id.address))
 	{
-		for (const auto& [uuid, identity] : m_identities)
-		{
-			if (identity.address == m_id.address && uuid != m_id.container.uuid)
-				DropIdentification(identity.container, id);
-		}
+		if (const auto uuids = m_identityIndex.FindCharacter(client->character))
+			candidates.insert(candidates.end(), uuids->begin(), uuids->end());
+	}
+
+	for (const std::string& uuid : candidates)
+	{
+		auto ident_it = m_identities.find(uuid);
+		if (ident_it != m_identities.end() && ident_it->second.IsDuplicate(id))
+			EraseIdentity(ident_it);
 	}
 }
 
@@ -450,51 +751,39 @@ void ServerPostOffice::ProcessDropContainer(const ActorContainer& container)
 
 	if (container.IsLocal())
 	{
-		std::vector<ActorIdentification> to_erase;
-
-		auto it = std::find_if(m_identities.begin(), m_identities.end(),
-			[&container](const std::pair<std::string, ActorIdentification>& pair)
-		{
-			return pair.second.container.IsIn(container);
-		});
-
-		while (it != m_identities.end())
+		// local containers are always processes, so everything in it is in the process index
+		std::vector<std::string> candidates;
+		if (const auto process = std::get_if<ActorContainer::Process>(&container.value))
 		{
-			to_erase.emplace_back(std::move(it->second));
-
-			it = std::find_if(m_identities.erase(it), m_identities.end(),
-				[&container](const std::pair<std::string, ActorIdentification>& pair)
-			{
-				return pair.second.container.IsIn(container);
-			});
+			if (const auto uuids = m_identityIndex.FindProcess(process->PID))
+				candidates.assign(uuids->begin(), uuids->end());
 		}
 
-		for (const auto& [uuid, identity] : m_identities)
+		for (const std::string& uuid : candidates)
 		{
-			if (identity.address == m_id.address && uuid != m_id.container.uuid)
-			{
-				for (const auto& dropped : to_erase)
-					DropIdentification(identity.container, dropped);
-			}
+			auto it = m_identities.find(uuid);
+			if (it != m_identities.end() && it->second.container.IsIn(container))
+				EraseIdentity(it);
 		}
 	}
 
 	// always remove explicit drops from identities
 	auto iter = m_identities.find(container.uuid);
 	if (iter != m_identities.end())
-		m_identities.erase(iter);
+		EraseIdentity(iter);
 }
 
-void ServerPostOffice::SendIdentities(const ActorContainer& requester)
+void ServerPostOffice::SendIdentities(const ActorContainer& requester, const std::string& epoch, uint64_t version)
 {
 	SPDLOG_TRACE("PostOffice {{{}}}: Requesting Send Identities from {}", GetName(), requester);
 
 	if (std::this_thread::get_id() == m_threadId)
 	{
-		ProcessSendIdentities(requester);
+		ProcessSendIdentities(requester, epoch, version);
 	}
 	else
 	{
+		// the queue only holds the requester, so it gets the whole table
 		{
 			std::unique_lock lock(m_identityMutex);
 			m_identityActions.emplace_back(IdentityAction::MassAdd, ActorIdentification{ requester, "" });
@@ -504,14 +793,38 @@ void ServerPostOffice::SendIdentities(const ActorContainer& requester)
 	}
 }
 
-void ServerPostOffice::ProcessSendIdentities(const ActorContainer& requester)
+void ServerPostOffice::ProcessSendIdentities(const ActorContainer& requester, const std::string& epoch, uint64_t version)
 {
 	SPDLOG_TRACE("PostOffice {{{}}}: Processing Send Identities from {}", GetName(), requester);
 
-	for (const auto& [_, client] : m_identities)
+	proto::routing::IdentitySync sync;
+	m_identityTable.BuildSync(epoch, version, sync);
+	*sync.mutable_sender() = m_id.GetProto();
+
+	SyncIdentities(requester, sync);
+}
+
+// It's worthwhile to note that the identity.address == m_id.address check is how peers are
+// found here, same as above. Only local identities are in the table, so identities that came from
+// a peer are never passed on to other peers and changes can't loop between them.
+void ServerPostOffice::ProcessIdentitySync()
+{
+	if (m_identityTable.GetVersion() == m_syncedVersion)
+		return;
+
+	proto::routing::IdentitySync sync;
+	m_identityTable.BuildSync(m_identityTable.GetEpoch(), m_syncedVersion, sync);
+	*sync.mutable_sender() = m_id.GetProto();
+
+	SPDLOG_TRACE("PostOffice {{{}}}: Syncing identities from version {} to {} ({} added, {} dropped)", GetName(),
+		sync.from_version(), sync.version(), sync.added_size(), sync.dropped_size());
+
+	m_syncedVersion = m_identityTable.GetVersion();
+
+	for (const auto& [uuid, identity] : m_identities)
 	{
-		if (client.container.IsLocal())
-			SendIdentification(requester, client);
+		if (identity.address == m_id.address && uuid != m_id.container.uuid)
+			SyncIdentities(identity.container, sync);
 	}
 }
 
@@ -521,29 +834,57 @@ void ServerPostOffice::ProcessReconnects()
 		m_peerConnection->EnsureHosts(m_persistentHosts);
 }
 
-void ServerPostOffice::FillAndSend(MessagePtr message, const std::function<bool(const ActorIdentification&)>& predicate)
+void ServerPostOffice::FillAndSend(MessagePtr message, const proto::routing::Address& address,
+	const std::function<bool(const ActorIdentification&)>& filter)
 {
 	std::vector<const ActorIdentification*> identities;
 
-	for (const auto& [_, identity] : m_identities)
+	ForEachRecipient(address,
+		[&identities, &filter](const ActorIdentification& identity)
+		{
+			if (!filter || filter(identity))
+				identities.emplace_back(&identity);
+
+			return true;
+		});
+
+	if (message->mode() == static_cast<uint32_t>(MQRequestMode::Gather))
 	{
-		if (predicate(identity))
-			identities.emplace_back(&identity);
+		SendToAll(StartGather(std::move(message), identities), identities);
 	}
-
-	if (message->mode() == static_cast<uint32_t>(MQRequestMode::CallAndResponse) && identities.size() != 1)
+	else if (message->mode() == static_cast<uint32_t>(MQRequestMode::CallAndResponse) && identities.size() != 1)
 	{
 		if (identities.size() > 1)
 			RoutingFailed(MsgError_AmbiguousRecipient, std::move(message), "Multiple recipients match identity");
 		else
 			RoutingFailed(MsgError_RoutingFailed, std::move(message), "No recipients match identity");
 	}
-	else if (identities.size() == 1)
+	else
+	{
+		SendToAll(std::move(message), identities);
+	}
+}
+
+void ServerPostOffice::SendToAll(MessagePtr message, const std::vector<const ActorIdentification*>& identities)
+{
+	if (identities.size() == 1)
 	{
 		// minor optimization, this lets us move
 		auto identity = identities.front();
 		SendMessage(identity->container, FillAddress(std::move(message), *identity));
 	}
+	else if (identities.size() > 1 && message->has_payload())
+	{
+		// only the envelope header changes between recipients, so take the payload out and share it
+		// between all of them instead of copying the whole envelope for each one
+		SharedPayload payload(std::move(*message->mutable_payload()));
+		message->clear_payload();
+
+		for (auto identity : identities)
+		{
+			SendMessage(identity->container, FillAddress(std::make_unique<proto::routing::Envelope>(*message), *identity), payload);
+		}
+	}
 	else
 	{
 		for (auto identity : identities)
@@ -553,6 +894,39 @@ void ServerPostOffice::FillAndSend(MessagePtr message, const std::function<bool(
 	}
 }
 
+MessagePtr ServerPostOffice::StartGather(MessagePtr message, const std::vector<const ActorIdentification*>& identities)
+{
+	// only the router that resolves the address knows who a gather went to, so it tells the sender.
+	// From here on every copy is a plain RPC to a single recipient, which keeps later hops and the
+	// receiving post offices unaware of gathers.
+	proto::routing::GatherManifest manifest;
+	for (auto identity : identities)
+	{
+		proto::routing::Address& recipient = *manifest.add_recipients();
+		identity->BuildAddress(recipient);
+
+		if (message->address().has_mailbox())
+			recipient.set_mailbox(message->address().mailbox());
+	}
+
+	auto reply = std::make_unique<proto::routing::Envelope>();
+	*reply->mutable_address() = message->return_address();
+	reply->set_sequence(message->sequence());
+	reply->set_mode(static_cast<uint32_t>(MQRequestMode::GatherManifest));
+	reply->set_payload(manifest.SerializeAsString());
+
+	SPDLOG_TRACE("PostOffice {{{}}}: Gathering from {} recipients seq={}", GetName(), identities.size(), message->sequence());
+
+	const proto::routing::Address sender = message->return_address();
+	if (sender.uuid() == m_id.container.uuid)
+		DeliverTo(sender.has_mailbox() ? sender.mailbox() : "post_office", std::move(reply));
+	else
+		FillAndSend(std::move(reply), sender);
+
+	message->set_mode(static_cast<uint32_t>(MQRequestMode::CallAndResponse));
+	return message;
+}
+
 void ServerPostOffice::RouteFromConnection(MessagePtr message)
 {
 	// it's safe to assume that any RPC requests will get routed back to the originating connection, so there is no
@@ -564,7 +938,9 @@ void ServerPostOffice::RouteFromConnection(MessagePtr message)
 		message->address().ShortDebugString(), message->return_address().ShortDebugString(), message->sequence());
 
 	if (message->has_return_address() && message->return_address().has_uuid())
-		AddReceiveStat(message->return_address().uuid());
+		AddReceiveStat(message->return_address().uuid(), message->payload().size());
+
+	TrackRpcStat(*message);
 
 	const auto& address = message->address();
 	std::string uuid = address.uuid();
@@ -580,6 +956,9 @@ void ServerPostOffice::RouteFromConnection(MessagePtr message)
 		SPDLOG_TRACE("PostOffice {{{}}}: Internal pipe message received, routing to mailbox {} seq={}",
 			GetName(), mailbox, message->sequence());
 
+		if (message->mode() == static_cast<uint32_t>(MQRequestMode::Gather))
+			message = StartGather(std::move(message), { &m_id });
+
 		// This is already an explicit address, so just package up the envelope into a message and deliver it
 		DeliverTo(mailbox, std::move(message));
 	}
@@ -599,11 +978,11 @@ void ServerPostOffice::RouteFromConnection(MessagePtr message)
 		else if (address.has_client())
 			*local_address.mutable_client() = address.client();
 
-		FillAndSend(std::move(message),
-			[&local_address, this](const auto& identity)
-		{
-			return identity.container.IsLocal() && IsRecipient(local_address, identity);
-		});
+		FillAndSend(std::move(message), local_address,
+			[](const ActorIdentification& identity)
+			{
+				return identity.container.IsLocal();
+			});
 	}
 	else
 	{
@@ -611,11 +990,7 @@ void ServerPostOffice::RouteFromConnection(MessagePtr message)
 		// should receive this message and send to each one
 		SPDLOG_TRACE("PostOffice {{{}}}: Routing message to [{}] seq={}", GetName(), address.ShortDebugString(), message->sequence());
 
-		FillAndSend(std::move(message),
-			[&address, this](const auto& identity)
-		{
-			return IsRecipient(address, identity);
-		});
+		FillAndSend(std::move(message), address);
 	}
 
 	RequestProcessEvents();
@@ -626,31 +1001,101 @@ void ServerPostOffice::OnDeliver(const std::string& localAddress, MessagePtr& me
 	RequestProcessEvents();
 }
 
-std::vector<const ActorStats*> ServerPostOffice::GetStats(bool showDropped)
+void ServerPostOffice::RoutingFailed(int status, MessagePtr message, std::string_view what)
 {
-	auto now = std::chrono::system_clock::now();
-	auto lookback = now - std::chrono::seconds(m_statsLookbackSeconds);
+	if (message->has_return_address() && message->return_address().has_uuid())
+		AddRoutingFailureStat(message->return_address().uuid());
+
+	PostOffice::RoutingFailed(status, std::move(message), what);
+}
+
+std::vector<ActorStatsSummary> ServerPostOffice::GetStats(bool showDropped)
+{
+	std::unique_lock lock(m_statsMutex);
+	const int64_t now = GetStatSecond();
 
-	std::vector<const ActorStats*> stats;
+	std::vector<ActorStatsSummary> stats;
 	stats.reserve(m_stats.size());
 
-	for (auto& [uuid, stat] : m_stats)
+	for (const auto& [uuid, stat] : m_stats)
 	{
-		if (showDropped || m_identities.find(uuid) != m_identities.end())
-		{
-			stat.Sent.erase(std::remove_if(stat.Sent.begin(), stat.Sent.end(),
-				[&lookback](const std::chrono::system_clock::time_point& t) { return t < lookback; }),
-				stat.Sent.end());
+		if (showDropped || !stat.Dropped)
+			stats.push_back({ stat.Identity.ToStringLite(), stat.Traffic.Sum(now, m_statsLookbackSeconds) });
+	}
+
+	return stats;
+}
+
+std::vector<ActorStatsSummary> ServerPostOffice::GetConnectionStats()
+{
+	std::unique_lock lock(m_statsMutex);
+	const int64_t now = GetStatSecond();
+
+	std::vector<ActorStatsSummary> stats;
+	stats.reserve(m_connectionStats.size());
+
+	for (const auto& [_, stat] : m_connectionStats)
+		stats.push_back({ stat.Name, stat.Traffic.Sum(now, m_statsLookbackSeconds) });
 
-			stat.Received.erase(std::remove_if(stat.Received.begin(), stat.Received.end(),
-				[&lookback](const std::chrono::system_clock::time_point& t) { return t < lookback; }),
-				stat.Received.end());
+	return stats;
+}
+
+proto::routing::StatsSnapshot ServerPostOffice::GetStatsSnapshot(bool showDropped)
+{
+	m_mailboxStatsRequested.store(true, std::memory_order_relaxed);
 
-			stats.push_back(&stat);
+	std::unique_lock lock(m_statsMutex);
+	const int64_t now = GetStatSecond();
+	const uint32_t lookback = m_statsLookbackSeconds;
+
+	proto::routing::StatsSnapshot snapshot;
+	snapshot.set_lookback_seconds(lookback);
+	for (uint32_t limit : ActorStatsCounters::LatencyLimits)
+		snapshot.add_rpc_latency_limits(limit);
+
+	for (const auto& [uuid, stat] : m_stats)
+	{
+		if (showDropped || !stat.Dropped)
+		{
+			auto identity = snapshot.add_identities();
+			identity->set_name(stat.Identity.ToStringLite());
+			identity->set_uuid(uuid);
+			FillTrafficStats(stat.Traffic, now, lookback, *identity);
 		}
 	}
 
-	return stats;
+	for (const auto& [_, stat] : m_connectionStats)
+	{
+		auto connection = snapshot.add_connections();
+		connection->set_name(stat.Name);
+		FillTrafficStats(stat.Traffic, now, lookback, *connection);
+	}
+
+	for (const auto& [address, stat] : m_mailboxStats)
+	{
+		auto mailbox = snapshot.add_mailboxes();
+		mailbox->set_name(address);
+		mailbox->set_depth(static_cast<uint32_t>(stat.Depth));
+		mailbox->set_high_water(static_cast<uint32_t>(stat.HighWater));
+		mailbox->set_capacity(static_cast<uint32_t>(stat.Capacity));
+		mailbox->set_dropped(stat.Dropped);
+	}
+
+	return snapshot;
+}
+
+std::vector<std::pair<std::string, MailboxStats>> ServerPostOffice::GetMailboxStatsSnapshot()
+{
+	// the post office thread picks this up on its next pass, until then the last copy is returned
+	m_mailboxStatsRequested.store(true, std::memory_order_relaxed);
+
+	std::unique_lock lock(m_statsMutex);
+	return m_mailboxStats;
+}
+
+NetworkCompressionStats ServerPostOffice::GetNetworkCompressionStats() const
+{
+	return m_peerConnection->GetCompressionStats();
 }
 
 //-----------------------------------------------------------------------------
@@ -704,7 +1149,7 @@ template <size_t I>
 void ServerPostOffice::BroadcastMessage(MessagePtr message)
 {
 	for (const auto& [uuid, _] : m_identities)
-		AddSendStat(uuid);
+		AddSendStat(uuid, message->payload().size());
 
 	using V = std::remove_const_t<decltype(ActorContainer::value)>;
 	if constexpr (I < std::variant_size_v<V>)
@@ -718,7 +1163,7 @@ void ServerPostOffice::BroadcastMessage(MessagePtr message)
 bool ServerPostOffice::SendMessage(const ActorContainer& ident, MessagePtr message)
 {
 	SPDLOG_TRACE("PostOffice {{{}}}: Sending message to {} seq={}", GetName(), ident, message->sequence());
-	AddSendStat(ident.uuid);
+	AddSendStat(ident.uuid, message->payload().size());
 
 	return std::visit([this, message = std::move(message), &ident](const auto& c) mutable
 		{
@@ -726,6 +1171,17 @@ bool ServerPostOffice::SendMessage(const ActorContainer& ident, MessagePtr messa
 		}, ident.value);
 }
 
+bool ServerPostOffice::SendMessage(const ActorContainer& ident, MessagePtr header, const SharedPayload& payload)
+{
+	SPDLOG_TRACE("PostOffice {{{}}}: Sending shared payload message to {} seq={}", GetName(), ident, header->sequence());
+	AddSendStat(ident.uuid, payload.Data->size());
+
+	return std::visit([this, header = std::move(header), &payload, &ident](const auto& c) mutable
+		{
+			return GetConnection<std::remove_const_t<std::remove_reference_t<decltype(c)>>>()->SendMessage(ident, std::move(header), payload);
+		}, ident.value);
+}
+
 void ServerPostOffice::SendIdentification(const ActorContainer& target, const ActorIdentification& id)
 {
 	SPDLOG_TRACE("PostOffice {{{}}}: Sending identification {} to {}", GetName(), id, target);
@@ -756,53 +1212,143 @@ void ServerPostOffice::RequestIdentities(const ActorContainer& from)
 		}, from.value);
 }
 
-void ServerPostOffice::AddSendStat(const std::string& uuid)
+void ServerPostOffice::SyncIdentities(const ActorContainer& target, const proto::routing::IdentitySync& sync)
+{
+	SPDLOG_TRACE("PostOffice {{{}}}: Syncing identities to {}", GetName(), target);
+
+	return std::visit([this, &sync, &target](const auto& c) mutable
+		{
+			return GetConnection<std::remove_const_t<std::remove_reference_t<decltype(c)>>>()->SyncIdentities(target, sync);
+		}, target.value);
+}
+
+void ServerPostOffice::AddStats(const ActorIdentification& id)
+{
+	std::unique_lock lock(m_statsMutex);
+	InsertStats(id);
+}
+
+ActorStats& ServerPostOffice::InsertStats(const ActorIdentification& id)
+{
+	auto stat_it = m_stats.find(id.container.uuid);
+	if (stat_it != m_stats.end())
+	{
+		stat_it->second.Identity = id;
+		stat_it->second.Dropped = false;
+	}
+	else
+	{
+		stat_it = m_stats.emplace(id.container.uuid, ActorStats{ id }).first;
+
+		// identities in the same process or from the same peer share a connection
+		auto connection = id.container.ToStringLite();
+		auto [connection_it, _] = m_connectionStats.try_emplace(connection);
+		connection_it->second.Name = std::move(connection);
+		stat_it->second.Connection = &connection_it->second;
+	}
+
+	return stat_it->second;
+}
+
+ActorStats* ServerPostOffice::FindStats(const std::string& uuid)
 {
 	auto stat_it = m_stats.find(uuid);
-	if (stat_it == m_stats.end())
+	if (stat_it != m_stats.end())
+		return &stat_it->second;
+
+	auto id_it = m_identities.find(uuid);
+	if (id_it != m_identities.end())
+		return &InsertStats(id_it->second);
+
+	return nullptr;
+}
+
+void ServerPostOffice::AddSendStat(const std::string& uuid, size_t bytes)
+{
+	std::unique_lock lock(m_statsMutex);
+	if (auto stat = FindStats(uuid))
 	{
-		auto id_it = m_identities.find(uuid);
-		if (id_it != m_identities.end())
+		const int64_t now = GetStatSecond();
+		for (auto window : { &stat->Traffic, &stat->Connection->Traffic })
 		{
-			auto [result, _] = m_stats.emplace(uuid, ActorStats{ id_it->second });
-			stat_it = result;
+			auto& counters = window->At(now);
+			++counters.Sent;
+			counters.SentBytes += bytes;
 		}
 	}
+}
 
-	if (stat_it != m_stats.end())
+void ServerPostOffice::AddReceiveStat(const std::string& uuid, size_t bytes)
+{
+	std::unique_lock lock(m_statsMutex);
+	if (auto stat = FindStats(uuid))
 	{
-		auto now = std::chrono::system_clock::now();
-		stat_it->second.Sent.emplace_back(now);
+		const int64_t now = GetStatSecond();
+		for (auto window : { &stat->Traffic, &stat->Connection->Traffic })
+		{
+			auto& counters = window->At(now);
+			++counters.Received;
+			counters.ReceivedBytes += bytes;
+		}
+	}
+}
 
-		auto lookback = now - std::chrono::seconds(m_statsLookbackSeconds);
-		stat_it->second.Sent.erase(std::remove_if(stat_it->second.Sent.begin(), stat_it->second.Sent.end(),
-			[&lookback](const std::chrono::system_clock::time_point& t) { return t < lookback; }),
-			stat_it->second.Sent.end());
+void ServerPostOffice::AddRoutingFailureStat(const std::string& uuid)
+{
+	std::unique_lock lock(m_statsMutex);
+	if (auto stat = FindStats(uuid))
+	{
+		const int64_t now = GetStatSecond();
+		for (auto window : { &stat->Traffic, &stat->Connection->Traffic })
+			++window->At(now).RoutingFailures;
 	}
 }
 
-void ServerPostOffice::AddReceiveStat(const std::string& uuid)
+void ServerPostOffice::TrackRpcStat(const proto::routing::Envelope& message)
 {
-	auto stat_it = m_stats.find(uuid);
-	if (stat_it == m_stats.end())
+	// RPC latency is the time between seeing a request and seeing the reply to it, and it's counted
+	// against the identity that replied
+	if (message.mode() == static_cast<uint32_t>(MQRequestMode::CallAndResponse) && message.return_address().has_uuid())
 	{
-		auto id_it = m_identities.find(uuid);
-		if (id_it != m_identities.end())
+		const auto now = std::chrono::steady_clock::now();
+
+		std::unique_lock lock(m_statsMutex);
+
+		// requests that never got a reply have fallen out of the window, so stop tracking them
+		const auto expired = now - std::chrono::seconds(ActorStatsWindow::MaxSeconds);
+		while (!m_pendingRpcOrder.empty() && m_pendingRpcOrder.front().second < expired)
 		{
-			auto [result, _] = m_stats.emplace(uuid, ActorStats{ id_it->second });
-			stat_it = result;
+			m_pendingRpcs.erase(m_pendingRpcOrder.front().first);
+			m_pendingRpcOrder.pop_front();
 		}
-	}
 
-	if (stat_it != m_stats.end())
+		if (m_pendingRpcs.size() < MAX_PENDING_RPC_STATS)
+		{
+			auto key = std::make_pair(message.return_address().uuid(), message.sequence());
+			if (m_pendingRpcs.find(key) == m_pendingRpcs.end())
+			{
+				m_pendingRpcOrder.emplace_back(key, now);
+				m_pendingRpcs.emplace(std::move(key), std::prev(m_pendingRpcOrder.end()));
+			}
+		}
+	}
+	else if (message.mode() == static_cast<uint32_t>(MQRequestMode::MessageReply) && message.address().has_uuid())
 	{
-		auto now = std::chrono::system_clock::now();
-		stat_it->second.Received.emplace_back(now);
+		std::unique_lock lock(m_statsMutex);
+		auto request = m_pendingRpcs.find(std::make_pair(message.address().uuid(), message.sequence()));
+		if (request != m_pendingRpcs.end())
+		{
+			const auto now = std::chrono::steady_clock::now();
+			const auto sent = request->second->second;
+			if (auto stat = FindStats(message.return_address().uuid()))
+			{
+				stat->Traffic.At(GetStatSecond(now)).AddLatency(now - sent);
+				stat->Connection->Traffic.At(GetStatSecond(now)).AddLatency(now - sent);
+			}
 
-		auto lookback = now - std::chrono::seconds(m_statsLookbackSeconds);
-		stat_it->second.Received.erase(std::remove_if(stat_it->second.Received.begin(), stat_it->second.Received.end(),
-			[&lookback](const std::chrono::system_clock::time_point& t) { return t < lookback; }),
-			stat_it->second.Received.end());
+			m_pendingRpcOrder.erase(request->second);
+			m_pendingRpcs.erase(request);
+		}
 	}
 }
 
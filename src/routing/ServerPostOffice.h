@@ -15,10 +15,18 @@
 #pragma once
 
 #include "routing/PostOffice.h"
+#include "routing/IdentitySync.h"
 #include "routing/Network.h"
+#include "mq/base/String.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #if defined(SendMessage)
@@ -52,15 +60,174 @@ class PeerConnection;
 template <> struct ConnectionTypeMap<ActorContainer::Process> { using Type = LocalConnection; };
 template <> struct ConnectionTypeMap<ActorContainer::Network> { using Type = PeerConnection; };
 
+/**
+ * Traffic counters for one second (or the sum of several seconds) of actor statistics
+ */
+struct ActorStatsCounters
+{
+	static constexpr size_t LatencyBuckets = 8;
+
+	// the upper bound in milliseconds of each RPC latency bucket, the last bucket holds everything slower
+	static constexpr std::array<uint32_t, LatencyBuckets - 1> LatencyLimits{ 1, 5, 10, 50, 100, 500, 1000 };
+
+	uint32_t Received = 0;
+	uint32_t Sent = 0;
+	uint64_t ReceivedBytes = 0;
+	uint64_t SentBytes = 0;
+	uint32_t RoutingFailures = 0;
+	std::array<uint32_t, LatencyBuckets> RpcLatency{};
+
+	void AddLatency(std::chrono::steady_clock::duration latency);
+	uint32_t RpcCount() const;
+
+	ActorStatsCounters& operator+=(const ActorStatsCounters& other);
+};
+
+/**
+ * Per second traffic counters over a fixed window. Recording is constant time, and the memory used
+ * doesn't depend on how much traffic there is.
+ */
+class ActorStatsWindow
+{
+public:
+	static constexpr uint32_t MaxSeconds = 120;
+
+	ActorStatsWindow() { m_seconds.fill(-1); }
+
+	// the counters for the given second, any older second that shared the slot is cleared out
+	ActorStatsCounters& At(int64_t second);
+
+	// the counters for a second in the window, or nullptr if nothing was recorded for it
+	const ActorStatsCounters* Find(int64_t second) const;
+
+	// the sum of the counters for the seconds (now - seconds, now]
+	ActorStatsCounters Sum(int64_t now, uint32_t seconds) const;
+
+private:
+	std::array<ActorStatsCounters, MaxSeconds> m_counters{};
+	std::array<int64_t, MaxSeconds> m_seconds{};
+};
+
+struct ConnectionStats
+{
+	std::string Name;
+	ActorStatsWindow Traffic;
+};
+
 struct ActorStats
 {
 	ActorIdentification Identity;
-	std::vector<std::chrono::system_clock::time_point> Received;
-	std::vector<std::chrono::system_clock::time_point> Sent;
+	ActorStatsWindow Traffic;
+	ConnectionStats* Connection = nullptr;
+
+	// set when the identity is dropped, so that the stats can be filtered without reading the identities
+	bool Dropped = false;
+};
+
+/**
+ * The statistics of an identity or connection summed over the lookback, this is what gets displayed
+ */
+struct ActorStatsSummary
+{
+	std::string Name;
+	ActorStatsCounters Totals;
 };
 
 using IdentitiesMap = std::unordered_map<std::string, ActorIdentification>;
 
+/**
+ * The payload of an envelope that is being fanned out to more than one recipient. The payload bytes
+ * are held once and shared by every copy, and only the envelope header (which carries the per
+ * recipient address) is serialized for each one.
+ */
+struct SharedPayload
+{
+	explicit SharedPayload(std::string data)
+		: Data(std::make_shared<const std::string>(std::move(data)))
+		, Network(std::make_shared<NetworkSharedPayload>(Data))
+	{
+	}
+
+	std::shared_ptr<const std::string> Data;
+
+	// Data as it is handed to peer sessions, which keep its compressed bytes with it so that it is
+	// compressed once for all of the peers it goes to
+	std::shared_ptr<NetworkSharedPayload> Network;
+
+	/**
+	 * Serializes an envelope that has no payload of its own, followed by the tag and length of the
+	 * payload field. Appending Data to the result gives the same wire message as serializing the
+	 * envelope with its payload set.
+	 *
+	 * @param header the envelope to serialize, without a payload
+	 * @return the serialized envelope, ready to have Data appended
+	 */
+	std::string SerializeHeader(const proto::routing::Envelope& header) const;
+};
+
+/**
+ * Secondary indexes over an IdentitiesMap. Every index maps a single addressable field to the
+ * set of container uuids (the keys of the IdentitiesMap) that carry it, which lets address
+ * resolution start from the narrowest set of candidates instead of testing every identity.
+ */
+class IdentityIndex
+{
+public:
+	using UUIDSet = std::unordered_set<std::string>;
+
+	void Add(const ActorIdentification& id);
+	void Remove(const ActorIdentification& id);
+	void Clear();
+
+	/**
+	 * Finds the narrowest set of identities that could possibly match an address
+	 *
+	 * @param address the address to resolve
+	 * @param out filled with the candidate uuids, only valid if this returns true
+	 * @return false if the address can't be narrowed and every identity needs to be tested
+	 */
+	bool GetCandidates(const proto::routing::Address& address, const UUIDSet*& out) const;
+
+	const UUIDSet* FindProcess(uint32_t pid) const { return Find(m_byProcess, pid); }
+	const UUIDSet* FindPeer(const NetworkAddress& peer) const { return Find(m_byPeer, peer); }
+	const UUIDSet* FindCharacter(const std::string& character) const { return Find(m_byCharacter, character); }
+
+private:
+	template <typename M, typename K>
+	static const UUIDSet* Find(const M& index, const K& key)
+	{
+		auto it = index.find(key);
+		return it != index.end() ? &it->second : nullptr;
+	}
+
+	template <typename M, typename K>
+	static void Insert(M& index, const K& key, const std::string& uuid)
+	{
+		index[key].insert(uuid);
+	}
+
+	template <typename M, typename K>
+	static void Erase(M& index, const K& key, const std::string& uuid)
+	{
+		auto it = index.find(key);
+		if (it != index.end())
+		{
+			it->second.erase(uuid);
+			if (it->second.empty())
+				index.erase(it);
+		}
+	}
+
+	static const UUIDSet s_empty;
+
+	std::unordered_map<uint32_t, UUIDSet> m_byProcess;
+	std::unordered_map<NetworkAddress, UUIDSet> m_byPeer;
+	ci_unordered::map<std::string, UUIDSet> m_byName;
+	ci_unordered::map<std::string, UUIDSet> m_byAccount;
+	ci_unordered::map<std::string, UUIDSet> m_byServer;
+	ci_unordered::map<std::string, UUIDSet> m_byCharacter;
+};
+
 //-----------------------------------------------------------------------------
 
 class ServerPostOffice : public postoffice::PostOffice
@@ -85,6 +252,7 @@ public:
 	// This is called when a dropbox registered to this pipe server attempts to send a message (an _outbound_ message)
 	virtual void RouteMessage(MessagePtr message) override;
 	virtual void OnDeliver(const std::string& localAddress, MessagePtr& message) override;
+	virtual void RoutingFailed(int status, MessagePtr message, std::string_view what) override;
 
 	// This is called when a message is received over a connection (an _inbound_ message)
 	void RouteFromConnection(MessagePtr message);
@@ -92,13 +260,18 @@ public:
 	void AddIdentity(const ActorIdentification& id);
 	void DropIdentity(const ActorIdentification& id);
 	void DropContainer(const ActorContainer& container);
-	void SendIdentities(const ActorContainer& requester);
+	// sends the local identities that requester doesn't have yet, based on the epoch and version of its copy
+	void SendIdentities(const ActorContainer& requester, const std::string& epoch = {}, uint64_t version = 0);
 
 	// add this for testing
 	uint32_t GetIdentityCount() const { return static_cast<uint32_t>(m_identities.size()); }
-	std::vector<const ActorStats*> GetStats(bool showDropped = false); // uuid is internal, so just turn this into a vector to return it
-	void SetStatLookback(uint32_t seconds) { m_statsLookbackSeconds = seconds; }
+	std::vector<ActorStatsSummary> GetStats(bool showDropped = false); // uuid is internal, so just turn this into a vector to return it
+	std::vector<ActorStatsSummary> GetConnectionStats();
+	proto::routing::StatsSnapshot GetStatsSnapshot(bool showDropped = false);
+	std::vector<std::pair<std::string, MailboxStats>> GetMailboxStatsSnapshot(); // as of the last time the post office thread published them
+	void SetStatLookback(uint32_t seconds) { m_statsLookbackSeconds = std::clamp<uint32_t>(seconds, 1, ActorStatsWindow::MaxSeconds); }
 	uint32_t GetStatLookback() { return m_statsLookbackSeconds; }
+	NetworkCompressionStats GetNetworkCompressionStats() const;
 
 	void Initialize();
 	void Shutdown();
@@ -130,14 +303,15 @@ private:
 
 	void ThreadProc();
 
-	IdentitiesMap::iterator FindIdentity(const proto::routing::Address& address, IdentitiesMap::iterator from)
-	{
-		return std::find_if(from, m_identities.end(),
-			[&address, this](const std::pair<std::string, ActorIdentification>& pair)
-		{
-			return IsRecipient(address, pair.second);
-		});
-	}
+	// copies the mailbox stats for the UI, if it has asked for them since the last time
+	void PublishMailboxStats();
+
+	// calls callback with every identity that address resolves to until the callback returns false
+	template <typename F>
+	void ForEachRecipient(const proto::routing::Address& address, F&& callback);
+
+	void InsertIdentity(const ActorIdentification& id);
+	IdentitiesMap::iterator EraseIdentity(IdentitiesMap::iterator it);
 
 protected:
 	uint16_t m_peerPort;
@@ -147,6 +321,7 @@ protected:
 	std::chrono::seconds m_heartBeatDuration{ 2 };
 
 	IdentitiesMap m_identities;
+	IdentityIndex m_identityIndex;
 
 	const std::unique_ptr<LocalConnection> m_localConnection;
 	const std::unique_ptr<PeerConnection> m_peerConnection;
@@ -166,6 +341,10 @@ protected:
 	std::vector<std::pair<IdentityAction, ActorIdentification>> m_identityActions;
 	std::mutex m_identityMutex;
 
+	// the local identities that peers mirror, and the version that has been sent to them
+	IdentityTable m_identityTable;
+	uint64_t m_syncedVersion = 0;
+
 	bool m_running = false;
 	std::thread m_thread;
 	std::thread::id m_threadId;
@@ -174,8 +353,31 @@ protected:
 	std::mutex m_processMutex;
 	std::condition_variable m_needsProcessing;
 
-	// maintain some statistics for displaying
+	// maintain some statistics for displaying. These are read from the UI thread, so they are locked
+	struct PendingRpcHash
+	{
+		size_t operator()(const std::pair<std::string, uint32_t>& key) const noexcept
+		{
+			return std::hash<std::string>{}(key.first) ^ std::hash<uint32_t>{}(key.second) << 1;
+		}
+	};
+
+	static constexpr size_t MAX_PENDING_RPC_STATS = 4096;
+
+	using PendingRpcKey = std::pair<std::string, uint32_t>;
+	using PendingRpcList = std::list<std::pair<PendingRpcKey, std::chrono::steady_clock::time_point>>;
+
 	std::unordered_map<std::string, ActorStats> m_stats;
+	std::unordered_map<std::string, ConnectionStats> m_connectionStats;
+	PendingRpcList m_pendingRpcOrder; // oldest request first, so requests that never got a reply expire from the front
+	std::unordered_map<PendingRpcKey, PendingRpcList::iterator, PendingRpcHash> m_pendingRpcs;
+	std::vector<std::pair<std::string, MailboxStats>> m_mailboxStats;
+	std::mutex m_statsMutex;
+
+	// the mailbox stats are only copied while someone is reading them, and at most this often
+	static constexpr std::chrono::milliseconds MAILBOX_STATS_INTERVAL{ 500 };
+	std::atomic<bool> m_mailboxStatsRequested{ false };
+	std::chrono::steady_clock::time_point m_mailboxStatsPublished;
 	uint32_t m_statsLookbackSeconds = 60;
 
 	template <size_t I = 0> void StartConnections();
@@ -183,12 +385,23 @@ protected:
 	template <size_t I = 0> void ProcessConnections();
 	template <size_t I = 0> void BroadcastMessage(MessagePtr message);
 	bool SendMessage(const ActorContainer& ident, MessagePtr message);
+	bool SendMessage(const ActorContainer& ident, MessagePtr header, const SharedPayload& payload);
+	void SendToAll(MessagePtr message, const std::vector<const ActorIdentification*>& identities);
+
+	// sends the gather manifest back to the sender, returns the message as an RPC to send to each identity
+	MessagePtr StartGather(MessagePtr message, const std::vector<const ActorIdentification*>& identities);
 	void SendIdentification(const ActorContainer& target, const ActorIdentification& id);
 	void DropIdentification(const ActorContainer& target, const ActorIdentification& id);
 	void RequestIdentities(const ActorContainer& from);
+	void SyncIdentities(const ActorContainer& target, const proto::routing::IdentitySync& sync);
 
-	void AddSendStat(const std::string& uuid);
-	void AddReceiveStat(const std::string& uuid);
+	void AddStats(const ActorIdentification& id);
+	ActorStats& InsertStats(const ActorIdentification& id); // expects m_statsMutex to be held
+	ActorStats* FindStats(const std::string& uuid); // expects m_statsMutex to be held
+	void AddSendStat(const std::string& uuid, size_t bytes);
+	void AddReceiveStat(const std::string& uuid, size_t bytes);
+	void AddRoutingFailureStat(const std::string& uuid);
+	void TrackRpcStat(const proto::routing::Envelope& message);
 
 	void ProcessOutgoing();
 	void ProcessOutgoingMessage(MessagePtr);
@@ -197,11 +410,13 @@ protected:
 	void ProcessAddIdentity(const ActorIdentification& id);
 	void ProcessDropIdentity(const ActorIdentification& id);
 	void ProcessDropContainer(const ActorContainer& container);
-	void ProcessSendIdentities(const ActorContainer& requester);
+	void ProcessSendIdentities(const ActorContainer& requester, const std::string& epoch = {}, uint64_t version = 0);
+	void ProcessIdentitySync();
 
 	void ProcessReconnects();
 
-	void FillAndSend(MessagePtr message, const std::function<bool(const ActorIdentification&)>& predicate);
+	void FillAndSend(MessagePtr message, const proto::routing::Address& address,
+		const std::function<bool(const ActorIdentification&)>& filter = nullptr);
 	virtual void AddConfiguredHosts() {}
 };
 
@@ -221,12 +436,16 @@ public:
 	virtual void Process() = 0;
 
 	virtual bool SendMessage(const ActorContainer& process, MessagePtr message) = 0;
+	virtual bool SendMessage(const ActorContainer& process, MessagePtr header, const SharedPayload& payload) = 0;
 	virtual void BroadcastMessage(MessagePtr message) = 0;
 
 	virtual void SendIdentification(const ActorContainer& process, const ActorIdentification& identity) const = 0;
 	virtual void DropIdentification(const ActorContainer& process, const ActorIdentification& identity) const = 0;
 	virtual void RequestIdentities(const ActorContainer& process) const = 0;
 
+	// sends a batch of identity changes, by default as one identification message per change
+	virtual void SyncIdentities(const ActorContainer& process, const proto::routing::IdentitySync& sync) const;
+
 	virtual void Start() = 0;
 	virtual void Stop() = 0;
 
@@ -256,6 +475,7 @@ public:
 	virtual void Process() override;
 
 	virtual bool SendMessage(const ActorContainer& process, MessagePtr message) override;
+	virtual bool SendMessage(const ActorContainer& process, MessagePtr header, const SharedPayload& payload) override;
 	virtual void BroadcastMessage(MessagePtr message) override;
 
 	virtual void SendIdentification(const ActorContainer& process, const ActorIdentification& identity) const override;
@@ -300,11 +520,13 @@ public:
 	virtual void Process() override;
 
 	virtual bool SendMessage(const ActorContainer& peer, MessagePtr message) override;
+	virtual bool SendMessage(const ActorContainer& peer, MessagePtr header, const SharedPayload& payload) override;
 	virtual void BroadcastMessage(MessagePtr message) override;
 
 	virtual void SendIdentification(const ActorContainer& peer, const ActorIdentification& identity) const override;
 	virtual void DropIdentification(const ActorContainer& peer, const ActorIdentification& identity) const override;
 	virtual void RequestIdentities(const ActorContainer& peer) const override;
+	virtual void SyncIdentities(const ActorContainer& peer, const proto::routing::IdentitySync& sync) const override;
 
 	virtual void Start() override;
 	virtual void Stop() override;
@@ -315,6 +537,7 @@ public:
 	bool HasHost(const std::string& address, uint16_t port) const;
 
 	uint16_t GetPort() const;
+	NetworkCompressionStats GetCompressionStats() const;
 
 	NetworkAddress GetConnectionAddress(const std::string& uuid) const;
 	std::string GetConnectionUUID(const NetworkAddress& address) const;
@@ -328,8 +551,11 @@ protected:
 	void OnRequestProcessHandler();
 
 private:
+	void HandleIdentitySync(const NetworkAddress& address, const proto::routing::IdentitySync& sync);
+
 	std::unique_ptr<mq::NetworkPeerAPI> m_network;
 	std::unordered_map<std::string, NetworkAddress> m_connections;
+	std::unordered_map<NetworkAddress, PeerIdentitySync> m_peerSync;
 };
 
 //=============================================================================
@@ -0,0 +1,646 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Uncomment to see super spammy read/write trace logging
+//#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
+
+#include "SharedMemory.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <fmt/os.h>
+#include <windows.h>
+#include <sddl.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+using namespace std::chrono_literals;
+
+namespace mq {
+
+//============================================================================
+// Shared layout
+//============================================================================
+
+constexpr uint32_t SHARED_MEMORY_MAGIC = 0x4843514d; // "MQCH"
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+	"shared memory atomics must be lock free to work across processes");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "doorbells wait on the atomic as a plain word");
+
+struct SharedDoorbellState
+{
+	std::atomic<uint32_t> sequence;                  // bumped every time the doorbell is rung
+	std::atomic<uint32_t> sleeping;                  // the owner is waiting, so ringing has to wake it
+};
+
+struct SharedRingState
+{
+	alignas(64) std::atomic<uint64_t> head;          // total bytes consumed, only the reader moves it
+	alignas(64) std::atomic<uint64_t> tail;          // total bytes produced, only the writer moves it
+	std::atomic<uint32_t> writerWaiting;             // the writer has messages waiting for room
+};
+
+struct SharedChannelHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;
+	uint32_t reserved;
+	SharedRingState rings[2];                        // rings[n] is written by side n
+	alignas(64) SharedDoorbellState doorbells[2];    // doorbells[n] wakes side n
+};
+
+// every record in a ring starts with one of these, records are padded to RECORD_ALIGNMENT
+struct SharedRecordHeader
+{
+	uint32_t fragmentLength;                         // bytes of the message in this record
+	uint32_t messageLength;                          // bytes in the whole message
+};
+
+constexpr size_t RECORD_ALIGNMENT = 8;
+
+// don't bother writing fragments smaller than this, wait for more room instead
+constexpr size_t MIN_FRAGMENT = 256;
+
+static constexpr size_t AlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static constexpr size_t GetDataOffset()
+{
+	return AlignUp(sizeof(SharedChannelHeader), 64);
+}
+
+static uint32_t NormalizeCapacity(uint32_t capacity)
+{
+	capacity = std::clamp(capacity, SHARED_MEMORY_MIN_CAPACITY, SHARED_MEMORY_MAX_CAPACITY);
+	return static_cast<uint32_t>(AlignUp(capacity, 64));
+}
+
+#if defined(_WIN32)
+// the launcher and the game can run at different integrity levels, so let everyone open the
+// channel the same way the named pipe does
+class EveryoneSecurityAttributes
+{
+public:
+	EveryoneSecurityAttributes()
+	{
+		m_attributes.nLength = sizeof(m_attributes);
+		m_attributes.bInheritHandle = FALSE;
+		m_attributes.lpSecurityDescriptor = nullptr;
+
+		if (!::ConvertStringSecurityDescriptorToSecurityDescriptorA("D:(A;OICI;GA;;;WD)",
+			SDDL_REVISION_1, &m_attributes.lpSecurityDescriptor, nullptr))
+		{
+			SPDLOG_WARN("Failed to create security descriptor for shared memory, other processes may not be able to open it");
+		}
+	}
+
+	~EveryoneSecurityAttributes()
+	{
+		if (m_attributes.lpSecurityDescriptor)
+			::LocalFree(m_attributes.lpSecurityDescriptor);
+	}
+
+	SECURITY_ATTRIBUTES* get() { return m_attributes.lpSecurityDescriptor ? &m_attributes : nullptr; }
+
+private:
+	SECURITY_ATTRIBUTES m_attributes;
+};
+
+static std::string GetObjectName(const std::string& name)
+{
+	return "Local\\" + name;
+}
+#endif
+
+//============================================================================
+// SharedMemoryRegion
+//============================================================================
+
+SharedMemoryRegion::~SharedMemoryRegion()
+{
+#if defined(_WIN32)
+	if (m_data)
+		::UnmapViewOfFile(m_data);
+
+	if (m_mapping)
+		::CloseHandle(m_mapping);
+#else
+	if (m_data)
+		::munmap(m_data, m_size);
+#endif
+
+	Unlink();
+}
+
+bool SharedMemoryRegion::Create(const std::string& name, size_t size)
+{
+	m_name = name;
+
+#if defined(_WIN32)
+	EveryoneSecurityAttributes attributes;
+	m_mapping = ::CreateFileMappingA(INVALID_HANDLE_VALUE, attributes.get(), PAGE_READWRITE,
+		static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), GetObjectName(name).c_str());
+	if (m_mapping == nullptr || ::GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		SPDLOG_ERROR("Failed to create shared memory {}: {}", name,
+			fmt::windows_error(::GetLastError(), "CreateFileMapping").what());
+		return false;
+	}
+
+	m_data = static_cast<uint8_t*>(::MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	if (m_data == nullptr)
+	{
+		SPDLOG_ERROR("Failed to map shared memory {}: {}", name,
+			fmt::windows_error(::GetLastError(), "MapViewOfFile").what());
+		return false;
+	}
+#else
+	const std::string path = "/" + name;
+	int fd = ::shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+	{
+		SPDLOG_ERROR("Failed to create shared memory {}: {}", name, std::strerror(errno));
+		return false;
+	}
+
+	m_linked = true;
+
+	if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		SPDLOG_ERROR("Failed to size shared memory {}: {}", name, std::strerror(errno));
+		::close(fd);
+		return false;
+	}
+
+	void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		SPDLOG_ERROR("Failed to map shared memory {}: {}", name, std::strerror(errno));
+		return false;
+	}
+
+	m_data = static_cast<uint8_t*>(data);
+#endif
+
+	m_size = size;
+	return true;
+}
+
+bool SharedMemoryRegion::Open(const std::string& name, size_t size)
+{
+	m_name = name;
+
+#if defined(_WIN32)
+	m_mapping = ::OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, GetObjectName(name).c_str());
+	if (m_mapping == nullptr)
+	{
+		SPDLOG_ERROR("Failed to open shared memory {}: {}", name,
+			fmt::windows_error(::GetLastError(), "OpenFileMapping").what());
+		return false;
+	}
+
+	m_data = static_cast<uint8_t*>(::MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	if (m_data == nullptr)
+	{
+		SPDLOG_ERROR("Failed to map shared memory {}: {}", name,
+			fmt::windows_error(::GetLastError(), "MapViewOfFile").what());
+		return false;
+	}
+#else
+	const std::string path = "/" + name;
+	int fd = ::shm_open(path.c_str(), O_RDWR, 0);
+	if (fd < 0)
+	{
+		SPDLOG_ERROR("Failed to open shared memory {}: {}", name, std::strerror(errno));
+		return false;
+	}
+
+	struct stat info;
+	if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < size)
+	{
+		SPDLOG_ERROR("Shared memory {} is smaller than the expected {} bytes", name, size);
+		::close(fd);
+		return false;
+	}
+
+	void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		SPDLOG_ERROR("Failed to map shared memory {}: {}", name, std::strerror(errno));
+		return false;
+	}
+
+	m_data = static_cast<uint8_t*>(data);
+#endif
+
+	m_size = size;
+	return true;
+}
+
+void SharedMemoryRegion::Unlink()
+{
+#if !defined(_WIN32)
+	if (m_linked)
+		::shm_unlink(("/" + m_name).c_str());
+#endif
+
+	m_linked = false;
+}
+
+//============================================================================
+// SharedMemoryChannel
+//============================================================================
+
+SharedMemoryChannel::SharedMemoryChannel(int side)
+	: m_side(side)
+{
+}
+
+SharedMemoryChannel::~SharedMemoryChannel()
+{
+	Stop();
+
+#if defined(_WIN32)
+	for (void* event : m_events)
+	{
+		if (event)
+			::CloseHandle(event);
+	}
+#endif
+}
+
+std::unique_ptr<SharedMemoryChannel> SharedMemoryChannel::Create(const std::string& name, uint32_t capacity)
+{
+	std::unique_ptr<SharedMemoryChannel> channel(new SharedMemoryChannel(0));
+	if (!channel->Initialize(name, capacity, true))
+		return nullptr;
+
+	return channel;
+}
+
+std::unique_ptr<SharedMemoryChannel> SharedMemoryChannel::Open(const std::string& name, uint32_t capacity)
+{
+	std::unique_ptr<SharedMemoryChannel> channel(new SharedMemoryChannel(1));
+	if (!channel->Initialize(name, capacity, false))
+		return nullptr;
+
+	return channel;
+}
+
+bool SharedMemoryChannel::Initialize(const std::string& name, uint32_t capacity, bool create)
+{
+	m_name = name;
+	m_capacity = NormalizeCapacity(capacity);
+
+	const size_t size = GetDataOffset() + 2 * static_cast<size_t>(m_capacity);
+
+	if (create)
+	{
+		if (!m_region.Create(name, size))
+			return false;
+
+		m_header = new (m_region.data()) SharedChannelHeader();
+		m_header->magic = SHARED_MEMORY_MAGIC;
+		m_header->version = SHARED_MEMORY_CHANNEL_VERSION;
+		m_header->capacity = m_capacity;
+	}
+	else
+	{
+		if (!m_region.Open(name, size))
+			return false;
+
+		m_header = reinterpret_cast<SharedChannelHeader*>(m_region.data());
+		if (m_header->magic != SHARED_MEMORY_MAGIC
+			|| m_header->version != SHARED_MEMORY_CHANNEL_VERSION
+			|| m_header->capacity != m_capacity)
+		{
+			SPDLOG_WARN("Shared memory {} doesn't match: version={} capacity={}, expected version={} capacity={}",
+				name, m_header->version, m_header->capacity, SHARED_MEMORY_CHANNEL_VERSION, m_capacity);
+			return false;
+		}
+	}
+
+	m_outgoing = &m_header->rings[m_side];
+	m_incoming = &m_header->rings[1 - m_side];
+	m_outgoingData = m_region.data() + GetDataOffset() + m_side * static_cast<size_t>(m_capacity);
+	m_incomingData = m_region.data() + GetDataOffset() + (1 - m_side) * static_cast<size_t>(m_capacity);
+
+#if defined(_WIN32)
+	EveryoneSecurityAttributes attributes;
+	for (int side = 0; side < 2; ++side)
+	{
+		const std::string event_name = GetObjectName(fmt::format("{}-{}", name, side));
+		m_events[side] = create
+			? ::CreateEventA(attributes.get(), FALSE, FALSE, event_name.c_str())
+			: ::OpenEventA(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, event_name.c_str());
+
+		if (m_events[side] == nullptr)
+		{
+			SPDLOG_ERROR("Failed to {} doorbell for shared memory {}: {}", create ? "create" : "open", name,
+				fmt::windows_error(::GetLastError(), "event").what());
+			return false;
+		}
+	}
+#endif
+
+	SPDLOG_DEBUG("{} shared memory channel {} with {} bytes per ring", create ? "Created" : "Opened", name, m_capacity);
+	return true;
+}
+
+void SharedMemoryChannel::Start(ReceiveCallback&& receive, WritableCallback&& writable)
+{
+	if (m_thread.joinable())
+		return;
+
+	m_receive = std::move(receive);
+	m_writable = std::move(writable);
+
+	m_running = true;
+	m_thread = std::thread([this] { ThreadProc(); });
+}
+
+void SharedMemoryChannel::Stop()
+{
+	m_running = false;
+
+	if (m_thread.joinable())
+	{
+		Ring(m_side);
+		m_thread.join();
+	}
+}
+
+bool SharedMemoryChannel::Send(const uint8_t* data, size_t length, const uint8_t* tail, size_t tailLength)
+{
+	const size_t total = length + tailLength;
+
+	if (m_pending.empty())
+	{
+		size_t offset = Write(data, length, tail, tailLength, 0);
+		if (offset == total)
+			return true;
+
+		m_pendingOffset = offset;
+	}
+
+	// keep the message so it goes out in order once there is room
+	auto& pending = m_pending.emplace_back(total);
+	if (length > 0)
+		memcpy(pending.data(), data, length);
+	if (tailLength > 0)
+		memcpy(pending.data() + length, tail, tailLength);
+
+	m_hasPending = true;
+	return Flush();
+}
+
+bool SharedMemoryChannel::Flush()
+{
+	m_flushRequested = false;
+
+	bool flagged = false;
+	while (!m_pending.empty())
+	{
+		const auto& message = m_pending.front();
+		m_pendingOffset = Write(message.data(), message.size(), nullptr, 0, m_pendingOffset);
+
+		if (m_pendingOffset < message.size())
+		{
+			// ask the reader to ring us once it makes room. It might have made room after we looked,
+			// in which case it didn't see the flag, so look once more before giving up.
+			if (!flagged)
+			{
+				m_outgoing->writerWaiting.store(1);
+				flagged = true;
+				continue;
+			}
+
+			break;
+		}
+
+		m_pending.pop_front();
+		m_pendingOffset = 0;
+	}
+
+	m_hasPending = !m_pending.empty();
+	return !m_hasPending;
+}
+
+size_t SharedMemoryChannel::Write(const uint8_t* data, size_t length, const uint8_t* tail, size_t tailLength, size_t offset)
+{
+	const size_t total = length + tailLength;
+	uint64_t position = m_outgoing->tail.load(std::memory_order_relaxed);
+	bool wrote = false;
+
+	auto copy_in = [this](uint64_t position, const uint8_t* source, size_t size)
+	{
+		const size_t index = static_cast<size_t>(position % m_capacity);
+		const size_t first = std::min(size, m_capacity - index);
+		memcpy(m_outgoingData + index, source, first);
+		memcpy(m_outgoingData, source + first, size - first);
+	};
+
+	while (offset < total)
+	{
+		const uint64_t head = m_outgoing->head.load();
+		const size_t free = m_capacity - static_cast<size_t>(position - head);
+		if (free <= sizeof(SharedRecordHeader))
+			break;
+
+		// big messages go out in fragments so that the reader can make room while we write
+		const size_t fragment = std::min({ total - offset, static_cast<size_t>(m_capacity / 4),
+			(free - sizeof(SharedRecordHeader)) & ~(RECORD_ALIGNMENT - 1) });
+		if (fragment < std::min(total - offset, MIN_FRAGMENT))
+			break;
+
+		const SharedRecordHeader record{ static_cast<uint32_t>(fragment), static_cast<uint32_t>(total) };
+		copy_in(position, reinterpret_cast<const uint8_t*>(&record), sizeof(record));
+
+		uint64_t at = position + sizeof(record);
+		size_t remaining = fragment;
+		if (offset < length)
+		{
+			const size_t size = std::min(remaining, length - offset);
+			copy_in(at, data + offset, size);
+			at += size;
+			offset += size;
+			remaining -= size;
+		}
+
+		if (remaining > 0)
+		{
+			copy_in(at, tail + (offset - length), remaining);
+			offset += remaining;
+		}
+
+		position += AlignUp(sizeof(record) + fragment, RECORD_ALIGNMENT);
+		m_outgoing->tail.store(position, std::memory_order_release);
+		wrote = true;
+	}
+
+	if (wrote)
+		Ring(1 - m_side);
+
+	return offset;
+}
+
+bool SharedMemoryChannel::Read(std::vector<SharedMemoryMessage>& messages)
+{
+	uint64_t head = m_incoming->head.load(std::memory_order_relaxed);
+	const uint64_t tail = m_incoming->tail.load(std::memory_order_acquire);
+	if (head == tail)
+		return false;
+
+	auto copy_out = [this](uint64_t position, uint8_t* destination, size_t size)
+	{
+		const size_t index = static_cast<size_t>(position % m_capacity);
+		const size_t first = std::min(size, m_capacity - index);
+		memcpy(destination, m_incomingData + index, first);
+		memcpy(destination + first, m_incomingData, size - first);
+	};
+
+	while (head != tail)
+	{
+		SharedRecordHeader record;
+		copy_out(head, reinterpret_cast<uint8_t*>(&record), sizeof(record));
+
+		const size_t record_size = AlignUp(sizeof(record) + record.fragmentLength, RECORD_ALIGNMENT);
+		if (record_size > tail - head
+			|| record.messageLength < m_assemblyReceived + record.fragmentLength
+			|| (m_assembly && record.messageLength != m_assemblyLength))
+		{
+			SPDLOG_ERROR("Shared memory channel {} is corrupt, no longer reading from it", m_name);
+			m_running = false;
+			return false;
+		}
+
+		if (!m_assembly)
+		{
+			m_assembly = std::make_unique<uint8_t[]>(record.messageLength);
+			m_assemblyLength = record.messageLength;
+		}
+
+		copy_out(head + sizeof(record), m_assembly.get() + m_assemblyReceived, record.fragmentLength);
+		m_assemblyReceived += record.fragmentLength;
+		head += record_size;
+
+		if (m_assemblyReceived == m_assemblyLength)
+		{
+			messages.push_back({ std::move(m_assembly), m_assemblyLength });
+			m_assemblyLength = 0;
+			m_assemblyReceived = 0;
+		}
+	}
+
+	m_incoming->head.store(head);
+
+	// the writer is waiting for the room we just made
+	if (m_incoming->writerWaiting.load() != 0 && m_incoming->writerWaiting.exchange(0) != 0)
+		Ring(1 - m_side);
+
+	return true;
+}
+
+void SharedMemoryChannel::Ring(int side)
+{
+	SharedDoorbellState& doorbell = m_header->doorbells[side];
+	doorbell.sequence.fetch_add(1);
+
+	if (doorbell.sleeping.load() == 0)
+		return;
+
+#if defined(_WIN32)
+	::SetEvent(m_events[side]);
+#elif defined(__linux__)
+	::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&doorbell.sequence), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+void SharedMemoryChannel::Wait(uint32_t sequence, std::chrono::milliseconds timeout)
+{
+	SharedDoorbellState& doorbell = m_header->doorbells[m_side];
+	doorbell.sleeping.store(1);
+
+	// if the doorbell was rung since the caller last looked, there's something to do already
+#if defined(_WIN32)
+	if (doorbell.sequence.load() == sequence)
+		::WaitForSingleObject(m_events[m_side], static_cast<DWORD>(timeout.count()));
+#elif defined(__linux__)
+	timespec wait_time{ static_cast<time_t>(timeout.count() / 1000), static_cast<long>((timeout.count() % 1000) * 1000000) };
+	::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&doorbell.sequence), FUTEX_WAIT, sequence, &wait_time, nullptr, 0);
+#else
+	// no way to wait on shared memory here, so poll it
+	if (doorbell.sequence.load() == sequence)
+		std::this_thread::sleep_for(1ms);
+#endif
+
+	doorbell.sleeping.store(0, std::memory_order_relaxed);
+}
+
+void SharedMemoryChannel::ThreadProc()
+{
+	SPDLOG_TRACE("Shared memory channel {} thread started", m_name);
+
+	std::vector<SharedMemoryMessage> messages;
+	while (m_running)
+	{
+		const uint32_t sequence = m_header->doorbells[m_side].sequence.load();
+
+		// hand off one pass at a time so a busy writer can't hold messages back
+		const bool read = Read(messages);
+		if (!messages.empty())
+		{
+			m_receive(std::move(messages));
+			messages.clear();
+		}
+
+		// the writer only flushes when asked, so let it know once there is a useful amount of room
+		if (m_hasPending)
+		{
+			const uint64_t used = m_outgoing->tail.load(std::memory_order_relaxed) - m_outgoing->head.load(std::memory_order_acquire);
+			if (m_capacity - used >= m_capacity / 4 && !m_flushRequested.exchange(true))
+				m_writable();
+		}
+
+		if (!read)
+			Wait(sequence, 100ms);
+	}
+
+	SPDLOG_TRACE("Shared memory channel {} thread stopped", m_name);
+}
+
+} // namespace mq
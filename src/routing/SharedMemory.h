@@ -0,0 +1,208 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mq {
+
+// bumped whenever the layout of the shared memory changes
+constexpr uint32_t SHARED_MEMORY_CHANNEL_VERSION = 1;
+
+// limits on the size of each ring in a channel
+constexpr uint32_t SHARED_MEMORY_MIN_CAPACITY = 4 * 1024;
+constexpr uint32_t SHARED_MEMORY_MAX_CAPACITY = 64 * 1024 * 1024;
+
+//============================================================================
+
+/**
+ * A named block of memory that other processes on the same host can map. This is a file mapping
+ * backed by the page file on Windows and POSIX shared memory everywhere else.
+ */
+class SharedMemoryRegion
+{
+public:
+	SharedMemoryRegion() = default;
+	~SharedMemoryRegion();
+
+	SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+	SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+
+	// creates and maps a new zero filled region, fails if the name is already taken
+	bool Create(const std::string& name, size_t size);
+
+	// maps a region that another process created
+	bool Open(const std::string& name, size_t size);
+
+	// removes the name so nothing else can open the region, existing mappings stay valid. Windows
+	// removes the name by itself once the last handle is closed.
+	void Unlink();
+
+	uint8_t* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	std::string m_name;
+	uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	bool m_linked = false;
+#if defined(_WIN32)
+	void* m_mapping = nullptr;
+#endif
+};
+
+//============================================================================
+
+struct SharedChannelHeader;
+struct SharedRingState;
+struct SharedDoorbellState;
+
+// a whole message read from a channel
+struct SharedMemoryMessage
+{
+	std::unique_ptr<uint8_t[]> data;
+	size_t length = 0;
+};
+
+/**
+ * A pair of single producer, single consumer byte rings in shared memory, one for each direction,
+ * that carry length prefixed messages between two processes on the same host.
+ *
+ * Messages that are larger than a fraction of the ring are split into fragments, so any message
+ * fits no matter how small the ring is. Messages that don't fit in the free space are kept in order
+ * on the sending side until the other side makes room, so Send never blocks.
+ *
+ * Each side has a doorbell in the shared memory that the other side rings after writing to or
+ * reading from a ring. The doorbell is a futex on Linux and a named event on Windows, and it is only
+ * rung when the other side is actually waiting, so a busy channel makes no system calls.
+ */
+class SharedMemoryChannel
+{
+public:
+	// called on the channel thread with every message that was read in one pass
+	using ReceiveCallback = std::function<void(std::vector<SharedMemoryMessage>&& messages)>;
+
+	// called on the channel thread when messages waiting to be sent can be flushed
+	using WritableCallback = std::function<void()>;
+
+	/**
+	 * Creates the shared memory for a new channel. The creator offers the channel to the other side,
+	 * which opens it by name.
+	 *
+	 * @param name a name for the channel that is unique on this host
+	 * @param capacity the size in bytes of each ring
+	 * @return the channel or nullptr if the shared memory couldn't be created
+	 */
+	static std::unique_ptr<SharedMemoryChannel> Create(const std::string& name, uint32_t capacity);
+
+	/**
+	 * Opens a channel that the other side created
+	 *
+	 * @return the channel or nullptr if it couldn't be opened or doesn't match this version
+	 */
+	static std::unique_ptr<SharedMemoryChannel> Open(const std::string& name, uint32_t capacity);
+
+	~SharedMemoryChannel();
+
+	SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+	SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+
+	const std::string& GetName() const { return m_name; }
+	uint32_t GetCapacity() const { return m_capacity; }
+
+	/**
+	 * Starts the thread that reads messages from the other side. Nothing is read before this is
+	 * called, so the owner can decide when messages from the channel start arriving.
+	 */
+	void Start(ReceiveCallback&& receive, WritableCallback&& writable);
+
+	// stops the channel thread, this is also done on destruction
+	void Stop();
+
+	// removes the name of the shared memory, for the creator to call once the other side has it open
+	void Unlink() { m_region.Unlink(); }
+
+	/**
+	 * Sends a message made up of data followed by an optional tail. This must always be called from
+	 * the same thread, which is the only thread that can call Flush.
+	 *
+	 * @return true if the whole message was written, otherwise the rest is written by Flush
+	 */
+	bool Send(const uint8_t* data, size_t length, const uint8_t* tail = nullptr, size_t tailLength = 0);
+
+	/**
+	 * Writes as much of the messages that are waiting for room as fits
+	 *
+	 * @return true if no messages are left waiting
+	 */
+	bool Flush();
+
+	bool HasPending() const { return m_hasPending; }
+
+private:
+	SharedMemoryChannel(int side);
+
+	bool Initialize(const std::string& name, uint32_t capacity, bool create);
+
+	// writes what fits of a message starting at offset, returns the new offset
+	size_t Write(const uint8_t* data, size_t length, const uint8_t* tail, size_t tailLength, size_t offset);
+
+	// reads everything available from the incoming ring, returns true if anything was read
+	bool Read(std::vector<SharedMemoryMessage>& messages);
+
+	void Ring(int side);
+	void Wait(uint32_t sequence, std::chrono::milliseconds timeout);
+	void ThreadProc();
+
+	const int m_side;        // 0 for the creator, 1 for the other side
+	std::string m_name;
+	uint32_t m_capacity = 0;
+	SharedMemoryRegion m_region;
+
+	SharedChannelHeader* m_header = nullptr;
+	SharedRingState* m_outgoing = nullptr;
+	SharedRingState* m_incoming = nullptr;
+	uint8_t* m_outgoingData = nullptr;
+	uint8_t* m_incomingData = nullptr;
+#if defined(_WIN32)
+	void* m_events[2] = { nullptr, nullptr };
+#endif
+
+	// messages that didn't fit, and how much of the first one has been written
+	std::deque<std::vector<uint8_t>> m_pending;
+	size_t m_pendingOffset = 0;
+	std::atomic_bool m_hasPending{ false };
+	std::atomic_bool m_flushRequested{ false };
+
+	// the message being put back together from fragments
+	std::unique_ptr<uint8_t[]> m_assembly;
+	size_t m_assemblyLength = 0;
+	size_t m_assemblyReceived = 0;
+
+	ReceiveCallback m_receive;
+	WritableCallback m_writable;
+	std::thread m_thread;
+	std::atomic_bool m_running{ false };
+};
+
+} // namespace mq
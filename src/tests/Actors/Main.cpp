@@ -287,7 +287,8 @@ class TestDropbox
 {
 public:
 	template <typename T>
-	TestDropbox(T& data, uint32_t index, const std::string& name, const std::unordered_map<std::string, int>& responseMap = {})
+	TestDropbox(T& data, uint32_t index, const std::string& name, const std::unordered_map<std::string, int>& responseMap = {},
+		const mq::postoffice::MailboxOptions& options = {})
 		: m_name(name)
 		, m_responseMap(responseMap)
 		, m_dropbox(GetPostOffice(data, index).RegisterAddress(name,
@@ -302,7 +303,11 @@ public:
 					auto response = fmt::format("{}: responding to message {}", m_name, message->payload());
 					PostReply(std::move(message), response, it->second);
 				}
-			}))
+				else
+				{
+					m_unanswered = std::move(message);
+				}
+			}, options))
 	{}
 
 	void Post(const mq::proto::routing::Address& addr, const std::string& obj,
@@ -311,11 +316,27 @@ public:
 		m_dropbox.Post(addr, obj, callback);
 	}
 
+	void Gather(const mq::proto::routing::Address& addr, const std::string& obj, std::chrono::milliseconds timeout,
+		const mq::postoffice::GatherCallback& callback)
+	{
+		m_dropbox.Gather(addr, obj, timeout, callback);
+	}
+
 	void PostReply(mq::postoffice::MessagePtr message, const std::string& data, int status)
 	{
 		m_dropbox.PostReply(std::move(message), data, status);
 	}
 
+	// replies to the last message that didn't get an automatic response
+	bool ReplyLate(const std::string& data, int status)
+	{
+		if (!m_unanswered)
+			return false;
+
+		PostReply(std::move(m_unanswered), data, status);
+		return true;
+	}
+
 	bool HasReceived(const std::string& payload)
 	{
 		return ReceivedCount(payload) > 0;
@@ -334,6 +355,7 @@ private:
 	mq::postoffice::Dropbox m_dropbox;
 
 	std::vector<std::string> m_received;
+	mq::postoffice::MessagePtr m_unanswered;
 };
 
 void PulsePostOffices()
@@ -581,6 +603,155 @@ void TestBasicClientSetup()
 	SPDLOG_INFO("TestBasicClientSetup: Tests Complete");
 }
 
+void TestGather()
+{
+	SPDLOG_INFO("================== Testing Gather ==================");
+
+	// pipe0
+	auto gatherer = TestDropbox(client, 0, "gatherer");
+	auto dropboxB = TestDropbox(client, 2, "G", {{"Please respond", 1}});
+
+	// pipe1
+	auto dropboxC = TestDropbox(client, 1, "G", {{"Please respond", 1}});
+	auto dropboxD = TestDropbox(client, 3, "G");
+
+	// single recipient, completes as soon as the reply arrives
+	int single_calls = 0;
+	size_t single_replies = 0;
+	{
+		mq::proto::routing::Address addr;
+		addr.set_mailbox("G");
+		addr.mutable_client()->set_character("characterB");
+		gatherer.Gather(addr, "Please respond", std::chrono::seconds(30),
+			[&single_calls, &single_replies](mq::postoffice::GatherResult&& result)
+			{
+				++single_calls;
+				single_replies = result.replies.size();
+			});
+	}
+
+	// every client, D never replies and the clients without a G mailbox fail to route
+	int all_calls = 0;
+	int all_status = -1;
+	int all_responded = 0;
+	bool d_timed_out = false;
+	{
+		mq::proto::routing::Address addr;
+		addr.set_mailbox("G");
+		gatherer.Gather(addr, "Please respond", std::chrono::seconds(1),
+			[&](mq::postoffice::GatherResult&& result)
+			{
+				++all_calls;
+				all_status = result.status;
+				all_responded = static_cast<int>(std::count_if(result.replies.begin(), result.replies.end(),
+					[](const mq::postoffice::MessagePtr& reply) { return reply->status() == 1; }));
+				d_timed_out = std::any_of(result.timedOut.begin(), result.timedOut.end(),
+					[](const mq::proto::routing::Address& recipient) { return recipient.client().character() == "characterD"; });
+			});
+	}
+
+	PulsePostOffices();
+	PulsePostOffices();
+
+	if (single_calls != 1 || single_replies != 1)
+		SPDLOG_ERROR("TestGather: Single recipient gather called back {} times with {} replies instead of once with 1", single_calls, single_replies);
+
+	if (all_calls != 0)
+		SPDLOG_ERROR("TestGather: Gather completed before D timed out");
+
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	PulsePostOffices();
+
+	if (all_calls != 1)
+		SPDLOG_ERROR("TestGather: Gather called back {} times instead of once", all_calls);
+
+	if (all_status != 0)
+		SPDLOG_ERROR("TestGather: Gather completed with status {} instead of 0", all_status);
+
+	if (all_responded != 2)
+		SPDLOG_ERROR("TestGather: Gather received {} responses instead of 2", all_responded);
+
+	if (!d_timed_out)
+		SPDLOG_ERROR("TestGather: D was not reported as timed out");
+
+	if (dropboxD.ReceivedCount("Please respond") != 1)
+		SPDLOG_ERROR("TestGather: D received {} gather requests instead of 1", dropboxD.ReceivedCount("Please respond"));
+
+	// D answering after the gather timed out is dropped without calling back again
+	if (!dropboxD.ReplyLate("D: responding late", 1))
+		SPDLOG_ERROR("TestGather: D has no gather request to reply to");
+
+	PulsePostOffices();
+
+	if (all_calls != 1)
+		SPDLOG_ERROR("TestGather: Late reply called the gather back again, {} calls", all_calls);
+
+	SPDLOG_INFO("TestGather: Tests Complete");
+}
+
+void TestMailboxOverflow()
+{
+	SPDLOG_INFO("================== Testing Mailbox Overflow ==================");
+
+	// pipe0, the messages all come back from the launcher in the same pulse
+	auto sender = TestDropbox(client, 0, "sender");
+	auto rejecting = TestDropbox(client, 0, "rejecting", {{"Please respond", 1}},
+		{ 2, mq::postoffice::MailboxOverflow::Reject });
+	auto dropping = TestDropbox(client, 0, "dropping", {},
+		{ 2, mq::postoffice::MailboxOverflow::DropOldest });
+	auto droppingRpc = TestDropbox(client, 0, "droppingRpc", {{"Please respond", 1}},
+		{ 2, mq::postoffice::MailboxOverflow::DropOldest });
+
+	int responded = 0;
+	int rejected = 0;
+	int rpc_status[5] = { 0, 0, 0, 0, 0 };
+	for (int i = 0; i < 5; ++i)
+	{
+		mq::proto::routing::Address addr;
+		addr.set_mailbox("rejecting");
+		sender.Post(addr, "Please respond",
+			[&responded, &rejected](int status, mq::postoffice::MessagePtr)
+			{
+				if (status == 1)
+					++responded;
+				else if (status == mq::postoffice::MsgError_MailboxFull)
+					++rejected;
+			});
+
+		addr.set_mailbox("dropping");
+		sender.Post(addr, fmt::format("Message {}", i));
+
+		// the oldest RPCs are the ones dropped, and their senders still hear back
+		addr.set_mailbox("droppingRpc");
+		sender.Post(addr, "Please respond",
+			[&rpc_status, i](int status, mq::postoffice::MessagePtr) { rpc_status[i] = status; });
+	}
+
+	PulsePostOffices();
+	PulsePostOffices();
+
+	if (responded != 2 || rejected != 3)
+		SPDLOG_ERROR("TestMailboxOverflow: Got {} responses and {} rejections instead of 2 and 3", responded, rejected);
+
+	if (dropping.HasReceived("Message 0") || !dropping.HasReceived("Message 3") || !dropping.HasReceived("Message 4"))
+		SPDLOG_ERROR("TestMailboxOverflow: Dropping mailbox didn't keep only the newest messages");
+
+	const int mailbox_full = mq::postoffice::MsgError_MailboxFull;
+	if (rpc_status[0] != mailbox_full || rpc_status[1] != mailbox_full || rpc_status[2] != mailbox_full
+		|| rpc_status[3] != 1 || rpc_status[4] != 1)
+	{
+		SPDLOG_ERROR("TestMailboxOverflow: Dropping mailbox RPCs got statuses {}, {}, {}, {}, {} instead of {}, {}, {}, 1, 1",
+			rpc_status[0], rpc_status[1], rpc_status[2], rpc_status[3], rpc_status[4], mailbox_full, mailbox_full, mailbox_full);
+	}
+
+	auto stats = GetPostOffice(client, 0).GetMailboxStats("rejecting").value_or(mq::postoffice::MailboxStats{});
+	if (stats.Depth != 0 || stats.HighWater != 2 || stats.Dropped != 3)
+		SPDLOG_ERROR("TestMailboxOverflow: Rejecting mailbox has depth {}, high water {} and {} dropped instead of 0, 2 and 3",
+			stats.Depth, stats.HighWater, stats.Dropped);
+
+	SPDLOG_INFO("TestMailboxOverflow: Tests Complete");
+}
+
 void TestReconnect()
 {
 	SPDLOG_INFO("================== Testing Reconnect ==================");
@@ -735,6 +906,8 @@ int main(int argc, TCHAR* argv[])
 
 	TestLauncherBehavior();
 	TestBasicClientSetup();
+	TestGather();
+	TestMailboxOverflow();
 	TestReconnect();
 	TestLargeNetwork();
 	TestLargeData();
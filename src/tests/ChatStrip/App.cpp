@@ -0,0 +1,306 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Benchmark for stripping color codes out of chat lines, the step PluginsWriteChatColor runs on
+// every line before the events see it. The corpus in chat.txt is raid chat: combat spam, tells with
+// item and spell links, and plugin and lua output full of color codes. Each line is stripped by the
+// old scalar loop into a freshly allocated buffer, the way WriteChatColor used to do it, and by
+// StripChatColors into a reused buffer. Both must produce the same bytes before anything is timed.
+//
+// The corpus file has one line of chat per line. \a, \n and \x12 stand for the bell that starts a
+// color code, an embedded newline and the link delimiter, and \\ for a backslash.
+//
+// Usage: ChatStrip [corpus file] [seconds per stripper]
+
+#include "main/ChatStrip.h"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// allocation counting
+
+static uint64_t s_allocations = 0;
+
+void* operator new(size_t size)
+{
+	++s_allocations;
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+//----------------------------------------------------------------------------
+// StripMQChat as it was before it was vectorized. It reads past the end of a line that ends in a
+// partial color code, so the corpus must not have any.
+
+static void OldStripMQChat(std::string_view in, char* out)
+{
+	size_t i = 0;
+	int o = 0;
+	while (i < in.size() && in[i])
+	{
+		if (in[i] == '\a')
+		{
+			i++;
+			if (in[i] == '-')
+			{
+				// skip 1 after -
+				i++;
+			}
+			else if (in[i] == '#')
+			{
+				// skip 6 after #
+				i += 6;
+			}
+		}
+		else if (in[i] == '\n')
+		{
+		}
+		else
+			out[o++] = in[i];
+		i++;
+	}
+	out[o] = 0;
+}
+
+// what PluginsWriteChatColor did with each line
+static char OldWriteChatColor(std::string_view line)
+{
+	std::unique_ptr<char[]> plainText = std::make_unique<char[]>(line.length() + 1);
+
+	OldStripMQChat(line, plainText.get());
+	return plainText[0];
+}
+
+// and what it does now
+static char NewWriteChatColor(std::string_view line)
+{
+	thread_local std::vector<char> plainText;
+	if (plainText.size() < line.length() + 1)
+		plainText.resize(line.length() + 1);
+
+	mq::StripChatColors(line, plainText.data());
+	return plainText[0];
+}
+
+//----------------------------------------------------------------------------
+
+static std::string Unescape(std::string_view text)
+{
+	std::string line;
+	line.reserve(text.length());
+
+	for (size_t i = 0; i < text.length(); ++i)
+	{
+		if (text[i] != '\\' || i + 1 == text.length())
+		{
+			line.push_back(text[i]);
+			continue;
+		}
+
+		const std::string_view rest = text.substr(i + 1);
+		if (rest[0] == 'a')
+		{
+			line.push_back('\a');
+			i += 1;
+		}
+		else if (rest[0] == 'n')
+		{
+			line.push_back('\n');
+			i += 1;
+		}
+		else if (rest.substr(0, 3) == "x12")
+		{
+			line.push_back('\x12');
+			i += 3;
+		}
+		else
+		{
+			line.push_back(rest[0]);
+			i += 1;
+		}
+	}
+
+	return line;
+}
+
+// the reverse of Unescape, for printing mismatches
+static std::string Escape(std::string_view line)
+{
+	std::string text;
+	text.reserve(line.length());
+
+	for (char ch : line)
+	{
+		switch (ch)
+		{
+		case '\a': text += "\\a"; break;
+		case '\n': text += "\\n"; break;
+		case '\x12': text += "\\x12"; break;
+		case '\\': text += "\\\\"; break;
+		default: text.push_back(ch); break;
+		}
+	}
+
+	return text;
+}
+
+static std::vector<std::string> LoadCorpus(const std::filesystem::path& path)
+{
+	std::vector<std::string> corpus;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		fmt::print("Could not read chat from {}\n", path.string());
+		return corpus;
+	}
+
+	std::string text;
+	while (std::getline(file, text))
+	{
+		if (!text.empty() && text.back() == '\r')
+			text.pop_back();
+
+		if (!text.empty())
+			corpus.push_back(Unescape(text));
+	}
+
+	return corpus;
+}
+
+static bool Verify(const std::vector<std::string>& corpus)
+{
+	std::vector<char> oldOut, newOut;
+	bool success = true;
+
+	for (const std::string& line : corpus)
+	{
+		oldOut.assign(line.length() + 1, '\xff');
+		newOut.assign(line.length() + 1, '\xff');
+
+		OldStripMQChat(line, oldOut.data());
+		mq::StripChatColors(line, newOut.data());
+
+		const size_t oldLength = strlen(oldOut.data());
+		const size_t newLength = strlen(newOut.data());
+
+		if (oldLength != newLength || memcmp(oldOut.data(), newOut.data(), oldLength) != 0)
+		{
+			fmt::print("MISMATCH: {}\n  old: {}\n  new: {}\n", Escape(line),
+				Escape(std::string_view(oldOut.data(), oldLength)), Escape(std::string_view(newOut.data(), newLength)));
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+static volatile uint64_t s_checksum = 0;
+
+struct Timing
+{
+	double nanoseconds = 0;
+	double megabytes = 0;
+	double allocations = 0;
+};
+
+template <typename Strip>
+static Timing Run(const std::vector<std::string>& corpus, std::chrono::milliseconds duration, Strip&& strip)
+{
+	size_t corpusBytes = 0;
+	for (const std::string& line : corpus)
+		corpusBytes += line.length();
+
+	uint64_t lines = 0;
+	uint64_t bytes = 0;
+	uint64_t checksum = 0;
+	const uint64_t allocationsBefore = s_allocations;
+	const auto start = std::chrono::steady_clock::now();
+	auto now = start;
+
+	while (now - start < duration)
+	{
+		for (const std::string& line : corpus)
+			checksum += static_cast<unsigned char>(strip(line));
+
+		lines += corpus.size();
+		bytes += corpusBytes;
+		now = std::chrono::steady_clock::now();
+	}
+
+	const double elapsed = std::chrono::duration<double, std::nano>(now - start).count();
+
+	Timing timing;
+	timing.nanoseconds = elapsed / lines;
+	timing.megabytes = bytes / (elapsed / 1e9) / (1024 * 1024);
+	timing.allocations = static_cast<double>(s_allocations - allocationsBefore) / lines;
+
+	// keeps the stripped text alive so the work can't be optimized away
+	s_checksum = checksum;
+
+	return timing;
+}
+
+int main(int argc, char* argv[])
+{
+	const std::filesystem::path path = argc > 1 ? std::filesystem::path(argv[1])
+		: std::filesystem::path(__FILE__).parent_path() / "chat.txt";
+	const auto duration = std::chrono::milliseconds(argc > 2 ? std::atoi(argv[2]) * 1000 : 2000);
+
+	const std::vector<std::string> corpus = LoadCorpus(path);
+	if (corpus.empty())
+		return 1;
+
+	size_t bytes = 0;
+	for (const std::string& line : corpus)
+		bytes += line.length();
+	fmt::print("{} lines, {:.1f} characters/line\n", corpus.size(), static_cast<double>(bytes) / corpus.size());
+
+	if (!Verify(corpus))
+		return 1;
+
+	const Timing oldTiming = Run(corpus, duration, OldWriteChatColor);
+	const Timing newTiming = Run(corpus, duration, NewWriteChatColor);
+
+	fmt::print("old strip:   {:8.1f} ns/line, {:7.1f} MB/s, {:.2f} allocations/line\n",
+		oldTiming.nanoseconds, oldTiming.megabytes, oldTiming.allocations);
+	fmt::print("sse2 strip:  {:8.1f} ns/line, {:7.1f} MB/s, {:.2f} allocations/line\n",
+		newTiming.nanoseconds, newTiming.megabytes, newTiming.allocations);
+	fmt::print("speedup:     {:8.2f}x\n", oldTiming.nanoseconds / newTiming.nanoseconds);
+
+	return 0;
+}
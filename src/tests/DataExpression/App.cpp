@@ -0,0 +1,607 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Microbenchmark for the data portion of ${...} expressions. The corpus is every innermost ${...}
+// in the shipped macros plus a few expressions that cover typecasts, quoted indexes and errors.
+// Each expression is evaluated by the old parser, which writes into a copy of the text, and by
+// replaying the cached compiled form, against the same stand-in TLOs and members. Both must make
+// the same calls in the same order before anything is timed.
+//
+// Usage: DataExpression [macro folder] [seconds per parser]
+
+#include "main/DataExpression.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+static constexpr size_t MAX_STRING = 2048;
+
+//----------------------------------------------------------------------------
+// allocation counting
+
+static uint64_t s_allocations = 0;
+
+void* operator new(size_t size)
+{
+	++s_allocations;
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+//----------------------------------------------------------------------------
+// Stand-in for the data api. Results only carry a type id, and every member of every type exists,
+// so chains always run to the end. Lookups go through hash maps like the real ones do.
+
+struct Result
+{
+	int type = 0;
+};
+
+static constexpr int TYPE_TYPE = 100;
+
+struct StringHash
+{
+	using is_transparent = void;
+
+	size_t operator()(std::string_view str) const noexcept { return std::hash<std::string_view>{}(str); }
+};
+
+static const char* const s_tloNames[] = {
+	"Me", "Target", "Cursor", "Switch", "Macro", "Spawn", "Math", "FindItemCount", "Window", "Zone", "Group",
+	"Int", "String", "Bool", "Float", "Select", "If", "Time", "Ini", "Navigation",
+};
+
+static const char* const s_typeNames[] = { "int", "string", "float", "bool", "spawn", "item", "type" };
+
+struct Evaluator
+{
+	// the old maps had std::string keys without a transparent hash, so every lookup built a key
+	std::unordered_map<std::string, int> oldTLOs;
+	std::unordered_map<std::string, int> oldTypes;
+	std::unordered_map<std::string, int> oldMembers;
+
+	std::unordered_map<std::string, int, StringHash, std::equal_to<>> tlos;
+	std::unordered_map<std::string, int, StringHash, std::equal_to<>> types;
+	std::unordered_map<std::string, int, StringHash, std::equal_to<>> members;
+
+	// set while verifying, the calls made by each parser are written here
+	std::string* trace = nullptr;
+	uint64_t checksum = 0;
+
+	Evaluator()
+	{
+		int id = 1;
+		for (const char* name : s_tloNames)
+		{
+			oldTLOs.emplace(name, id);
+			tlos.emplace(name, id++);
+		}
+
+		for (const char* name : s_typeNames)
+		{
+			const int typeId = strcmp(name, "type") == 0 ? TYPE_TYPE : id++;
+			oldTypes.emplace(name, typeId);
+			types.emplace(name, typeId);
+		}
+	}
+
+	void Trace(std::string_view what, const char* name, const char* index = nullptr, bool allowFunction = false)
+	{
+		if (trace)
+			*trace += fmt::format("{}:{}[{}]{};", what, name, index ? index : "", allowFunction ? "f" : "");
+	}
+
+	int Consume(const char* name, const char* index)
+	{
+		// stand-in for the work a member does with its index
+		const int type = static_cast<int>((strlen(name) + static_cast<unsigned char>(index[0])) % 50) + 1;
+		checksum += type;
+		return type;
+	}
+
+	// same signature and lookups as the old EvaluateDataExpression, with the std::string member name
+	// that the old EvaluateMacroDataMember took
+	bool OldEvaluate(Result& result, const char* name, char* index, bool allowFunction = false)
+	{
+		Trace("eval", name, index, allowFunction);
+
+		if (!result.type)
+		{
+			auto iter = oldTLOs.find(name);
+			result.type = iter != oldTLOs.end() ? iter->second : Consume(name, index);
+			return true;
+		}
+
+		const std::string& member = name;
+		auto iter = oldMembers.find(member);
+		result.type = iter != oldMembers.end() ? iter->second : Consume(member.c_str(), index);
+		return true;
+	}
+
+	bool NewEvaluate(Result& result, const char* name, char* index, bool allowFunction = false)
+	{
+		Trace("eval", name, index, allowFunction);
+
+		if (!result.type)
+		{
+			auto iter = tlos.find(name);
+			result.type = iter != tlos.end() ? iter->second : Consume(name, index);
+			return true;
+		}
+
+		auto iter = members.find(name);
+		result.type = iter != members.end() ? iter->second : Consume(name, index);
+		return true;
+	}
+
+	template <typename Map>
+	bool Cast(Map& map, Result& result, const char* type)
+	{
+		Trace("cast", type);
+
+		auto iter = map.find(type);
+		if (iter == map.end())
+		{
+			Error(fmt::format("Unknown type '{}'", type).c_str());
+			return false;
+		}
+
+		result.type = iter->second;
+		return true;
+	}
+
+	void Error(const char* message)
+	{
+		Trace("error", message);
+	}
+};
+
+//----------------------------------------------------------------------------
+// The parser as it was before expressions were compiled. It writes into the text it is given.
+
+static bool OldParseDataPortion(Evaluator& eval, char* szOriginal, Result& Result)
+{
+	Result.type = 0;
+
+	char Index[MAX_STRING] = { 0 };
+
+	// Find [] before a . or null
+	char* pPos = &szOriginal[0];
+	char* pStart = pPos;
+	char* pIndex = &Index[0];
+	bool Quote = false;
+	bool functionAllowed = false;
+
+	while (true)
+	{
+		if (*pPos == 0)
+		{
+			// end completely. process
+			if (pStart == pPos)
+			{
+				if (!Result.type)
+				{
+					eval.Error("Nothing to parse");
+					return false;
+				}
+
+				return true;
+			}
+
+			if (!eval.OldEvaluate(Result, pStart, pIndex, functionAllowed))
+				return false;
+
+			// done processing
+			return true;
+		}
+
+		if (*pPos == '(')
+		{
+			*pPos = 0;
+			if (pStart == pPos)
+			{
+				if (!Result.type)
+				{
+					eval.Error("Encountered typecast without object to cast");
+					return false;
+				}
+
+				return true;
+			}
+			else
+			{
+				if (!eval.OldEvaluate(Result, pStart, pIndex))
+					return false;
+			}
+
+			if (!Result.type)
+			{
+				// error
+				return false;
+			}
+
+			*pPos = 0;
+			++pPos;
+			char* pType = pPos;
+
+			while (*pPos != ')')
+			{
+				if (!*pPos)
+				{
+					// error
+					eval.Error("Encountered unmatched parenthesis");
+					return false;
+				}
+				++pPos;
+			}
+
+			*pPos = 0;
+
+			if (!eval.Cast(eval.oldTypes, Result, pType))
+				return false;
+
+			if (pPos[1] == '.')
+			{
+				++pPos;
+				pStart = &pPos[1];
+			}
+			else if (!pPos[1])
+			{
+				return true;
+			}
+			else
+			{
+				eval.Error(fmt::format("Invalid character found after typecast '){}'", &pPos[1]).c_str());
+				return false;
+			}
+		}
+		else
+		{
+			if (*pPos == '[')
+			{
+				// index
+				*pPos = 0;
+				++pPos;
+				functionAllowed = true;
+				Quote = false;
+				bool BeginParam = true;
+
+				while (true)
+				{
+					if (*pPos == 0)
+					{
+						eval.Error(fmt::format("Unmatched bracket or invalid character following bracket found in index: '{}'",
+							std::string_view(Index, pIndex - Index)).c_str());
+						return false;
+					}
+
+					if (BeginParam)
+					{
+						BeginParam = false;
+						if (*pPos == '\"')
+						{
+							Quote = true;
+							++pPos;
+							continue;
+						}
+					}
+
+					if (Quote)
+					{
+						if (*pPos == '\"')
+						{
+							if (pPos[1] == ']' || pPos[1] == ',')
+							{
+								Quote = false;
+								++pPos;
+								continue;
+							}
+						}
+					}
+					else
+					{
+						if (*pPos == ']')
+						{
+							if (pPos[1] == '.' || pPos[1] == '(' || pPos[1] == 0)
+								break;// valid end
+						}
+						else if (*pPos == ',')
+							BeginParam = true;
+					}
+
+					*pIndex = *pPos;
+					++pIndex;
+					++pPos;
+				}
+
+				*pIndex = 0;
+				pIndex = &Index[0];
+				*pPos = 0;
+			}
+			else
+			{
+				if (*pPos == '.')
+				{
+					// end of this one, but more to come!
+					*pPos = 0;
+					if (pStart == pPos)
+					{
+						if (!Result.type)
+						{
+							eval.Error("Encountered member access without object");
+							return false;
+						}
+
+						return true;
+					}
+
+					if (!eval.OldEvaluate(Result, pStart, pIndex))
+						return false;
+
+					pStart = &pPos[1];
+					Index[0] = 0;
+				}
+			}
+		}
+		++pPos;
+	}
+}
+
+// Callers had to hand the old parser a writable copy of the expression.
+static bool OldParse(Evaluator& eval, std::string_view expression, Result& result)
+{
+	char szCurrent[MAX_STRING];
+	const size_t length = std::min(expression.length(), MAX_STRING - 1);
+	memcpy(szCurrent, expression.data(), length);
+	szCurrent[length] = 0;
+
+	return OldParseDataPortion(eval, szCurrent, result);
+}
+
+//----------------------------------------------------------------------------
+// The current path: look the expression up in the cache and replay its ops, the same way
+// MQDataAPI::EvaluateCompiledExpression does.
+
+static void CopyIndex(char (&Index)[MAX_STRING], const std::string& index)
+{
+	const size_t length = std::min(index.length(), MAX_STRING - 1);
+	memcpy(Index, index.c_str(), length);
+	Index[length] = 0;
+}
+
+static bool NewParse(Evaluator& eval, mq::CompiledExpressionCache& cache, std::string_view expression, Result& result)
+{
+	using OpCode = mq::CompiledExpression::OpCode;
+
+	std::shared_ptr<const mq::CompiledExpression> compiled = cache.Get(expression);
+
+	result.type = 0;
+
+	char Index[MAX_STRING];
+
+	for (const mq::CompiledExpression::Op& op : compiled->ops)
+	{
+		switch (op.code)
+		{
+		case OpCode::Evaluate:
+			// like strncpy_s with _TRUNCATE, which doesn't pad the rest of the buffer
+			CopyIndex(Index, op.index);
+
+			if (!eval.NewEvaluate(result, op.name.c_str(), Index, op.allowFunction))
+				return false;
+			break;
+
+		case OpCode::RequireType:
+			if (!result.type)
+				return false;
+			break;
+
+		case OpCode::Cast:
+			if (!eval.Cast(eval.types, result, op.name.c_str()))
+				return false;
+			break;
+
+		case OpCode::Finish:
+			if (!result.type)
+			{
+				eval.Error(op.name.c_str());
+				return false;
+			}
+			return true;
+
+		case OpCode::Error:
+			eval.Error(op.name.c_str());
+			return false;
+
+		case OpCode::Done:
+			return true;
+		}
+	}
+
+	return true;
+}
+
+//----------------------------------------------------------------------------
+
+static const char* const s_extraExpressions[] = {
+	"Me.Inventory[mainhand].ID(int)",
+	"Target.ID(string).Length",
+	"Me.Buff[\"Spirit of Wolf\"].Duration.TotalSeconds",
+	"Spawn[pc radius 50 noalert 3].CleanName",
+	"Window[InventoryWindow].Child[IW_Money0].Text",
+	"Math.Calc[3+4*2].Int",
+	"Ini[\"settings.ini\",General,\"Key\"].Arg[1,|]",
+	"Me.Name(type).Name",
+	"Me.Level(unknown)",
+	"Me..Level",
+	"Me.Inventory[mainhand",
+	"Me.Level(int",
+	".Level",
+	"(int)",
+	"Me.Level(int)x",
+};
+
+static void AddExpressions(std::string_view text, std::vector<std::string>& corpus)
+{
+	// innermost ${...}, which the macro engine evaluates first
+	size_t pos = 0;
+	while ((pos = text.find("${", pos)) != std::string_view::npos)
+	{
+		const size_t start = pos + 2;
+		const size_t end = text.find_first_of("${}\r\n", start);
+		if (end == std::string_view::npos)
+			break;
+
+		if (text[end] == '}' && end > start)
+			corpus.emplace_back(text.substr(start, end - start));
+
+		pos = start;
+	}
+}
+
+static std::vector<std::string> LoadCorpus(const std::filesystem::path& folder)
+{
+	std::vector<std::string> corpus;
+
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(folder, ec))
+	{
+		if (entry.path().extension() != ".mac")
+			continue;
+
+		std::ifstream file(entry.path(), std::ios::binary);
+		std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		AddExpressions(text, corpus);
+	}
+
+	if (ec)
+		fmt::print("Could not read macros from {}: {}\n", folder.string(), ec.message());
+
+	for (const char* expression : s_extraExpressions)
+		corpus.emplace_back(expression);
+
+	return corpus;
+}
+
+static bool Verify(Evaluator& eval, mq::CompiledExpressionCache& cache, const std::vector<std::string>& corpus)
+{
+	std::string oldTrace, newTrace;
+	bool success = true;
+
+	for (const std::string& expression : corpus)
+	{
+		Result oldResult, newResult;
+
+		oldTrace.clear();
+		eval.trace = &oldTrace;
+		const bool oldSuccess = OldParse(eval, expression, oldResult);
+
+		newTrace.clear();
+		eval.trace = &newTrace;
+		const bool newSuccess = NewParse(eval, cache, expression, newResult);
+
+		if (oldSuccess != newSuccess || oldTrace != newTrace || oldResult.type != newResult.type)
+		{
+			fmt::print("MISMATCH: ${{{}}}\n  old: {} {}\n  new: {} {}\n", expression,
+				oldSuccess, oldTrace, newSuccess, newTrace);
+			success = false;
+		}
+	}
+
+	eval.trace = nullptr;
+	return success;
+}
+
+struct Timing
+{
+	double nanoseconds = 0;
+	double allocations = 0;
+};
+
+template <typename Parse>
+static Timing Run(const std::vector<std::string>& corpus, std::chrono::milliseconds duration, Parse&& parse)
+{
+	uint64_t evaluations = 0;
+	const uint64_t allocationsBefore = s_allocations;
+	const auto start = std::chrono::steady_clock::now();
+	auto now = start;
+
+	while (now - start < duration)
+	{
+		for (const std::string& expression : corpus)
+		{
+			Result result;
+			parse(expression, result);
+		}
+
+		evaluations += corpus.size();
+		now = std::chrono::steady_clock::now();
+	}
+
+	Timing timing;
+	timing.nanoseconds = std::chrono::duration<double, std::nano>(now - start).count() / evaluations;
+	timing.allocations = static_cast<double>(s_allocations - allocationsBefore) / evaluations;
+	return timing;
+}
+
+int main(int argc, char* argv[])
+{
+	const std::filesystem::path folder = argc > 1 ? std::filesystem::path(argv[1])
+		: std::filesystem::path(__FILE__).parent_path() / "../../../data/macros";
+	const auto duration = std::chrono::milliseconds(argc > 2 ? std::atoi(argv[2]) * 1000 : 2000);
+
+	const std::vector<std::string> corpus = LoadCorpus(folder);
+	std::set<std::string_view> distinct(corpus.begin(), corpus.end());
+	fmt::print("{} expressions ({} distinct)\n", corpus.size(), distinct.size());
+
+	Evaluator eval;
+	mq::CompiledExpressionCache cache;
+
+	if (!Verify(eval, cache, corpus))
+		return 1;
+
+	const Timing oldTiming = Run(corpus, duration,
+		[&](const std::string& expression, Result& result) { return OldParse(eval, expression, result); });
+	const Timing newTiming = Run(corpus, duration,
+		[&](const std::string& expression, Result& result) { return NewParse(eval, cache, expression, result); });
+	const Timing lookupTiming = Run(corpus, duration,
+		[&](const std::string& expression, Result&) { return cache.Get(expression) != nullptr; });
+
+	fmt::print("old parser:  {:8.1f} ns/expression, {:.2f} allocations/expression\n",
+		oldTiming.nanoseconds, oldTiming.allocations);
+	fmt::print("compiled:    {:8.1f} ns/expression, {:.2f} allocations/expression\n",
+		newTiming.nanoseconds, newTiming.allocations);
+	fmt::print("  of which cache lookup: {:.1f} ns\n", lookupTiming.nanoseconds);
+	fmt::print("speedup:     {:8.2f}x\n", oldTiming.nanoseconds / newTiming.nanoseconds);
+	fmt::print("checksum:    {}\n", eval.checksum);
+
+	return 0;
+}
@@ -0,0 +1,637 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Simulation of the identity sync between launchers. A handful of peers in one process churn their
+// actors while the links between them drop (losing whatever was in flight), come back, and peers
+// restart. The state of each link is kept in a PeerIdentitySync, which decides what PeerConnection
+// does with it: changes are sent as one delta per tick, a reconnect asks for the changes since the
+// version it has, and a sync that doesn't follow on from the mirror is answered with a request.
+// Some of the peers are legacy peers from before identity syncs. They push their whole table on
+// connect and every change on its own, and they only learn about identities that are pushed to them.
+// Once everything settles, every peer has to know the live actors of every other peer, the mirrors
+// between current peers have to match exactly, and the peers have to stop talking.
+//
+// Usage: IdentitySync [ticks] [peers] [actors per peer] [seed] [legacy peers]
+
+#include "routing/IdentitySync.h"
+
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mq::postoffice;
+
+struct SimMessage
+{
+	enum class Kind { Request, Sync, Add, Drop };
+
+	Kind kind = Kind::Request;
+	int from = 0;
+	int to = 0;
+	int deliverAt = 0;
+	std::optional<mq::proto::routing::IdentitySync> sync;
+	mq::proto::routing::Identification id;   // for adds and drops
+	std::string epoch;                        // for requests
+	uint64_t version = 0;                     // for requests
+	bool identitySync = false;                // for requests
+};
+
+struct SimCounters
+{
+	uint64_t batches = 0;          // the per tick syncs
+	uint64_t changes = 0;          // the messages it would take to send every change on its own
+	uint64_t replies = 0;          // the syncs sent to answer a request
+	uint64_t replyEntries = 0;     // the identities in those
+	uint64_t replyBaseline = 0;    // the identities it would take to answer with the whole table every time
+	uint64_t fullSyncs = 0;
+	uint64_t requests = 0;
+	uint64_t pushed = 0;           // the identities sent one at a time, to and from legacy peers
+	uint64_t gaps = 0;
+	uint64_t lost = 0;
+	uint64_t unknown = 0;          // syncs that reached a legacy peer, which would drop them
+};
+
+struct SimPeer
+{
+	int index = 0;
+	bool legacy = false;
+	int restarts = 0;
+	std::unique_ptr<IdentityTable> table;
+	uint64_t syncedVersion = 0;
+	std::map<std::string, mq::proto::routing::Identification> live;
+	uint32_t nextActor = 0;
+
+	// what the peer knows of another peer. Legacy peers only have the identities.
+	struct Remote
+	{
+		PeerIdentitySync sync;
+		std::map<std::string, mq::proto::routing::Identification> identities;
+	};
+	std::map<int, Remote> remotes;
+
+	void Start(size_t maxTombstones)
+	{
+		table = std::make_unique<IdentityTable>(fmt::format("peer{}-epoch{}", index, restarts), maxTombstones);
+		syncedVersion = 0;
+		live.clear();
+		remotes.clear();
+	}
+
+	void AddActor()
+	{
+		mq::proto::routing::Identification id;
+		id.mutable_process()->set_pid(1000 + index);
+		id.set_uuid(fmt::format("peer{}-epoch{}-actor{}", index, restarts, nextActor));
+		id.set_name(fmt::format("actor{}", nextActor++));
+
+		table->Add(id);
+		live[id.uuid()] = id;
+	}
+
+	void DropActor(std::mt19937& rng)
+	{
+		if (live.empty())
+			return;
+
+		auto it = std::next(live.begin(), std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng));
+		table->Drop(it->first);
+		live.erase(it);
+	}
+
+	void RenameActor(std::mt19937& rng)
+	{
+		if (live.empty())
+			return;
+
+		auto it = std::next(live.begin(), std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng));
+		it->second.set_name(it->second.name() + "'");
+		table->Add(it->second);
+	}
+};
+
+class Simulation
+{
+public:
+	Simulation(int peers, int actors, int legacy, uint32_t seed)
+		: m_rng(seed)
+		, m_actors(actors)
+		, m_peers(peers)
+		, m_links(peers, std::vector<bool>(peers, true))
+	{
+		for (int i = 0; i < peers; ++i)
+		{
+			m_peers[i].index = i;
+			m_peers[i].legacy = i >= peers - legacy;
+			m_peers[i].Start(MaxTombstones);
+			for (int a = 0; a < actors; ++a)
+				m_peers[i].AddActor();
+		}
+
+		// everyone starts out connected, which looks like a connect to each side
+		for (int i = 0; i < peers; ++i)
+		{
+			for (int j = 0; j < peers; ++j)
+			{
+				if (i != j)
+					OnConnected(i, j);
+			}
+		}
+	}
+
+	void Tick(bool churn)
+	{
+		++m_tick;
+
+		if (churn)
+			Churn();
+
+		Deliver();
+
+		// the per tick batch, same as ServerPostOffice::ProcessIdentitySync. Legacy peers send the
+		// same changes one at a time.
+		for (SimPeer& peer : m_peers)
+		{
+			if (peer.table->GetVersion() == peer.syncedVersion)
+				continue;
+
+			mq::proto::routing::IdentitySync sync;
+			peer.table->BuildSync(peer.table->GetEpoch(), peer.syncedVersion, sync);
+			const uint64_t changes = peer.table->GetVersion() - peer.syncedVersion;
+			peer.syncedVersion = peer.table->GetVersion();
+
+			for (int to = 0; to < static_cast<int>(m_peers.size()); ++to)
+			{
+				if (to != peer.index && m_links[peer.index][to])
+				{
+					SyncIdentities(peer.index, to, sync);
+					++m_counters.batches;
+					m_counters.changes += changes;
+				}
+			}
+		}
+	}
+
+	bool IsQuiet() const { return m_inFlight.empty(); }
+	uint64_t GetTraffic() const
+	{
+		return m_counters.batches + m_counters.replies + m_counters.requests + m_counters.pushed;
+	}
+	const SimCounters& GetCounters() const { return m_counters; }
+
+	void ConnectAll()
+	{
+		for (int i = 0; i < static_cast<int>(m_peers.size()); ++i)
+		{
+			for (int j = i + 1; j < static_cast<int>(m_peers.size()); ++j)
+			{
+				if (!m_links[i][j])
+					Connect(i, j);
+			}
+		}
+	}
+
+	// every peer has to know the live actors of the others, and every mirror has to have exactly those
+	bool Verify() const
+	{
+		bool ok = true;
+		for (const SimPeer& peer : m_peers)
+		{
+			if (peer.table->GetCount() != peer.live.size())
+			{
+				SPDLOG_ERROR("peer {} table has {} identities but {} are live", peer.index,
+					peer.table->GetCount(), peer.live.size());
+				ok = false;
+			}
+
+			for (const SimPeer& other : m_peers)
+			{
+				if (other.index == peer.index)
+					continue;
+
+				auto it = other.remotes.find(peer.index);
+				if (it == other.remotes.end())
+				{
+					SPDLOG_ERROR("peer {} has no mirror of peer {}", other.index, peer.index);
+					ok = false;
+					continue;
+				}
+
+				const auto& identities = it->second.identities;
+				for (const auto& [uuid, id] : peer.live)
+				{
+					auto found = identities.find(uuid);
+					if (found == identities.end() || found->second.name() != id.name())
+					{
+						SPDLOG_ERROR("peer {} doesn't know actor {} of peer {}", other.index, id.name(), peer.index);
+						ok = false;
+					}
+				}
+
+				// drops that happen while a legacy peer is disconnected are never sent, so only the identities
+				// and mirrors between current peers have to match exactly
+				if (peer.legacy || other.legacy)
+					continue;
+
+				if (!it->second.sync.IsSyncCapable())
+				{
+					SPDLOG_ERROR("peer {} never found out that peer {} takes syncs", other.index, peer.index);
+					ok = false;
+				}
+
+				if (identities.size() != peer.live.size())
+				{
+					SPDLOG_ERROR("peer {} knows {} identities of peer {}, expected {}", other.index, identities.size(),
+						peer.index, peer.live.size());
+					ok = false;
+				}
+
+				const IdentityMirror& mirror = it->second.sync.GetMirror();
+				bool same = mirror.GetEpoch() == peer.table->GetEpoch()
+					&& mirror.GetVersion() == peer.table->GetVersion()
+					&& mirror.GetIdentities().size() == peer.live.size();
+
+				for (const auto& [uuid, id] : peer.live)
+				{
+					auto found = mirror.GetIdentities().find(uuid);
+					if (found == mirror.GetIdentities().end() || found->second.name() != id.name())
+						same = false;
+				}
+
+				if (!same)
+				{
+					SPDLOG_ERROR("peer {} mirror of peer {} is at {}@{} with {} identities, expected {}@{} with {}",
+						other.index, peer.index, mirror.GetEpoch(), mirror.GetVersion(), mirror.GetIdentities().size(),
+						peer.table->GetEpoch(), peer.table->GetVersion(), peer.live.size());
+					ok = false;
+				}
+			}
+		}
+
+		return ok;
+	}
+
+private:
+	static constexpr size_t MaxTombstones = 64;
+
+	void Churn()
+	{
+		std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+		for (SimPeer& peer : m_peers)
+		{
+			if (chance(m_rng) < 0.002)
+			{
+				Restart(peer);
+				continue;
+			}
+
+			const int changes = std::uniform_int_distribution<int>(0, 2)(m_rng);
+			for (int i = 0; i < changes; ++i)
+			{
+				const double roll = chance(m_rng);
+				if (roll < 0.45 || peer.live.size() < static_cast<size_t>(m_actors) / 2)
+					peer.AddActor();
+				else if (roll < 0.9)
+					peer.DropActor(m_rng);
+				else
+					peer.RenameActor(m_rng);
+			}
+		}
+
+		for (int i = 0; i < static_cast<int>(m_peers.size()); ++i)
+		{
+			for (int j = i + 1; j < static_cast<int>(m_peers.size()); ++j)
+			{
+				if (m_links[i][j] && chance(m_rng) < 0.01)
+					Disconnect(i, j);
+				else if (!m_links[i][j] && chance(m_rng) < 0.05)
+					Connect(i, j);
+			}
+		}
+	}
+
+	void Restart(SimPeer& peer)
+	{
+		for (int other = 0; other < static_cast<int>(m_peers.size()); ++other)
+		{
+			if (other != peer.index && m_links[peer.index][other])
+				Disconnect(peer.index, other);
+		}
+
+		++peer.restarts;
+		peer.Start(MaxTombstones);
+		for (int a = 0; a < m_actors; ++a)
+			peer.AddActor();
+	}
+
+	void Disconnect(int a, int b)
+	{
+		m_links[a][b] = m_links[b][a] = false;
+
+		for (auto it = m_inFlight.begin(); it != m_inFlight.end();)
+		{
+			if ((it->from == a && it->to == b) || (it->from == b && it->to == a))
+			{
+				it = m_inFlight.erase(it);
+				++m_counters.lost;
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		// same as PeerConnection::OnSessionDisconnectedHandler, the mirrors are kept
+		m_peers[a].remotes[b].sync.OnDisconnected();
+		m_peers[b].remotes[a].sync.OnDisconnected();
+	}
+
+	void Connect(int a, int b)
+	{
+		m_links[a][b] = m_links[b][a] = true;
+		OnConnected(a, b);
+		OnConnected(b, a);
+	}
+
+	// same as PeerConnection::OnSessionConnectedHandler
+	void OnConnected(int from, int to)
+	{
+		SimPeer& peer = m_peers[from];
+		if (peer.legacy)
+		{
+			// legacy peers push everything they have and never ask
+			PushIdentities(from, to);
+			return;
+		}
+
+		if (peer.remotes[to].sync.OnConnected())
+			PushIdentities(from, to);
+
+		SendRequest(from, to);
+	}
+
+	void PushIdentities(int from, int to)
+	{
+		mq::proto::routing::IdentitySync sync;
+		m_peers[from].table->BuildSync({}, 0, sync);
+		SyncIdentities(from, to, sync);
+	}
+
+	void SendRequest(int from, int to)
+	{
+		const IdentityMirror& mirror = m_peers[from].remotes[to].sync.GetMirror();
+
+		SimMessage message;
+		message.kind = SimMessage::Kind::Request;
+		message.from = from;
+		message.to = to;
+		message.epoch = mirror.GetEpoch();
+		message.version = mirror.GetVersion();
+		message.identitySync = true;
+		Post(std::move(message));
+
+		++m_counters.requests;
+	}
+
+	// same as PeerConnection::SyncIdentities, peers that don't take syncs get the changes one at a time
+	void SyncIdentities(int from, int to, const mq::proto::routing::IdentitySync& sync)
+	{
+		if (!m_peers[from].legacy && m_peers[from].remotes[to].sync.IsSyncCapable())
+		{
+			SendSync(from, to, sync);
+			return;
+		}
+
+		for (const auto& id : sync.added())
+			SendIdentity(SimMessage::Kind::Add, from, to, id);
+
+		for (const auto& id : sync.dropped())
+			SendIdentity(SimMessage::Kind::Drop, from, to, id);
+	}
+
+	void SendSync(int from, int to, const mq::proto::routing::IdentitySync& sync)
+	{
+		SimMessage message;
+		message.kind = SimMessage::Kind::Sync;
+		message.from = from;
+		message.to = to;
+		message.sync = sync;
+		Post(std::move(message));
+
+		m_counters.fullSyncs += sync.full() ? 1 : 0;
+	}
+
+	void SendIdentity(SimMessage::Kind kind, int from, int to, const mq::proto::routing::Identification& id)
+	{
+		SimMessage message;
+		message.kind = kind;
+		message.from = from;
+		message.to = to;
+		message.id = id;
+		Post(std::move(message));
+
+		++m_counters.pushed;
+	}
+
+	void Post(SimMessage message)
+	{
+		// links are in order like a TCP session, but each takes its own time
+		int deliverAt = m_tick + std::uniform_int_distribution<int>(0, 3)(m_rng);
+		for (const SimMessage& other : m_inFlight)
+		{
+			if (other.from == message.from && other.to == message.to)
+				deliverAt = std::max(deliverAt, other.deliverAt);
+		}
+
+		message.deliverAt = deliverAt;
+		m_inFlight.push_back(std::move(message));
+	}
+
+	void Deliver()
+	{
+		std::vector<SimMessage> ready;
+		for (auto it = m_inFlight.begin(); it != m_inFlight.end();)
+		{
+			if (it->deliverAt <= m_tick)
+			{
+				ready.push_back(std::move(*it));
+				it = m_inFlight.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		for (SimMessage& message : ready)
+		{
+			// anything delivered after a disconnect in this tick was lost with the session
+			if (!m_links[message.from][message.to])
+			{
+				++m_counters.lost;
+				continue;
+			}
+
+			Receive(m_peers[message.to], message);
+		}
+	}
+
+	// same as PeerConnection::PeerMessageHandler
+	void Receive(SimPeer& peer, const SimMessage& message)
+	{
+		SimPeer::Remote& remote = peer.remotes[message.from];
+
+		switch (message.kind)
+		{
+		case SimMessage::Kind::Request:
+		{
+			// legacy peers answer with the whole table, which is what they get for not sending a version
+			mq::proto::routing::IdentitySync sync;
+			if (peer.legacy)
+			{
+				peer.table->BuildSync({}, 0, sync);
+			}
+			else
+			{
+				remote.sync.OnRequest(message.identitySync);
+				peer.table->BuildSync(message.epoch, message.version, sync);
+			}
+
+			SyncIdentities(peer.index, message.from, sync);
+
+			++m_counters.replies;
+			m_counters.replyEntries += sync.added_size() + sync.dropped_size();
+			m_counters.replyBaseline += peer.live.size();
+			break;
+		}
+
+		case SimMessage::Kind::Add:
+			if (!peer.legacy)
+				remote.sync.OnAdd(message.id);
+
+			remote.identities[message.id.uuid()] = message.id;
+			break;
+
+		case SimMessage::Kind::Drop:
+			if (!peer.legacy)
+				remote.sync.OnDrop(message.id);
+
+			remote.identities.erase(message.id.uuid());
+			break;
+
+		case SimMessage::Kind::Sync:
+		{
+			if (peer.legacy)
+			{
+				SPDLOG_ERROR("peer {} sent a sync to legacy peer {}", message.from, peer.index);
+				++m_counters.unknown;
+				break;
+			}
+
+			std::vector<mq::proto::routing::Identification> added;
+			std::vector<mq::proto::routing::Identification> dropped;
+
+			switch (remote.sync.OnSync(*message.sync, added, dropped))
+			{
+			case IdentityMirror::Result::Applied:
+				for (const auto& id : added)
+					remote.identities[id.uuid()] = id;
+
+				for (const auto& id : dropped)
+					remote.identities.erase(id.uuid());
+				break;
+
+			case IdentityMirror::Result::Gap:
+				++m_counters.gaps;
+				if (remote.sync.StartRequest())
+					SendRequest(peer.index, message.from);
+				break;
+
+			case IdentityMirror::Result::Stale:
+				break;
+			}
+			break;
+		}
+		}
+	}
+
+	std::mt19937 m_rng;
+	const int m_actors;
+	int m_tick = 0;
+	std::vector<SimPeer> m_peers;
+	std::vector<std::vector<bool>> m_links;
+	std::deque<SimMessage> m_inFlight;
+	SimCounters m_counters;
+};
+
+int main(int argc, char* argv[])
+{
+	spdlog::set_level(spdlog::level::info);
+
+	const int ticks = argc > 1 ? std::atoi(argv[1]) : 5000;
+	const int peers = argc > 2 ? std::atoi(argv[2]) : 4;
+	const int actors = argc > 3 ? std::atoi(argv[3]) : 50;
+	const uint32_t seed = argc > 4 ? static_cast<uint32_t>(std::atoi(argv[4])) : 1;
+	const int legacy = argc > 5 ? std::atoi(argv[5]) : 1;
+
+	SPDLOG_INFO("Simulating {} peers ({} legacy) with {} actors each for {} ticks (seed {})", peers, legacy, actors,
+		ticks, seed);
+
+	Simulation simulation(peers, actors, legacy, seed);
+	for (int i = 0; i < ticks; ++i)
+		simulation.Tick(true);
+
+	// let everything settle with every link up
+	simulation.ConnectAll();
+	int settle = 0;
+	while (!simulation.IsQuiet() && settle < 1000)
+	{
+		simulation.Tick(false);
+		++settle;
+	}
+
+	// a settled network has to stay silent, anything else means changes are looping
+	const uint64_t traffic = simulation.GetTraffic();
+	for (int i = 0; i < 100; ++i)
+		simulation.Tick(false);
+
+	const SimCounters& counters = simulation.GetCounters();
+	SPDLOG_INFO("Settled after {} ticks: {} requests, {} gaps, {} full syncs, {} messages lost",
+		settle, counters.requests, counters.gaps, counters.fullSyncs, counters.lost);
+	SPDLOG_INFO("Changes went out in {} batches, one message per change would be {}",
+		counters.batches, counters.changes);
+	SPDLOG_INFO("Requests were answered with {} identities, sending the whole table would be {}",
+		counters.replyEntries, counters.replyBaseline);
+	SPDLOG_INFO("{} identities were sent one at a time to and from legacy peers", counters.pushed);
+
+	if (!simulation.IsQuiet() || simulation.GetTraffic() != traffic)
+	{
+		SPDLOG_ERROR("Peers kept sending after settling: {} messages", simulation.GetTraffic() - traffic);
+		return 1;
+	}
+
+	if (counters.unknown > 0 || !simulation.Verify())
+		return 1;
+
+	SPDLOG_INFO("All mirrors match");
+	return 0;
+}
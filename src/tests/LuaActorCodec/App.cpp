@@ -0,0 +1,286 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Round trip tests for the lua actor payload encoding. Each test builds a value in a lua state,
+// encodes it and decodes it again, and then compares the two in lua. Malformed payloads have to be
+// rejected without leaving anything on the stack.
+//
+// Usage: LuaActorCodec
+
+#include "plugins/lua/LuaActorCodec.h"
+
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+
+#include <string>
+#include <string_view>
+
+using mq::lua::LuaActorCodec;
+
+static int s_failures = 0;
+
+static void Check(bool condition, std::string_view test, std::string_view what)
+{
+	if (!condition)
+	{
+		SPDLOG_ERROR("{}: {}", test, what);
+		++s_failures;
+	}
+}
+
+// evaluates a lua expression that is expected to be true
+static bool Eval(sol::state& lua, std::string_view expression)
+{
+	return lua.script(fmt::format("return {}", expression)).get<bool>();
+}
+
+static void InitState(sol::state& lua)
+{
+	lua.open_libraries(sol::lib::base, sol::lib::math, sol::lib::string, sol::lib::table);
+
+	lua.script(R"(
+		function deepeq(a, b)
+			if type(a) ~= type(b) then return false end
+			if type(a) ~= 'table' then return a == b end
+			for k, v in pairs(a) do
+				if not deepeq(v, b[k]) then return false end
+			end
+			for k in pairs(b) do
+				if a[k] == nil then return false end
+			end
+			return true
+		end
+	)");
+}
+
+// runs script, which sets the global 'value', then encodes it and decodes it into the global 'decoded'
+static bool RoundTrip(sol::state& lua, LuaActorCodec& codec, std::string_view test, const char* script,
+	std::string* encoded = nullptr)
+{
+	lua.script(script);
+
+	lua_State* L = lua.lua_state();
+	const int top = lua_gettop(L);
+
+	lua_getglobal(L, "value");
+	const std::string data = codec.Encode(L, -1);
+	lua_pop(L, 1);
+
+	if (encoded != nullptr)
+		*encoded = data;
+
+	Check(LuaActorCodec::IsEncoded(data), test, "payload is not marked as encoded");
+	if (!LuaActorCodec::Decode(L, data))
+	{
+		Check(false, test, "failed to decode payload");
+		return false;
+	}
+
+	lua_setglobal(L, "decoded");
+	Check(lua_gettop(L) == top, test, "stack is unbalanced");
+
+	return true;
+}
+
+static void TestNested(sol::state& lua, LuaActorCodec& codec)
+{
+	constexpr std::string_view test = "TestNested";
+
+	if (RoundTrip(lua, codec, test, R"(
+		value = {
+			a = { b = { c = { 1, 2, 3 } } },
+			records = { { x = 1, y = 2 }, { x = 3, y = 4 }, { x = 5, y = 6, z = { 'deep' } } },
+			empty = {},
+		}
+		local node = value
+		for i = 1, 40 do
+			node.child = { level = i }
+			node = node.child
+		end
+	)"))
+	{
+		Check(Eval(lua, "deepeq(value, decoded)"), test, "decoded value differs");
+	}
+
+	// tables deeper than the limit are cut off, the rest of the value still comes through
+	if (RoundTrip(lua, codec, test, R"(
+		value = { level = 0 }
+		local node = value
+		for i = 1, 100 do
+			node.next = { level = i }
+			node = node.next
+		end
+	)"))
+	{
+		const int depth = lua.script(R"(
+			local depth, node = 0, decoded
+			while node ~= nil do
+				depth = depth + 1
+				node = node.next
+			end
+			return depth
+		)").get<int>();
+		Check(depth == 64, test, fmt::format("decoded {} nested tables instead of 64", depth));
+	}
+}
+
+static void TestKeys(sol::state& lua, LuaActorCodec& codec)
+{
+	constexpr std::string_view test = "TestKeys";
+
+	if (RoundTrip(lua, codec, test, R"(
+		value = {
+			'one', 'two', 'three',
+			[0] = 'zero',
+			[-5] = 'negative',
+			[1.5] = 'float',
+			[2^40] = 'large',
+			[true] = 'true',
+			[false] = 'false',
+			[''] = 'empty',
+			name = 'string',
+			['with\0nul'] = 'nul',
+			integer = -7,
+			float = 1.25,
+			tiny = 1e-300,
+			boolean = false,
+			bytes = 'x\0y',
+		}
+	)"))
+	{
+		Check(Eval(lua, "deepeq(value, decoded)"), test, "decoded value differs");
+		Check(Eval(lua, "#decoded == 3"), test, "array part has the wrong length");
+	}
+
+	// negative zero doesn't survive the integer encoding, so it has to go out as a double
+	if (RoundTrip(lua, codec, test, "value = { zero = -0.0 }"))
+		Check(Eval(lua, "1 / decoded.zero == -math.huge"), test, "negative zero lost its sign");
+
+	// repeated keys are sent once and referred to after that
+	std::string encoded;
+	if (RoundTrip(lua, codec, test, R"(
+		value = {}
+		for i = 1, 100 do
+			value[i] = { health = i, mana = i * 2, name = 'member' .. i }
+		end
+	)", &encoded))
+	{
+		Check(Eval(lua, "deepeq(value, decoded)"), test, "decoded records differ");
+		Check(encoded.find("health") == encoded.rfind("health"), test, "repeated key was written more than once");
+	}
+}
+
+static void TestTruncated(sol::state& lua, LuaActorCodec& codec)
+{
+	constexpr std::string_view test = "TestTruncated";
+
+	std::string encoded;
+	if (!RoundTrip(lua, codec, test, R"(
+		value = { name = 'truncated', list = { 1, 2.5, true, 'four' }, nested = { name = 'inner', [3] = {} } }
+	)", &encoded))
+	{
+		return;
+	}
+
+	lua_State* L = lua.lua_state();
+	const int top = lua_gettop(L);
+
+	for (size_t length = 0; length < encoded.size(); ++length)
+	{
+		const bool decoded = LuaActorCodec::Decode(L, std::string_view(encoded).substr(0, length));
+		Check(!decoded, test, fmt::format("decoded a payload cut down to {} of {} bytes", length, encoded.size()));
+		if (decoded)
+			lua_settop(L, top);
+
+		Check(lua_gettop(L) == top, test, fmt::format("payload cut down to {} bytes left values on the stack", length));
+	}
+
+	// trailing bytes are as wrong as missing ones
+	Check(!LuaActorCodec::Decode(L, encoded + '\0'), test, "decoded a payload with trailing bytes");
+	Check(lua_gettop(L) == top, test, "payload with trailing bytes left values on the stack");
+
+	// and so are protobuf payloads
+	Check(!LuaActorCodec::Decode(L, "\x0a\x03" "abc"), test, "decoded a protobuf payload");
+	Check(lua_gettop(L) == top, test, "protobuf payload left values on the stack");
+}
+
+static void TestCyclic(sol::state& lua, LuaActorCodec& codec)
+{
+	constexpr std::string_view test = "TestCyclic";
+
+	// references back to a table that is being written become nil, everything else is kept
+	if (RoundTrip(lua, codec, test, R"(
+		value = { name = 'self' }
+		value.self = value
+		value.list = { value, value }
+	)"))
+	{
+		Check(Eval(lua, "decoded.name == 'self' and decoded.self == nil"), test, "self reference was not dropped");
+		Check(Eval(lua, "type(decoded.list) == 'table' and next(decoded.list) == nil"), test,
+			"self references in a child table were not dropped");
+	}
+
+	if (RoundTrip(lua, codec, test, R"(
+		local a, b = { name = 'a' }, { name = 'b' }
+		a.b, b.a = b, a
+		value = a
+	)"))
+	{
+		Check(Eval(lua, "decoded.b.name == 'b' and decoded.b.a == nil"), test, "mutual reference was not dropped");
+	}
+
+	// every key refers back to the table, which without cycle detection is written out keys^depth times
+	std::string encoded;
+	if (RoundTrip(lua, codec, test, R"(
+		value = {}
+		for i = 1, 8 do
+			value['key' .. i] = value
+		end
+	)", &encoded))
+	{
+		Check(encoded.size() < 256, test, fmt::format("self referencing table encoded to {} bytes", encoded.size()));
+		Check(Eval(lua, "next(decoded) == nil"), test, "self referencing table has entries");
+	}
+
+	// the same table in two places isn't a cycle, so it's written both times
+	if (RoundTrip(lua, codec, test, R"(
+		local shared = { 1, 2, 3 }
+		value = { x = shared, y = { shared } }
+	)"))
+	{
+		Check(Eval(lua, "deepeq(value, decoded)"), test, "shared table was not written in every place");
+	}
+}
+
+int main()
+{
+	sol::state lua;
+	InitState(lua);
+
+	LuaActorCodec codec;
+
+	TestNested(lua, codec);
+	TestKeys(lua, codec);
+	TestTruncated(lua, codec);
+	TestCyclic(lua, codec);
+
+	if (s_failures > 0)
+	{
+		SPDLOG_ERROR("{} checks failed", s_failures);
+		return 1;
+	}
+
+	SPDLOG_INFO("All checks passed");
+	return 0;
+}
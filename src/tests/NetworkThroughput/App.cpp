@@ -0,0 +1,277 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Loopback throughput benchmark for peer sessions. Two peers are brought up in this process and
+// connected over 127.0.0.1, then one sends routed messages to the other as fast as the receiver
+// keeps up. Throughput is measured with many messages in flight, latency with one message in
+// flight at a time so that it isn't just the time spent queued behind the others. Each message
+// carries its send time and sequence number, and the receiver checks that nothing is lost or
+// reordered.
+//
+// Usage: NetworkThroughput [seconds per size]
+
+#include "routing/Network.h"
+
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+#if defined(NETWORK_THROUGHPUT_STANDALONE)
+// The standalone build only compiles the network layer, which gets this from the post office.
+std::string mq::CreateUUID()
+{
+	std::random_device random;
+	return fmt::format("{:08x}-{:08x}", random(), random());
+}
+#endif
+
+struct MessageStamp
+{
+	int64_t sent; // steady clock ticks in nanoseconds
+	uint64_t sequence;
+};
+
+static int64_t Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class Endpoint
+{
+public:
+	explicit Endpoint(uint16_t multicastPort)
+	{
+		mq::NetworkConfiguration configuration;
+		configuration.Port = 0;
+		configuration.MulticastPort = multicastPort;
+		configuration.MulticastPeriod = 60000;
+
+		// measure the transport, random payloads don't compress anyway
+		configuration.Compression = false;
+
+		m_api = std::make_unique<mq::NetworkPeerAPI>(mq::NetworkPeerAPI::GetOrCreate(configuration,
+			[this](const mq::NetworkAddress&, mq::NetworkMessagePtr message) { Receive(std::move(message)); },
+			[this](const mq::NetworkAddress&) { ++m_connected; },
+			[](const mq::NetworkAddress&) {},
+			[] {}));
+	}
+
+	~Endpoint()
+	{
+		m_api->Shutdown();
+	}
+
+	mq::NetworkPeerAPI& API() { return *m_api; }
+	uint16_t Port() const { return m_api->GetPort(); }
+	int Connected() const { return m_connected; }
+
+	void Reset(size_t expectedLength)
+	{
+		m_expectedLength = expectedLength;
+		m_received = 0;
+		m_failed = false;
+		m_latencies.clear();
+	}
+
+	uint64_t Received() const { return m_received; }
+	bool Failed() const { return m_failed; }
+	std::vector<int64_t>& Latencies() { return m_latencies; }
+
+private:
+	void Receive(mq::NetworkMessagePtr message)
+	{
+		const int64_t now = Now();
+
+		const std::string& routed = message->routed();
+		if (routed.size() != m_expectedLength)
+		{
+			Fail(fmt::format("message {} has length {}, expected {}", m_received, routed.size(), m_expectedLength));
+			return;
+		}
+
+		MessageStamp stamp;
+		memcpy(&stamp, routed.data(), sizeof(stamp));
+		if (stamp.sequence != m_received)
+		{
+			Fail(fmt::format("expected message {} but got {}", m_received, stamp.sequence));
+			return;
+		}
+
+		m_latencies.push_back(now - stamp.sent);
+		++m_received;
+	}
+
+	void Fail(const std::string& reason)
+	{
+		if (!m_failed)
+			SPDLOG_ERROR("{}", reason);
+
+		m_failed = true;
+	}
+
+	std::unique_ptr<mq::NetworkPeerAPI> m_api;
+	int m_connected = 0;
+
+	size_t m_expectedLength = 0;
+	uint64_t m_received = 0;
+	bool m_failed = false;
+	std::vector<int64_t> m_latencies;
+};
+
+static bool WaitFor(Endpoint& sender, Endpoint& receiver, std::chrono::milliseconds timeout, const std::function<bool()>& done)
+{
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+	while (!done())
+	{
+		if (std::chrono::steady_clock::now() > deadline)
+			return false;
+
+		sender.API().Process();
+		receiver.API().Process();
+		std::this_thread::yield();
+	}
+
+	return true;
+}
+
+struct RunResult
+{
+	uint64_t messages = 0;
+	double seconds = 0;
+	double p50 = 0;
+	double p99 = 0;
+	double max = 0;
+};
+
+static bool Run(Endpoint& sender, Endpoint& receiver, size_t length, uint64_t window, std::chrono::seconds duration,
+	RunResult& result)
+{
+	// the routed payload is the stamp followed by a tail that is shared by every message, the way
+	// the post office sends routed messages
+	std::string tail(length - sizeof(MessageStamp), '\0');
+	std::mt19937 random(static_cast<uint32_t>(length));
+	std::generate(tail.begin(), tail.end(), [&random] { return static_cast<char>(random()); });
+	auto sharedTail = std::make_shared<mq::NetworkSharedPayload>(std::make_shared<const std::string>(std::move(tail)));
+
+	receiver.Reset(length);
+
+	uint64_t sent = 0;
+	const auto start = std::chrono::steady_clock::now();
+	const auto end = start + duration;
+
+	while (std::chrono::steady_clock::now() < end && !receiver.Failed())
+	{
+		while (sent - receiver.Received() < window)
+		{
+			MessageStamp stamp{ Now(), sent++ };
+			sender.API().SendRouted("127.0.0.1", receiver.Port(),
+				std::string(reinterpret_cast<const char*>(&stamp), sizeof(stamp)), sharedTail);
+		}
+
+		sender.API().Process();
+		receiver.API().Process();
+	}
+
+	// let everything that was sent arrive, so the latencies include the tail of the queue
+	if (!WaitFor(sender, receiver, 10s, [&] { return receiver.Failed() || receiver.Received() == sent; }))
+	{
+		SPDLOG_ERROR("Only received {} of {} messages", receiver.Received(), sent);
+		return false;
+	}
+
+	if (receiver.Failed())
+		return false;
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.messages = receiver.Received();
+
+	auto& latencies = receiver.Latencies();
+	std::sort(latencies.begin(), latencies.end());
+
+	auto percentile = [&latencies](double p)
+	{
+		const size_t index = std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()));
+		return latencies[index] / 1000.0;
+	};
+
+	result.p50 = percentile(0.50);
+	result.p99 = percentile(0.99);
+	result.max = latencies.back() / 1000.0;
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	spdlog::set_level(spdlog::level::warn);
+
+	const auto duration = std::chrono::seconds(argc > 1 ? std::atoi(argv[1]) : 3);
+
+	// keep the peers from discovering anything else on the network
+#if defined(_WIN32)
+	const uint16_t multicastPort = static_cast<uint16_t>(40000 + ::GetCurrentProcessId() % 20000);
+#else
+	const uint16_t multicastPort = static_cast<uint16_t>(40000 + ::getpid() % 20000);
+#endif
+
+	Endpoint sender(multicastPort);
+	Endpoint receiver(multicastPort);
+
+	sender.API().AddHost("127.0.0.1", receiver.Port());
+	if (!WaitFor(sender, receiver, 5s, [&] { return sender.Connected() > 0 && receiver.Connected() > 0; }))
+	{
+		SPDLOG_ERROR("Peers on ports {} and {} failed to connect", sender.Port(), receiver.Port());
+		return 1;
+	}
+
+	fmt::print("{:>8} {:>14} {:>12} {:>12} {:>12} {:>12}\n", "size", "messages/s", "MB/s", "p50 us", "p99 us", "max us");
+
+	for (size_t length : { 64, 1024, 64 * 1024 })
+	{
+		// enough in flight to keep the pipe full without queueing more than a few megabytes
+		const uint64_t window = std::clamp<uint64_t>((4 * 1024 * 1024) / length, 16, 1024);
+
+		RunResult throughput, latency;
+		if (!Run(sender, receiver, length, window, duration, throughput)
+			|| !Run(sender, receiver, length, 1, duration, latency))
+		{
+			return 1;
+		}
+
+		const double rate = throughput.messages / throughput.seconds;
+		fmt::print("{:>8} {:>14.0f} {:>12.1f} {:>12.1f} {:>12.1f} {:>12.1f}\n", length, rate,
+			rate * length / (1024 * 1024), latency.p50, latency.p99, latency.max);
+	}
+
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stress test for the shared memory channel. Both ends of a channel are opened in this process and
+// hammered from both directions with messages of random sizes, up to several times the size of the
+// ring, and every byte that comes out is checked.
+//
+// Usage: SharedMemory [seconds] [capacity]
+
+#include "routing/SharedMemory.h"
+
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+struct TestMessageHeader
+{
+	uint64_t sequence;
+	uint32_t length;
+	uint32_t padding;
+};
+
+static uint8_t PatternByte(uint64_t sequence, size_t index)
+{
+	return static_cast<uint8_t>((sequence * 31 + index * 7) ^ (index >> 8));
+}
+
+class TestEnd
+{
+public:
+	TestEnd(const char* name, std::unique_ptr<mq::SharedMemoryChannel> channel)
+		: m_name(name)
+		, m_channel(std::move(channel))
+	{
+	}
+
+	void Start(TestEnd& peer)
+	{
+		m_channel->Start(
+			[&peer](std::vector<mq::SharedMemoryMessage>&& messages)
+			{
+				for (auto& message : messages)
+					peer.Verify(message);
+			},
+			[this]()
+			{
+				std::unique_lock lock(m_mutex);
+				m_writable = true;
+				m_cv.notify_one();
+			});
+	}
+
+	void Send(std::chrono::seconds duration, size_t maxLength, uint32_t seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_int_distribution<size_t> lengths(sizeof(TestMessageHeader), maxLength);
+		std::vector<uint8_t> buffer(maxLength);
+
+		const auto end = std::chrono::steady_clock::now() + duration;
+		while (std::chrono::steady_clock::now() < end && !m_failed)
+		{
+			if (m_channel->HasPending())
+			{
+				std::unique_lock lock(m_mutex);
+				m_cv.wait_for(lock, 10ms, [this] { return m_writable; });
+				m_writable = false;
+				lock.unlock();
+
+				m_channel->Flush();
+				continue;
+			}
+
+			// mostly small messages, like actor traffic, with the occasional huge one
+			const size_t length = random() % 8 == 0 ? lengths(random) : std::min<size_t>(lengths(random), 512);
+
+			TestMessageHeader header{ m_sent, static_cast<uint32_t>(length), 0 };
+			memcpy(buffer.data(), &header, sizeof(header));
+			for (size_t i = sizeof(header); i < length; ++i)
+				buffer[i] = PatternByte(m_sent, i);
+
+			// split some messages into a header and a tail, the way pipe messages are sent
+			const size_t split = random() % 2 == 0 ? length : sizeof(header) + (length - sizeof(header)) / 2;
+			m_channel->Send(buffer.data(), split, buffer.data() + split, length - split);
+
+			++m_sent;
+			m_sentBytes += length;
+		}
+
+		const auto deadline = std::chrono::steady_clock::now() + 5s;
+		while (m_channel->HasPending() && !m_failed && std::chrono::steady_clock::now() < deadline)
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait_for(lock, 10ms, [this] { return m_writable; });
+			m_writable = false;
+			lock.unlock();
+
+			m_channel->Flush();
+		}
+	}
+
+	// called on the other end's channel thread with messages this end sent
+	void Verify(const mq::SharedMemoryMessage& message)
+	{
+		TestMessageHeader header;
+		if (message.length < sizeof(header))
+		{
+			Fail(fmt::format("message {} is too short: {}", m_received.load(), message.length));
+			return;
+		}
+
+		memcpy(&header, message.data.get(), sizeof(header));
+		if (header.sequence != m_received || header.length != message.length)
+		{
+			Fail(fmt::format("expected message {} but got {} with length {} (header says {})",
+				m_received.load(), header.sequence, message.length, header.length));
+			return;
+		}
+
+		for (size_t i = sizeof(header); i < message.length; ++i)
+		{
+			if (message.data[i] != PatternByte(header.sequence, i))
+			{
+				Fail(fmt::format("message {} is corrupt at byte {}", header.sequence, i));
+				return;
+			}
+		}
+
+		++m_received;
+	}
+
+	void Fail(const std::string& reason)
+	{
+		SPDLOG_ERROR("{}: {}", m_name, reason);
+		m_failed = true;
+	}
+
+	bool IsDone() const { return m_failed || m_received == m_sent; }
+
+	const char* m_name;
+	std::unique_ptr<mq::SharedMemoryChannel> m_channel;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_writable = false;
+
+	std::atomic<uint64_t> m_sent{ 0 };
+	uint64_t m_sentBytes = 0;
+	std::atomic<uint64_t> m_received{ 0 };
+	std::atomic_bool m_failed{ false };
+};
+
+int main(int argc, char* argv[])
+{
+	spdlog::set_level(spdlog::level::info);
+
+	const auto duration = std::chrono::seconds(argc > 1 ? std::atoi(argv[1]) : 5);
+	const uint32_t capacity = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : mq::SHARED_MEMORY_MIN_CAPACITY;
+
+#if defined(_WIN32)
+	const std::string name = fmt::format("mq-shm-test-{}", ::GetCurrentProcessId());
+#else
+	const std::string name = fmt::format("mq-shm-test-{}", ::getpid());
+#endif
+
+	auto creator = mq::SharedMemoryChannel::Create(name, capacity);
+	if (!creator)
+		return 1;
+
+	auto opener = mq::SharedMemoryChannel::Open(name, capacity);
+	if (!opener)
+		return 1;
+
+	creator->Unlink();
+
+	const size_t maxLength = 3 * static_cast<size_t>(creator->GetCapacity());
+	SPDLOG_INFO("Testing {} for {}s with {} byte rings and messages up to {} bytes", name, duration.count(),
+		creator->GetCapacity(), maxLength);
+
+	TestEnd first("creator", std::move(creator));
+	TestEnd second("opener", std::move(opener));
+	first.Start(second);
+	second.Start(first);
+
+	const auto start = std::chrono::steady_clock::now();
+	std::thread firstSender([&] { first.Send(duration, maxLength, 1); });
+	std::thread secondSender([&] { second.Send(duration, maxLength, 2); });
+	firstSender.join();
+	secondSender.join();
+
+	// wait for everything in flight to come out the other end
+	const auto deadline = std::chrono::steady_clock::now() + 5s;
+	while ((!first.IsDone() || !second.IsDone()) && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(1ms);
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	first.m_channel->Stop();
+	second.m_channel->Stop();
+
+	bool passed = true;
+	for (TestEnd* end : { &first, &second })
+	{
+		SPDLOG_INFO("{}: sent {} messages ({:.1f} MB), {} arrived, {:.0f} messages/s, {:.1f} MB/s", end->m_name,
+			end->m_sent.load(), end->m_sentBytes / 1048576.0, end->m_received.load(), end->m_sent / seconds,
+			end->m_sentBytes / 1048576.0 / seconds);
+
+		if (end->m_failed || end->m_received != end->m_sent)
+			passed = false;
+	}
+
+	SPDLOG_INFO(passed ? "PASSED" : "FAILED");
+	return passed ? 0 : 1;
+}